@@ -0,0 +1,69 @@
+#!/bin/sh
+# vim: set ts=4 sw=4 sts=4 et :
+##
+## @file bench_affinity.sh
+## TCP/IP Network Programming
+## compares the placement options of simple_message_server with sms_bench,
+## look at p99: unplaced, acceptor and server logic on CPUs of their own,
+## each server logic on the CPU that received its client's packets, and
+## memory bound to the NUMA node of the CPU
+##
+## usage: ./bench_affinity.sh [requests] [concurrency] [rate]
+##
+## without rate sms_bench runs closed loop, with rate (requests/s) requests
+## arrive open loop with Poisson gaps; sms_bench itself runs on all CPUs, as
+## a remote client's packets would arrive on all NIC queues
+##
+## over loopback the receiving CPU is the one of the sending client, on a
+## real NIC it is the one its RSS queue interrupts; --incoming-cpu pays off
+## most with remote clients on a multi-queue NIC and NUMA hosts
+##
+
+REQUESTS=${1:-20000}
+CONCURRENCY=${2:-64}
+RATE=${3:-}
+PORT=${PORT:-15400}
+HANDLER=./simple_message_server_example_handler.so
+SERVER_LOGIC=${SERVER_LOGIC:-./sms_stub_logic}
+CPUS=$(getconf _NPROCESSORS_ONLN)
+LAST=$((CPUS - 1))
+
+make -s simple_message_server sms_bench sms_stub_logic $HANDLER || exit 1
+
+case "$SERVER_LOGIC" in
+    /*) ;;
+    *) SERVER_LOGIC=$(pwd)/$SERVER_LOGIC ;;
+esac
+
+run() {
+    name=$1
+    shift
+    ./simple_message_server -p $PORT "$@" &
+    server=$!
+    sleep 0.5
+    echo "== $name"
+    if [ -n "$RATE" ]; then
+        ./sms_bench -s localhost -p $PORT -n $REQUESTS -c $CONCURRENCY -r $RATE -a poisson
+    else
+        ./sms_bench -s localhost -p $PORT -n $REQUESTS -c $CONCURRENCY
+    fi
+    kill $server
+    wait $server 2>/dev/null
+    PORT=$((PORT + 1))
+}
+
+if [ -x "$SERVER_LOGIC" ]; then
+    run "fork" --logic=$SERVER_LOGIC
+    if [ $CPUS -ge 2 ]; then
+        run "fork, acceptor on 0, logic on 1-$LAST" --logic=$SERVER_LOGIC --acceptor-cpus=0 --logic-cpus=1-$LAST
+    else
+        echo "== fork, acceptor and logic apart: skipped, needs 2 cpus"
+    fi
+    run "fork, incoming cpu" --logic=$SERVER_LOGIC --incoming-cpu
+    run "fork, incoming cpu, numa local" --logic=$SERVER_LOGIC --incoming-cpu --numa-local
+else
+    echo "== fork: skipped, $SERVER_LOGIC not found"
+fi
+run "epoll, prefork" --engine=epoll --handler=$HANDLER --workers
+run "epoll, prefork, incoming cpu" --engine=epoll --handler=$HANDLER --workers --incoming-cpu
+run "epoll, prefork, incoming cpu, numa local" --engine=epoll --handler=$HANDLER --workers --incoming-cpu --numa-local
@@ -0,0 +1,60 @@
+#!/bin/sh
+# vim: set ts=4 sw=4 sts=4 et :
+##
+## @file bench_agent.sh
+## TCP/IP Network Programming
+## measures the latency of one simple_message_client run, with and without
+## smc_agent handing it a connection made ahead of time
+##
+## usage: ./bench_agent.sh [runs] [server]
+##
+## the epoll engine answers with the example handler; against localhost the
+## agent saves little more than the resolver, against a remote server it
+## saves the round trip of the handshake as well
+##
+
+RUNS=${1:-200}
+SERVER=${2:-localhost}
+PORT=${PORT:-15500}
+HANDLER=./simple_message_server_example_handler.so
+
+make -s simple_message_client simple_message_server smc_agent $HANDLER || exit 1
+
+HERE=$(pwd)
+WORKDIR=$(mktemp -d) || exit 1
+SMC_AGENT=$WORKDIR/agent.sock
+export SMC_AGENT
+trap 'rm -rf "$WORKDIR"' EXIT
+
+now() {
+    date +%s%N
+}
+
+measure() {
+    name=$1
+    run=0
+    start=$(now)
+    while [ $run -lt $RUNS ]; do
+        (cd "$WORKDIR" && "$HERE/simple_message_client" -s $SERVER -p $PORT -u bench -m bench >/dev/null) || echo "client failed"
+        run=$((run + 1))
+    done
+    elapsed=$(( $(now) - start ))
+    echo "$name: $((elapsed / RUNS / 1000)) us per request"
+}
+
+./simple_message_server -p $PORT --engine=epoll --handler=$HANDLER &
+server=$!
+sleep 0.5
+
+measure "direct"
+
+./smc_agent -a "$SMC_AGENT" -w 4 &
+agent=$!
+sleep 0.2
+# the first request only starts warming
+(cd "$WORKDIR" && "$HERE/simple_message_client" -s $SERVER -p $PORT -u bench -m bench >/dev/null)
+sleep 0.2
+measure "agent"
+
+kill $agent $server
+wait $agent $server 2>/dev/null
@@ -0,0 +1,50 @@
+#!/bin/sh
+# vim: set ts=4 sw=4 sts=4 et :
+##
+## @file bench_client.sh
+## TCP/IP Network Programming
+## measures how fast simple_message_client stores responses of growing size
+##
+## usage: ./bench_client.sh [sizes in bytes]
+##
+## the fork engine answers with sms_stub_logic, files are written to a
+## temporary directory (TMPDIR) that needs room for the largest size
+##
+
+SIZES=${*:-1024 1048576 67108864 1073741824}
+PORT=${PORT:-15200}
+RUNS=${RUNS:-3}
+
+make -s simple_message_client simple_message_server sms_stub_logic || exit 1
+
+HERE=$(pwd)
+WORKDIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORKDIR"' EXIT
+
+now() {
+    date +%s%N
+}
+
+for size in $SIZES; do
+    SMS_STUB_SIZE=$size ./simple_message_server -p $PORT --logic="$HERE/sms_stub_logic" &
+    server=$!
+    sleep 0.5
+
+    best=0
+    run=0
+    while [ $run -lt $RUNS ]; do
+        start=$(now)
+        (cd "$WORKDIR" && "$HERE/simple_message_client" -s localhost -p $PORT -u bench -m bench) || echo "client failed for $size bytes"
+        elapsed=$(( $(now) - start ))
+        if [ $best -eq 0 ] || [ $elapsed -lt $best ]; then best=$elapsed; fi
+        rm -f "$WORKDIR/sms_stub_logic.html"
+        run=$((run + 1))
+    done
+
+    # best of RUNS, MB/s = bytes / ns * 1000
+    echo "$size bytes: $((best / 1000)) us, $((size * 1000 / best)) MB/s"
+
+    kill $server
+    wait $server 2>/dev/null
+    PORT=$((PORT + 1))
+done
@@ -0,0 +1,74 @@
+#!/bin/sh
+# vim: set ts=4 sw=4 sts=4 et :
+##
+## @file bench_engines.sh
+## TCP/IP Network Programming
+## compares the engines of simple_message_server with sms_bench
+##
+## usage: ./bench_engines.sh [requests] [concurrency] [rate]
+##
+## without rate sms_bench runs closed loop, with rate (requests/s) requests
+## arrive open loop with Poisson gaps
+##
+## engine fork starts SERVER_LOGIC, by default the stub ./sms_stub_logic, so
+## everything runs offline; SMS_STUB_SIZE and SMS_STUB_THINK_US set the size
+## of its response and its think time
+##
+## the fastopen runs compare against the runs without: sms_bench -F sends
+## each request with the SYN once it holds a cookie of the server; this
+## needs bits 1 and 2 of net.ipv4.tcp_fastopen (client and server enabled)
+##
+
+REQUESTS=${1:-20000}
+CONCURRENCY=${2:-64}
+RATE=${3:-}
+PORT=${PORT:-15000}
+HANDLER=./simple_message_server_example_handler.so
+SERVER_LOGIC=${SERVER_LOGIC:-./sms_stub_logic}
+
+make -s simple_message_server sms_bench sms_stub_logic $HANDLER || exit 1
+
+case "$SERVER_LOGIC" in
+    /*) ;;
+    *) SERVER_LOGIC=$(pwd)/$SERVER_LOGIC ;;
+esac
+
+run() {
+    name=$1
+    shift
+    ./simple_message_server -p $PORT "$@" &
+    server=$!
+    sleep 0.5
+    echo "== $name"
+    if [ -n "$RATE" ]; then
+        ./sms_bench -s localhost -p $PORT -n $REQUESTS -c $CONCURRENCY -r $RATE -a poisson $BENCH_FLAGS
+    else
+        ./sms_bench -s localhost -p $PORT -n $REQUESTS -c $CONCURRENCY $BENCH_FLAGS
+    fi
+    kill $server
+    wait $server 2>/dev/null
+    PORT=$((PORT + 1))
+}
+
+if [ -x "$SERVER_LOGIC" ]; then
+    run fork --logic=$SERVER_LOGIC
+    run "fork, pool" --logic=$SERVER_LOGIC --pool=$CONCURRENCY
+else
+    echo "== fork: skipped, $SERVER_LOGIC not found"
+fi
+run epoll --engine=epoll --handler=$HANDLER
+run uring --engine=uring --handler=$HANDLER
+run "epoll, prefork" --engine=epoll --handler=$HANDLER --workers
+run "uring, prefork" --engine=uring --handler=$HANDLER --workers
+
+FASTOPEN=$(cat /proc/sys/net/ipv4/tcp_fastopen 2>/dev/null || echo 0)
+if [ $((FASTOPEN & 3)) -eq 3 ]; then
+    BENCH_FLAGS=-F
+    if [ -x "$SERVER_LOGIC" ]; then
+        run "fork, fastopen" --logic=$SERVER_LOGIC --fastopen
+    fi
+    run "epoll, fastopen" --engine=epoll --handler=$HANDLER --fastopen
+    BENCH_FLAGS=
+else
+    echo "== fastopen: skipped, needs net.ipv4.tcp_fastopen=3"
+fi
@@ -0,0 +1,91 @@
+#!/bin/sh
+# vim: set ts=4 sw=4 sts=4 et :
+##
+## @file bench_transport.sh
+## TCP/IP Network Programming
+## compares the transports of a client on the server's host: TCP loopback
+## and a UNIX socket (--unix on the server, unix: address for the client)
+##
+## usage: ./bench_transport.sh [sizes in bytes]
+##
+## latency is the mean of ROUNDS requests for a small page, throughput the
+## best of RUNS requests for each size; the fork engine answers with
+## sms_stub_logic, files are written to a temporary directory (TMPDIR)
+##
+
+SIZES=${*:-1048576 67108864 1073741824}
+PORT=${PORT:-15300}
+SOCKET=${SOCKET:-@bench_transport.$$}
+RUNS=${RUNS:-3}
+ROUNDS=${ROUNDS:-200}
+
+make -s simple_message_client simple_message_server sms_stub_logic || exit 1
+
+HERE=$(pwd)
+WORKDIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORKDIR"' EXIT
+
+now() {
+    date +%s%N
+}
+
+# name and server address of each transport
+TRANSPORTS="tcp|localhost unix|unix:$SOCKET"
+
+startServer() {
+    SMS_STUB_SIZE=$1 ./simple_message_server -p $PORT --unix="$SOCKET" --logic="$HERE/sms_stub_logic" &
+    server=$!
+    sleep 0.5
+}
+
+stopServer() {
+    kill $server
+    wait $server 2>/dev/null
+    PORT=$((PORT + 1))
+}
+
+# request: <address>
+request() {
+    (cd "$WORKDIR" && "$HERE/simple_message_client" -s "$1" -p $PORT -u bench -m bench) || echo "client failed for $1"
+    rm -f "$WORKDIR/sms_stub_logic.html"
+}
+
+echo "latency, $ROUNDS requests of 1024 bytes"
+startServer 1024
+for transport in $TRANSPORTS; do
+    name=${transport%%|*}
+    address=${transport#*|}
+
+    start=$(now)
+    round=0
+    while [ $round -lt $ROUNDS ]; do
+        request "$address"
+        round=$((round + 1))
+    done
+    elapsed=$(( $(now) - start ))
+    echo "  $name: $((elapsed / ROUNDS / 1000)) us per request"
+done
+stopServer
+
+echo "throughput, best of $RUNS"
+for size in $SIZES; do
+    startServer $size
+    for transport in $TRANSPORTS; do
+        name=${transport%%|*}
+        address=${transport#*|}
+
+        best=0
+        run=0
+        while [ $run -lt $RUNS ]; do
+            start=$(now)
+            request "$address"
+            elapsed=$(( $(now) - start ))
+            if [ $best -eq 0 ] || [ $elapsed -lt $best ]; then best=$elapsed; fi
+            run=$((run + 1))
+        done
+
+        # MB/s = bytes / ns * 1000
+        echo "  $size bytes, $name: $((best / 1000)) us, $((size * 1000 / best)) MB/s"
+    done
+    stopServer
+done
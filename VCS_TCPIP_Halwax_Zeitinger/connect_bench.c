@@ -0,0 +1,304 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file connect_bench.c
+ * VCS - Tcp/Ip Exercise - checks the parallel connect of the client against
+ * a blackhole listener on loopback
+ *
+ * The blackhole is a listening socket with a backlog of 0 whose accept
+ * queue is filled and never drained, so the kernel drops every further SYN
+ * and a connect to it hangs like to an unreachable host. The scenarios:
+ *
+ *   blackhole, live     the live address wins after about the attempt delay
+ *   refused, live       the live address wins at once
+ *   blackhole           fails with ETIMEDOUT at the deadline
+ *
+ * With -l the blackhole is only held open, e.g. to point the client at it
+ * through a name that resolves to it and to the server.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include "simple_message_client_connect.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define ERROR -1
+#define SUCCESS 0
+
+/* connects queued on the blackhole, more than a backlog of 0 admits */
+#define FILL_CONNECTIONS 4
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+static const char *programName;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void printUsage(void);
+static int openListener(int port, int backlog, struct sockaddr_in *address);
+static int openBlackhole(int port, struct sockaddr_in *address);
+static int refusedAddress(struct sockaddr_in *address);
+static int runScenario(const char *name, struct sockaddr_in *first, struct sockaddr_in *second,
+                       int attemptDelay, int timeout, int expectSuccess, int64_t limit);
+static int64_t now(void);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief       Main function
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * @return    exit status of program
+ * @retval    EXIT_FAILURE      a scenario did not behave as expected
+ * @retval    EXIT_SUCCESS      all scenarios passed
+ *
+ */
+int main(int argc, char *argv[]) {
+    int attemptDelay = CONNECT_ATTEMPT_DELAY;
+    int timeout = 1000;
+    int port = 0;
+    int listenOnly = 0;
+    int option;
+
+    programName = argv[0];
+    while ((option = getopt(argc, argv, "d:t:p:lh")) != ERROR) {
+        switch (option) {
+            case 'd': attemptDelay = atoi(optarg); break;
+            case 't': timeout = atoi(optarg); break;
+            case 'p': port = atoi(optarg); break;
+            case 'l': listenOnly = 1; break;
+            default: printUsage();
+        }
+    }
+    if (attemptDelay <= 0 || timeout <= 0 || port < 0 || port > 65535) printUsage();
+
+    struct sockaddr_in blackhole;
+    struct sockaddr_in live;
+    struct sockaddr_in refused;
+    if (openBlackhole(port, &blackhole) == ERROR) {
+        fprintf(stderr, "%s: blackhole setup failed: %s\n", programName, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    if (listenOnly) {
+        printf("blackhole listening on 127.0.0.1:%d\n", ntohs(blackhole.sin_port));
+        fflush(stdout);
+        pause();
+        exit(EXIT_SUCCESS);
+    }
+
+    if (openListener(0, SOMAXCONN, &live) == ERROR || refusedAddress(&refused) == ERROR) {
+        fprintf(stderr, "%s: setup failed: %s\n", programName, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    /* the slack covers scheduling, not another attempt delay */
+    int64_t slack = attemptDelay / 2 + 50;
+    int failures = 0;
+    failures += runScenario("blackhole, live", &blackhole, &live, attemptDelay, timeout, 1, attemptDelay + slack);
+    failures += runScenario("refused, live", &refused, &live, attemptDelay, timeout, 1, slack);
+    failures += runScenario("blackhole", &blackhole, NULL, attemptDelay, timeout, 0, timeout + slack);
+
+    exit(failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/**
+ * @brief runScenario
+ *
+ * connect to one or two addresses with happyEyeballsConnect() and check
+ * the outcome and the time it took
+ *
+ * \param name name of the scenario
+ * \param first first address
+ * \param second second address, or NULL
+ * \param attemptDelay milliseconds before the next address is tried
+ * \param timeout deadline in milliseconds
+ * \param expectSuccess 1 if the connect has to succeed
+ * \param limit milliseconds the connect may take
+ *
+ * \return int
+ * \retval 0 if the scenario passed
+ * \retval 1 if it failed
+ *
+ */
+static int runScenario(const char *name, struct sockaddr_in *first, struct sockaddr_in *second,
+                       int attemptDelay, int timeout, int expectSuccess, int64_t limit) {
+    struct addrinfo addresses[2];
+
+    memset(addresses, 0, sizeof(addresses));
+    addresses[0].ai_family = AF_INET;
+    addresses[0].ai_socktype = SOCK_STREAM;
+    addresses[0].ai_addr = (struct sockaddr *)first;
+    addresses[0].ai_addrlen = sizeof(*first);
+    if (second != NULL) {
+        addresses[1] = addresses[0];
+        addresses[1].ai_addr = (struct sockaddr *)second;
+        addresses[0].ai_next = &addresses[1];
+    }
+
+    int fd = ERROR;
+    int64_t start = now();
+    int result = happyEyeballsConnect(addresses, attemptDelay, timeout, NULL, &fd);
+    int64_t elapsed = now() - start;
+    int error = errno;
+
+    int passed = elapsed <= limit && (expectSuccess ? result == SUCCESS : result == ERROR && error == ETIMEDOUT);
+    if (result == SUCCESS) {
+        struct sockaddr_in peer;
+        socklen_t size = sizeof(peer);
+        /* the winner has to be the live address, not a stale blackhole attempt */
+        if (getpeername(fd, (struct sockaddr *)&peer, &size) == ERROR || second == NULL || peer.sin_port != second->sin_port) passed = 0;
+        close(fd);
+    }
+
+    printf("%-16s %-20s %6lld ms (limit %lld ms) %s\n", name, result == SUCCESS ? "connected" : strerror(error),
+           (long long)elapsed, (long long)limit, passed ? "ok" : "FAILED");
+    return passed ? 0 : 1;
+}
+
+/**
+ * @brief openBlackhole
+ *
+ * listen with a backlog of 0 and fill the accept queue, further SYNs are
+ * dropped then
+ *
+ * \param port port to listen on, 0 for any
+ * \param address set to the address of the blackhole
+ *
+ * \return int
+ * \retval the listening socket
+ * \retval ERROR on Error
+ *
+ */
+static int openBlackhole(int port, struct sockaddr_in *address) {
+    int listener = openListener(port, 0, address);
+    if (listener == ERROR) return ERROR;
+
+    for (int i = 0; i < FILL_CONNECTIONS; i++) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == ERROR) return ERROR;
+        if (connect(fd, (struct sockaddr *)address, sizeof(*address)) == ERROR && errno != EINPROGRESS) return ERROR;
+        /* the fillers stay open for the lifetime of the process */
+    }
+
+    /* let the handshakes of the fillers land in the queue */
+    struct timespec settle = { .tv_sec = 0, .tv_nsec = 200 * 1000 * 1000 };
+    nanosleep(&settle, NULL);
+    return listener;
+}
+
+/**
+ * @brief openListener
+ *
+ * \param port port to listen on, 0 for any
+ * \param backlog backlog of listen()
+ * \param address set to the address listened on
+ *
+ * \return int
+ * \retval the listening socket
+ * \retval ERROR on Error
+ *
+ */
+static int openListener(int port, int backlog, struct sockaddr_in *address) {
+    socklen_t size = sizeof(*address);
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener == ERROR) return ERROR;
+
+    memset(address, 0, sizeof(*address));
+    address->sin_family = AF_INET;
+    address->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address->sin_port = htons((uint16_t)port);
+    if (bind(listener, (struct sockaddr *)address, sizeof(*address)) == ERROR || listen(listener, backlog) == ERROR
+        || getsockname(listener, (struct sockaddr *)address, &size) == ERROR) {
+        close(listener);
+        return ERROR;
+    }
+    return listener;
+}
+
+/**
+ * @brief refusedAddress
+ *
+ * \param address set to a loopback address nobody listens on
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int refusedAddress(struct sockaddr_in *address) {
+    socklen_t size = sizeof(*address);
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == ERROR) return ERROR;
+
+    memset(address, 0, sizeof(*address));
+    address->sin_family = AF_INET;
+    address->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    /* a port that was just free stays so, bound but not listening */
+    int result = bind(fd, (struct sockaddr *)address, sizeof(*address)) == ERROR
+                 || getsockname(fd, (struct sockaddr *)address, &size) == ERROR ? ERROR : SUCCESS;
+    if (result == ERROR) close(fd);
+    return result;
+}
+
+/**
+ * @brief now
+ *
+ * \return int64_t
+ * \retval monotonic time in milliseconds
+ *
+ */
+static int64_t now(void) {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t)time.tv_sec * 1000 + time.tv_nsec / 1000000;
+}
+
+/**
+ * @brief printUsage
+ *
+ * print usage parameter to stderr and exit
+ *
+ */
+static void printUsage(void) {
+    fprintf(stderr, "usage: %s [-d attempt delay ms] [-t timeout ms] [-p port] [-l]\n"
+                    "\t-l\tonly hold a blackhole open on 127.0.0.1:port\n", programName);
+    exit(EXIT_FAILURE);
+}
@@ -0,0 +1,217 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file crc_bench.c
+ * VCS - Tcp/Ip Exercise - throughput of the CRC32C kernels behind the
+ * crc32c= trailer, and a check that they agree
+ *
+ * Every kernel hashes buffers of several sizes, from a short line to a
+ * chunk like the client reads from the socket, in a loop over the same
+ * buffer, so the numbers are of the kernels and not of the memory. Before
+ * timing, each kernel is checked against the test vector of RFC 3720 and
+ * against the portable kernel on random data with odd lengths and offsets.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include "simple_message_crc32c.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define ERROR -1
+#define SUCCESS 0
+
+/* largest buffer hashed, like TRANSFER_CHUNK_SIZE of the client */
+#define MAX_BUFFER_SIZE (1024 * 1024)
+
+/* CRC32C of "123456789" */
+#define CHECK_VALUE 0xe3069283U
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+struct crcKernel {
+    const char *name;
+    uint32_t (*function)(uint32_t crc, const void *data, size_t length);
+};
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+static const char *programName;
+
+static const struct crcKernel kernels[] = {
+    { "portable", crc32cPortable },
+    { "hardware", crc32cHardware },
+    { "hardware3", crc32cHardware3Way }
+};
+
+static const size_t sizes[] = { 64, 1024, 16 * 1024, MAX_BUFFER_SIZE };
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void printUsage(void);
+static uint64_t now(void);
+static int checkKernel(const struct crcKernel *kernel, const unsigned char *buffer);
+static double measureKernel(const struct crcKernel *kernel, const unsigned char *buffer, size_t size, uint64_t total);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief       Main function
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * @return    exit status of program
+ * @retval    EXIT_FAILURE      a kernel computed a wrong CRC
+ * @retval    EXIT_SUCCESS      benchmark done
+ *
+ */
+int main(int argc, char *argv[]) {
+    long megabytes = 1024;
+    int option;
+
+    programName = argv[0];
+    while ((option = getopt(argc, argv, "m:h")) != ERROR) {
+        switch (option) {
+            case 'm': megabytes = atol(optarg); break;
+            default: printUsage();
+        }
+    }
+    if (megabytes <= 0) printUsage();
+
+    initCrc32c();
+    unsigned char *buffer = malloc(MAX_BUFFER_SIZE + 16);
+    if (buffer == NULL) {
+        fprintf(stderr, "%s: setup failed: %s\n", programName, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    srand(3720);
+    for (size_t i = 0; i < MAX_BUFFER_SIZE + 16; i++) buffer[i] = (unsigned char)rand();
+
+    int failures = 0;
+    size_t count = sizeof(kernels) / sizeof(kernels[0]);
+    for (size_t i = 0; i < count; i++) failures += checkKernel(&kernels[i], buffer);
+
+    printf("crc32c() uses %s, hardware %s\n", crc32cKernel(), crc32cHardwareSupported() ? "supported" : "not supported");
+    printf("%-10s", "GB/s");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) printf(" %9zu", sizes[s]);
+    printf("\n");
+    for (size_t i = 0; i < count; i++) {
+        printf("%-10s", kernels[i].name);
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            printf(" %9.2f", measureKernel(&kernels[i], buffer, sizes[s], (uint64_t)megabytes * 1024 * 1024));
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+
+    free(buffer);
+    exit(failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/**
+ * @brief checkKernel
+ *
+ * \param kernel kernel to check
+ * \param buffer random data of MAX_BUFFER_SIZE + 16 bytes
+ *
+ * \return int
+ * \retval 0 if the kernel agrees with the test vector and the portable one
+ * \retval 1 otherwise
+ *
+ */
+static int checkKernel(const struct crcKernel *kernel, const unsigned char *buffer) {
+    if (kernel->function(0, "123456789", 9) != CHECK_VALUE) {
+        fprintf(stderr, "%s: %s fails the test vector\n", programName, kernel->name);
+        return 1;
+    }
+    for (size_t length = 1; length <= MAX_BUFFER_SIZE; length = length * 3 + 1) {
+        for (size_t offset = 0; offset < 16; offset += 5) {
+            /* in two calls, a CRC has to continue over them */
+            size_t first = length / 3;
+            uint32_t crc = kernel->function(kernel->function(0, buffer + offset, first), buffer + offset + first, length - first);
+            if (crc != crc32cPortable(0, buffer + offset, length)) {
+                fprintf(stderr, "%s: %s differs for %zu bytes at offset %zu\n", programName, kernel->name, length, offset);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief measureKernel
+ *
+ * \param kernel kernel to run
+ * \param buffer data
+ * \param size bytes per call
+ * \param total bytes over all calls
+ *
+ * \return double
+ * \retval GB/s
+ *
+ */
+static double measureKernel(const struct crcKernel *kernel, const unsigned char *buffer, size_t size, uint64_t total) {
+    uint64_t calls = total / size;
+    /* the CRC of one call feeds the next, the loop is not optimized away */
+    volatile uint32_t crc = 0;
+
+    uint64_t start = now();
+    for (uint64_t i = 0; i < calls; i++) crc = kernel->function(crc, buffer, size);
+    uint64_t elapsed = now() - start;
+
+    return (double)(calls * size) / (double)(elapsed > 0 ? elapsed : 1);
+}
+
+/**
+ * @brief now
+ *
+ * \return uint64_t
+ * \retval monotonic time in nanoseconds
+ *
+ */
+static uint64_t now(void) {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000ULL + (uint64_t)time.tv_nsec;
+}
+
+/**
+ * @brief printUsage
+ *
+ * print usage parameter to stderr and exit
+ *
+ */
+static void printUsage(void) {
+    fprintf(stderr, "usage: %s [-m megabytes per kernel and size]\n", programName);
+    exit(EXIT_FAILURE);
+}
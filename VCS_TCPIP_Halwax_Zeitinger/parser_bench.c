@@ -0,0 +1,344 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file parser_bench.c
+ * VCS - Tcp/Ip Exercise - compares the response parser of the client with
+ * the getline()/sscanf() functions it replaced, on responses held in memory
+ *
+ * Each response is a status= line and two file= len= records with small
+ * bodies, so the time goes into the header lines. The old functions read
+ * through fmemopen(), the parser is fed in chunks like from read().
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include "simple_message_client_parser.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define ERROR -1
+#define SUCCESS 0
+
+#define BODY_SIZE 64
+
+/* bytes handed to the parser per simulated read() */
+#define READ_SIZE 4096
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+static const char *programName;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void printUsage(void);
+static uint64_t now(void);
+static char *buildResponses(long responses, size_t *length);
+static long parseWithStdio(char *responses, size_t length);
+static long parseWithRing(const char *responses, size_t length);
+static size_t feedParser(struct responseParser *parser, const char *responses, size_t length, size_t *offset);
+static int stdioStatus(FILE *source, int *status);
+static int stdioFileName(FILE *source, char **value);
+static int stdioFileLength(FILE *source, unsigned long *value);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief       Main function
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * @return    exit status of program
+ * @retval    EXIT_FAILURE      a parser did not see every record
+ * @retval    EXIT_SUCCESS      benchmark done
+ *
+ */
+int main(int argc, char *argv[]) {
+    long responses = 200000;
+    int option;
+
+    programName = argv[0];
+    while ((option = getopt(argc, argv, "n:h")) != ERROR) {
+        switch (option) {
+            case 'n': responses = atol(optarg); break;
+            default: printUsage();
+        }
+    }
+    if (responses <= 0) printUsage();
+
+    size_t length;
+    char *data = buildResponses(responses, &length);
+    if (data == NULL) {
+        fprintf(stderr, "%s: setup failed: %s\n", programName, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t start = now();
+    long stdioRecords = parseWithStdio(data, length);
+    uint64_t stdioTime = now() - start;
+
+    start = now();
+    long ringRecords = parseWithRing(data, length);
+    uint64_t ringTime = now() - start;
+
+    long expected = responses * 5;
+    printf("%ld responses, %zu bytes\n", responses, length);
+    printf("getline/sscanf: %8.1f ns/response, %ld records\n", (double)stdioTime / (double)responses, stdioRecords);
+    printf("ring parser:    %8.1f ns/response, %ld records\n", (double)ringTime / (double)responses, ringRecords);
+    printf("speedup:        %8.2f\n", (double)stdioTime / (double)ringTime);
+
+    free(data);
+    exit(stdioRecords == expected && ringRecords == expected ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/**
+ * @brief buildResponses
+ *
+ * \param responses number of responses
+ * \param length set to the total length
+ *
+ * \return char *
+ * \retval the responses back to back, to be freed by the caller
+ * \retval NULL on Error
+ *
+ */
+static char *buildResponses(long responses, size_t *length) {
+    char body[BODY_SIZE];
+    char *data = NULL;
+    FILE *stream = open_memstream(&data, length);
+
+    if (stream == NULL) return NULL;
+    memset(body, 'x', sizeof(body));
+    for (long i = 0; i < responses; i++) {
+        fprintf(stream, "status=0\nfile=bulletin_board_%ld.html\nlen=%d\n", i, BODY_SIZE);
+        fwrite(body, 1, sizeof(body), stream);
+        fprintf(stream, "file=image_%ld.png\nlen=%d\n", i, BODY_SIZE);
+        fwrite(body, 1, sizeof(body), stream);
+    }
+    if (fclose(stream) != SUCCESS) return NULL;
+    return data;
+}
+
+/**
+ * @brief parseWithStdio
+ *
+ * \param responses responses back to back
+ * \param length total length
+ *
+ * \return long
+ * \retval number of records parsed
+ *
+ */
+static long parseWithStdio(char *responses, size_t length) {
+    static char body[BODY_SIZE];
+    FILE *source = fmemopen(responses, length, "r");
+    long records = 0;
+
+    if (source == NULL) return ERROR;
+    while (1 == 1) {
+        int status;
+        if (stdioStatus(source, &status) != SUCCESS) break;
+        records++;
+        for (int file = 0; file < 2; file++) {
+            char *fileName = NULL;
+            unsigned long fileLength = 0;
+            if (stdioFileName(source, &fileName) != SUCCESS) break;
+            free(fileName);
+            if (stdioFileLength(source, &fileLength) != SUCCESS) break;
+            if (fread(body, 1, fileLength, source) != fileLength) break;
+            records += 2;
+        }
+    }
+    fclose(source);
+    return records;
+}
+
+/**
+ * @brief parseWithRing
+ *
+ * \param responses responses back to back
+ * \param length total length
+ *
+ * \return long
+ * \retval number of records parsed
+ *
+ */
+static long parseWithRing(const char *responses, size_t length) {
+    static struct responseParser parser;
+    struct responseRecord record;
+    size_t offset = 0;
+    long records = 0;
+
+    initResponseParser(&parser);
+    while (1 == 1) {
+        int result = nextResponseRecord(&parser, &record);
+        if (result == RESPONSE_INCOMPLETE) {
+            if (feedParser(&parser, responses, length, &offset) == 0) break;
+            continue;
+        }
+        if (result != SUCCESS) break;
+        records++;
+
+        unsigned long remaining = record.type == RECORD_LENGTH ? record.length : 0;
+        while (remaining > 0) {
+            const char *data;
+            size_t buffered = responseParserData(&parser, &data);
+            if (buffered == 0) {
+                if (feedParser(&parser, responses, length, &offset) == 0) return records;
+                continue;
+            }
+            if (buffered > remaining) buffered = (size_t)remaining;
+            responseParserConsume(&parser, buffered);
+            remaining -= buffered;
+        }
+    }
+    return records;
+}
+
+/**
+ * @brief feedParser
+ *
+ * copy the next chunk of the responses into the parser, as read() would
+ *
+ * \param parser the parser
+ * \param responses responses back to back
+ * \param length total length
+ * \param offset first byte not fed yet, advanced
+ *
+ * \return size_t
+ * \retval number of bytes fed, 0 at the end of the responses
+ *
+ */
+static size_t feedParser(struct responseParser *parser, const char *responses, size_t length, size_t *offset) {
+    char *space;
+    size_t size = responseParserSpace(parser, &space);
+
+    if (size > READ_SIZE) size = READ_SIZE;
+    if (size > length - *offset) size = length - *offset;
+    memcpy(space, responses + *offset, size);
+    responseParserFilled(parser, size);
+    *offset += size;
+    return size;
+}
+
+/**
+ * @brief stdioStatus
+ *
+ * checkServerResponseStatus() before the ring parser
+ *
+ */
+static int stdioStatus(FILE *source, int *status) {
+    char *line = NULL;
+    size_t sizeOfLine = 0;
+    int found;
+
+    if (getline(&line, &sizeOfLine, source) < SUCCESS) {
+        free(line);
+        return ERROR;
+    }
+    found = sscanf(line, "status=%d", status);
+    free(line);
+    return found == 1 ? SUCCESS : ERROR;
+}
+
+/**
+ * @brief stdioFileName
+ *
+ * getOutputFileName() before the ring parser
+ *
+ */
+static int stdioFileName(FILE *source, char **value) {
+    char *line = NULL;
+    size_t sizeOfLine = 0;
+
+    if (getline(&line, &sizeOfLine, source) < SUCCESS) {
+        free(line);
+        return ERROR;
+    }
+    char *fileName = malloc(strlen(line));
+    if (fileName == NULL) {
+        free(line);
+        return ERROR;
+    }
+    fileName[0] = '\0';
+    if (sscanf(line, "file=%s", fileName) == EOF || strlen(fileName) == 0) {
+        free(fileName);
+        free(line);
+        return ERROR;
+    }
+    free(line);
+    *value = fileName;
+    return SUCCESS;
+}
+
+/**
+ * @brief stdioFileLength
+ *
+ * getOutputFileLength() before the ring parser
+ *
+ */
+static int stdioFileLength(FILE *source, unsigned long *value) {
+    char *line = NULL;
+    size_t sizeOfLine = 0;
+    int found;
+
+    if (getline(&line, &sizeOfLine, source) < SUCCESS) {
+        free(line);
+        return ERROR;
+    }
+    found = sscanf(line, "len=%lu", value);
+    free(line);
+    return found == 1 ? SUCCESS : ERROR;
+}
+
+/**
+ * @brief now
+ *
+ * \return uint64_t
+ * \retval monotonic time in nanoseconds
+ *
+ */
+static uint64_t now(void) {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000ULL + (uint64_t)time.tv_nsec;
+}
+
+/**
+ * @brief printUsage
+ *
+ * print usage parameter to stderr and exit
+ *
+ */
+static void printUsage(void) {
+    fprintf(stderr, "usage: %s [-n responses]\n", programName);
+    exit(EXIT_FAILURE);
+}
@@ -5,6 +5,13 @@
  * given port, and sends bulletin board messages. After sending, connection is 
  * shutdown and response is stored local.
  *
+ * The post is made with libsmc, which this file sets up from the command
+ * line and the environment: files are written by the writer threads, or
+ * spliced to the files by libsmc with SMC_WRITERS=0; a message given as
+ * -m @file or -m - is streamed by libsmc with sendfile() or splice();
+ * SMC_RESUME, SMC_CHECKSUM, SMC_FASTOPEN, the connect and I/O timeouts and
+ * smc_agent are options of the post.
+ *
  * @author Thomas Halwax <ic14b050@technikum-wien.at>
  * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
  * @date 2015/12/13
@@ -24,15 +31,18 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/types.h>
-#include <sys/socket.h>
 #include <netdb.h>
 #include <errno.h>
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
-#include <stdarg.h>
 #include "simple_message_client_commandline_handling.h"
+#include "simple_message_client_batch.h"
+#include "simple_message_client_library.h"
+#include "simple_message_client_connect.h"
+#include "simple_message_client_writer.h"
+#include "simple_message_client_resume.h"
+#include "simple_message_trace.h"
 
 /*
  * ---------------------------------------------------------------- defines --
@@ -40,29 +50,45 @@
 
 #define ERROR -1
 #define SUCCESS 0
-#define DONE 2
 
+#if LOG_LEVEL >= LOG_LEVEL_INFO
 #define INFO(function, M, ...) \
 		if (verbose) fprintf(stdout, "%s [%s, %s, line %d]: " M "\n", programName, __FILE__, function, __LINE__, ##__VA_ARGS__)
+#else
+#define INFO(function, M, ...) do { } while (0)
+#endif
 
 /*
- * ---------------------------------------------------------------- globals --
+ * ------------------------------------------------------------- prototypes --
  */
 
-static const char *programName;
-static int verbose;
+void showUsage(FILE *stream, const char *cmnd, int exitcode);
+static int openMessageSource(const char **message, int *source);
+static char *startResume(void);
+static void setPostOptions(struct smcPostOptions *options);
+static int startFileWriters(void);
+static void *openWriterFile(const char *fileName, unsigned long offset, unsigned long length, void *context);
+static char *takeWriterBuffer(void *context);
+static int submitWriterBuffer(void *file, char *buffer, size_t length, void *context);
+static void releaseWriterBuffer(char *buffer, void *context);
+static void closeWriterFile(void *file, void *context);
 
 /*
- * ------------------------------------------------------------- prototypes --
+ * ---------------------------------------------------------------- globals --
  */
 
-void showUsage(FILE *stream, const char *cmnd, int exitcode);
-static int connectToServer(const char *server, const char *port, int *socketDescriptor);
-static int sendData(FILE *target, const char *key, const char *payload);
-static int checkServerResponseStatus(FILE *source, int *status);
-static int transferFile(FILE *source);
-static int getOutputFileLength(FILE *source, unsigned long *value);
-static int getOutputFileName(FILE *source, char **value);
+static const char *programName;
+static int verbose;
+/* number of writer threads, 0 has libsmc write the files */
+static int writers;
+/* files held, advertised with have= lines if SMC_RESUME is set */
+static int resuming;
+static struct resumeState resume;
+
+/* hands the files to the writer threads */
+static const struct smcFileSink writerSink = {
+    openWriterFile, takeWriterBuffer, submitWriterBuffer, releaseWriterBuffer, closeWriterFile, WRITE_BUFFER_SIZE
+};
 
 /**
  * @brief       Main function
@@ -88,431 +114,303 @@ int main(int argc, const char * argv[]) {
     const char *message;
     
     programName = argv[0];
+
+    /* SMC_TRACE=<path> records events to <path>.<pid>, see trace_export */
+    const char *tracePath = getenv("SMC_TRACE");
+    if (tracePath != NULL && startTrace(tracePath, programName) != SUCCESS) {
+        fprintf(stderr, "%s: can not trace to %s: %s\n", programName, tracePath, strerror(errno));
+    }
+
+    /* -b/--batch has a command line of its own */
+    if (isBatchCommandline(argc, argv)) exit(runBatchCommandline(argc, argv));
     
     smc_parsecommandline(argc, argv, showUsage, &server, &port, &user, &message, &image_url, &verbose);
     
     INFO("main()", "Using the following options: server=\"%s\", port=\"%s\", user=\"%s\", img_url=\"%s\", message=\"%s\"", server, port, user, image_url, message);
-	
-    INFO("main()", "connecting to server=\"%s\", port=\"%s\"", server, port);
-    int sfd = 0;
-    if (connectToServer(server, port, &sfd) != SUCCESS) {
-        fprintf(stderr, "%s: connectToServer() failed for server %s and port %s: %s\n", programName, server, port, strerror(errno));
-        exit(errno);
+
+    /* -m @path and -m - stream the message, opened before connecting */
+    int messageSource = ERROR;
+    if (openMessageSource(&message, &messageSource) != SUCCESS) {
+        fprintf(stderr, "%s: can not open message %s: %s\n", programName, message + 1, strerror(errno));
+        exit(EXIT_FAILURE);
     }
-    
-    INFO("main()", "open file descriptor for writing %s", "");
-    errno = SUCCESS;
-    FILE *toServer = fdopen(sfd, "w");
-    if (toServer == NULL) {
-        fprintf(stderr, "%s: fdOpen() to write to server failed: %s\n", programName, strerror(errno));
-        close(sfd);
-        exit(errno);
+
+    /* a running smc_agent has resolved and connected ahead of time */
+    struct smcClient *client;
+    int created = smcCreateAgentClient(server, port, &client);
+    if (created != SUCCESS) {
+        fprintf(stderr, "%s: getaddrinfo() failed: %s\n", programName, created == EAI_SYSTEM ? strerror(errno) : gai_strerror(created));
+        exit(EXIT_FAILURE);
     }
-    
-	INFO("main()", "sending data to server %s", server);
-    if (sendData(toServer, "user=", user) == ERROR) {
-        fprintf(stderr, "%s: sendData() for param user=<user> failed: %s\n", programName, strerror(errno));
-        shutdown(sfd, SHUT_RDWR);
-        fclose(toServer);
-        exit(errno);
+
+    if (startFileWriters() != SUCCESS) {
+        fprintf(stderr, "%s: starting the file writers failed: %s\n", programName, strerror(errno));
+        exit(EXIT_FAILURE);
     }
-    
-    if (image_url != NULL) {
-		INFO("main()", "found image, sending to server %s", server);
-        if (sendData(toServer, "img=", image_url) == ERROR) {
-            fprintf(stderr, "%s: sendData() for param img=<image_url> failed: %s\n", programName, strerror(errno));
-            shutdown(sfd, SHUT_RDWR);
-            fclose(toServer);
-            exit(errno);
-        }
+
+    struct smcRequest request = { user, messageSource == ERROR ? message : NULL, image_url, messageSource, startResume() };
+    struct smcPostOptions options;
+    setPostOptions(&options);
+
+    INFO("main()", "connecting to server=\"%s\", port=\"%s\"", server, port);
+    struct smcPost *post = smcSubmit(client, &request, &options);
+    if (post == NULL) {
+        fprintf(stderr, "%s: could not connect to server %s and port %s: %s\n", programName, server, port, strerror(errno));
+        exit(EXIT_FAILURE);
     }
-    
-	INFO("main()", "send message to server %s", server);
-    if (sendData(toServer, "", message) == ERROR) {
-        fprintf(stderr, "%s: sendData() for message failed: %s\n", programName, strerror(errno));
-        shutdown(sfd, SHUT_RDWR);
-        fclose(toServer);
-        exit(errno);
+
+    const struct smcResult *result;
+    while ((result = smcPostResult(post)) == NULL) {
+        if (smcProcess(client, ERROR) == ERROR) {
+            fprintf(stderr, "%s: smcProcess() failed: %s\n", programName, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
     }
-    
-    /* fclose schließt auch sfd, daher vorher ein dup */
-    INFO("main()", "creating backup of file descriptor %s", "");	
-    int backupOfSfd = dup(sfd);
-    
-	INFO("main()", "closing connection to server %s", server);
-    if (shutdown(sfd, SHUT_WR) != SUCCESS) {
-        fprintf(stderr, "%s: shutDown() SHUT_WR for server connection failed: %s\n", programName, strerror(errno));
-        fclose(toServer);
+    if (messageSource > STDIN_FILENO) close(messageSource);
+    free((char *)request.have);
+
+    if (result->error != SUCCESS) {
+        fprintf(stderr, "%s: post to server %s failed after %d files: %s\n", programName, server, result->fileCount, strerror(result->error));
         exit(EXIT_FAILURE);
     }
-    
-	INFO("main()", "closing file descriptor %s", "");
-    fclose(toServer);
-    INFO("main()", "closed writing channel to server %s", server);
-    
-	INFO("main()", "open stream from server %s", server);
-    FILE *fromServer = fdopen(backupOfSfd, "r");
-    if (fromServer == NULL) {
-        fprintf(stderr, "%s: fdOpen() to read from server failed: %s\n", programName, strerror(errno));
-        close(backupOfSfd);
-        exit(errno);
+    if (result->status != SUCCESS) {
+        fprintf(stderr, "%s: reading server response failed with error %d\n", programName, result->status);
+        exit(result->status);
     }
-    INFO("main()", "opened reading channel from server %s", server);
-    /* read line for status=... */
-    /* if status returned from server != 0 then exit using the status */
-    int status = ERROR;
-    
-	INFO("main()", "start checking server response %s", "");
-    if (checkServerResponseStatus(fromServer, &status) != SUCCESS || status != SUCCESS) {
-        fprintf(stderr, "%s: reading server response failed with error %d\n", programName, status);
-        fclose(fromServer);
-        close(backupOfSfd);
-        exit(status);
+    INFO("main()", "received %d files with %llu bytes from server %s", result->fileCount, result->bytes, server);
+
+    /* the writers may still be busy with the last files */
+    if (writers > 0 && stopWriters() != SUCCESS) {
+        fprintf(stderr, "%s: writing the files failed: %s\n", programName, strerror(errno));
+        exit(EXIT_FAILURE);
     }
-    INFO("main()", "server returned status %d", status);
-    
-	INFO("main()", "start receiving files from server %s", server);
-    int canTransferFile = SUCCESS;
-    while (canTransferFile != DONE) {
-        canTransferFile = transferFile(fromServer);
-        if (canTransferFile == ERROR) {
-            fprintf(stderr, "%s: transferFile() failed: %s\n", programName, strerror(errno));
-            fclose(fromServer);
-            close(backupOfSfd);
-            exit(EXIT_FAILURE);
+    if (resuming) {
+        /* a file the server skipped stays as it is, its hash too */
+        for (int i = 0; i < result->fileCount; i++) {
+            if (result->files[i].offset == 0 || result->files[i].length > 0) resumeStarted(&resume, result->files[i].name);
+        }
+        if (saveResumeState(&resume) != SUCCESS) {
+            fprintf(stderr, "%s: can not save %s: %s\n", programName, RESUME_MANIFEST, strerror(errno));
         }
     }
-    
-	INFO("main()", "received all data, closing connection to server %s", server);
-    fclose(fromServer);
-    close(backupOfSfd);
-    INFO("main()", "closed connection to server %s", server);
+
+    int status = result->status;
+    smcFreePost(post);
+    smcDestroyClient(client);
     INFO("main()", "bye %s!", user);
     exit(status);
 }
 
 /**
- * @brief connectToServer
+ * @brief openMessageSource
  *
- * Connect to server
- * Writes Errors to stderr
+ * -m @path sends the contents of a file as message, -m - the contents of
+ * stdin; -m @@text sends "@text". The message is streamed then, so its
+ * size is neither limited by the command line nor by memory.
  *
- * \param server server address for connecting to
- * \param port port from the server is given
- * \param socketDescriptor file descriptor for handling the connection
+ * \param message message from the command line, the literal message
+ *        after unescaping
+ * \param source set to the file to stream, ERROR for a literal message
  *
  * \return int
  * \retval SUCCESS on Success
- * \retval ERROR on Error
+ * \retval ERROR if the file can not be opened
  *
  */
-
-static int connectToServer(const char *server, const char *port, int *socketDescriptor) {
-    struct addrinfo hints;
-    struct addrinfo *result, *rp;
-    int sfd = -1;
-    
-	INFO("connectToServer()", "creating address strct %s", "");
-    memset(&hints, 0, sizeof(struct addrinfo));
-    hints.ai_family = AF_UNSPEC;    /* Allow IPv4 or IPv6 */
-    hints.ai_socktype = SOCK_STREAM; /* Stream socket */
-    hints.ai_flags = 0;
-    hints.ai_protocol = 0;          /* Any protocol */
-    
-	INFO("connectToServer()", "use getaddrinfo() on %s", server);
-    if (getaddrinfo(server, port, &hints, &result) != SUCCESS) {
-        fprintf(stderr, "%s: getaddrinfo() failed: %s\n", programName, strerror(errno));
-        return ERROR;
+static int openMessageSource(const char **message, int *source) {
+    *source = ERROR;
+    if (strcmp(*message, "-") == 0) {
+        *source = STDIN_FILENO;
     }
-    
-    /* getaddrinfo() returns a list of address structures.
-     Try each address until we successfully connect(2).
-     If socket(2) (or connect(2)) fails, we (close the socket
-     and) try the next address. */
- 	INFO("connectToServer()", "iterate through list of getaddrinfo filled structure %s", ""); 
-    for (rp = result; rp != NULL; rp = rp->ai_next) {
-		INFO("connectToServer()", "try socket %d - %d - %d", rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-        sfd = socket(rp->ai_family, rp->ai_socktype,
-                     rp->ai_protocol);
-        if (sfd == -1)
-            continue;
-        
-		INFO("connectToServer()", "try connect to former created socket %s", "");
-        if (connect(sfd, rp->ai_addr, rp->ai_addrlen) != -1)
-            break;                  /* Success */
-        
-		INFO("connectToServer()", "closing socket %s", "");
-        close(sfd);
+    else if (strncmp(*message, "@@", 2) == 0) {
+        (*message)++;
     }
-
-	INFO("connectToServer()", "freeaddrinfo() %s", "");
-    freeaddrinfo(result);           /* No longer needed */
-    
-    if (rp == NULL) {               /* No address succeeded */
-        fprintf(stderr, "%s: could not connect: %s\n", programName, strerror(errno));
-        return ERROR;
+    else if ((*message)[0] == '@') {
+        *source = open(*message + 1, O_RDONLY | O_CLOEXEC);
+        if (*source == ERROR) return ERROR;
     }
-    
-    INFO("connectToServer()", "connected to address %s, port number %s", server, port);
-    *socketDescriptor = sfd;
     return SUCCESS;
+}
+
+/**
+ * @brief startResume
+ *
+ * with SMC_RESUME=1, load the files held from RESUME_MANIFEST; they are
+ * advertised between the img= line and the message, so a logic without
+ * the extension takes them for part of the message
+ *
+ * \return char *
+ * \retval the have= lines, to be freed by the caller
+ * \retval NULL if nothing is advertised
+ *
+ */
+static char *startResume(void) {
+    const char *setting = getenv("SMC_RESUME");
+    size_t length = 0;
+
+    if (setting == NULL || atoi(setting) == 0) return NULL;
+    if (loadResumeState(&resume) != SUCCESS) {
+        fprintf(stderr, "%s: can not use %s, resuming disabled: %s\n", programName, RESUME_MANIFEST, strerror(errno));
+        return NULL;
+    }
+    resuming = 1;
 
+    char *have = resumeRequest(&resume, &length);
+    INFO("startResume()", "advertising %d files in %zu bytes", resume.count, length);
+    return have;
 }
 
 /**
- * @brief sendData
+ * @brief setPostOptions
  *
- * Send data to opend connection
+ * files go to the writers, or to the current directory without them;
+ * SMC_CONNECT_DELAY and SMC_CONNECT_TIMEOUT in the environment override the
+ * attempt delay and the deadline of the connect in milliseconds,
+ * SMC_IO_TIMEOUT fails the post once no data moved for its milliseconds,
+ * SMC_FASTOPEN=1 enables TCP Fast Open and SMC_CHECKSUM=1 asks for the
+ * CRC32C of every file, verified while the bytes come in
  *
- * \param FILE opened file for writing to
- * \param key keyvalue from communication protocol
- * \param payload data
+ * \param options filled for the post
  *
- * \return int
- * \retval SUCCESS on Success
- * \retval ERROR on Error
+ * \return void
+ * \retval void
  *
  */
-static int sendData(FILE *target, const char *key, const char *payload) {
-    if (fprintf(target, "%s", key) < 0) return ERROR;
-    if (fprintf(target, "%s", payload) < 0) return ERROR;
-    if (fprintf(target, "\n") < 0) return ERROR;
-    if (fflush(target) == EOF) return ERROR;
-    INFO("sendData()", "sent Data %s%s", key, payload);
-    return SUCCESS;
+static void setPostOptions(struct smcPostOptions *options) {
+    memset(options, 0, sizeof(*options));
+    options->directory = AT_FDCWD;
+    if (writers > 0) options->sink = &writerSink;
+
+    const char *setting = getenv("SMC_CONNECT_DELAY");
+    /* 0 tries all addresses at once */
+    if (setting != NULL) options->attemptDelay = atoi(setting) > 0 ? atoi(setting) : ERROR;
+    setting = getenv("SMC_CONNECT_TIMEOUT");
+    options->connectTimeout = setting != NULL ? atoi(setting) : CONNECT_TIMEOUT;
+    setting = getenv("SMC_IO_TIMEOUT");
+    if (setting != NULL && atoi(setting) > 0) options->idleTimeout = atoi(setting);
+    setting = getenv("SMC_FASTOPEN");
+    options->fastOpen = setting != NULL && atoi(setting) != 0;
+    setting = getenv("SMC_CHECKSUM");
+    options->checksum = setting != NULL && atoi(setting) != 0;
+    INFO("setPostOptions()", "attempt delay %d ms, connect timeout %d ms, I/O timeout %d ms, fast open %d, checksum %d", options->attemptDelay, options->connectTimeout, options->idleTimeout, options->fastOpen, options->checksum);
 }
 
 /**
- * @brief checkServerResponseStatus
+ * @brief startFileWriters
  *
- * searching key "status=" in data from server
- *
- * \param source opened file for reading from
- * \param status pointer for writing status into
+ * start the writer threads unless SMC_WRITERS is 0; SMC_WRITE_BUDGET caps
+ * the MiB of received data waiting for the disk
  *
  * \return int
- * \retval DONE on EOF
  * \retval SUCCESS on Success
  * \retval ERROR on Error
  *
  */
-static int checkServerResponseStatus(FILE *source, int *status) {
-    /* read line from source */
-    /* compare n chars with status=0 */
-    char *line = NULL;
-    size_t sizeOfLine = 0;
-    int found = 0;
-
-	INFO("checkServerResponseStatus()", "start read lines %s", "");
-    errno = SUCCESS;
-    if (getline(&line, &sizeOfLine, source) < SUCCESS) {
-        free(line);
-        if (errno == EINVAL || errno == EOVERFLOW) {
-        fprintf(stderr, "%s: checkServerResponseStatus()/getline() failed: %s\n", programName, strerror(errno));
-            return ERROR;
-        }
-        else {
-            /* must be EOF */
-            INFO("checkServerResponseStatus()", "found EOF %s", "");
-            return DONE;
-        }
+static int startFileWriters(void) {
+    const char *setting = getenv("SMC_WRITERS");
+    writers = setting != NULL ? atoi(setting) : DEFAULT_WRITERS;
+    if (writers <= 0) {
+        writers = 0;
+        return SUCCESS;
     }
+    setting = getenv("SMC_WRITE_BUDGET");
+    long budget = setting != NULL ? atol(setting) : DEFAULT_WRITE_BUDGET;
+    if (budget <= 0) budget = DEFAULT_WRITE_BUDGET;
 
-	INFO("checkServerResponseStatus()", "try to find status code in stream %s", "");
-    found = sscanf(line, "status=%d", status);
-    if (found == 0 || found == EOF) {
-        fprintf(stderr, "%s: checkServerResponseStatus()/sscanf() failed: %s\n", programName, strerror(errno));
-        free(line);
-        return ERROR;
-    }
-    free(line);
-    
-    INFO("checkServerResponseStatus()", "status=%d", *status);
-    return SUCCESS;
+    INFO("startFileWriters()", "starting %d writers with %ld MiB of buffers", writers, budget);
+    return startWriters(programName, writers, (size_t)budget * 1024 * 1024);
 }
 
 /**
- * @brief getOutputFileName
+ * @brief openWriterFile
  *
- * searching key "file=" in data from server
+ * sink callback: opening, writing and closing happen on a writer thread
+ * while libsmc keeps reading the socket
  *
- * \param source opened file for reading from
- * \param value pointer for writing filename into
+ * \param fileName name sent by the server
+ * \param offset bytes of the file kept
+ * \param length announced length behind offset
+ * \param context unused
  *
- * \return int
- * \retval DONE on EOF
- * \retval SUCCESS on Success
- * \retval ERROR on Error
+ * \return void *
+ * \retval the file of writerOpen()
+ * \retval NULL on Error
  *
  */
-static int getOutputFileName(FILE *source, char **value) {
-    char *line = NULL;
-    char *fileName = NULL;
-    size_t sizeOfLine = 0;
-    
-	INFO("getOutputFileName()", "start read lines %s", "");
-    errno = SUCCESS;
-    if (getline(&line, &sizeOfLine, source) < SUCCESS) {
-        free(line);
-        if (errno == EINVAL || errno == EOVERFLOW) {
-        fprintf(stderr, "%s: getOutputFileName()/getline() failed: %s\n", programName, strerror(errno));
-            return ERROR;
-        }
-        else {
-            /* EOF */
-            INFO("getOutputFileName()", "found EOF %s", "");
-            return DONE;
-        }
-    }
-    
-	INFO("getOutputFileName()", "try to malloc for filename %s", "");
-    fileName = malloc(sizeof(char) * strlen(line));
-    if (fileName == NULL) {
-        fprintf(stderr, "%s: getOutputFileName()/malloc() failed: %s\n", programName, strerror(errno));
-        free(line);
-        return ERROR;
-    }
-    fileName[0] = '\0';
-	INFO("getOutputFileName()", "try to find filename in stream %s", "");
-    if (sscanf(line, "file=%s", fileName) == EOF) {
-        fprintf(stderr, "%s: getOutputFileName()/file=<file> pattern not found\n", programName);
-        free(fileName);
-        free(line);
-        return ERROR;
-    }
-    
-    free(line);
-    
-    if (strlen(fileName) == 0) {
-        fprintf(stderr, "%s: getOutputFileName()/file=<file> pattern not found\n", programName);
-        free(fileName);
-        return ERROR;
-    }
-    INFO("getOutputFileName()", "found fileName %s", fileName);
-    /* memory gets freed in transferFile() */
-    *value = fileName;
-    return SUCCESS;
+static void *openWriterFile(const char *fileName, unsigned long offset, unsigned long length, void *context) {
+    (void)context;
+    INFO("openWriterFile()", "handing %lu bytes of %s at %lu to the writers", length, fileName, offset);
+    return writerOpen(fileName, offset, length);
 }
 
 /**
- * @brief getOutputFileLength
+ * @brief takeWriterBuffer
  *
- * searching key "len=" in data from server
+ * sink callback, waits for a buffer when the write budget is used up
  *
- * \param source opened file for reading from
- * \param value pointer for writing lenght into
+ * \param context unused
  *
- * \return int
- * \retval DONE on EOF
- * \retval SUCCESS on Success
- * \retval ERROR on Error
+ * \return char *
+ * \retval buffer of writerBuffer()
  *
  */
-static int getOutputFileLength(FILE *source, unsigned long *value) {
-    char *line = NULL;
-    size_t sizeOfLine = 0;
-    int found = 0;
-    
-	INFO("getOutputFileLength()", "start read lines %s", "");
-    errno = SUCCESS;
-    if (getline(&line, &sizeOfLine, source) < SUCCESS) {
-        if (errno == EINVAL || errno == EOVERFLOW) {
-            fprintf(stderr, "%s: getOutputFileLength()/getline() failed: %s\n", programName, strerror(errno));
-            free(line);
-            return ERROR;
-        }
-        else {
-            /* EOF */
-            INFO("getOutputFileLength()", "found EOF %s", "");
-            return DONE;
-        }
-    }
-    
-	INFO("getOutputFileLength()", "try to find file length in stream %s", "");
-    found = sscanf(line, "len=%lu", value);
-    if (found == 0 || found == EOF) {
-        fprintf(stderr, "%s: getOutputFileLength()/pattern len=<length> not found\n", programName);
-        free(line);
-        return ERROR;
-    }
-    
-    free(line);
-    INFO("getOutputFileLength()", "found len=%lu", *value);
-    return SUCCESS;
+static char *takeWriterBuffer(void *context) {
+    (void)context;
+    return writerBuffer();
 }
 
 /**
- * @brief transferFile
+ * @brief submitWriterBuffer
  *
- * writing data from server to local file
+ * sink callback
  *
- * \param source opened file for reading from
+ * \param file file of openWriterFile()
+ * \param buffer buffer of takeWriterBuffer()
+ * \param length number of bytes in buffer
+ * \param context unused
  *
  * \return int
  * \retval SUCCESS on Success
- * \retval ERROR on Error
+ * \retval ERROR if writing already failed
  *
  */
-static int transferFile(FILE *source) {
-    char *fileName = NULL;
-    unsigned long fileLength = 0;
-    int result = 0;
-    
-	INFO("transferFile()", "get result from getOutputFileName() %s", "");
-    if ((result = getOutputFileName(source, &fileName)) != SUCCESS) return result;
-	INFO("transferFile()", "get result from getOutputFileLength() %s", "");
-    if ((result = getOutputFileLength(source, &fileLength)) != SUCCESS) return result;
-    
-    errno = SUCCESS;
-	INFO("transferFile()", "open outputFileDescriptor %s", "");
-    int outputFileDescriptor = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0664);
-    if (outputFileDescriptor == ERROR) {
-        fprintf(stderr, "%s: transferFile()/open() failed: %s\n", programName, strerror(errno));
-        free(fileName);
-        return ERROR;
-    }
+static int submitWriterBuffer(void *file, char *buffer, size_t length, void *context) {
+    (void)context;
+    return writerSubmit(file, buffer, length);
+}
 
-	INFO("transferFile()", "fdopen outputFile  %s", "");
-    FILE *outputFile = fdopen(outputFileDescriptor, "w");
-    if (outputFile == NULL) {
-        free(fileName);
-        fprintf(stderr, "%s: transferFile()/fdopen() failed: %s\n", programName, strerror(errno));
-        return ERROR;
-    }
-    INFO("transferFile()", "opened %s for writing", fileName);
-    free(fileName);
-
-    size_t bytesAvailable = 0;
-    size_t bytesWritten = 0;
-    size_t bytesTransferred = 0;
-    size_t bufferSize = 1;
-    char buffer;
-    
-	INFO("transferFile()", "start writing bytes to outputFile %s", fileName);
-    while ((bytesAvailable = fread(&buffer, (size_t)sizeof(char), bufferSize, source)) > 0) {
-        
-        bytesWritten = fwrite(&buffer, (size_t)sizeof(char), bytesAvailable, outputFile);
-        if (bytesAvailable != bytesWritten) {
-            fprintf(stderr, "%s: failed writing %zu bytes to file\n", programName, bytesAvailable);
-            fclose(outputFile);
-            return ERROR;
-        }
-        bytesTransferred += bytesWritten;
-        if (bytesTransferred == fileLength) {
-            INFO("transferFile()", "transferred %zu bytes to file", bytesTransferred);
-            fclose(outputFile);
-            return SUCCESS;
-        }
-    }
-    
-    fclose(outputFile);
-    INFO("transferFile()", "closed %s", fileName);
-    if (bytesTransferred < fileLength) {
-        fprintf(stderr, "%s: missing bytes! received %zu out of %lu\n", programName, bytesTransferred, fileLength);
-        return ERROR;
-    }
+/**
+ * @brief releaseWriterBuffer
+ *
+ * sink callback
+ *
+ * \param buffer buffer of takeWriterBuffer() that got no bytes
+ * \param context unused
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void releaseWriterBuffer(char *buffer, void *context) {
+    (void)context;
+    writerRelease(buffer);
+}
 
-    return SUCCESS;
+/**
+ * @brief closeWriterFile
+ *
+ * sink callback
+ *
+ * \param file file of openWriterFile()
+ * \param context unused
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void closeWriterFile(void *file, void *context) {
+    (void)context;
+    writerClose(file);
 }
 
 /**
@@ -530,7 +428,8 @@ static int transferFile(FILE *source) {
  *
  */
 void showUsage(FILE *stream, const char *cmnd, int exitcode) {
-    fprintf(stream, "%s: %s\n", cmnd, "-s server -p port -u user [-i image URL] -m message [-v] [-h]");
+    fprintf(stream, "%s: %s\n", cmnd, "-s server -p port -u user [-i image URL] -m <message|@file|-> [-v] [-h]");
+    fprintf(stream, "%s: %s\n", cmnd, "-s server -p port -b <file|-> [-c inflight] [-o directory] [-v] [-h]");
     exit(exitcode);
 }
 
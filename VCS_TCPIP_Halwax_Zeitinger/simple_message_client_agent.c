@@ -0,0 +1,162 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_client_agent.c
+ * VCS - Tcp/Ip Exercise - client side of smc_agent: ask the agent for a
+ * connection to a server, which it has resolved and connected before the
+ * client started, and take it over as SCM_RIGHTS. Without an agent this
+ * costs one failed connect() on a UNIX socket, and the client resolves and
+ * connects itself, as it always did; so does it if the agent has no
+ * connection ready yet.
+ *
+ * The agent is asked only if SMC_AGENT=<path> names its socket, or if
+ * $XDG_RUNTIME_DIR, a directory private to the user, holds it; SMC_AGENT=
+ * (empty) turns it off. A connection is taken only from a socket owned by
+ * the user, not writable by others, whose peer runs as the user: whoever
+ * hands it over receives the request and chooses the files written.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "simple_message_client_agent.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define ERROR -1
+#define SUCCESS 0
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief agentSocketPath
+ *
+ * \param path set to the path of the agent's socket
+ * \param size size of path
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR if the agent is turned off, neither SMC_AGENT nor
+ *         XDG_RUNTIME_DIR is set, or the path is too long
+ *
+ */
+int agentSocketPath(char *path, size_t size) {
+    const char *setting = getenv("SMC_AGENT");
+    int length;
+
+    if (setting != NULL) {
+        if (setting[0] == '\0') return ERROR;
+        length = snprintf(path, size, "%s", setting);
+    }
+    else {
+        /* not a shared directory like /tmp, where anyone could bind the path first */
+        const char *runtimeDirectory = getenv("XDG_RUNTIME_DIR");
+        if (runtimeDirectory == NULL || runtimeDirectory[0] == '\0') return ERROR;
+        length = snprintf(path, size, "%s/%s", runtimeDirectory, AGENT_SOCKET_NAME);
+    }
+    return length > 0 && (size_t)length < size ? SUCCESS : ERROR;
+}
+
+/**
+ * @brief takeAgentConnection
+ *
+ * \param server server address as given on the command line
+ * \param port port as given on the command line
+ * \param socketDescriptor set to a connected, blocking socket
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR if there is no agent, it does not run as the user, or it
+ *         has no connection ready, the caller connects itself
+ *
+ */
+int takeAgentConnection(const char *server, const char *port, int *socketDescriptor) {
+    struct sockaddr_un address;
+    char request[AGENT_REQUEST_SIZE];
+    size_t serverLength = strlen(server) + 1;
+    size_t portLength = strlen(port) + 1;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (agentSocketPath(address.sun_path, sizeof(address.sun_path)) != SUCCESS) return ERROR;
+    if (serverLength + portLength > sizeof(request)) return ERROR;
+    memcpy(request, server, serverLength);
+    memcpy(request + serverLength, port, portLength);
+
+    /* no agent: ENOENT right away */
+    struct stat status;
+    if (lstat(address.sun_path, &status) == ERROR || !S_ISSOCK(status.st_mode)
+        || status.st_uid != getuid() || (status.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        return ERROR;
+    }
+
+    int agent = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (agent == ERROR) return ERROR;
+
+    /* the path may be replaced between lstat() and connect(), the peer can not */
+    struct ucred peer;
+    socklen_t peerLength = sizeof(peer);
+    struct timeval limit = { AGENT_REPLY_TIMEOUT / 1000, (AGENT_REPLY_TIMEOUT % 1000) * 1000 };
+    if (connect(agent, (struct sockaddr *)&address, sizeof(address)) == ERROR
+        || getsockopt(agent, SOL_SOCKET, SO_PEERCRED, &peer, &peerLength) == ERROR
+        || peer.uid != getuid()
+        || setsockopt(agent, SOL_SOCKET, SO_RCVTIMEO, &limit, sizeof(limit)) == ERROR
+        || send(agent, request, serverLength + portLength, MSG_NOSIGNAL) == ERROR) {
+        close(agent);
+        return ERROR;
+    }
+
+    struct agentReply reply;
+    struct iovec data = { &reply, sizeof(reply) };
+    union {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr message;
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    ssize_t received = recvmsg(agent, &message, MSG_CMSG_CLOEXEC);
+    close(agent);
+
+    int connection = ERROR;
+    struct cmsghdr *header = received > 0 ? CMSG_FIRSTHDR(&message) : NULL;
+    if (header != NULL && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+        memcpy(&connection, CMSG_DATA(header), sizeof(connection));
+    }
+    if (received != sizeof(reply) || reply.error != 0 || connection == ERROR) {
+        if (connection != ERROR) close(connection);
+        return ERROR;
+    }
+
+    *socketDescriptor = connection;
+    return SUCCESS;
+}
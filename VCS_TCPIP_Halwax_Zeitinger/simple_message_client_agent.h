@@ -0,0 +1,57 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_client_agent.h
+ * VCS - Tcp/Ip Exercise - connections made ahead of time by smc_agent,
+ * taken over by simple_message_client through a UNIX socket
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_AGENT_H
+#define SIMPLE_MESSAGE_CLIENT_AGENT_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <netdb.h>
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* socket of the agent in $XDG_RUNTIME_DIR, unless SMC_AGENT names one */
+#define AGENT_SOCKET_NAME "smc_agent"
+
+/* milliseconds a client waits for the answer, the agent answers at once */
+#define AGENT_REPLY_TIMEOUT 1000
+
+/* a request is "<server>\0<port>\0" in one SOCK_SEQPACKET message */
+#define AGENT_REQUEST_SIZE (NI_MAXHOST + NI_MAXSERV)
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+/* the answer, with the connection as SCM_RIGHTS if error is 0 */
+struct agentReply {
+    int error;                  /* errno value, EAGAIN: no connection ready */
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int agentSocketPath(char *path, size_t size);
+int takeAgentConnection(const char *server, const char *port, int *socketDescriptor);
+
+#endif /* SIMPLE_MESSAGE_CLIENT_AGENT_H */
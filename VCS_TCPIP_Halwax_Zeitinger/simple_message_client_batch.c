@@ -0,0 +1,688 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_client_batch.c
+ * VCS - Tcp/Ip Exercise - batch mode of simple_message_client
+ *
+ * Reads one record per line from a file or stdin, as a JSON object
+ *
+ *     {"user": "alice", "message": "hello", "img": "http://..."}
+ *
+ * with "img" optional, and posts each record with libsmc, see
+ * simple_message_client_library.h. Up to --inflight posts run at once,
+ * driven by smcProcess(); the files of record n are written to the
+ * directory n below the output directory. The server is resolved once for
+ * the whole batch.
+ *
+ * Every finished record prints one line to stdout, a summary with the
+ * throughput and latency goes to stderr at the end.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <netdb.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include "simple_message_client_batch.h"
+#include "simple_message_client_library.h"
+#include "simple_message_client_connect.h"
+#include "simple_message_trace.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define ERROR -1
+#define SUCCESS 0
+#define DONE 2
+
+#define DEFAULT_INFLIGHT 16
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define INFO(function, M, ...) \
+        if (verbose) fprintf(stderr, "%s [%s, %s, line %d]: " M "\n", programName, __FILE__, function, __LINE__, ##__VA_ARGS__)
+#else
+#define INFO(function, M, ...) do { } while (0)
+#endif
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+/* a record being posted, the context of its post */
+struct batchRecord {
+    long number;                /* input line of the record */
+    uint64_t started;
+    int directory;              /* the directory number below the output directory */
+};
+
+struct batchOptions {
+    const char *server;
+    const char *port;
+    const char *input;
+    const char *outputDirectory;
+    int inflight;
+    int connectTimeout;         /* milliseconds, 0: none */
+    int idleTimeout;            /* milliseconds, 0: none */
+};
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+static const char *programName;
+static int verbose;
+
+static int outputDirectory;
+static FILE *input;
+static long inputLine;
+static int inputDone;
+
+static uint64_t *latencies;
+static size_t latencyCapacity;
+static size_t latencyCount;
+static long succeeded;
+static long failed;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void printBatchUsage(void);
+static int getBatchOptions(int argc, const char * const argv[], struct batchOptions *batchOptions);
+static int runBatch(const struct batchOptions *batchOptions);
+static int startNextRecord(struct smcClient *client, const struct batchOptions *batchOptions);
+static void completeRecord(struct smcPost *post, const struct smcResult *result, void *context);
+static void finishRecord(struct batchRecord *record, const struct smcResult *result, const char *error);
+static int parseJsonRecord(char *line, const char **user, const char **message, const char **image);
+static char *parseJsonString(char **cursor);
+static int parseHexQuad(const char *digits, unsigned long *value);
+static char *skipSpace(char *cursor);
+static uint64_t now(void);
+static int compareLatencies(const void *a, const void *b);
+static void printSummary(uint64_t elapsed);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief isBatchCommandline
+ *
+ * batch mode is chosen with -b/--batch, the other options then follow
+ * runBatchCommandline() instead of smc_parsecommandline(); an argument of
+ * another option that reads "-b" does not count
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * \return int
+ * \retval 1 if the command line asks for batch mode
+ * \retval 0 otherwise
+ *
+ */
+int isBatchCommandline(int argc, const char * const argv[]) {
+    /* options of either command line that take an argument, "-m -b" posts the message "-b" */
+    static const char *withArgument = "spuimcot";
+    static const char *longWithArgument[] = { "server", "port", "user", "image", "message", "inflight", "output", "connect-timeout", "idle-timeout", NULL };
+
+    for (int i = 1; i < argc; i++) {
+        const char *argument = argv[i];
+
+        if (strcmp(argument, "--") == 0) return 0;
+        if (argument[0] != '-' || argument[1] == '\0') continue;
+
+        if (argument[1] == '-') {
+            const char *name = argument + 2;
+            size_t length = strcspn(name, "=");
+            if (length == strlen("batch") && strncmp(name, "batch", length) == 0) return 1;
+            if (name[length] == '=') continue;
+            for (int j = 0; longWithArgument[j] != NULL; j++) {
+                if (strlen(longWithArgument[j]) == length && strncmp(name, longWithArgument[j], length) == 0) {
+                    i++;
+                    break;
+                }
+            }
+            continue;
+        }
+
+        /* a group of short options, "-vb" included; one taking an argument ends it */
+        for (const char *option = argument + 1; *option != '\0'; option++) {
+            if (*option == 'b') return 1;
+            if (strchr(withArgument, *option) != NULL) {
+                if (option[1] == '\0') i++;
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief runBatchCommandline
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * \return int
+ * \retval EXIT_SUCCESS if every record was answered with status=0
+ * \retval EXIT_FAILURE otherwise
+ *
+ */
+int runBatchCommandline(int argc, const char * const argv[]) {
+    struct batchOptions batchOptions;
+
+    programName = argv[0];
+    if (getBatchOptions(argc, argv, &batchOptions) != SUCCESS) {
+        printBatchUsage();
+        return EXIT_FAILURE;
+    }
+    return runBatch(&batchOptions) == SUCCESS && failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @brief runBatch
+ *
+ * post every record of the input
+ *
+ * \param batchOptions parsed command line
+ *
+ * \return int
+ * \retval SUCCESS if all records were run, failed or not
+ * \retval ERROR if the batch could not be run
+ *
+ */
+static int runBatch(const struct batchOptions *batchOptions) {
+    struct smcClient *client;
+    int result = smcCreateClient(batchOptions->server, batchOptions->port, &client);
+    if (result != SUCCESS) {
+        fprintf(stderr, "%s: getaddrinfo() failed: %s\n", programName, result == EAI_SYSTEM ? strerror(errno) : gai_strerror(result));
+        return ERROR;
+    }
+
+    input = strcmp(batchOptions->input, "-") == 0 ? stdin : fopen(batchOptions->input, "r");
+    if (input == NULL) {
+        fprintf(stderr, "%s: can not open %s: %s\n", programName, batchOptions->input, strerror(errno));
+        smcDestroyClient(client);
+        return ERROR;
+    }
+
+    outputDirectory = open(batchOptions->outputDirectory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (outputDirectory == ERROR) {
+        fprintf(stderr, "%s: batch setup failed: %s\n", programName, strerror(errno));
+        smcDestroyClient(client);
+        return ERROR;
+    }
+
+    uint64_t begin = now();
+    while (1 == 1) {
+        /* a slot takes the next record as soon as it is free */
+        while (!inputDone && smcPending(client) < batchOptions->inflight && startNextRecord(client, batchOptions) == SUCCESS) {
+        }
+        if (smcPending(client) == 0) break;
+
+        if (smcProcess(client, -1) == ERROR) {
+            fprintf(stderr, "%s: smcProcess() failed: %s\n", programName, strerror(errno));
+            break;
+        }
+    }
+
+    printSummary(now() - begin);
+
+    free(latencies);
+    smcDestroyClient(client);
+    close(outputDirectory);
+    if (input != stdin) fclose(input);
+    return SUCCESS;
+}
+
+/**
+ * @brief startNextRecord
+ *
+ * read records until one is posted; records that can not be parsed or
+ * connected are reported and skipped
+ *
+ * \param client client of the server
+ * \param batchOptions timeouts of the posts
+ *
+ * \return int
+ * \retval SUCCESS if a record was posted
+ * \retval DONE if the input is used up
+ *
+ */
+static int startNextRecord(struct smcClient *client, const struct batchOptions *batchOptions) {
+    char *line = NULL;
+    size_t sizeOfLine = 0;
+
+    while (!inputDone) {
+        errno = SUCCESS;
+        ssize_t length = getline(&line, &sizeOfLine, input);
+        if (length < 0) {
+            if (errno != SUCCESS) fprintf(stderr, "%s: reading records failed: %s\n", programName, strerror(errno));
+            inputDone = 1;
+            break;
+        }
+        inputLine++;
+
+        if (*skipSpace(line) == '\0') continue;
+
+        struct batchRecord *record = malloc(sizeof(*record));
+        if (record == NULL) {
+            fprintf(stderr, "%s: out of memory for record %ld\n", programName, inputLine);
+            inputDone = 1;
+            break;
+        }
+        record->number = inputLine;
+        record->started = now();
+        record->directory = ERROR;
+
+        struct smcRequest request = { NULL, NULL, NULL, ERROR, NULL };
+        if (parseJsonRecord(line, &request.user, &request.message, &request.image) != SUCCESS) {
+            finishRecord(record, NULL, "malformed record");
+            continue;
+        }
+
+        char directoryName[32];
+        snprintf(directoryName, sizeof(directoryName), "%ld", record->number);
+        if ((mkdirat(outputDirectory, directoryName, 0775) == ERROR && errno != EEXIST)
+            || (record->directory = openat(outputDirectory, directoryName, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == ERROR) {
+            finishRecord(record, NULL, strerror(errno));
+            continue;
+        }
+
+        struct smcPostOptions options = { record->directory, NULL, completeRecord, record, batchOptions->connectTimeout, batchOptions->idleTimeout, NULL, 0, 0, 0 };
+        if (smcSubmit(client, &request, &options) == NULL) {
+            INFO("startNextRecord()", "record %ld: %s", record->number, strerror(errno));
+            finishRecord(record, NULL, "could not connect");
+            continue;
+        }
+        INFO("startNextRecord()", "record %ld posted", record->number);
+        free(line);
+        return SUCCESS;
+    }
+
+    free(line);
+    return DONE;
+}
+
+/**
+ * @brief completeRecord
+ *
+ * completion callback of a post
+ *
+ * \param post the post of the record, freed
+ * \param result its result
+ * \param context the record
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void completeRecord(struct smcPost *post, const struct smcResult *result, void *context) {
+    finishRecord(context, result, NULL);
+    smcFreePost(post);
+}
+
+/**
+ * @brief finishRecord
+ *
+ * report a record and release it
+ *
+ * \param record the record
+ * \param result result of its post, or NULL if it was not posted
+ * \param error why it was not posted, NULL if it was
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void finishRecord(struct batchRecord *record, const struct smcResult *result, const char *error) {
+    uint64_t latency = now() - record->started;
+
+    if (error == NULL && result->error != SUCCESS) {
+        error = result->error == EPROTO ? "malformed response" : strerror(result->error);
+    }
+    if (error != NULL) {
+        printf("%ld error=\"%s\"\n", record->number, error);
+        failed++;
+    }
+    else {
+        printf("%ld status=%d files=%d bytes=%llu latency_us=%.1f\n", record->number, result->status,
+               result->fileCount, result->bytes, (double)latency / 1e3);
+        if (result->status == SUCCESS) succeeded++;
+        else failed++;
+
+        /* only answered records, a malformed record or refused connect takes no time */
+        if (latencyCount == latencyCapacity) {
+            size_t capacity = latencyCapacity == 0 ? 1024 : latencyCapacity * 2;
+            uint64_t *grown = realloc(latencies, capacity * sizeof(uint64_t));
+            if (grown != NULL) {
+                latencies = grown;
+                latencyCapacity = capacity;
+            }
+        }
+        if (latencyCount < latencyCapacity) latencies[latencyCount++] = latency;
+    }
+
+    if (record->directory != ERROR) close(record->directory);
+    free(record);
+}
+
+/**
+ * @brief parseJsonRecord
+ *
+ * parse a JSON object with the string members user, message and img in
+ * place; other members with string or null values are ignored
+ *
+ * \param line the record, changed by decoding the strings
+ * \param user set to the user
+ * \param message set to the message
+ * \param image set to the image URL, or NULL
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR if the line is not such an object or user or message is
+ *         missing
+ *
+ */
+static int parseJsonRecord(char *line, const char **user, const char **message, const char **image) {
+    char *cursor = skipSpace(line);
+
+    *user = NULL;
+    *message = NULL;
+    *image = NULL;
+
+    if (*cursor++ != '{') return ERROR;
+    cursor = skipSpace(cursor);
+    while (*cursor != '}') {
+        char *key = parseJsonString(&cursor);
+        if (key == NULL) return ERROR;
+        cursor = skipSpace(cursor);
+        if (*cursor++ != ':') return ERROR;
+        cursor = skipSpace(cursor);
+
+        char *value = NULL;
+        if (strncmp(cursor, "null", 4) == 0) {
+            cursor += 4;
+        }
+        else if ((value = parseJsonString(&cursor)) == NULL) {
+            return ERROR;
+        }
+
+        if (strcmp(key, "user") == 0) *user = value;
+        else if (strcmp(key, "message") == 0) *message = value;
+        else if (strcmp(key, "img") == 0) *image = value;
+
+        cursor = skipSpace(cursor);
+        if (*cursor == ',') cursor = skipSpace(cursor + 1);
+        else if (*cursor != '}') return ERROR;
+    }
+
+    /* user= and img= are single lines of the request */
+    if (*user == NULL || *message == NULL || strchr(*user, '\n') != NULL) return ERROR;
+    if (*image != NULL && strchr(*image, '\n') != NULL) return ERROR;
+    return SUCCESS;
+}
+
+/**
+ * @brief parseJsonString
+ *
+ * decode a JSON string in place, the result is never longer than its
+ * encoding
+ *
+ * \param cursor at the opening quote, moved behind the closing quote
+ *
+ * \return char *
+ * \retval the decoded, terminated string
+ * \retval NULL if there is no valid string at cursor
+ *
+ */
+static char *parseJsonString(char **cursor) {
+    char *source = *cursor;
+    char *target;
+    char *start;
+
+    if (*source++ != '"') return NULL;
+    start = target = source;
+    while (*source != '"') {
+        if (*source == '\0') return NULL;
+        if (*source != '\\') {
+            *target++ = *source++;
+            continue;
+        }
+
+        source++;
+        switch (*source++) {
+            case '"': *target++ = '"'; break;
+            case '\\': *target++ = '\\'; break;
+            case '/': *target++ = '/'; break;
+            case 'b': *target++ = '\b'; break;
+            case 'f': *target++ = '\f'; break;
+            case 'n': *target++ = '\n'; break;
+            case 'r': *target++ = '\r'; break;
+            case 't': *target++ = '\t'; break;
+            case 'u': {
+                unsigned long codePoint;
+
+                if (parseHexQuad(source, &codePoint) != SUCCESS) return NULL;
+                source += 4;
+
+                /* a surrogate pair encodes one code point above U+FFFF */
+                if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+                    unsigned long low;
+                    if (source[0] != '\\' || source[1] != 'u') return NULL;
+                    if (parseHexQuad(source + 2, &low) != SUCCESS || low < 0xDC00 || low > 0xDFFF) return NULL;
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                    source += 6;
+                }
+
+                if (codePoint == 0) return NULL;
+                if (codePoint < 0x80) {
+                    *target++ = (char)codePoint;
+                }
+                else if (codePoint < 0x800) {
+                    *target++ = (char)(0xC0 | (codePoint >> 6));
+                    *target++ = (char)(0x80 | (codePoint & 0x3F));
+                }
+                else if (codePoint < 0x10000) {
+                    *target++ = (char)(0xE0 | (codePoint >> 12));
+                    *target++ = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+                    *target++ = (char)(0x80 | (codePoint & 0x3F));
+                }
+                else {
+                    *target++ = (char)(0xF0 | (codePoint >> 18));
+                    *target++ = (char)(0x80 | ((codePoint >> 12) & 0x3F));
+                    *target++ = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+                    *target++ = (char)(0x80 | (codePoint & 0x3F));
+                }
+                break;
+            }
+            default:
+                return NULL;
+        }
+    }
+
+    *target = '\0';
+    *cursor = source + 1;
+    return start;
+}
+
+/**
+ * @brief parseHexQuad
+ *
+ * \param digits the four hex digits of a \\u escape, the string may end
+ *        before them
+ * \param value set to their value
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR if the string has no four hex digits there
+ *
+ */
+static int parseHexQuad(const char *digits, unsigned long *value) {
+    *value = 0;
+    /* stops at the terminating '\0', nothing behind it is read */
+    for (int i = 0; i < 4; i++) {
+        if (!isxdigit((unsigned char)digits[i])) return ERROR;
+        *value = (*value << 4) | (unsigned long)(isdigit((unsigned char)digits[i]) ? digits[i] - '0' : tolower((unsigned char)digits[i]) - 'a' + 10);
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief skipSpace
+ *
+ * \param cursor position in a record
+ *
+ * \return char *
+ * \retval first character at or behind cursor that is no JSON white space
+ *
+ */
+static char *skipSpace(char *cursor) {
+    while (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r') cursor++;
+    return cursor;
+}
+
+/**
+ * @brief now
+ *
+ * \return uint64_t
+ * \retval monotonic time in nanoseconds
+ *
+ */
+static uint64_t now(void) {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000ULL + (uint64_t)time.tv_nsec;
+}
+
+/**
+ * @brief compareLatencies
+ *
+ * qsort() comparison of two latencies
+ *
+ */
+static int compareLatencies(const void *a, const void *b) {
+    uint64_t left = *(const uint64_t *)a;
+    uint64_t right = *(const uint64_t *)b;
+
+    return (left > right) - (left < right);
+}
+
+/**
+ * @brief printSummary
+ *
+ * print throughput of all records and latency percentiles of the answered
+ * ones to stderr
+ *
+ * \param elapsed duration of the batch in nanoseconds
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void printSummary(uint64_t elapsed) {
+    size_t count = latencyCount;
+
+    fprintf(stderr, "%s: %ld records ok, %ld failed in %.3f s, %.1f records/s\n", programName, succeeded, failed,
+            (double)elapsed / 1e9, (double)(succeeded + failed) / ((double)elapsed / 1e9));
+    if (count == 0) return;
+
+    qsort(latencies, count, sizeof(uint64_t), compareLatencies);
+    fprintf(stderr, "%s: latency p50 %.1f us, p99 %.1f us, max %.1f us\n", programName,
+            (double)latencies[(count - 1) * 50 / 100] / 1e3, (double)latencies[(count - 1) * 99 / 100] / 1e3,
+            (double)latencies[count - 1] / 1e3);
+}
+
+/**
+ * @brief getBatchOptions
+ *
+ * parse the command line of batch mode
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ * \param batchOptions filled with the parsed options
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int getBatchOptions(int argc, const char * const argv[], struct batchOptions *batchOptions) {
+    static struct option options[] = {
+        {"server", required_argument, 0, 's'},
+        {"port", required_argument, 0, 'p'},
+        {"batch", required_argument, 0, 'b'},
+        {"inflight", required_argument, 0, 'c'},
+        {"output", required_argument, 0, 'o'},
+        {"connect-timeout", required_argument, 0, 't'},
+        {"idle-timeout", required_argument, 0, 'i'},
+        {"verbose", no_argument, 0, 'v'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int option;
+
+    memset(batchOptions, 0, sizeof(*batchOptions));
+    batchOptions->inflight = DEFAULT_INFLIGHT;
+    batchOptions->outputDirectory = ".";
+    batchOptions->connectTimeout = CONNECT_TIMEOUT;
+
+    while ((option = getopt_long(argc, (char ** const)argv, "s:p:b:c:o:t:i:vh", options, NULL)) != ERROR) {
+        switch (option) {
+            case 's': batchOptions->server = optarg; break;
+            case 'p': batchOptions->port = optarg; break;
+            case 'b': batchOptions->input = optarg; break;
+            case 'c': batchOptions->inflight = atoi(optarg); break;
+            case 'o': batchOptions->outputDirectory = optarg; break;
+            case 't': batchOptions->connectTimeout = atoi(optarg); break;
+            case 'i': batchOptions->idleTimeout = atoi(optarg); break;
+            case 'v': verbose = 1; break;
+            default: return ERROR;
+        }
+    }
+
+    if (optind != argc || batchOptions->server == NULL || batchOptions->port == NULL
+        || batchOptions->input == NULL || batchOptions->inflight <= 0
+        || batchOptions->connectTimeout < 0 || batchOptions->idleTimeout < 0) return ERROR;
+    return SUCCESS;
+}
+
+/**
+ * @brief printBatchUsage
+ *
+ * print usage parameter of batch mode to stderr
+ *
+ */
+static void printBatchUsage(void) {
+    fprintf(stderr, "%s: -s server -p port -b <file|-> [-c inflight] [-o directory] [-t ms] [-i ms] [-v] [-h]\n"
+                    "\t-b, --batch <file|->\tone JSON object per line: {\"user\": ..., \"message\": ..., \"img\": ...}\n"
+                    "\t-c, --inflight <n>\tconnections at once (default: %d)\n"
+                    "\t-o, --output <dir>\tfiles of the record on line n go to dir/n (default: .)\n"
+                    "\t-t, --connect-timeout <ms>\tfail a record not connected within ms (default: %d, 0: none)\n"
+                    "\t-i, --idle-timeout <ms>\tfail a record whose connection moves no data for ms (default: none)\n",
+            programName, DEFAULT_INFLIGHT, CONNECT_TIMEOUT);
+}
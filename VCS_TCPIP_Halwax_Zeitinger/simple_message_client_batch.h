@@ -0,0 +1,28 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_client_batch.h
+ * VCS - Tcp/Ip Exercise - batch mode of simple_message_client: posts many
+ * messages over concurrent connections
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_BATCH_H
+#define SIMPLE_MESSAGE_CLIENT_BATCH_H
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int isBatchCommandline(int argc, const char * const argv[]);
+int runBatchCommandline(int argc, const char * const argv[]);
+
+#endif /* SIMPLE_MESSAGE_CLIENT_BATCH_H */
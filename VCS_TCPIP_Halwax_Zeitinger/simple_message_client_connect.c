@@ -0,0 +1,398 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_client_connect.c
+ * VCS - Tcp/Ip Exercise - staggered parallel connect to all addresses of a
+ * server (Happy Eyeballs, RFC 8305)
+ *
+ * The addresses are ordered so that the families alternate, starting with
+ * the family of the first address. A non-blocking connect is started to
+ * the first one; whenever the attempt delay passes without a connection,
+ * or an attempt fails, the next address is tried while the earlier
+ * attempts keep running. The first attempt to complete wins and the others
+ * are closed. An unreachable or blackholed address therefore costs the
+ * attempt delay instead of the kernel connect timeout, and the deadline
+ * bounds the whole connect. libsmc runs the same steps, orderAddresses(),
+ * startConnectAttempt() and abortConnectAttempt(), from its event loop.
+ *
+ * With TCP Fast Open the first attempt connects with sendmsg(MSG_FASTOPEN),
+ * which puts the start of the request into the SYN once the kernel has a
+ * cookie of the server, and asks for a cookie otherwise. Attempts that lose
+ * are reset, so a server never sees a complete request from them.
+ *
+ * A server address unix:<path> or unix:@<name> (abstract namespace) is not
+ * resolved but stands for a UNIX socket of a server on this host, which is
+ * connected right away, without TCP Fast Open.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include "simple_message_client_connect.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define ERROR -1
+#define SUCCESS 0
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+/* the only address of a unix: server, freed as one block */
+struct unixAddress {
+    struct addrinfo info;
+    struct sockaddr_un address;
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static int64_t now(void);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief resolveServer
+ *
+ * getaddrinfo() for a stream socket to server and port, or a single
+ * AF_UNIX address for unix:<path> and unix:@<name>, where port is ignored
+ *
+ * \param server host name, address or unix: address
+ * \param port service name or port number
+ * \param addresses set to the addresses, free them with freeServerAddresses()
+ *
+ * \return int
+ * \retval 0 on Success
+ * \retval an error code of getaddrinfo() for gai_strerror(), EAI_SYSTEM
+ *         with errno set
+ *
+ */
+int resolveServer(const char *server, const char *port, struct addrinfo **addresses) {
+    struct addrinfo hints;
+
+    if (strncmp(server, UNIX_SERVER_PREFIX, strlen(UNIX_SERVER_PREFIX)) == 0) {
+        const char *path = server + strlen(UNIX_SERVER_PREFIX);
+        size_t length = strlen(path);
+        struct unixAddress *unixAddress = calloc(1, sizeof(*unixAddress));
+        if (unixAddress == NULL) return EAI_MEMORY;
+        if (length == 0 || length >= sizeof(unixAddress->address.sun_path)) {
+            free(unixAddress);
+            return EAI_NONAME;
+        }
+
+        unixAddress->address.sun_family = AF_UNIX;
+        memcpy(unixAddress->address.sun_path, path, length);
+        /* @name: abstract, its length counts, there is no terminating zero */
+        if (path[0] == '@') unixAddress->address.sun_path[0] = '\0';
+        else length++;
+        unixAddress->info.ai_family = AF_UNIX;
+        unixAddress->info.ai_socktype = SOCK_STREAM;
+        unixAddress->info.ai_addr = (struct sockaddr *)&unixAddress->address;
+        unixAddress->info.ai_addrlen = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + length);
+        *addresses = &unixAddress->info;
+        return 0;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;    /* Allow IPv4 or IPv6 */
+    hints.ai_socktype = SOCK_STREAM;
+    return getaddrinfo(server, port, &hints, addresses);
+}
+
+/**
+ * @brief freeServerAddresses
+ *
+ * \param addresses result of resolveServer()
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void freeServerAddresses(struct addrinfo *addresses) {
+    /* getaddrinfo() never returns AF_UNIX */
+    if (addresses != NULL && addresses->ai_family == AF_UNIX) free(addresses);
+    else if (addresses != NULL) freeaddrinfo(addresses);
+}
+
+/**
+ * @brief happyEyeballsConnect
+ *
+ * \param addresses result of getaddrinfo()
+ * \param attemptDelay milliseconds before the next address is tried
+ * \param timeout milliseconds for all attempts, 0 for no deadline
+ * \param fastOpen request to send with the SYN of the first attempt, NULL
+ *        to connect without TCP Fast Open; its sent member tells how much
+ *        of it is on the way on the returned socket
+ * \param socketDescriptor set to the connected, blocking socket
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR if no address could be connected, errno is ETIMEDOUT if
+ *         the deadline passed, otherwise the error of the last attempt
+ *
+ */
+int happyEyeballsConnect(const struct addrinfo *addresses, int attemptDelay, int timeout, struct fastOpenData *fastOpen, int *socketDescriptor) {
+    size_t count;
+    const struct addrinfo **ordered = orderAddresses(addresses, &count);
+    if (ordered == NULL) return ERROR;
+
+    struct pollfd *attempts = calloc(count > 0 ? count : 1, sizeof(*attempts));
+    if (attempts == NULL) {
+        free(ordered);
+        return ERROR;
+    }
+
+    int64_t deadline = timeout > 0 ? now() + timeout : INT64_MAX;
+    int64_t nextAttempt = now();
+    size_t next = 0;
+    nfds_t active = 0;
+    int winner = ERROR;
+    int fastOpenTried = 0;
+    int fastOpenFd = ERROR;
+    int lastError = ECONNREFUSED;
+
+    if (fastOpen != NULL) fastOpen->sent = 0;
+
+    while (winner == ERROR) {
+        int64_t current = now();
+        if (current >= deadline) {
+            lastError = ETIMEDOUT;
+            break;
+        }
+
+        /* start the next address when its turn came or nothing is running */
+        if (next < count && (active == 0 || current >= nextAttempt)) {
+            int connected = 0;
+            int fd = startConnectAttempt(ordered[next++], fastOpenTried ? NULL : fastOpen, &connected);
+            if (fd == ERROR) {
+                lastError = errno;
+                continue;
+            }
+            if (fastOpen != NULL && !fastOpenTried) {
+                fastOpenTried = 1;
+                fastOpenFd = fd;
+            }
+            if (connected) {
+                winner = fd;
+                break;
+            }
+            attempts[active].fd = fd;
+            attempts[active].events = POLLOUT;
+            active++;
+            nextAttempt = current + attemptDelay;
+        }
+        if (active == 0) break;
+
+        int64_t wait = deadline - current;
+        if (next < count && nextAttempt - current < wait) wait = nextAttempt - current;
+        int ready = poll(attempts, active, wait > INT32_MAX ? -1 : (int)wait);
+        if (ready == ERROR) {
+            if (errno == EINTR) continue;
+            lastError = errno;
+            break;
+        }
+
+        for (nfds_t i = 0; i < active && ready > 0; i++) {
+            if (attempts[i].revents == 0) continue;
+            ready--;
+
+            int socketError = 0;
+            socklen_t size = sizeof(socketError);
+            if (getsockopt(attempts[i].fd, SOL_SOCKET, SO_ERROR, &socketError, &size) == ERROR) socketError = errno;
+            if (socketError == 0) {
+                winner = attempts[i].fd;
+                attempts[i] = attempts[--active];
+                break;
+            }
+
+            /* a failed attempt hands its turn to the next address at once */
+            lastError = socketError;
+            if (attempts[i].fd == fastOpenFd) fastOpenFd = ERROR;
+            close(attempts[i].fd);
+            attempts[i] = attempts[--active];
+            nextAttempt = current;
+            i--;
+        }
+    }
+
+    for (nfds_t i = 0; i < active; i++) abortConnectAttempt(attempts[i].fd);
+    free(attempts);
+    free(ordered);
+
+    /* the early data went out on an attempt that lost */
+    if (fastOpen != NULL && winner != fastOpenFd) fastOpen->sent = 0;
+
+    if (winner == ERROR) {
+        errno = lastError;
+        return ERROR;
+    }
+
+    int flags = fcntl(winner, F_GETFL);
+    if (flags == ERROR || fcntl(winner, F_SETFL, flags & ~O_NONBLOCK) == ERROR) {
+        close(winner);
+        return ERROR;
+    }
+    *socketDescriptor = winner;
+    return SUCCESS;
+}
+
+/**
+ * @brief orderAddresses
+ *
+ * order the addresses so that the first family and the others alternate,
+ * keeping the order of getaddrinfo() within each
+ *
+ * \param addresses result of getaddrinfo()
+ * \param count set to the number of addresses
+ *
+ * \return const struct addrinfo **
+ * \retval array of the addresses, to be freed by the caller
+ * \retval NULL on Error
+ *
+ */
+const struct addrinfo **orderAddresses(const struct addrinfo *addresses, size_t *count) {
+    size_t total = 0;
+
+    for (const struct addrinfo *address = addresses; address != NULL; address = address->ai_next) total++;
+    const struct addrinfo **ordered = malloc((total > 0 ? total : 1) * sizeof(*ordered));
+    if (ordered == NULL) return NULL;
+
+    const struct addrinfo *preferred = addresses;
+    const struct addrinfo *other = addresses;
+    int family = addresses != NULL ? addresses->ai_family : AF_UNSPEC;
+    size_t index = 0;
+
+    while (index < total) {
+        while (preferred != NULL && preferred->ai_family != family) preferred = preferred->ai_next;
+        if (preferred != NULL) {
+            ordered[index++] = preferred;
+            preferred = preferred->ai_next;
+        }
+        while (other != NULL && other->ai_family == family) other = other->ai_next;
+        if (other != NULL) {
+            ordered[index++] = other;
+            other = other->ai_next;
+        }
+    }
+
+    *count = total;
+    return ordered;
+}
+
+/**
+ * @brief startConnectAttempt
+ *
+ * \param address address to connect to
+ * \param fastOpen request to send with the SYN, or NULL
+ * \param connected set to 1 if the connect completed right away
+ *
+ * \return int
+ * \retval the non-blocking socket
+ * \retval ERROR if the attempt failed right away
+ *
+ */
+int startConnectAttempt(const struct addrinfo *address, struct fastOpenData *fastOpen, int *connected) {
+    /* a UNIX socket connects at once, unless the accept queue is full,
+     and then a non-blocking one would fail with EAGAIN instead of waiting */
+    int blocking = address->ai_family == AF_UNIX;
+    int fd = socket(address->ai_family, address->ai_socktype | (blocking ? 0 : SOCK_NONBLOCK) | SOCK_CLOEXEC, address->ai_protocol);
+    if (fd == ERROR) return ERROR;
+
+    if (fastOpen != NULL && !blocking) {
+        struct msghdr header;
+        memset(&header, 0, sizeof(header));
+        header.msg_name = address->ai_addr;
+        header.msg_namelen = address->ai_addrlen;
+        header.msg_iov = (struct iovec *)fastOpen->vector;
+        header.msg_iovlen = (size_t)fastOpen->count;
+
+        /* without a cookie nothing is sent but the SYN, EINPROGRESS then */
+        ssize_t sent = sendmsg(fd, &header, MSG_FASTOPEN | MSG_NOSIGNAL);
+        if (sent >= 0) {
+            fastOpen->sent = (size_t)sent;
+            return fd;
+        }
+        if (errno == EINPROGRESS) return fd;
+        if (errno != EOPNOTSUPP) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            return ERROR;
+        }
+        /* TCP Fast Open is disabled for clients, connect as usual */
+    }
+
+    if (connect(fd, address->ai_addr, address->ai_addrlen) == SUCCESS) {
+        *connected = 1;
+        return fd;
+    }
+    if (errno == EINPROGRESS) return fd;
+
+    int error = errno;
+    close(fd);
+    errno = error;
+    return ERROR;
+}
+
+/**
+ * @brief abortConnectAttempt
+ *
+ * close an attempt with a reset instead of a FIN, so data it may have sent
+ * is never taken for a complete request
+ *
+ * \param fd socket of the attempt
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void abortConnectAttempt(int fd) {
+    struct linger linger = { .l_onoff = 1, .l_linger = 0 };
+
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+    close(fd);
+}
+
+/**
+ * @brief now
+ *
+ * \return int64_t
+ * \retval monotonic time in milliseconds
+ *
+ */
+static int64_t now(void) {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (int64_t)time.tv_sec * 1000 + time.tv_nsec / 1000000;
+}
@@ -0,0 +1,67 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_client_connect.h
+ * VCS - Tcp/Ip Exercise - staggered parallel connect to all addresses of a
+ * server (Happy Eyeballs, RFC 8305)
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_CONNECT_H
+#define SIMPLE_MESSAGE_CLIENT_CONNECT_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <sys/uio.h>
+#include <netdb.h>
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* milliseconds before the next address is tried, RFC 8305 recommends 250 */
+#define CONNECT_ATTEMPT_DELAY 250
+
+/* milliseconds for all attempts together */
+#define CONNECT_TIMEOUT 30000
+
+/* prefix of a server address on this host, unix:<path> or unix:@<name> */
+#define UNIX_SERVER_PREFIX "unix:"
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+/* start of the request, sent with the SYN of the first attempt by TCP Fast
+ Open if the kernel holds a cookie of the server */
+struct fastOpenData {
+    const struct iovec *vector;
+    int count;
+    size_t sent;                /* bytes the kernel took with the connect of
+                                   the winner, it resends them itself if the
+                                   server drops the data of the SYN */
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int resolveServer(const char *server, const char *port, struct addrinfo **addresses);
+void freeServerAddresses(struct addrinfo *addresses);
+int happyEyeballsConnect(const struct addrinfo *addresses, int attemptDelay, int timeout, struct fastOpenData *fastOpen, int *socketDescriptor);
+const struct addrinfo **orderAddresses(const struct addrinfo *addresses, size_t *count);
+int startConnectAttempt(const struct addrinfo *address, struct fastOpenData *fastOpen, int *connected);
+void abortConnectAttempt(int fd);
+
+#endif /* SIMPLE_MESSAGE_CLIENT_CONNECT_H */
@@ -0,0 +1,1543 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_client_library.c
+ * VCS - Tcp/Ip Exercise - libsmc, non-blocking posts to a
+ * simple_message_server
+ *
+ * A client resolves the server once and owns an epoll instance with the
+ * sockets of all its posts, so an event loop has only the one descriptor
+ * of smcClientDescriptor() to watch; smcProcess() advances the posts that
+ * are ready. Each post connects without blocking to all addresses of the
+ * server, staggered by the attempt delay (Happy Eyeballs), or takes a warm
+ * connection from smc_agent; it sends its request, streaming a large
+ * message with sendfile() or splice(), and runs the response through the
+ * incremental response parser. File data goes straight from the socket
+ * into the memory of the file, into the buffers of a sink, or into a file
+ * below the directory of the post: spliced through a pipe of the client,
+ * or copied through a chunk buffer where splice() is not supported or the
+ * bytes are checked with CRC32C.
+ *
+ * Connect and idle timeouts of the posts, and the turns of the next
+ * addresses while connecting, are timers on a wheel of the client;
+ * smcProcess() waits no longer than until the next one, and a caller
+ * polling the descriptor itself asks smcTimeout().
+ *
+ * Nothing is printed and nothing exits, failures end up in the result of
+ * the post.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include "simple_message_client_library.h"
+#include "simple_message_client_parser.h"
+#include "simple_message_client_connect.h"
+#include "simple_message_client_agent.h"
+#include "simple_message_client_resume.h"
+#include "simple_message_crc32c.h"
+#include "simple_message_trace.h"
+#include "simple_message_timer.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define ERROR -1
+#define SUCCESS 0
+#define DONE 2
+
+#define MAX_EVENTS 64
+
+/* bytes read from the socket per read() of a file written to a directory */
+#define DATA_CHUNK_SIZE (256 * 1024)
+
+/* bytes moved per sendfile() or splice(), also the size of the pipe */
+#define TRANSFER_CHUNK_SIZE (1024 * 1024)
+
+/* bytes of a streamed message read per read() where it can not be spliced */
+#define STREAM_BUFFER_SIZE (64 * 1024)
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+enum postState {
+    POST_CONNECTING,
+    POST_SENDING,
+    POST_RECEIVING,
+    POST_DONE
+};
+
+/* what the next part of the response is */
+enum responsePart {
+    PART_STATUS,
+    PART_FILE,
+    PART_LENGTH,                /* or offset= before it */
+    PART_DATA,
+    PART_CHECKSUM
+};
+
+/* how a streamed message gets to the socket */
+enum streamMode {
+    STREAM_UNKNOWN,
+    STREAM_SENDFILE,
+    STREAM_SPLICE,
+    STREAM_COPY
+};
+
+struct smcClient {
+    char *server;
+    char *port;
+    int agent;                  /* ask smc_agent for a connection first */
+    struct addrinfo *addresses; /* NULL until resolved */
+    const struct addrinfo **ordered;    /* the addresses, families alternating */
+    size_t addressCount;
+    int epoll;
+    struct smcPost *posts;      /* pending posts */
+    int pending;
+    uint64_t submitted;
+    char *chunk;                /* DATA_CHUNK_SIZE, allocated on first use */
+    int splicePipe[2];          /* empty between calls, created on first use */
+    int noSplice;               /* splice() failed with EINVAL, copy instead */
+    struct timerWheel timers;   /* connect and idle timeouts of the posts */
+    int completed;              /* posts completed in the current smcProcess() */
+};
+
+struct smcPost {
+    struct smcClient *client;   /* NULL once the post is done */
+    struct smcPost *previous;
+    struct smcPost *next;
+    int fd;
+    enum postState state;
+    uint64_t number;            /* id of its trace events */
+    char *request;              /* ends with the newline behind the message */
+    size_t requestLength;
+    size_t requestSent;
+    int messageSource;          /* streamed before the last newline, -1: none or sent */
+    enum streamMode streamMode;
+    int streamStarted;
+    char *streamBuffer;         /* STREAM_BUFFER_SIZE for STREAM_COPY */
+    size_t streamBuffered;
+    size_t streamSent;
+    int *attempts;              /* sockets of the running connect attempts */
+    int attemptCount;
+    size_t nextAddress;         /* index into client->ordered */
+    uint64_t nextAttempt;       /* timers.now when the next address is due */
+    uint64_t connectStarted;
+    int fastOpenTried;
+    int fastOpenFd;             /* attempt that sent fastOpenSent bytes with its SYN */
+    size_t fastOpenSent;
+    int lastError;
+    struct smcPostOptions options;
+    struct wheelTimer timer;
+    uint64_t lastProgress;      /* timers.now of the last event */
+    enum responsePart part;
+    int resuming;               /* have= was sent, offset= may come */
+    int outputFile;
+    void *sinkFile;
+    char *sinkBuffer;
+    size_t sinkFilled;
+    unsigned long remaining;    /* data of the current file still expected */
+    uint32_t checksum;          /* CRC32C of the current file so far */
+    int fileCapacity;
+    struct smcResult result;
+    struct responseParser parser;
+};
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+static pthread_once_t crc32cOnce = PTHREAD_ONCE_INIT;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static int createClient(const char *server, const char *port, int agent, struct smcClient **client);
+static int resolveClient(struct smcClient *client);
+static int startConnect(struct smcPost *post);
+static int startAttempts(struct smcPost *post);
+static int checkAttempts(struct smcPost *post);
+static int useConnection(struct smcPost *post, int fd);
+static void abortAttempts(struct smcPost *post);
+static int handlePost(struct smcPost *post);
+static int sendRequest(struct smcPost *post);
+static int sendBytes(struct smcPost *post, size_t end, int flags);
+static int streamMessage(struct smcPost *post);
+static ssize_t moveMessage(struct smcPost *post);
+static int receiveResponse(struct smcPost *post);
+static int handleRecord(struct smcPost *post, const struct responseRecord *record);
+static int addFile(struct smcPost *post, const char *fileName);
+static int startFileData(struct smcPost *post, unsigned long length);
+static int receiveData(struct smcPost *post);
+static int storeData(struct smcPost *post, struct smcFile *file, const char *data, size_t length);
+static ssize_t readData(struct smcPost *post, struct smcFile *file);
+static ssize_t spliceData(struct smcPost *post);
+static int submitSinkBuffer(struct smcPost *post);
+static int finishFile(struct smcPost *post);
+static void closeFileData(struct smcPost *post);
+static void completePost(struct smcPost *post, int error);
+static void armPostTimer(struct smcPost *post);
+static void expirePost(void *context);
+static void unlinkPost(struct smcPost *post);
+static void closeSplicePipe(struct smcClient *client);
+static int writeAll(int fileDescriptor, const char *data, size_t length);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief smcCreateClient
+ *
+ * resolve the server, this is the only call that blocks
+ *
+ * \param server host name or address, or unix:<path> / unix:@<name> for
+ *        a UNIX socket on this host
+ * \param port service name or port number, ignored for unix:
+ * \param client set to the new client
+ *
+ * \return int
+ * \retval 0 on Success
+ * \retval an error code of getaddrinfo() for gai_strerror(), EAI_SYSTEM
+ *         with errno set
+ *
+ */
+int smcCreateClient(const char *server, const char *port, struct smcClient **client) {
+    return createClient(server, port, 0, client);
+}
+
+/**
+ * @brief smcCreateAgentClient
+ *
+ * like smcCreateClient(), but each post first takes a warm connection from
+ * smc_agent; the server is resolved by the first post the agent has no
+ * connection for, which blocks in smcSubmit() then. Without an agent set up
+ * this is smcCreateClient().
+ *
+ * \param server host name or address, or unix: address, as the agent knows
+ *        it
+ * \param port service name or port number
+ * \param client set to the new client
+ *
+ * \return int
+ * \retval 0 on Success
+ * \retval an error code of getaddrinfo() for gai_strerror(), EAI_SYSTEM
+ *         with errno set
+ *
+ */
+int smcCreateAgentClient(const char *server, const char *port, struct smcClient **client) {
+    char path[sizeof(((struct sockaddr_un *)NULL)->sun_path)];
+
+    return createClient(server, port, agentSocketPath(path, sizeof(path)) == SUCCESS, client);
+}
+
+/**
+ * @brief smcClientDescriptor
+ *
+ * \param client client
+ *
+ * \return int
+ * \retval descriptor that polls readable when smcProcess() has work
+ *
+ */
+int smcClientDescriptor(const struct smcClient *client) {
+    return client->epoll;
+}
+
+/**
+ * @brief smcPending
+ *
+ * \param client client
+ *
+ * \return int
+ * \retval number of posts that are not done
+ *
+ */
+int smcPending(const struct smcClient *client) {
+    return client->pending;
+}
+
+/**
+ * @brief smcSubmit
+ *
+ * start a post, it connects while the caller goes on
+ *
+ * \param client client of the server
+ * \param request user, message and optional image URL and have= lines
+ * \param options where the files go and whom to tell, NULL: keep the
+ *        files in memory and poll smcPostResult()
+ *
+ * \return struct smcPost *
+ * \retval the post, to be freed with smcFreePost()
+ * \retval NULL on Error, errno is EINVAL for a request that does not fit
+ *         the protocol or the options, EHOSTUNREACH if the server of an
+ *         agent client can not be resolved, or the error of the last
+ *         connect()
+ *
+ */
+struct smcPost *smcSubmit(struct smcClient *client, const struct smcRequest *request, const struct smcPostOptions *options) {
+    /* user= and img= are single lines of the request; a resumed file is
+     continued where it is kept, not in memory */
+    if (request->user == NULL || (request->message == NULL && request->messageSource < 0) || strchr(request->user, '\n') != NULL
+        || (request->image != NULL && strchr(request->image, '\n') != NULL)
+        || (request->have != NULL && (options == NULL || (options->directory == ERROR && options->sink == NULL)))) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct smcPost *post = calloc(1, sizeof(*post));
+    if (post == NULL) return NULL;
+    int checksum = options != NULL && options->checksum;
+    int requestLength = asprintf(&post->request, "user=%s\n%s%s%s%s%s%s\n", request->user,
+                                 request->image != NULL ? "img=" : "", request->image != NULL ? request->image : "", request->image != NULL ? "\n" : "",
+                                 request->have != NULL ? request->have : "", checksum ? "checksum=crc32c\n" : "",
+                                 request->message != NULL ? request->message : "");
+    if (requestLength < 0) {
+        free(post);
+        return NULL;
+    }
+    if (checksum) pthread_once(&crc32cOnce, initCrc32c);
+
+    post->requestLength = (size_t)requestLength;
+    post->messageSource = request->message == NULL ? request->messageSource : ERROR;
+    post->fd = ERROR;
+    post->fastOpenFd = ERROR;
+    post->lastError = ECONNREFUSED;
+    post->outputFile = ERROR;
+    post->options.directory = ERROR;
+    if (options != NULL) post->options = *options;
+    post->resuming = request->have != NULL;
+    post->part = PART_STATUS;
+    post->result.status = ERROR;
+    post->number = client->submitted++;
+    initResponseParser(&post->parser);
+    initTimer(&post->timer, expirePost, post);
+
+    post->client = client;
+    post->next = client->posts;
+    if (client->posts != NULL) client->posts->previous = post;
+    client->posts = post;
+    client->pending++;
+
+    TRACE(TRACE_REQUEST, TRACE_BEGIN, post->number, 0);
+    TRACE(TRACE_CONNECT, TRACE_BEGIN, post->number, 0);
+    /* the caller may not have called smcProcess() for a while */
+    updateTimerClock(&client->timers);
+    if (startConnect(post) != SUCCESS) {
+        int error = errno;
+        smcFreePost(post);
+        errno = error;
+        return NULL;
+    }
+    return post;
+}
+
+/**
+ * @brief smcProcess
+ *
+ * advance the posts whose sockets are ready and fail those that have
+ * timed out, completion callbacks run in here
+ *
+ * \param client client
+ * \param timeout milliseconds to wait for a socket, 0: none, -1: forever;
+ *        the wait ends earlier if a post times out
+ *
+ * \return int
+ * \retval number of posts done
+ * \retval -1 on Error
+ *
+ */
+int smcProcess(struct smcClient *client, int timeout) {
+    struct epoll_event events[MAX_EVENTS];
+
+    updateTimerClock(&client->timers);
+    int next = smcTimeout(client);
+    if (next != ERROR && (timeout == ERROR || next < timeout)) timeout = next;
+
+    int ready = epoll_wait(client->epoll, events, MAX_EVENTS, timeout);
+    if (ready == ERROR && errno != EINTR) return ERROR;
+    updateTimerClock(&client->timers);
+
+    client->completed = 0;
+    for (int i = 0; i < ready; i++) {
+        /* the post may be freed by its callback, it is not touched after
+         DONE; a post with several connect attempts may show up more than
+         once, it is handled once */
+        struct smcPost *post = events[i].data.ptr;
+        int repeated = 0;
+        for (int j = 0; j < i && !repeated; j++) repeated = events[j].data.ptr == post;
+        if (!repeated) handlePost(post);
+    }
+    /* an expiry completes its post, or re-arms the timer if data moved */
+    advanceTimers(&client->timers);
+    return client->completed;
+}
+
+/**
+ * @brief smcTimeout
+ *
+ * for callers that poll smcClientDescriptor() themselves
+ *
+ * \param client client
+ *
+ * \return int
+ * \retval milliseconds until smcProcess() has timeouts to handle, even if
+ *         the descriptor is not readable
+ * \retval -1 if no post has a timeout
+ *
+ */
+int smcTimeout(const struct smcClient *client) {
+    return timeToNextTimer(&client->timers);
+}
+
+/**
+ * @brief smcPostResult
+ *
+ * \param post post
+ *
+ * \return const struct smcResult *
+ * \retval the result, valid until the post is freed
+ * \retval NULL while the post is not done
+ *
+ */
+const struct smcResult *smcPostResult(const struct smcPost *post) {
+    return post->state == POST_DONE ? &post->result : NULL;
+}
+
+/**
+ * @brief smcFreePost
+ *
+ * release a post with its files, a pending post is cancelled
+ *
+ * \param post post
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void smcFreePost(struct smcPost *post) {
+    if (post->client != NULL) unlinkPost(post);
+    abortAttempts(post);
+    if (post->fd != ERROR) close(post->fd);
+    closeFileData(post);
+
+    for (int i = 0; i < post->result.fileCount; i++) {
+        free(post->result.files[i].name);
+        if (post->options.buffer == NULL) free(post->result.files[i].data);
+    }
+    free(post->result.files);
+    free(post->attempts);
+    free(post->streamBuffer);
+    free(post->request);
+    free(post);
+}
+
+/**
+ * @brief smcDestroyClient
+ *
+ * cancel and free the pending posts and release the client; posts that
+ * are done stay valid until they are freed
+ *
+ * \param client client
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void smcDestroyClient(struct smcClient *client) {
+    while (client->posts != NULL) smcFreePost(client->posts);
+    close(client->epoll);
+    closeSplicePipe(client);
+    if (client->addresses != NULL) freeServerAddresses(client->addresses);
+    free(client->ordered);
+    free(client->server);
+    free(client->port);
+    free(client->chunk);
+    free(client);
+}
+
+/**
+ * @brief createClient
+ *
+ * \param server host name or address, or unix: address
+ * \param port service name or port number
+ * \param agent 1 to take connections from smc_agent and resolve later
+ * \param client set to the new client
+ *
+ * \return int
+ * \retval 0 on Success
+ * \retval an error code of getaddrinfo(), EAI_SYSTEM with errno set
+ *
+ */
+static int createClient(const char *server, const char *port, int agent, struct smcClient **client) {
+    struct smcClient *created = calloc(1, sizeof(*created));
+    if (created == NULL) return EAI_SYSTEM;
+
+    created->agent = agent;
+    created->splicePipe[0] = ERROR;
+    created->splicePipe[1] = ERROR;
+    created->epoll = ERROR;
+    created->server = strdup(server);
+    created->port = strdup(port);
+    int result = created->server == NULL || created->port == NULL ? EAI_MEMORY : SUCCESS;
+    if (result == SUCCESS && !agent) result = resolveClient(created);
+    if (result == SUCCESS) {
+        created->epoll = epoll_create1(EPOLL_CLOEXEC);
+        if (created->epoll == ERROR) result = EAI_SYSTEM;
+    }
+    if (result != SUCCESS) {
+        int error = errno;
+        smcDestroyClient(created);
+        errno = error;
+        return result;
+    }
+
+    initTimerWheel(&created->timers);
+    *client = created;
+    return SUCCESS;
+}
+
+/**
+ * @brief resolveClient
+ *
+ * \param client client without addresses
+ *
+ * \return int
+ * \retval 0 on Success
+ * \retval an error code of getaddrinfo(), EAI_SYSTEM with errno set
+ *
+ */
+static int resolveClient(struct smcClient *client) {
+    int result = resolveServer(client->server, client->port, &client->addresses);
+    if (result != SUCCESS) {
+        client->addresses = NULL;
+        return result;
+    }
+
+    client->ordered = orderAddresses(client->addresses, &client->addressCount);
+    if (client->ordered == NULL) {
+        freeServerAddresses(client->addresses);
+        client->addresses = NULL;
+        return EAI_MEMORY;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief startConnect
+ *
+ * take a connection from smc_agent, or start connecting to the addresses
+ * of the server
+ *
+ * \param post new post
+ *
+ * \return int
+ * \retval SUCCESS if the post is connected or connecting
+ * \retval ERROR if no address is left
+ *
+ */
+static int startConnect(struct smcPost *post) {
+    struct smcClient *client = post->client;
+    int fd;
+
+    post->state = POST_CONNECTING;
+    post->connectStarted = client->timers.now;
+    post->nextAttempt = client->timers.now;
+    if (client->agent && takeAgentConnection(client->server, client->port, &fd) == SUCCESS) {
+        return useConnection(post, fd);
+    }
+
+    if (client->addresses == NULL) {
+        int result = resolveClient(client);
+        if (result != SUCCESS) {
+            if (result != EAI_SYSTEM) errno = result == EAI_MEMORY ? ENOMEM : EHOSTUNREACH;
+            return ERROR;
+        }
+    }
+
+    post->attempts = malloc((client->addressCount > 0 ? client->addressCount : 1) * sizeof(*post->attempts));
+    if (post->attempts == NULL) return ERROR;
+    return startAttempts(post);
+}
+
+/**
+ * @brief startAttempts
+ *
+ * start the next addresses whose turn has come, or the next one at all if
+ * no attempt is running, and arm the timer for the turn after them
+ *
+ * \param post connecting post
+ *
+ * \return int
+ * \retval SUCCESS if the post is connected or connecting
+ * \retval ERROR if no attempt is running and no address is left, errno is
+ *         the error of the last attempt
+ *
+ */
+static int startAttempts(struct smcPost *post) {
+    struct smcClient *client = post->client;
+    int delay = post->options.attemptDelay == 0 ? CONNECT_ATTEMPT_DELAY : post->options.attemptDelay < 0 ? 0 : post->options.attemptDelay;
+
+    while (post->nextAddress < client->addressCount && (post->attemptCount == 0 || client->timers.now >= post->nextAttempt)) {
+        const struct addrinfo *address = client->ordered[post->nextAddress++];
+        /* TCP Fast Open puts the request into the SYN of the first attempt,
+         a streamed message is not part of it */
+        struct iovec request = { post->request, post->messageSource != ERROR ? post->requestLength - 1 : post->requestLength };
+        struct fastOpenData fastOpen = { &request, 1, 0 };
+        int useFastOpen = post->options.fastOpen && !post->fastOpenTried;
+        int connected = 0;
+
+        int fd = startConnectAttempt(address, useFastOpen ? &fastOpen : NULL, &connected);
+        if (fd == ERROR) {
+            post->lastError = errno;
+            continue;
+        }
+        if (useFastOpen) {
+            post->fastOpenTried = 1;
+            post->fastOpenFd = fd;
+            post->fastOpenSent = fastOpen.sent;
+        }
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLOUT;
+        event.data.ptr = post;
+        if (epoll_ctl(client->epoll, EPOLL_CTL_ADD, fd, &event) == ERROR) {
+            post->lastError = errno;
+            close(fd);
+            continue;
+        }
+        post->attempts[post->attemptCount++] = fd;
+        if (connected) {
+            post->attemptCount--;
+            return useConnection(post, fd);
+        }
+        post->nextAttempt = client->timers.now + (uint64_t)delay;
+    }
+
+    if (post->attemptCount == 0) {
+        errno = post->lastError;
+        return ERROR;
+    }
+    armPostTimer(post);
+    return SUCCESS;
+}
+
+/**
+ * @brief checkAttempts
+ *
+ * find the attempt that connected, or close those that failed and hand
+ * their turns to the next addresses
+ *
+ * \param post connecting post
+ *
+ * \return int
+ * \retval SUCCESS if the post is connected or still connecting
+ * \retval ERROR if all attempts failed, errno is the error of the last one
+ *
+ */
+static int checkAttempts(struct smcPost *post) {
+    for (int i = 0; i < post->attemptCount; i++) {
+        struct pollfd attempt = { post->attempts[i], POLLOUT, 0 };
+        if (poll(&attempt, 1, 0) != 1) continue;
+
+        int socketError = 0;
+        socklen_t size = sizeof(socketError);
+        if (getsockopt(attempt.fd, SOL_SOCKET, SO_ERROR, &socketError, &size) == ERROR) socketError = errno;
+        post->attempts[i] = post->attempts[--post->attemptCount];
+        if (socketError == 0) return useConnection(post, attempt.fd);
+
+        /* a failed attempt hands its turn to the next address at once */
+        post->lastError = socketError;
+        if (attempt.fd == post->fastOpenFd) post->fastOpenFd = ERROR;
+        close(attempt.fd);
+        post->nextAttempt = post->client->timers.now;
+        i--;
+    }
+    return startAttempts(post);
+}
+
+/**
+ * @brief useConnection
+ *
+ * send the request on a connected socket, the other attempts are reset
+ *
+ * \param post connecting post
+ * \param fd connected socket, in the epoll instance unless it came from
+ *        smc_agent
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int useConnection(struct smcPost *post, int fd) {
+    /* the early data went out on this attempt or on one that lost */
+    if (fd == post->fastOpenFd) post->requestSent = post->fastOpenSent;
+    abortAttempts(post);
+    post->fd = fd;
+
+    /* UNIX sockets and those of smc_agent connect blocking */
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == ERROR || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == ERROR) return ERROR;
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLOUT;
+    event.data.ptr = post;
+    if (epoll_ctl(post->client->epoll, EPOLL_CTL_ADD, fd, &event) == ERROR && errno != EEXIST) return ERROR;
+
+    post->state = POST_SENDING;
+    armPostTimer(post);
+    TRACE(TRACE_CONNECT, TRACE_END, post->number, post->requestSent);
+    TRACE(TRACE_SEND, TRACE_BEGIN, post->number, 0);
+    return SUCCESS;
+}
+
+/**
+ * @brief abortAttempts
+ *
+ * \param post post whose running connect attempts are reset
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void abortAttempts(struct smcPost *post) {
+    while (post->attemptCount > 0) abortConnectAttempt(post->attempts[--post->attemptCount]);
+}
+
+/**
+ * @brief handlePost
+ *
+ * advance a post as far as its socket allows
+ *
+ * \param post pending post
+ *
+ * \return int
+ * \retval DONE if the post is done, it may have been freed
+ * \retval SUCCESS if it waits for its socket
+ *
+ */
+static int handlePost(struct smcPost *post) {
+    post->lastProgress = post->client->timers.now;
+    if (post->state == POST_CONNECTING) {
+        if (checkAttempts(post) != SUCCESS) {
+            completePost(post, errno);
+            return DONE;
+        }
+        if (post->state == POST_CONNECTING) return SUCCESS;
+    }
+
+    if (post->state == POST_SENDING) {
+        int result = sendRequest(post);
+        if (result == ERROR) {
+            completePost(post, errno);
+            return DONE;
+        }
+        if (result != DONE) return SUCCESS;
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = post;
+        if (shutdown(post->fd, SHUT_WR) == ERROR || epoll_ctl(post->client->epoll, EPOLL_CTL_MOD, post->fd, &event) == ERROR) {
+            completePost(post, errno);
+            return DONE;
+        }
+        post->state = POST_RECEIVING;
+        TRACE(TRACE_SEND, TRACE_END, post->number, post->requestLength);
+        /* the response is read once EPOLLIN reports it */
+        return SUCCESS;
+    }
+
+    int result = receiveResponse(post);
+    if (result == SUCCESS) return SUCCESS;
+    completePost(post, result == DONE ? SUCCESS : errno);
+    return DONE;
+}
+
+/**
+ * @brief sendRequest
+ *
+ * send the request; a streamed message goes between its last newline and
+ * the rest, which is held back with MSG_MORE to go out with the first
+ * bytes of the message
+ *
+ * \param post post sending its request
+ *
+ * \return int
+ * \retval DONE if the request is sent
+ * \retval SUCCESS if the socket is full
+ * \retval ERROR on Error
+ *
+ */
+static int sendRequest(struct smcPost *post) {
+    if (post->messageSource != ERROR) {
+        int result = sendBytes(post, post->requestLength - 1, MSG_MORE);
+        if (result == DONE) result = streamMessage(post);
+        if (result != DONE) return result;
+        /* the source belongs to the caller */
+        post->messageSource = ERROR;
+    }
+    return sendBytes(post, post->requestLength, 0);
+}
+
+/**
+ * @brief sendBytes
+ *
+ * \param post post sending its request
+ * \param end send the request up to here
+ * \param flags flags for send(), e.g. MSG_MORE
+ *
+ * \return int
+ * \retval DONE if the request is sent up to end
+ * \retval SUCCESS if the socket is full
+ * \retval ERROR on Error
+ *
+ */
+static int sendBytes(struct smcPost *post, size_t end, int flags) {
+    while (post->requestSent < end) {
+        ssize_t sent = send(post->fd, post->request + post->requestSent, end - post->requestSent, flags | MSG_NOSIGNAL);
+        if (sent == ERROR) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return SUCCESS;
+            return ERROR;
+        }
+        post->requestSent += (size_t)sent;
+    }
+    return DONE;
+}
+
+/**
+ * @brief streamMessage
+ *
+ * send the message from a file with sendfile(), from a pipe with splice()
+ * and from anything else through a buffer of the post; a pipe without data
+ * blocks, a full socket does not
+ *
+ * \param post post sending its request
+ *
+ * \return int
+ * \retval DONE if the source is sent to its end
+ * \retval SUCCESS if the socket is full
+ * \retval ERROR on Error
+ *
+ */
+static int streamMessage(struct smcPost *post) {
+    if (post->streamMode == STREAM_UNKNOWN) {
+        struct stat status;
+        if (fstat(post->messageSource, &status) == ERROR) return ERROR;
+        post->streamMode = S_ISREG(status.st_mode) ? STREAM_SENDFILE : S_ISFIFO(status.st_mode) ? STREAM_SPLICE : STREAM_COPY;
+    }
+
+    while (1 == 1) {
+        ssize_t sent;
+        if (post->streamMode != STREAM_COPY) {
+            sent = moveMessage(post);
+        }
+        else {
+            if (post->streamSent == post->streamBuffered) {
+                if (post->streamBuffer == NULL && (post->streamBuffer = malloc(STREAM_BUFFER_SIZE)) == NULL) return ERROR;
+                ssize_t received = read(post->messageSource, post->streamBuffer, STREAM_BUFFER_SIZE);
+                if (received == ERROR) {
+                    if (errno == EINTR) continue;
+                    return ERROR;
+                }
+                if (received == 0) return DONE;
+                post->streamBuffered = (size_t)received;
+                post->streamSent = 0;
+            }
+            sent = send(post->fd, post->streamBuffer + post->streamSent, post->streamBuffered - post->streamSent, MSG_MORE | MSG_NOSIGNAL);
+            if (sent > 0) post->streamSent += (size_t)sent;
+        }
+
+        if (sent == ERROR) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return SUCCESS;
+            /* the source does not support sendfile() or splice(), nothing
+             is lost before the first byte */
+            if (post->streamMode != STREAM_COPY && !post->streamStarted && (errno == EINVAL || errno == ENOSYS)) {
+                post->streamMode = STREAM_COPY;
+                continue;
+            }
+            return ERROR;
+        }
+        if (sent == 0 && post->streamMode != STREAM_COPY) return DONE;
+        post->streamStarted = 1;
+    }
+}
+
+/**
+ * @brief moveMessage
+ *
+ * sendfile() or splice() a chunk of the message; neither knows
+ * MSG_NOSIGNAL, so SIGPIPE is blocked meanwhile and taken back if the
+ * server closed, the caller of the library sees EPIPE instead
+ *
+ * \param post post streaming its message with STREAM_SENDFILE or
+ *        STREAM_SPLICE
+ *
+ * \return ssize_t
+ * \retval number of bytes sent
+ * \retval 0 at the end of the message
+ * \retval ERROR on Error
+ *
+ */
+static ssize_t moveMessage(struct smcPost *post) {
+    sigset_t pipeSignal;
+    sigset_t previous;
+    sigset_t pending;
+
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, &previous);
+    sigpending(&pending);
+    int wasPending = sigismember(&pending, SIGPIPE);
+
+    ssize_t sent = post->streamMode == STREAM_SENDFILE
+                   ? sendfile(post->fd, post->messageSource, NULL, TRANSFER_CHUNK_SIZE)
+                   : splice(post->messageSource, NULL, post->fd, NULL, TRANSFER_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+
+    if (sent == ERROR && errno == EPIPE && !wasPending) {
+        struct timespec immediately = { 0, 0 };
+        sigtimedwait(&pipeSignal, NULL, &immediately);
+        errno = EPIPE;
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    return sent;
+}
+
+/**
+ * @brief receiveResponse
+ *
+ * read and handle everything available of the response
+ *
+ * \param post post receiving its response
+ *
+ * \return int
+ * \retval DONE if the server closed after a complete response
+ * \retval SUCCESS if more is to come
+ * \retval ERROR on Error, errno is EPROTO for a malformed response
+ *
+ */
+static int receiveResponse(struct smcPost *post) {
+    struct responseRecord record;
+
+    while (1 == 1) {
+        if (post->part == PART_DATA) {
+            int result = receiveData(post);
+            if (result != DONE) return result;
+            continue;
+        }
+
+        int result = nextResponseRecord(&post->parser, &record);
+        if (result == SUCCESS) {
+            if (handleRecord(post, &record) != SUCCESS) return ERROR;
+            continue;
+        }
+        if (result == ERROR) {
+            errno = EPROTO;
+            return ERROR;
+        }
+
+        /* RESPONSE_INCOMPLETE */
+        char *space;
+        size_t size = responseParserSpace(&post->parser, &space);
+        ssize_t received = read(post->fd, space, size);
+        if (received > 0) {
+            responseParserFilled(&post->parser, (size_t)received);
+            continue;
+        }
+        if (received == ERROR) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return SUCCESS;
+            return ERROR;
+        }
+
+        /* end of the response, only complete after a status= and between files */
+        if (responseParserBuffered(&post->parser) != 0 || post->part != PART_FILE) {
+            errno = EPROTO;
+            return ERROR;
+        }
+        return DONE;
+    }
+}
+
+/**
+ * @brief handleRecord
+ *
+ * \param post post receiving its response
+ * \param record line parsed from the response
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR if the line does not fit in or the file can not be stored,
+ *         errno is EIO if the file does not match its crc32c= line
+ *
+ */
+static int handleRecord(struct smcPost *post, const struct responseRecord *record) {
+    struct smcFile *file = post->result.fileCount > 0 ? &post->result.files[post->result.fileCount - 1] : NULL;
+
+    errno = EPROTO;
+    switch (post->part) {
+        case PART_STATUS:
+            if (record->type != RECORD_STATUS) return ERROR;
+            post->result.status = record->status;
+            post->part = PART_FILE;
+            TRACE(TRACE_STATUS, TRACE_INSTANT, post->number, (uint64_t)record->status);
+            return SUCCESS;
+        case PART_FILE:
+            if (record->type != RECORD_FILE) return ERROR;
+            if (addFile(post, record->fileName) != SUCCESS) return ERROR;
+            post->part = PART_LENGTH;
+            return SUCCESS;
+        case PART_LENGTH:
+            /* offset= only comes as answer to have= */
+            if (record->type == RECORD_OFFSET && post->resuming) {
+                file->offset = record->offset;
+                return SUCCESS;
+            }
+            if (record->type != RECORD_LENGTH) return ERROR;
+            if (startFileData(post, record->length) != SUCCESS) return ERROR;
+            post->part = PART_DATA;
+            TRACE(TRACE_FILE, TRACE_BEGIN, post->number, record->length);
+            return SUCCESS;
+        case PART_CHECKSUM:
+            if (record->type != RECORD_CHECKSUM) return ERROR;
+            if (record->checksum != post->checksum) {
+                errno = EIO;
+                return ERROR;
+            }
+            post->part = PART_FILE;
+            return SUCCESS;
+        default:
+            return ERROR;
+    }
+}
+
+/**
+ * @brief addFile
+ *
+ * \param post post receiving its response
+ * \param fileName name sent by the server
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int addFile(struct smcPost *post, const char *fileName) {
+    struct smcResult *result = &post->result;
+
+    if (result->fileCount == post->fileCapacity) {
+        int capacity = post->fileCapacity == 0 ? 4 : post->fileCapacity * 2;
+        struct smcFile *grown = realloc(result->files, (size_t)capacity * sizeof(*grown));
+        if (grown == NULL) return ERROR;
+        result->files = grown;
+        post->fileCapacity = capacity;
+    }
+
+    struct smcFile *file = &result->files[result->fileCount];
+    memset(file, 0, sizeof(*file));
+    file->name = strdup(fileName);
+    if (file->name == NULL) return ERROR;
+    result->fileCount++;
+    return SUCCESS;
+}
+
+/**
+ * @brief startFileData
+ *
+ * open the current file at the sink, get its memory, or create it in the
+ * directory; a resumed file keeps its first offset bytes
+ *
+ * \param post post receiving its response
+ * \param length announced length of the file, behind its offset
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int startFileData(struct smcPost *post, unsigned long length) {
+    struct smcFile *file = &post->result.files[post->result.fileCount - 1];
+
+    post->remaining = length;
+    post->checksum = 0;
+    if (post->options.sink != NULL) {
+        post->sinkFile = post->options.sink->open(file->name, file->offset, length, post->options.context);
+        return post->sinkFile == NULL ? ERROR : SUCCESS;
+    }
+    if (post->options.directory == ERROR) {
+        if (post->options.buffer != NULL) {
+            file->data = post->options.buffer(post, file->name, length, post->options.context);
+            if (file->data == NULL) errno = ENOBUFS;
+        }
+        else {
+            file->data = malloc(length > 0 ? length : 1);
+        }
+        return file->data == NULL ? ERROR : SUCCESS;
+    }
+
+    struct smcClient *client = post->client;
+    if (client->chunk == NULL && (client->chunk = malloc(DATA_CHUNK_SIZE)) == NULL) return ERROR;
+    post->outputFile = openat(post->options.directory, file->name, O_WRONLY | O_CREAT | (file->offset > 0 ? 0 : O_TRUNC) | O_CLOEXEC, 0664);
+    if (post->outputFile == ERROR) return ERROR;
+    if (file->offset > 0 && (keepFileStart(post->outputFile, file->offset) == ERROR || lseek(post->outputFile, (off_t)file->offset, SEEK_SET) == ERROR)) return ERROR;
+    /* reserve the blocks up front, KEEP_SIZE leaves the file as long as what
+     was received if the server sends less than announced */
+    if (length > 0) (void)fallocate(post->outputFile, FALLOC_FL_KEEP_SIZE, (off_t)file->offset, (off_t)length);
+    return SUCCESS;
+}
+
+/**
+ * @brief receiveData
+ *
+ * store file data, first what the parser has buffered, then straight from
+ * the socket
+ *
+ * \param post post receiving file data
+ *
+ * \return int
+ * \retval DONE if the file is complete
+ * \retval SUCCESS if the socket has nothing more for now
+ * \retval ERROR on Error, also if the server closed early
+ *
+ */
+static int receiveData(struct smcPost *post) {
+    struct smcFile *file = &post->result.files[post->result.fileCount - 1];
+
+    while (post->remaining > 0) {
+        const char *data;
+        size_t length = responseParserData(&post->parser, &data);
+
+        if (length > 0) {
+            if (length > post->remaining) length = (size_t)post->remaining;
+            if (storeData(post, file, data, length) != SUCCESS) return ERROR;
+            responseParserConsume(&post->parser, length);
+        }
+        else {
+            ssize_t received = readData(post, file);
+            if (received == ERROR) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return SUCCESS;
+                return ERROR;
+            }
+            if (received == 0) {
+                errno = EPROTO;
+                return ERROR;
+            }
+            length = (size_t)received;
+        }
+        file->length += length;
+        post->remaining -= length;
+        post->result.bytes += length;
+    }
+    return finishFile(post);
+}
+
+/**
+ * @brief storeData
+ *
+ * store bytes of the current file the parser has read past its len= line
+ *
+ * \param post post receiving file data
+ * \param file current file
+ * \param data bytes of the file
+ * \param length number of bytes, at most what the file still expects
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int storeData(struct smcPost *post, struct smcFile *file, const char *data, size_t length) {
+    const struct smcFileSink *sink = post->options.sink;
+
+    if (post->options.checksum) post->checksum = crc32c(post->checksum, data, length);
+    if (file->data != NULL) {
+        memcpy(file->data + file->length, data, length);
+        return SUCCESS;
+    }
+    if (post->sinkFile == NULL) return writeAll(post->outputFile, data, length);
+
+    while (length > 0) {
+        if (post->sinkBuffer == NULL && (post->sinkBuffer = sink->buffer(post->options.context)) == NULL) {
+            errno = ENOBUFS;
+            return ERROR;
+        }
+        size_t size = sink->bufferSize - post->sinkFilled;
+        if (size > length) size = length;
+        memcpy(post->sinkBuffer + post->sinkFilled, data, size);
+        post->sinkFilled += size;
+        data += size;
+        length -= size;
+        if (post->sinkFilled == sink->bufferSize && submitSinkBuffer(post) != SUCCESS) return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief readData
+ *
+ * read bytes of the current file from the socket: into its memory, into a
+ * buffer of the sink, which is submitted once full, or to its output file,
+ * spliced unless the bytes are checked
+ *
+ * \param post post receiving file data
+ * \param file current file
+ *
+ * \return ssize_t
+ * \retval number of bytes stored
+ * \retval 0 if the server closed
+ * \retval ERROR on Error, EAGAIN if the socket has nothing for now
+ *
+ */
+static ssize_t readData(struct smcPost *post, struct smcFile *file) {
+    struct smcClient *client = post->client;
+    const struct smcFileSink *sink = post->options.sink;
+    ssize_t received;
+
+    if (file->data != NULL) {
+        received = read(post->fd, file->data + file->length, (size_t)post->remaining);
+        if (received > 0 && post->options.checksum) post->checksum = crc32c(post->checksum, file->data + file->length, (size_t)received);
+        return received;
+    }
+
+    if (post->sinkFile != NULL) {
+        if (post->sinkBuffer == NULL && (post->sinkBuffer = sink->buffer(post->options.context)) == NULL) {
+            errno = ENOBUFS;
+            return ERROR;
+        }
+        size_t size = sink->bufferSize - post->sinkFilled;
+        if (size > post->remaining) size = (size_t)post->remaining;
+        received = read(post->fd, post->sinkBuffer + post->sinkFilled, size);
+        if (received <= 0) return received;
+        /* while the bytes are still in the cache */
+        if (post->options.checksum) post->checksum = crc32c(post->checksum, post->sinkBuffer + post->sinkFilled, (size_t)received);
+        post->sinkFilled += (size_t)received;
+        if (post->sinkFilled == sink->bufferSize && submitSinkBuffer(post) != SUCCESS) return ERROR;
+        return received;
+    }
+
+    if (!post->options.checksum && !client->noSplice) {
+        received = spliceData(post);
+        if (received != ERROR || errno != EINVAL) return received;
+        client->noSplice = 1;
+    }
+
+    size_t size = post->remaining < DATA_CHUNK_SIZE ? (size_t)post->remaining : DATA_CHUNK_SIZE;
+    received = read(post->fd, client->chunk, size);
+    if (received <= 0) return received;
+    if (post->options.checksum) post->checksum = crc32c(post->checksum, client->chunk, (size_t)received);
+    if (writeAll(post->outputFile, client->chunk, (size_t)received) != SUCCESS) return ERROR;
+    return received;
+}
+
+/**
+ * @brief spliceData
+ *
+ * move bytes from the socket to the output file through the pipe of the
+ * client, without copying them to user space; the pipe is shared by the
+ * posts and left empty
+ *
+ * \param post post receiving file data
+ *
+ * \return ssize_t
+ * \retval number of bytes written
+ * \retval 0 if the server closed
+ * \retval ERROR on Error, EINVAL if splice() is not supported here and
+ *         nothing was moved
+ *
+ */
+static ssize_t spliceData(struct smcPost *post) {
+    struct smcClient *client = post->client;
+
+    if (client->splicePipe[0] == ERROR) {
+        if (pipe2(client->splicePipe, O_CLOEXEC) == ERROR) {
+            errno = EINVAL;
+            return ERROR;
+        }
+        /* a larger pipe means fewer splice() calls, the default size is fine too */
+        (void)fcntl(client->splicePipe[1], F_SETPIPE_SZ, TRANSFER_CHUNK_SIZE);
+    }
+
+    size_t size = post->remaining < TRANSFER_CHUNK_SIZE ? (size_t)post->remaining : TRANSFER_CHUNK_SIZE;
+    ssize_t received = splice(post->fd, NULL, client->splicePipe[1], NULL, size, SPLICE_F_MOVE | SPLICE_F_MORE | SPLICE_F_NONBLOCK);
+    if (received <= 0) return received;
+
+    size_t inPipe = (size_t)received;
+    while (inPipe > 0) {
+        ssize_t written = splice(client->splicePipe[0], NULL, post->outputFile, NULL, inPipe, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (written == ERROR && errno == EINTR) continue;
+        if (written == ERROR && errno == EINVAL) {
+            /* the file system can not splice, empty the pipe by hand */
+            client->noSplice = 1;
+            written = read(client->splicePipe[0], client->chunk, inPipe < DATA_CHUNK_SIZE ? inPipe : DATA_CHUNK_SIZE);
+            if (written > 0 && writeAll(post->outputFile, client->chunk, (size_t)written) != SUCCESS) written = ERROR;
+        }
+        if (written <= 0) {
+            /* whatever is left in the pipe must not end up in another file */
+            int error = written == 0 ? EIO : errno;
+            closeSplicePipe(client);
+            errno = error;
+            return ERROR;
+        }
+        inPipe -= (size_t)written;
+    }
+    return received;
+}
+
+/**
+ * @brief submitSinkBuffer
+ *
+ * \param post post with a buffer of the sink, which is handed over
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR if the sink failed
+ *
+ */
+static int submitSinkBuffer(struct smcPost *post) {
+    char *buffer = post->sinkBuffer;
+    size_t length = post->sinkFilled;
+
+    post->sinkBuffer = NULL;
+    post->sinkFilled = 0;
+    return post->options.sink->submit(post->sinkFile, buffer, length, post->options.context) == SUCCESS ? SUCCESS : ERROR;
+}
+
+/**
+ * @brief finishFile
+ *
+ * close the complete current file, its crc32c= line comes next if asked
+ * for
+ *
+ * \param post post receiving file data
+ *
+ * \return int
+ * \retval DONE on Success
+ * \retval ERROR on Error
+ *
+ */
+static int finishFile(struct smcPost *post) {
+    int result = SUCCESS;
+
+    if (post->sinkFilled > 0) result = submitSinkBuffer(post);
+    if (post->outputFile != ERROR && close(post->outputFile) == ERROR) result = ERROR;
+    post->outputFile = ERROR;
+    closeFileData(post);
+    if (result != SUCCESS) return ERROR;
+
+    post->part = post->options.checksum ? PART_CHECKSUM : PART_FILE;
+    TRACE(TRACE_FILE, TRACE_END, post->number, post->result.files[post->result.fileCount - 1].length);
+    return DONE;
+}
+
+/**
+ * @brief closeFileData
+ *
+ * give back what a post holds of its current file: the output file, the
+ * buffer and the file of the sink
+ *
+ * \param post post
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void closeFileData(struct smcPost *post) {
+    const struct smcFileSink *sink = post->options.sink;
+
+    if (post->outputFile != ERROR) close(post->outputFile);
+    post->outputFile = ERROR;
+    if (post->sinkBuffer != NULL) sink->release(post->sinkBuffer, post->options.context);
+    post->sinkBuffer = NULL;
+    post->sinkFilled = 0;
+    if (post->sinkFile != NULL) sink->close(post->sinkFile, post->options.context);
+    post->sinkFile = NULL;
+}
+
+/**
+ * @brief completePost
+ *
+ * release the socket of a post and tell the caller, the post must not be
+ * touched afterwards
+ *
+ * \param post pending post
+ * \param error 0, or the errno of the failure
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void completePost(struct smcPost *post, int error) {
+    /* closing the socket also removes it from the epoll instance */
+    abortAttempts(post);
+    if (post->fd != ERROR) close(post->fd);
+    post->fd = ERROR;
+    closeFileData(post);
+    post->client->completed++;
+    unlinkPost(post);
+
+    post->state = POST_DONE;
+    post->result.error = error;
+    TRACE(TRACE_REQUEST, TRACE_END, post->number, (uint64_t)error);
+    if (post->options.completion != NULL) post->options.completion(post, &post->result, post->options.context);
+}
+
+/**
+ * @brief unlinkPost
+ *
+ * \param post pending post, taken off the list of its client
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void unlinkPost(struct smcPost *post) {
+    struct smcClient *client = post->client;
+
+    disarmTimer(&client->timers, &post->timer);
+    if (post->previous != NULL) post->previous->next = post->next;
+    else client->posts = post->next;
+    if (post->next != NULL) post->next->previous = post->previous;
+    client->pending--;
+    post->client = NULL;
+    post->previous = NULL;
+    post->next = NULL;
+}
+
+/**
+ * @brief armPostTimer
+ *
+ * arm the timer for the state of a post: while connecting the connect
+ * timeout or the turn of the next address, whichever comes first, the idle
+ * timeout from now after that
+ *
+ * \param post pending post
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void armPostTimer(struct smcPost *post) {
+    struct timerWheel *wheel = &post->client->timers;
+
+    post->lastProgress = wheel->now;
+    if (post->state == POST_CONNECTING) {
+        uint64_t expires = UINT64_MAX;
+        if (post->options.connectTimeout > 0) expires = post->connectStarted + (uint64_t)post->options.connectTimeout;
+        if (post->nextAddress < post->client->addressCount && post->nextAttempt < expires) expires = post->nextAttempt;
+        if (expires != UINT64_MAX) armTimer(wheel, &post->timer, expires);
+        else disarmTimer(wheel, &post->timer);
+        return;
+    }
+
+    if (post->options.idleTimeout > 0) armTimer(wheel, &post->timer, wheel->now + (uint64_t)post->options.idleTimeout);
+    else disarmTimer(wheel, &post->timer);
+}
+
+/**
+ * @brief expirePost
+ *
+ * timer callback: fail the post with ETIMEDOUT, unless data moved since
+ * the timer was armed; progress only stores the time, the timer is armed
+ * again here for the rest of the idle time. While connecting it may also
+ * be the turn of the next address.
+ *
+ * \param context the post
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void expirePost(void *context) {
+    struct smcPost *post = context;
+    struct timerWheel *wheel = &post->client->timers;
+
+    if (post->state == POST_CONNECTING) {
+        if (post->options.connectTimeout > 0 && wheel->now >= post->connectStarted + (uint64_t)post->options.connectTimeout) completePost(post, ETIMEDOUT);
+        else if (startAttempts(post) != SUCCESS) completePost(post, errno);
+        return;
+    }
+    if (post->lastProgress + (uint64_t)post->options.idleTimeout > wheel->now) {
+        armTimer(wheel, &post->timer, post->lastProgress + (uint64_t)post->options.idleTimeout);
+        return;
+    }
+    completePost(post, ETIMEDOUT);
+}
+
+/**
+ * @brief closeSplicePipe
+ *
+ * \param client client whose pipe is closed, a new one is made when needed
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void closeSplicePipe(struct smcClient *client) {
+    for (int i = 0; i < 2; i++) {
+        if (client->splicePipe[i] != ERROR) close(client->splicePipe[i]);
+        client->splicePipe[i] = ERROR;
+    }
+}
+
+/**
+ * @brief writeAll
+ *
+ * \param fileDescriptor file to write to
+ * \param data bytes to write
+ * \param length number of bytes
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int writeAll(int fileDescriptor, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fileDescriptor, data, length);
+        if (written == ERROR) {
+            if (errno == EINTR) continue;
+            return ERROR;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,137 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_client_library.h
+ * VCS - Tcp/Ip Exercise - libsmc, non-blocking posts to a
+ * simple_message_server for programs with an event loop of their own
+ *
+ *     struct smcClient *client;
+ *     if (smcCreateClient("localhost", "7329", &client) != 0) ...
+ *     struct smcRequest request = { "alice", "hello", NULL, -1, NULL };
+ *     struct smcPost *post = smcSubmit(client, &request, NULL);
+ *     ... watch smcClientDescriptor(client) for input, for at most
+ *     smcTimeout(client) ms if posts have timeouts, then
+ *     smcProcess(client, 0);
+ *     const struct smcResult *result = smcPostResult(post);
+ *     if (result != NULL) { ... result->files[i].data ...; smcFreePost(post); }
+ *
+ * A message too large for memory is streamed from a file or pipe with
+ * request.message NULL and request.messageSource set. Files may be resumed
+ * with have= lines, checked with CRC32C, and handed to a struct
+ * smcFileSink, e.g. writer threads, instead of memory or a directory;
+ * smcCreateAgentClient() takes warm connections from smc_agent.
+ *
+ * A client and its posts belong to one thread at a time. Link with
+ * libsmc.a and -pthread.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_LIBRARY_H
+#define SIMPLE_MESSAGE_CLIENT_LIBRARY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+/* the resolved server and the posts to it, opaque */
+struct smcClient;
+
+/* one request and its response, opaque */
+struct smcPost;
+
+struct smcRequest {
+    const char *user;
+    const char *message;        /* NULL: stream it from messageSource */
+    const char *image;          /* URL for img=, NULL: none */
+    int messageSource;          /* file or pipe sent to its end if message is NULL,
+                                   smcProcess() waits while a pipe is empty */
+    const char *have;           /* have= lines of the files held, see
+                                   resumeRequest(), NULL: none; needs a
+                                   directory or a sink */
+};
+
+struct smcFile {
+    char *name;
+    char *data;                 /* NULL if the file was written to the directory or the sink */
+    unsigned long offset;       /* offset= of a resumed file, the data starts there */
+    unsigned long length;       /* bytes received */
+};
+
+struct smcResult {
+    int status;                 /* status= of the server, -1 if none was received */
+    int error;                  /* 0, or the errno of the failure, EPROTO for a malformed response */
+    int fileCount;
+    struct smcFile *files;
+    unsigned long long bytes;   /* file data received */
+};
+
+/* memory for a file of length bytes, or NULL to fail the post with ENOBUFS;
+ it has to stay valid until the post is freed */
+typedef char *(*smcBufferCallback)(struct smcPost *post, const char *fileName, unsigned long length, void *context);
+
+/* the post is done, it may be freed here */
+typedef void (*smcCompletionCallback)(struct smcPost *post, const struct smcResult *result, void *context);
+
+/* takes the files instead of memory or a directory, e.g. writer threads;
+ the calls may block while the sink waits for memory of its own */
+struct smcFileSink {
+    void *(*open)(const char *fileName, unsigned long offset, unsigned long length, void *context);    /* handle of the file, NULL fails the post */
+    char *(*buffer)(void *context);                 /* memory for the next bufferSize bytes */
+    int (*submit)(void *file, char *buffer, size_t length, void *context);  /* the buffer belongs to the sink then, 0 on Success */
+    void (*release)(char *buffer, void *context);   /* a buffer that got no bytes */
+    void (*close)(void *file, void *context);
+    size_t bufferSize;
+};
+
+struct smcPostOptions {
+    int directory;              /* write files below this directory descriptor, -1: keep them in memory */
+    smcBufferCallback buffer;   /* memory for files kept in memory, NULL: malloc()'ed and freed with the post */
+    smcCompletionCallback completion;   /* NULL: poll smcPostResult() */
+    void *context;              /* also given to the sink */
+    int connectTimeout;         /* milliseconds to connect, the post fails with ETIMEDOUT, 0: none */
+    int idleTimeout;            /* milliseconds without data moving once connected, 0: none */
+    const struct smcFileSink *sink;     /* NULL: the directory, or memory */
+    int attemptDelay;           /* milliseconds before the next address of the server is tried
+                                   alongside, 0: 250, -1: all at once */
+    int fastOpen;               /* 1: send the request with the SYN by TCP Fast Open */
+    int checksum;               /* 1: ask for crc32c= lines, a corrupt file fails the post with EIO */
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int smcCreateClient(const char *server, const char *port, struct smcClient **client);
+int smcCreateAgentClient(const char *server, const char *port, struct smcClient **client);
+int smcClientDescriptor(const struct smcClient *client);
+int smcPending(const struct smcClient *client);
+struct smcPost *smcSubmit(struct smcClient *client, const struct smcRequest *request, const struct smcPostOptions *options);
+int smcProcess(struct smcClient *client, int timeout);
+int smcTimeout(const struct smcClient *client);
+const struct smcResult *smcPostResult(const struct smcPost *post);
+void smcFreePost(struct smcPost *post);
+void smcDestroyClient(struct smcClient *client);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIMPLE_MESSAGE_CLIENT_LIBRARY_H */
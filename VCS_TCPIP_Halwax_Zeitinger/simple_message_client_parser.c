@@ -0,0 +1,389 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_client_parser.c
+ * VCS - Tcp/Ip Exercise - incremental parser of the status=, file=, offset=,
+ * len= and crc32c= lines of a server response
+ *
+ * The caller reads from the server into the free space of a fixed ring
+ * buffer and asks for records; a line that is not complete yet is reported
+ * as such and picks up where scanning stopped once more data arrived, so
+ * the parser works with partial and non-blocking reads alike. Lines are
+ * scanned 16 bytes at a time for the newline and the first '=' with SSE2.
+ * Nothing is allocated: values are parsed in place, only a file name is
+ * copied into the record.
+ *
+ * After a len= record the data of the file follows; the caller takes what
+ * is already buffered with responseParserData() and responseParserConsume()
+ * before asking for the next record.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "simple_message_client_parser.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define ERROR -1
+#define SUCCESS 0
+
+#define RING_MASK (RESPONSE_BUFFER_SIZE - 1)
+#define NOT_FOUND ((size_t)-1)
+
+/* longest keys, "status", "offset" and "crc32c" */
+#define MAX_KEY_LENGTH 6
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static size_t scanSegment(const char *data, size_t length, size_t *equals);
+static void copyFromRing(const struct responseParser *parser, size_t from, size_t length, char *target);
+static int parseNumber(const struct responseParser *parser, size_t from, size_t to, unsigned long limit, unsigned long *value);
+static int parseChecksum(const struct responseParser *parser, size_t from, size_t to, unsigned long *value);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief initResponseParser
+ *
+ * \param parser parser to reset
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void initResponseParser(struct responseParser *parser) {
+    parser->head = 0;
+    parser->tail = 0;
+    parser->scanned = 0;
+    parser->equals = NOT_FOUND;
+}
+
+/**
+ * @brief responseParserSpace
+ *
+ * where the next bytes from the server go
+ *
+ * \param parser the parser
+ * \param space set to the start of the free space
+ *
+ * \return size_t
+ * \retval number of bytes that fit at space, 0 if the ring is full
+ *
+ */
+size_t responseParserSpace(struct responseParser *parser, char **space) {
+    size_t start = parser->tail & RING_MASK;
+    size_t free = RESPONSE_BUFFER_SIZE - (parser->tail - parser->head);
+
+    *space = parser->buffer + start;
+    return free < RESPONSE_BUFFER_SIZE - start ? free : RESPONSE_BUFFER_SIZE - start;
+}
+
+/**
+ * @brief responseParserFilled
+ *
+ * \param parser the parser
+ * \param length number of bytes read into the space of responseParserSpace()
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void responseParserFilled(struct responseParser *parser, size_t length) {
+    parser->tail += length;
+}
+
+/**
+ * @brief nextResponseRecord
+ *
+ * parse the next line of the response
+ *
+ * \param parser the parser
+ * \param record filled with the parsed line
+ *
+ * \return int
+ * \retval SUCCESS if record was filled
+ * \retval RESPONSE_INCOMPLETE if the line is not complete yet
+ * \retval ERROR if the line is malformed or longer than the ring
+ *
+ */
+int nextResponseRecord(struct responseParser *parser, struct responseRecord *record) {
+    size_t newline = NOT_FOUND;
+
+    while (parser->scanned < parser->tail) {
+        size_t start = parser->scanned & RING_MASK;
+        size_t length = parser->tail - parser->scanned;
+        if (length > RESPONSE_BUFFER_SIZE - start) length = RESPONSE_BUFFER_SIZE - start;
+
+        /* once the '=' is known, scanSegment() only looks for the newline */
+        size_t equals = parser->equals == NOT_FOUND ? NOT_FOUND : 0;
+        size_t offset = scanSegment(parser->buffer + start, length, &equals);
+        if (parser->equals == NOT_FOUND && equals != NOT_FOUND) parser->equals = parser->scanned + equals;
+        if (offset < length) {
+            newline = parser->scanned + offset;
+            break;
+        }
+        parser->scanned += length;
+    }
+
+    if (newline == NOT_FOUND) {
+        return parser->tail - parser->head == RESPONSE_BUFFER_SIZE ? ERROR : RESPONSE_INCOMPLETE;
+    }
+
+    size_t equals = parser->equals;
+    size_t lineStart = parser->head;
+    size_t lineEnd = newline;
+    int result = ERROR;
+
+    /* the line is used up whether it parses or not */
+    parser->head = newline + 1;
+    parser->scanned = parser->head;
+    parser->equals = NOT_FOUND;
+
+    if (equals == NOT_FOUND || equals - lineStart > MAX_KEY_LENGTH) return ERROR;
+    if (lineEnd > equals + 1 && parser->buffer[(lineEnd - 1) & RING_MASK] == '\r') lineEnd--;
+
+    char key[MAX_KEY_LENGTH + 1];
+    copyFromRing(parser, lineStart, equals - lineStart, key);
+    key[equals - lineStart] = '\0';
+
+    size_t valueStart = equals + 1;
+    size_t valueLength = lineEnd - valueStart;
+    unsigned long value;
+
+    if (strcmp(key, "status") == 0) {
+        int negative = valueLength > 0 && parser->buffer[valueStart & RING_MASK] == '-';
+        if (parseNumber(parser, valueStart + (size_t)negative, lineEnd, (unsigned long)INT_MAX, &value) == SUCCESS) {
+            record->type = RECORD_STATUS;
+            record->status = negative ? -(int)value : (int)value;
+            result = SUCCESS;
+        }
+    }
+    else if (strcmp(key, "file") == 0) {
+        if (valueLength > 0 && valueLength < sizeof(record->fileName)) {
+            copyFromRing(parser, valueStart, valueLength, record->fileName);
+            record->fileName[valueLength] = '\0';
+            record->type = RECORD_FILE;
+            result = SUCCESS;
+        }
+    }
+    else if (strcmp(key, "offset") == 0) {
+        if (parseNumber(parser, valueStart, lineEnd, ULONG_MAX, &value) == SUCCESS) {
+            record->type = RECORD_OFFSET;
+            record->offset = value;
+            result = SUCCESS;
+        }
+    }
+    else if (strcmp(key, "len") == 0) {
+        if (parseNumber(parser, valueStart, lineEnd, ULONG_MAX, &value) == SUCCESS) {
+            record->type = RECORD_LENGTH;
+            record->length = value;
+            result = SUCCESS;
+        }
+    }
+    else if (strcmp(key, "crc32c") == 0) {
+        if (parseChecksum(parser, valueStart, lineEnd, &value) == SUCCESS) {
+            record->type = RECORD_CHECKSUM;
+            record->checksum = value;
+            result = SUCCESS;
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief responseParserData
+ *
+ * buffered bytes after the last parsed line, e.g. the start of a file
+ *
+ * \param parser the parser
+ * \param data set to the first buffered byte
+ *
+ * \return size_t
+ * \retval number of contiguous bytes at data, call again after consuming
+ *         them for the rest of a wrapped ring
+ *
+ */
+size_t responseParserData(struct responseParser *parser, const char **data) {
+    size_t start = parser->head & RING_MASK;
+    size_t length = parser->tail - parser->head;
+
+    *data = parser->buffer + start;
+    return length < RESPONSE_BUFFER_SIZE - start ? length : RESPONSE_BUFFER_SIZE - start;
+}
+
+/**
+ * @brief responseParserConsume
+ *
+ * drop bytes taken with responseParserData()
+ *
+ * \param parser the parser
+ * \param length number of bytes
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void responseParserConsume(struct responseParser *parser, size_t length) {
+    parser->head += length;
+    parser->scanned = parser->head;
+    parser->equals = NOT_FOUND;
+}
+
+/**
+ * @brief responseParserBuffered
+ *
+ * \param parser the parser
+ *
+ * \return size_t
+ * \retval number of received bytes not parsed or consumed yet
+ *
+ */
+size_t responseParserBuffered(const struct responseParser *parser) {
+    return parser->tail - parser->head;
+}
+
+/**
+ * @brief scanSegment
+ *
+ * find the first newline of a contiguous part of the ring and the first
+ * '=' in front of it
+ *
+ * \param data bytes to scan
+ * \param length number of bytes
+ * \param equals set to the offset of the first '=' before the newline,
+ *        left alone if there is none
+ *
+ * \return size_t
+ * \retval offset of the newline, or length if there is none
+ *
+ */
+static size_t scanSegment(const char *data, size_t length, size_t *equals) {
+    size_t offset = 0;
+
+#ifdef __SSE2__
+    const __m128i newlines = _mm_set1_epi8('\n');
+    const __m128i equalSigns = _mm_set1_epi8('=');
+
+    for (; offset + sizeof(__m128i) <= length; offset += sizeof(__m128i)) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(const void *)(data + offset));
+        unsigned newlineMask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newlines));
+        if (*equals == NOT_FOUND) {
+            unsigned equalsMask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, equalSigns));
+            /* only an '=' in front of the newline belongs to this line */
+            if (newlineMask != 0) equalsMask &= (1U << __builtin_ctz(newlineMask)) - 1;
+            if (equalsMask != 0) *equals = offset + (size_t)__builtin_ctz(equalsMask);
+        }
+        if (newlineMask != 0) return offset + (size_t)__builtin_ctz(newlineMask);
+    }
+#endif
+
+    for (; offset < length; offset++) {
+        if (data[offset] == '\n') return offset;
+        if (data[offset] == '=' && *equals == NOT_FOUND) *equals = offset;
+    }
+    return length;
+}
+
+/**
+ * @brief copyFromRing
+ *
+ * \param parser the parser
+ * \param from index of the first byte
+ * \param length number of bytes
+ * \param target where to copy them, possibly from both ends of the ring
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void copyFromRing(const struct responseParser *parser, size_t from, size_t length, char *target) {
+    size_t start = from & RING_MASK;
+    size_t first = length < RESPONSE_BUFFER_SIZE - start ? length : RESPONSE_BUFFER_SIZE - start;
+
+    memcpy(target, parser->buffer + start, first);
+    memcpy(target + first, parser->buffer, length - first);
+}
+
+/**
+ * @brief parseNumber
+ *
+ * parse the decimal digits between two ring indices
+ *
+ * \param parser the parser
+ * \param from index of the first digit
+ * \param to index behind the last digit
+ * \param limit largest value accepted
+ * \param value set to the parsed number
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR if there are no digits, other characters or the value is
+ *         above limit
+ *
+ */
+static int parseNumber(const struct responseParser *parser, size_t from, size_t to, unsigned long limit, unsigned long *value) {
+    unsigned long number = 0;
+
+    if (from >= to) return ERROR;
+    for (size_t index = from; index < to; index++) {
+        unsigned digit = (unsigned)(unsigned char)parser->buffer[index & RING_MASK] - '0';
+        if (digit > 9 || number > (limit - digit) / 10) return ERROR;
+        number = number * 10 + digit;
+    }
+    *value = number;
+    return SUCCESS;
+}
+
+/**
+ * @brief parseChecksum
+ *
+ * parse the 8 hex digits of a CRC32C between two ring indices
+ *
+ * \param parser the parser
+ * \param from index of the first digit
+ * \param to index behind the last digit
+ * \param value set to the parsed checksum
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR if there are not 8 hex digits
+ *
+ */
+static int parseChecksum(const struct responseParser *parser, size_t from, size_t to, unsigned long *value) {
+    unsigned long number = 0;
+
+    if (to - from != 8) return ERROR;
+    for (size_t index = from; index < to; index++) {
+        char digit = parser->buffer[index & RING_MASK];
+        if (digit >= '0' && digit <= '9') number = number << 4 | (unsigned long)(digit - '0');
+        else if (digit >= 'a' && digit <= 'f') number = number << 4 | (unsigned long)(digit - 'a' + 10);
+        else if (digit >= 'A' && digit <= 'F') number = number << 4 | (unsigned long)(digit - 'A' + 10);
+        else return ERROR;
+    }
+    *value = number;
+    return SUCCESS;
+}
@@ -0,0 +1,79 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_client_parser.h
+ * VCS - Tcp/Ip Exercise - incremental parser of the status=, file=, offset=,
+ * len= and crc32c= lines of a server response, working on a fixed ring buffer
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_PARSER_H
+#define SIMPLE_MESSAGE_CLIENT_PARSER_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* size of the ring, a power of 2; also the longest line accepted */
+#define RESPONSE_BUFFER_SIZE 4096
+
+/* nextResponseRecord() needs more data to complete the line */
+#define RESPONSE_INCOMPLETE 1
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+enum responseRecordType {
+    RECORD_STATUS,              /* status=<int> */
+    RECORD_FILE,                /* file=<name> */
+    RECORD_OFFSET,              /* offset=<unsigned long>, optional before len= */
+    RECORD_LENGTH,              /* len=<unsigned long>, followed by the data */
+    RECORD_CHECKSUM             /* crc32c=<hex>, behind the data if asked for */
+};
+
+struct responseRecord {
+    enum responseRecordType type;
+    int status;
+    unsigned long length;
+    unsigned long offset;
+    unsigned long checksum;
+    char fileName[FILENAME_MAX];
+};
+
+struct responseParser {
+    char buffer[RESPONSE_BUFFER_SIZE];
+    size_t head;                /* first unparsed byte, indices run freely */
+    size_t tail;                /* end of the received data */
+    size_t scanned;             /* no newline in [head, scanned) */
+    size_t equals;              /* first '=' of the line, or (size_t)-1 */
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+void initResponseParser(struct responseParser *parser);
+size_t responseParserSpace(struct responseParser *parser, char **space);
+void responseParserFilled(struct responseParser *parser, size_t length);
+int nextResponseRecord(struct responseParser *parser, struct responseRecord *record);
+size_t responseParserData(struct responseParser *parser, const char **data);
+void responseParserConsume(struct responseParser *parser, size_t length);
+size_t responseParserBuffered(const struct responseParser *parser);
+
+#endif /* SIMPLE_MESSAGE_CLIENT_PARSER_H */
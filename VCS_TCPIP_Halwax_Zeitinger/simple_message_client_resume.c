@@ -0,0 +1,338 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_client_resume.c
+ * VCS - Tcp/Ip Exercise - files the client already holds
+ *
+ * The manifest lists the files received into the working directory, one
+ * line each:
+ *
+ *   <hash> <size> <seconds> <nanoseconds> <name>
+ *
+ * with the hex content hash of the file and its size and modification
+ * time when the hash was taken. A file is appended as "- 0 0 0 <name>"
+ * before its first byte is written, so a transfer that breaks off is
+ * known at the next start; such files, and files whose size or time
+ * changed, are hashed again from disk. Unchanged files are not read.
+ *
+ * Every verified file is advertised as
+ *
+ *   have=<size> <hash> <name>
+ *
+ * and the server answers with offset=<size> before len= for a file whose
+ * first size bytes are the same, sending only the bytes behind them.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "simple_message_client_resume.h"
+#include "simple_message_hash.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define ERROR -1
+#define SUCCESS 0
+
+/* bytes read per read() when hashing a file */
+#define HASH_CHUNK_SIZE (256 * 1024)
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static struct resumeFile *findFile(struct resumeState *state, const char *fileName);
+static void refreshFiles(struct resumeState *state);
+static int hashFile(struct resumeFile *file);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief loadResumeState
+ *
+ * read the manifest and bring it up to date with the disk
+ *
+ * \param state filled with the files held
+ *
+ * \return int
+ * \retval SUCCESS on Success, also without a manifest
+ * \retval ERROR if the manifest can not be written
+ *
+ */
+int loadResumeState(struct resumeState *state) {
+    memset(state, 0, sizeof(*state));
+    state->manifest = ERROR;
+
+    FILE *manifest = fopen(RESUME_MANIFEST, "re");
+    if (manifest != NULL) {
+        char *line = NULL;
+        size_t capacity = 0;
+        ssize_t length;
+
+        while ((length = getline(&line, &capacity, manifest)) > 0) {
+            char hash[17];
+            long long seconds;
+            long nanoseconds;
+            unsigned long size;
+            int name = 0;
+
+            if (line[length - 1] == '\n') line[--length] = '\0';
+            if (sscanf(line, "%16s %lu %lld %ld %n", hash, &size, &seconds, &nanoseconds, &name) != 4 || name == 0 || line[name] == '\0') continue;
+
+            struct resumeFile *file = findFile(state, line + name);
+            if (file == NULL) continue;
+            file->verified = strcmp(hash, "-") != 0;
+            file->hash = strtoull(hash, NULL, 16);
+            file->size = size;
+            file->modified.tv_sec = (time_t)seconds;
+            file->modified.tv_nsec = nanoseconds;
+        }
+        free(line);
+        fclose(manifest);
+    }
+    else if (errno != ENOENT) {
+        return ERROR;
+    }
+
+    refreshFiles(state);
+    state->manifest = open(RESUME_MANIFEST, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0664);
+    return state->manifest == ERROR ? ERROR : SUCCESS;
+}
+
+/**
+ * @brief resumeRequest
+ *
+ * \param state files held
+ * \param length set to the length of the lines
+ *
+ * \return char *
+ * \retval the have= lines, to be freed by the caller
+ * \retval NULL if there is nothing to advertise
+ *
+ */
+char *resumeRequest(const struct resumeState *state, size_t *length) {
+    size_t capacity = 0;
+
+    for (int i = 0; i < state->count; i++) capacity += strlen(state->files[i].name) + 64;
+    char *lines = capacity > 0 ? malloc(capacity) : NULL;
+    if (lines == NULL) return NULL;
+
+    *length = 0;
+    for (int i = 0; i < state->count; i++) {
+        const struct resumeFile *file = &state->files[i];
+        if (!file->verified || file->size == 0) continue;
+        *length += (size_t)sprintf(lines + *length, "have=%lu %016llx %s\n", file->size, (unsigned long long)file->hash, file->name);
+    }
+    if (*length == 0) {
+        free(lines);
+        return NULL;
+    }
+    return lines;
+}
+
+/**
+ * @brief resumeStarted
+ *
+ * note a file before its bytes are written, it is hashed again at
+ * saveResumeState() or at the next start if the transfer breaks off
+ *
+ * \param state files held
+ * \param fileName name sent by the server
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void resumeStarted(struct resumeState *state, const char *fileName) {
+    struct resumeFile *file = findFile(state, fileName);
+    if (file == NULL) return;
+
+    file->verified = 0;
+    if (state->manifest != ERROR) {
+        char line[FILENAME_MAX + 16];
+        int length = snprintf(line, sizeof(line), "- 0 0 0 %s\n", fileName);
+        /* one write() per line, appends of other clients do not interleave */
+        if (length > 0 && (size_t)length < sizeof(line)) (void)write(state->manifest, line, (size_t)length);
+    }
+}
+
+/**
+ * @brief saveResumeState
+ *
+ * hash the files written in this run and replace the manifest
+ *
+ * \param state files held, released
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+int saveResumeState(struct resumeState *state) {
+    refreshFiles(state);
+    if (state->manifest != ERROR) close(state->manifest);
+    state->manifest = ERROR;
+
+    int result = SUCCESS;
+    FILE *manifest = fopen(RESUME_MANIFEST ".new", "we");
+    if (manifest == NULL) result = ERROR;
+
+    for (int i = 0; i < state->count; i++) {
+        struct resumeFile *file = &state->files[i];
+        if (manifest != NULL && file->verified) {
+            fprintf(manifest, "%016llx %lu %lld %ld %s\n", (unsigned long long)file->hash, file->size,
+                    (long long)file->modified.tv_sec, (long)file->modified.tv_nsec, file->name);
+        }
+        free(file->name);
+    }
+    state->count = 0;
+
+    if (manifest != NULL && fclose(manifest) != SUCCESS) result = ERROR;
+    if (result == SUCCESS && rename(RESUME_MANIFEST ".new", RESUME_MANIFEST) == ERROR) result = ERROR;
+    return result;
+}
+
+/**
+ * @brief keepFileStart
+ *
+ * cut a file to the bytes the server continues after
+ *
+ * \param fd file opened for writing
+ * \param offset bytes to keep, all of them have to be there
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error, ESPIPE if the file is shorter than offset
+ *
+ */
+int keepFileStart(int fd, unsigned long offset) {
+    struct stat status;
+
+    if (fstat(fd, &status) == ERROR) return ERROR;
+    if ((unsigned long)status.st_size < offset) {
+        errno = ESPIPE;
+        return ERROR;
+    }
+    /* left alone when it fits, so the time of an unchanged file stays */
+    if ((unsigned long)status.st_size > offset && ftruncate(fd, (off_t)offset) == ERROR) return ERROR;
+    return SUCCESS;
+}
+
+/**
+ * @brief findFile
+ *
+ * \param state files held
+ * \param fileName name of the file
+ *
+ * \return struct resumeFile *
+ * \retval the file, added unverified if it was not known
+ * \retval NULL if no more files can be tracked
+ *
+ */
+static struct resumeFile *findFile(struct resumeState *state, const char *fileName) {
+    for (int i = 0; i < state->count; i++) {
+        if (strcmp(state->files[i].name, fileName) == 0) return &state->files[i];
+    }
+    if (state->count == MAX_RESUME_FILES) return NULL;
+
+    struct resumeFile *file = &state->files[state->count];
+    memset(file, 0, sizeof(*file));
+    file->name = strdup(fileName);
+    if (file->name == NULL) return NULL;
+    state->count++;
+    return file;
+}
+
+/**
+ * @brief refreshFiles
+ *
+ * drop files that are gone, hash those that are unverified or changed
+ *
+ * \param state files held
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void refreshFiles(struct resumeState *state) {
+    for (int i = 0; i < state->count; i++) {
+        struct resumeFile *file = &state->files[i];
+        struct stat status;
+
+        int present = stat(file->name, &status) == SUCCESS && S_ISREG(status.st_mode);
+        if (present && file->verified && (unsigned long)status.st_size == file->size
+            && status.st_mtim.tv_sec == file->modified.tv_sec && status.st_mtim.tv_nsec == file->modified.tv_nsec) continue;
+
+        if (!present || hashFile(file) != SUCCESS) {
+            free(file->name);
+            state->files[i--] = state->files[--state->count];
+        }
+    }
+}
+
+/**
+ * @brief hashFile
+ *
+ * \param file file to hash, its size, time and hash are set
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int hashFile(struct resumeFile *file) {
+    static char chunk[HASH_CHUNK_SIZE];
+    struct stat status;
+
+    int fd = open(file->name, O_RDONLY | O_CLOEXEC);
+    if (fd == ERROR) return ERROR;
+    if (fstat(fd, &status) == ERROR) {
+        close(fd);
+        return ERROR;
+    }
+
+    /* bytes appended meanwhile are not part of the hash */
+    unsigned long remaining = (unsigned long)status.st_size;
+    struct contentHash hash;
+    initContentHash(&hash);
+    while (remaining > 0) {
+        ssize_t received = read(fd, chunk, remaining < HASH_CHUNK_SIZE ? (size_t)remaining : HASH_CHUNK_SIZE);
+        if (received == ERROR && errno == EINTR) continue;
+        if (received <= 0) {
+            close(fd);
+            return ERROR;
+        }
+        updateContentHash(&hash, chunk, (size_t)received);
+        remaining -= (unsigned long)received;
+    }
+    close(fd);
+
+    file->size = (unsigned long)status.st_size;
+    file->hash = finishContentHash(&hash);
+    file->modified = status.st_mtim;
+    file->verified = 1;
+    return SUCCESS;
+}
@@ -0,0 +1,67 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_client_resume.h
+ * VCS - Tcp/Ip Exercise - files the client already holds, advertised with
+ * have= lines so the server sends only what is missing
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_RESUME_H
+#define SIMPLE_MESSAGE_CLIENT_RESUME_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* manifest of the received files, in the working directory */
+#define RESUME_MANIFEST ".simple_message_client.resume"
+
+/* files tracked and advertised at most */
+#define MAX_RESUME_FILES 64
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+struct resumeFile {
+    char *name;
+    unsigned long size;
+    uint64_t hash;              /* content hash of size bytes */
+    struct timespec modified;
+    int verified;               /* size, modified and hash match the disk */
+};
+
+struct resumeState {
+    struct resumeFile files[MAX_RESUME_FILES];
+    int count;
+    int manifest;               /* appended to when a file is started */
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int loadResumeState(struct resumeState *state);
+char *resumeRequest(const struct resumeState *state, size_t *length);
+void resumeStarted(struct resumeState *state, const char *fileName);
+int saveResumeState(struct resumeState *state);
+int keepFileStart(int fd, unsigned long offset);
+
+#endif /* SIMPLE_MESSAGE_CLIENT_RESUME_H */
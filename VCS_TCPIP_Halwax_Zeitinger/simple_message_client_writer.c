@@ -0,0 +1,539 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_client_writer.c
+ * VCS - Tcp/Ip Exercise - writer threads of simple_message_client
+ *
+ * The receiving thread reads file data into buffers of a fixed pool and
+ * hands them to a writer thread, which writes them and puts the buffers
+ * back; so the socket is drained while the disk is busy, and once the pool
+ * is used up the receiver waits, which keeps the memory within the budget.
+ * Every file belongs to one writer, in turn, so its opening, writes and
+ * closing happen in order on one thread while different files are written
+ * in parallel.
+ *
+ * Files are created with openat() relative to the working directory at
+ * startWriters(); the directories of file names with a path are opened
+ * once and kept.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include "simple_message_client_writer.h"
+#include "simple_message_client_resume.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define ERROR -1
+#define SUCCESS 0
+
+/* directories kept open, further ones are opened per file */
+#define DIRECTORY_CACHE_SIZE 64
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+enum jobKind {
+    JOB_OPEN,
+    JOB_WRITE,
+    JOB_CLOSE,
+    JOB_STOP
+};
+
+struct writeJob {
+    enum jobKind kind;
+    struct outputFile *file;
+    char *buffer;               /* JOB_WRITE, back to the pool when written */
+    size_t length;
+    struct writeJob *next;
+};
+
+struct outputFile {
+    char *name;
+    int fd;
+    unsigned long length;       /* announced length, reserved on open */
+    off_t offset;               /* where the next write goes, kept on open if > 0 */
+    int failed;
+    int writer;
+};
+
+struct writer {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    struct writeJob *head;
+    struct writeJob *tail;
+};
+
+struct cachedDirectory {
+    char *path;
+    int fd;
+};
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+static const char *programName;
+
+static struct writer *writers;
+static int writerCount;
+static int nextWriter;
+
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t poolReady = PTHREAD_COND_INITIALIZER;
+static char *bufferMemory;
+static char **freeBuffers;
+static size_t freeCount;
+
+static int baseDirectory = ERROR;
+static pthread_mutex_t directoryLock = PTHREAD_MUTEX_INITIALIZER;
+static struct cachedDirectory directories[DIRECTORY_CACHE_SIZE];
+static int cachedDirectories;
+
+/* errno of the first failed open, write or close */
+static atomic_int writeError;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void *runWriter(void *argument);
+static int enqueue(struct outputFile *file, enum jobKind kind, char *buffer, size_t length);
+static void openFile(struct outputFile *file);
+static void writeFile(struct outputFile *file, const char *buffer, size_t length);
+static void closeFile(struct outputFile *file);
+static void failFile(struct outputFile *file, const char *what);
+static int directoryOf(const char *fileName, const char **leaf, int *temporary);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief startWriters
+ *
+ * \param name program name for error messages
+ * \param count number of writer threads
+ * \param budget bytes of buffers, at least two buffers are used
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+int startWriters(const char *name, int count, size_t budget) {
+    size_t buffers = budget / WRITE_BUFFER_SIZE;
+
+    programName = name;
+    if (buffers < 2) buffers = 2;
+
+    baseDirectory = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    bufferMemory = malloc(buffers * WRITE_BUFFER_SIZE);
+    freeBuffers = malloc(buffers * sizeof(char *));
+    writers = calloc((size_t)count, sizeof(struct writer));
+    if (baseDirectory == ERROR || bufferMemory == NULL || freeBuffers == NULL || writers == NULL) return ERROR;
+
+    for (freeCount = 0; freeCount < buffers; freeCount++) {
+        freeBuffers[freeCount] = bufferMemory + freeCount * WRITE_BUFFER_SIZE;
+    }
+
+    for (writerCount = 0; writerCount < count; writerCount++) {
+        struct writer *writer = &writers[writerCount];
+        pthread_mutex_init(&writer->lock, NULL);
+        pthread_cond_init(&writer->ready, NULL);
+        int result = pthread_create(&writer->thread, NULL, runWriter, writer);
+        if (result != SUCCESS) {
+            errno = result;
+            return ERROR;
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief writerOpen
+ *
+ * create a file on the next writer, or continue one at offset; errors show
+ * up at stopWriters()
+ *
+ * \param fileName name sent by the server
+ * \param offset bytes of the file kept, 0 to truncate it
+ * \param length announced length behind offset
+ *
+ * \return struct outputFile *
+ * \retval the file, to be given to writerSubmit() and writerClose()
+ * \retval NULL on Error
+ *
+ */
+struct outputFile *writerOpen(const char *fileName, unsigned long offset, unsigned long length) {
+    struct outputFile *file = calloc(1, sizeof(*file));
+    if (file == NULL) return NULL;
+
+    file->name = strdup(fileName);
+    file->fd = ERROR;
+    file->offset = (off_t)offset;
+    file->length = length;
+    file->writer = nextWriter++ % writerCount;
+    if (file->name == NULL || enqueue(file, JOB_OPEN, NULL, 0) != SUCCESS) {
+        free(file->name);
+        free(file);
+        return NULL;
+    }
+    return file;
+}
+
+/**
+ * @brief writerBuffer
+ *
+ * take a buffer of WRITE_BUFFER_SIZE bytes from the pool, waiting for the
+ * writers to return one if all are in use
+ *
+ * \return char *
+ * \retval the buffer
+ *
+ */
+char *writerBuffer(void) {
+    pthread_mutex_lock(&poolLock);
+    while (freeCount == 0) pthread_cond_wait(&poolReady, &poolLock);
+    char *buffer = freeBuffers[--freeCount];
+    pthread_mutex_unlock(&poolLock);
+    return buffer;
+}
+
+/**
+ * @brief writerRelease
+ *
+ * \param buffer buffer of writerBuffer() that is not submitted
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void writerRelease(char *buffer) {
+    pthread_mutex_lock(&poolLock);
+    freeBuffers[freeCount++] = buffer;
+    pthread_cond_signal(&poolReady);
+    pthread_mutex_unlock(&poolLock);
+}
+
+/**
+ * @brief writerSubmit
+ *
+ * append a filled buffer to a file, the buffer belongs to the writer then
+ *
+ * \param file file of writerOpen()
+ * \param buffer buffer of writerBuffer()
+ * \param length number of bytes in buffer
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR if writing already failed, errno tells why
+ *
+ */
+int writerSubmit(struct outputFile *file, char *buffer, size_t length) {
+    int error = atomic_load(&writeError);
+
+    if (error != SUCCESS || enqueue(file, JOB_WRITE, buffer, length) != SUCCESS) {
+        writerRelease(buffer);
+        if (error != SUCCESS) errno = error;
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief writerClose
+ *
+ * \param file file of writerOpen(), closed and freed by its writer
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void writerClose(struct outputFile *file) {
+    /* without memory for the job the file is left open until exit */
+    enqueue(file, JOB_CLOSE, NULL, 0);
+}
+
+/**
+ * @brief stopWriters
+ *
+ * wait until everything submitted is written and stop the writers
+ *
+ * \return int
+ * \retval SUCCESS if all files were written
+ * \retval ERROR otherwise, errno of the first failure
+ *
+ */
+int stopWriters(void) {
+    for (int i = 0; i < writerCount; i++) {
+        struct outputFile stop = { .writer = i };
+        while (enqueue(&stop, JOB_STOP, NULL, 0) != SUCCESS) sched_yield();
+        pthread_join(writers[i].thread, NULL);
+        pthread_mutex_destroy(&writers[i].lock);
+        pthread_cond_destroy(&writers[i].ready);
+    }
+
+    for (int i = 0; i < cachedDirectories; i++) {
+        close(directories[i].fd);
+        free(directories[i].path);
+    }
+    if (baseDirectory != ERROR) close(baseDirectory);
+    free(writers);
+    free(freeBuffers);
+    free(bufferMemory);
+
+    int error = atomic_load(&writeError);
+    if (error != SUCCESS) {
+        errno = error;
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief runWriter
+ *
+ * thread function: work through the jobs of one writer until JOB_STOP
+ *
+ * \param argument the writer
+ *
+ * \return void *
+ * \retval NULL
+ *
+ */
+static void *runWriter(void *argument) {
+    struct writer *writer = argument;
+
+    while (1 == 1) {
+        pthread_mutex_lock(&writer->lock);
+        while (writer->head == NULL) pthread_cond_wait(&writer->ready, &writer->lock);
+        struct writeJob *job = writer->head;
+        writer->head = job->next;
+        if (writer->head == NULL) writer->tail = NULL;
+        pthread_mutex_unlock(&writer->lock);
+
+        enum jobKind kind = job->kind;
+        switch (kind) {
+            case JOB_OPEN:
+                openFile(job->file);
+                break;
+            case JOB_WRITE:
+                writeFile(job->file, job->buffer, job->length);
+                writerRelease(job->buffer);
+                break;
+            case JOB_CLOSE:
+                closeFile(job->file);
+                break;
+            case JOB_STOP:
+                break;
+        }
+        free(job);
+        if (kind == JOB_STOP) return NULL;
+    }
+}
+
+/**
+ * @brief enqueue
+ *
+ * \param file file the job is for, selects the writer
+ * \param kind what to do
+ * \param buffer data of JOB_WRITE
+ * \param length number of bytes in buffer
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int enqueue(struct outputFile *file, enum jobKind kind, char *buffer, size_t length) {
+    struct writeJob *job = malloc(sizeof(*job));
+    if (job == NULL) return ERROR;
+
+    job->kind = kind;
+    job->file = file;
+    job->buffer = buffer;
+    job->length = length;
+    job->next = NULL;
+
+    struct writer *writer = &writers[file->writer];
+    pthread_mutex_lock(&writer->lock);
+    if (writer->tail != NULL) writer->tail->next = job;
+    else writer->head = job;
+    writer->tail = job;
+    pthread_cond_signal(&writer->ready);
+    pthread_mutex_unlock(&writer->lock);
+    return SUCCESS;
+}
+
+/**
+ * @brief openFile
+ *
+ * \param file file to create
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void openFile(struct outputFile *file) {
+    const char *leaf;
+    int temporary;
+    int directory = directoryOf(file->name, &leaf, &temporary);
+
+    if (directory == ERROR) {
+        failFile(file, "opening the directory");
+        return;
+    }
+    file->fd = openat(directory, leaf, O_WRONLY | O_CREAT | (file->offset > 0 ? 0 : O_TRUNC) | O_CLOEXEC, 0664);
+    if (temporary) close(directory);
+    if (file->fd == ERROR) {
+        failFile(file, "open()");
+        return;
+    }
+    if (file->offset > 0 && keepFileStart(file->fd, file->offset) == ERROR) {
+        failFile(file, "resuming");
+        return;
+    }
+
+    /* reserve the blocks up front, KEEP_SIZE leaves the file as long as what
+     was received if the server sends less than announced */
+    if (file->length > 0) (void)fallocate(file->fd, FALLOC_FL_KEEP_SIZE, file->offset, (off_t)file->length);
+}
+
+/**
+ * @brief writeFile
+ *
+ * \param file file to append to
+ * \param buffer data
+ * \param length number of bytes
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void writeFile(struct outputFile *file, const char *buffer, size_t length) {
+    while (length > 0 && !file->failed) {
+        ssize_t written = pwrite(file->fd, buffer, length, file->offset);
+        if (written == ERROR) {
+            if (errno == EINTR) continue;
+            failFile(file, "write()");
+            return;
+        }
+        buffer += written;
+        length -= (size_t)written;
+        file->offset += written;
+    }
+}
+
+/**
+ * @brief closeFile
+ *
+ * \param file file to close and free
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void closeFile(struct outputFile *file) {
+    if (file->fd != ERROR && close(file->fd) == ERROR) failFile(file, "close()");
+    free(file->name);
+    free(file);
+}
+
+/**
+ * @brief failFile
+ *
+ * report the first error of a file, and remember the first of all files
+ *
+ * \param file file that failed
+ * \param what failed operation
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void failFile(struct outputFile *file, const char *what) {
+    int error = errno;
+    int none = SUCCESS;
+
+    if (file->failed) return;
+    file->failed = 1;
+    fprintf(stderr, "%s: %s of %s failed: %s\n", programName, what, file->name, strerror(error));
+    atomic_compare_exchange_strong(&writeError, &none, error);
+}
+
+/**
+ * @brief directoryOf
+ *
+ * find the directory a file name is relative to
+ *
+ * \param fileName name sent by the server
+ * \param leaf set to the part of the name behind the last '/'
+ * \param temporary set to 1 if the caller has to close the directory
+ *
+ * \return int
+ * \retval descriptor of the directory
+ * \retval ERROR on Error
+ *
+ */
+static int directoryOf(const char *fileName, const char **leaf, int *temporary) {
+    const char *slash = strrchr(fileName, '/');
+
+    *temporary = 0;
+    if (slash == NULL) {
+        *leaf = fileName;
+        return baseDirectory;
+    }
+    *leaf = slash + 1;
+
+    char *path = slash == fileName ? strdup("/") : strndup(fileName, (size_t)(slash - fileName));
+    if (path == NULL) return ERROR;
+
+    pthread_mutex_lock(&directoryLock);
+    int directory = ERROR;
+    for (int i = 0; i < cachedDirectories && directory == ERROR; i++) {
+        if (strcmp(directories[i].path, path) == 0) directory = directories[i].fd;
+    }
+    if (directory == ERROR) {
+        directory = openat(baseDirectory, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (directory != ERROR && cachedDirectories < DIRECTORY_CACHE_SIZE) {
+            directories[cachedDirectories].path = path;
+            directories[cachedDirectories].fd = directory;
+            cachedDirectories++;
+            path = NULL;
+        }
+        else if (directory != ERROR) {
+            *temporary = 1;
+        }
+    }
+    pthread_mutex_unlock(&directoryLock);
+
+    free(path);
+    return directory;
+}
@@ -0,0 +1,57 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_client_writer.h
+ * VCS - Tcp/Ip Exercise - writer threads of simple_message_client, store
+ * received files while the socket is drained
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_WRITER_H
+#define SIMPLE_MESSAGE_CLIENT_WRITER_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* size of one pooled buffer */
+#define WRITE_BUFFER_SIZE (1024 * 1024)
+
+/* defaults for SMC_WRITERS and SMC_WRITE_BUDGET (MiB) */
+#define DEFAULT_WRITERS 2
+#define DEFAULT_WRITE_BUDGET 16
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+/* a file being written by one of the writers, opaque to the caller */
+struct outputFile;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int startWriters(const char *name, int writers, size_t budget);
+struct outputFile *writerOpen(const char *fileName, unsigned long offset, unsigned long length);
+char *writerBuffer(void);
+int writerSubmit(struct outputFile *file, char *buffer, size_t length);
+void writerRelease(char *buffer);
+void writerClose(struct outputFile *file);
+int stopWriters(void);
+
+#endif /* SIMPLE_MESSAGE_CLIENT_WRITER_H */
@@ -0,0 +1,333 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_crc32c.c
+ * VCS - Tcp/Ip Exercise - CRC32C (Castagnoli) of file bodies
+ *
+ * Three kernels give the same result:
+ *
+ *   portable    slicing-by-8, eight table lookups per 8 bytes
+ *   hardware    the SSE4.2 crc32 instruction, 8 bytes per instruction
+ *   hardware3   three crc32 streams over neighbouring blocks at once, so
+ *               the three cycles of latency of the instruction overlap;
+ *               the streams are joined by shifting a CRC over the length
+ *               of a block with four table lookups
+ *
+ * initCrc32c() builds the tables and picks the fastest kernel the CPU
+ * supports; it has to run before crc32c() is used. A CRC is continued over
+ * consecutive calls, starting with 0.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <string.h>
+#ifdef __x86_64__
+#include <nmmintrin.h>
+#endif
+#include "simple_message_crc32c.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* reflected Castagnoli polynomial */
+#define CRC32C_POLYNOMIAL 0x82f63b78U
+
+/* block lengths of the three streams, a long one for bulk data and a
+ short one for what is left of it */
+#define LONG_BLOCK 8192
+#define SHORT_BLOCK 256
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+static uint32_t sliceTable[8][256];
+static uint32_t longShift[4][256];
+static uint32_t shortShift[4][256];
+static uint32_t (*kernel)(uint32_t crc, const void *data, size_t length) = crc32cPortable;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static uint32_t multiplyModulo(uint32_t a, uint32_t b);
+static void buildShiftTable(uint32_t table[4][256], size_t length);
+#ifdef __x86_64__
+static uint32_t shiftCrc(uint32_t table[4][256], uint32_t crc);
+#endif
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief initCrc32c
+ *
+ * build the tables and choose the kernel of crc32c()
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void initCrc32c(void) {
+    for (uint32_t byte = 0; byte < 256; byte++) {
+        uint32_t crc = byte;
+        for (int bit = 0; bit < 8; bit++) crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
+        sliceTable[0][byte] = crc;
+    }
+    for (uint32_t byte = 0; byte < 256; byte++) {
+        uint32_t crc = sliceTable[0][byte];
+        for (int slice = 1; slice < 8; slice++) {
+            crc = sliceTable[0][crc & 0xff] ^ (crc >> 8);
+            sliceTable[slice][byte] = crc;
+        }
+    }
+    buildShiftTable(longShift, LONG_BLOCK);
+    buildShiftTable(shortShift, SHORT_BLOCK);
+
+    kernel = crc32cHardwareSupported() ? crc32cHardware3Way : crc32cPortable;
+}
+
+/**
+ * @brief crc32c
+ *
+ * \param crc CRC of the preceding bytes, 0 for none
+ * \param data bytes to add
+ * \param length number of bytes
+ *
+ * \return uint32_t
+ * \retval CRC of all bytes so far
+ *
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t length) {
+    return kernel(crc, data, length);
+}
+
+/**
+ * @brief crc32cKernel
+ *
+ * \return const char *
+ * \retval name of the kernel crc32c() uses
+ *
+ */
+const char *crc32cKernel(void) {
+    return kernel == crc32cPortable ? "portable" : "hardware3";
+}
+
+/**
+ * @brief crc32cHardwareSupported
+ *
+ * \return int
+ * \retval 1 if the CPU has the SSE4.2 crc32 instruction
+ * \retval 0 otherwise, the hardware kernels fall back to the portable one
+ *
+ */
+int crc32cHardwareSupported(void) {
+#ifdef __x86_64__
+    return __builtin_cpu_supports("sse4.2") ? 1 : 0;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief crc32cPortable
+ *
+ * \param crc CRC of the preceding bytes
+ * \param data bytes to add
+ * \param length number of bytes
+ *
+ * \return uint32_t
+ * \retval CRC of all bytes so far
+ *
+ */
+uint32_t crc32cPortable(uint32_t crc, const void *data, size_t length) {
+    const unsigned char *byte = data;
+
+    crc = ~crc;
+    for (; length >= 8; byte += 8, length -= 8) {
+        uint32_t low = crc ^ ((uint32_t)byte[0] | (uint32_t)byte[1] << 8 | (uint32_t)byte[2] << 16 | (uint32_t)byte[3] << 24);
+        crc = sliceTable[7][low & 0xff] ^ sliceTable[6][(low >> 8) & 0xff]
+              ^ sliceTable[5][(low >> 16) & 0xff] ^ sliceTable[4][low >> 24]
+              ^ sliceTable[3][byte[4]] ^ sliceTable[2][byte[5]]
+              ^ sliceTable[1][byte[6]] ^ sliceTable[0][byte[7]];
+    }
+    for (; length > 0; length--) crc = sliceTable[0][(crc ^ *byte++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+#ifdef __x86_64__
+
+/**
+ * @brief crc32cHardware
+ *
+ * \param crc CRC of the preceding bytes
+ * \param data bytes to add
+ * \param length number of bytes
+ *
+ * \return uint32_t
+ * \retval CRC of all bytes so far
+ *
+ */
+__attribute__((target("sse4.2")))
+uint32_t crc32cHardware(uint32_t crc, const void *data, size_t length) {
+    const unsigned char *byte = data;
+    uint64_t state = ~crc;
+    uint64_t word;
+
+    for (; length >= 8; byte += 8, length -= 8) {
+        memcpy(&word, byte, sizeof(word));
+        state = _mm_crc32_u64(state, word);
+    }
+    for (; length > 0; length--) state = _mm_crc32_u8((uint32_t)state, *byte++);
+    return ~(uint32_t)state;
+}
+
+/**
+ * @brief crc32cHardware3Way
+ *
+ * \param crc CRC of the preceding bytes
+ * \param data bytes to add
+ * \param length number of bytes
+ *
+ * \return uint32_t
+ * \retval CRC of all bytes so far
+ *
+ */
+__attribute__((target("sse4.2")))
+uint32_t crc32cHardware3Way(uint32_t crc, const void *data, size_t length) {
+    const unsigned char *byte = data;
+    uint64_t state0 = ~crc;
+    uint64_t word0, word1, word2;
+
+    while (length >= 3 * LONG_BLOCK) {
+        uint64_t state1 = 0;
+        uint64_t state2 = 0;
+        for (const unsigned char *end = byte + LONG_BLOCK; byte < end; byte += 8) {
+            memcpy(&word0, byte, 8);
+            memcpy(&word1, byte + LONG_BLOCK, 8);
+            memcpy(&word2, byte + 2 * LONG_BLOCK, 8);
+            state0 = _mm_crc32_u64(state0, word0);
+            state1 = _mm_crc32_u64(state1, word1);
+            state2 = _mm_crc32_u64(state2, word2);
+        }
+        state0 = shiftCrc(longShift, (uint32_t)state0) ^ state1;
+        state0 = shiftCrc(longShift, (uint32_t)state0) ^ state2;
+        byte += 2 * LONG_BLOCK;
+        length -= 3 * LONG_BLOCK;
+    }
+
+    while (length >= 3 * SHORT_BLOCK) {
+        uint64_t state1 = 0;
+        uint64_t state2 = 0;
+        for (const unsigned char *end = byte + SHORT_BLOCK; byte < end; byte += 8) {
+            memcpy(&word0, byte, 8);
+            memcpy(&word1, byte + SHORT_BLOCK, 8);
+            memcpy(&word2, byte + 2 * SHORT_BLOCK, 8);
+            state0 = _mm_crc32_u64(state0, word0);
+            state1 = _mm_crc32_u64(state1, word1);
+            state2 = _mm_crc32_u64(state2, word2);
+        }
+        state0 = shiftCrc(shortShift, (uint32_t)state0) ^ state1;
+        state0 = shiftCrc(shortShift, (uint32_t)state0) ^ state2;
+        byte += 2 * SHORT_BLOCK;
+        length -= 3 * SHORT_BLOCK;
+    }
+
+    return crc32cHardware(~(uint32_t)state0, byte, length);
+}
+
+#else
+
+/* without SSE4.2 the hardware kernels are the portable one */
+uint32_t crc32cHardware(uint32_t crc, const void *data, size_t length) {
+    return crc32cPortable(crc, data, length);
+}
+
+uint32_t crc32cHardware3Way(uint32_t crc, const void *data, size_t length) {
+    return crc32cPortable(crc, data, length);
+}
+
+#endif
+
+/**
+ * @brief multiplyModulo
+ *
+ * multiply two polynomials modulo the CRC polynomial, in the reflected
+ * bit order of the CRC
+ *
+ * \param a first factor
+ * \param b second factor
+ *
+ * \return uint32_t
+ * \retval a * b modulo the polynomial
+ *
+ */
+static uint32_t multiplyModulo(uint32_t a, uint32_t b) {
+    uint32_t product = 0;
+
+    for (uint32_t bit = 1U << 31; bit != 0; bit >>= 1) {
+        if (a & bit) product ^= b;
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLYNOMIAL : b >> 1;
+    }
+    return product;
+}
+
+/**
+ * @brief buildShiftTable
+ *
+ * tables of the operator that appends length zero bytes to a CRC register,
+ * a multiplication by x^(8 * length)
+ *
+ * \param table filled with the operator, applied to each byte of a register
+ * \param length number of zero bytes
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void buildShiftTable(uint32_t table[4][256], size_t length) {
+    /* x^0 is the top bit in reflected order, x^1 the one below */
+    uint32_t power = 1U << 31;
+    uint32_t square = 1U << 30;
+
+    for (size_t bits = 8 * length; bits > 0; bits >>= 1) {
+        if (bits & 1) power = multiplyModulo(power, square);
+        square = multiplyModulo(square, square);
+    }
+    for (int slice = 0; slice < 4; slice++) {
+        for (uint32_t byte = 0; byte < 256; byte++) {
+            table[slice][byte] = multiplyModulo(power, byte << (8 * slice));
+        }
+    }
+}
+
+#ifdef __x86_64__
+
+/**
+ * @brief shiftCrc
+ *
+ * \param table operator of buildShiftTable()
+ * \param crc CRC register
+ *
+ * \return uint32_t
+ * \retval the register after the zero bytes of the table
+ *
+ */
+static uint32_t shiftCrc(uint32_t table[4][256], uint32_t crc) {
+    return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+}
+
+#endif
@@ -0,0 +1,42 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_crc32c.h
+ * VCS - Tcp/Ip Exercise - CRC32C (Castagnoli) of file bodies, for the
+ * crc32c= trailer
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_CRC32C_H
+#define SIMPLE_MESSAGE_CRC32C_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+void initCrc32c(void);
+uint32_t crc32c(uint32_t crc, const void *data, size_t length);
+const char *crc32cKernel(void);
+
+/* the kernels crc32c() chooses from, for crc_bench */
+int crc32cHardwareSupported(void);
+uint32_t crc32cPortable(uint32_t crc, const void *data, size_t length);
+uint32_t crc32cHardware(uint32_t crc, const void *data, size_t length);
+uint32_t crc32cHardware3Way(uint32_t crc, const void *data, size_t length);
+
+#endif /* SIMPLE_MESSAGE_CRC32C_H */
@@ -0,0 +1,136 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_hash.c
+ * VCS - Tcp/Ip Exercise - content hash shared by client and logic
+ *
+ * The data is taken 8 bytes at a time, each word is mixed in with a
+ * multiply and a shift, which runs at several bytes per cycle instead of
+ * the one byte of hashes that work bytewise. Bytes short of a word are
+ * kept in the state, so a file gives the same hash however it is split
+ * into chunks. Not a cryptographic hash: it tells a changed file from an
+ * unchanged one, it does not stand up to someone forging a file.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <string.h>
+#include "simple_message_hash.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define HASH_SEED 0xcbf29ce484222325ULL
+#define HASH_PRIME 0x100000001b3ULL
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static uint64_t mixWord(uint64_t hash, uint64_t word);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief initContentHash
+ *
+ * \param state hash of no bytes afterwards
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void initContentHash(struct contentHash *state) {
+    state->hash = HASH_SEED;
+    state->tail = 0;
+    state->tailLength = 0;
+}
+
+/**
+ * @brief updateContentHash
+ *
+ * \param state hash of the preceding bytes
+ * \param data bytes to add
+ * \param length number of bytes
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void updateContentHash(struct contentHash *state, const void *data, size_t length) {
+    const unsigned char *byte = data;
+    uint64_t hash = state->hash;
+    uint64_t word;
+
+    /* complete the word of the last call first */
+    while (state->tailLength > 0 && length > 0) {
+        state->tail |= (uint64_t)*byte++ << (8 * state->tailLength);
+        length--;
+        if (++state->tailLength == sizeof(word)) {
+            hash = mixWord(hash, state->tail);
+            state->tail = 0;
+            state->tailLength = 0;
+        }
+    }
+
+    for (; length >= sizeof(word); byte += sizeof(word), length -= sizeof(word)) {
+        memcpy(&word, byte, sizeof(word));
+        hash = mixWord(hash, word);
+    }
+
+    for (; length > 0; length--) state->tail |= (uint64_t)*byte++ << (8 * state->tailLength++);
+    state->hash = hash;
+}
+
+/**
+ * @brief finishContentHash
+ *
+ * \param state hash of all bytes, unchanged
+ *
+ * \return uint64_t
+ * \retval the hash
+ *
+ */
+uint64_t finishContentHash(const struct contentHash *state) {
+    uint64_t hash = state->hash;
+
+    /* the length of the tail keeps "a" and "a\0" apart */
+    if (state->tailLength > 0) hash = mixWord(hash, state->tail);
+    hash = mixWord(hash, (uint64_t)state->tailLength);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/**
+ * @brief mixWord
+ *
+ * words are read in host order, hashes of hosts with different byte order
+ * do not match
+ *
+ * \param hash hash so far
+ * \param word next 8 bytes
+ *
+ * \return uint64_t
+ * \retval hash including word
+ *
+ */
+static uint64_t mixWord(uint64_t hash, uint64_t word) {
+    hash = (hash ^ word) * HASH_PRIME;
+    return hash ^ (hash >> 32);
+}
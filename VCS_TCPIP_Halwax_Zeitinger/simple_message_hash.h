@@ -0,0 +1,46 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_hash.h
+ * VCS - Tcp/Ip Exercise - content hash shared by client and logic for the
+ * have= and offset= extension
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_HASH_H
+#define SIMPLE_MESSAGE_HASH_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+struct contentHash {
+    uint64_t hash;
+    uint64_t tail;              /* bytes short of a word */
+    unsigned int tailLength;
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+void initContentHash(struct contentHash *state);
+void updateContentHash(struct contentHash *state, const void *data, size_t length);
+uint64_t finishContentHash(const struct contentHash *state);
+
+#endif /* SIMPLE_MESSAGE_HASH_H */
@@ -3,7 +3,8 @@
  * @file simple_message_server_cs.c
  * VCS - Tcp/Ip Exercise - server programm listens on a given port (command
  * argument '-p'), forks off new child processes on incoming tcp-connections and
- * starts the 'simple_message_server_logic'
+ * starts the 'simple_message_server_logic' - or, with '--engine=epoll|uring',
+ * serves all connections in one process through a request handler shared object
  *
  * @author Thomas Halwax <ic14b050@technikum-wien.at>
  * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
@@ -22,12 +23,18 @@
  * --------------------------------------------------------------- includes --
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #include <errno.h>
 #include <unistd.h>
@@ -38,41 +45,113 @@
 #include <errno.h>
 #include <limits.h>
 #include <signal.h>
+#include <sched.h>
+#include "simple_message_server.h"
+#include "simple_message_server_epoll.h"
+#include "simple_message_server_uring.h"
+#include "simple_message_server_prefork.h"
+#include "simple_message_server_pool.h"
+#include "simple_message_server_spawn.h"
+#include "simple_message_server_affinity.h"
+#include "simple_message_server_children.h"
+#include "simple_message_server_buffer.h"
+#include "simple_message_server_metrics.h"
+#include "simple_message_server_timeouts.h"
+#include "simple_message_timer.h"
 
 /*
  * ---------------------------------------------------------------- defines --
  */
 
-#define ERROR -1
-#define SUCCESS 0
-#define DONE 2
+/* default maximum length for the queue of pending connections, the kernel
+ caps it at net.core.somaxconn */
+#define BACKLOG_SIZE SOMAXCONN
 
-/* maximum length for the queue of pending connections */
-#define BACKLOG_SIZE 10
+/* pending TCP Fast Open requests accepted before the kernel falls back to
+ a regular handshake, see --fastopen */
+#define FASTOPEN_QUEUE_SIZE 256
+
+/* memory for buffered responses, see --buffer (MiB) */
+#define RESPONSE_BUFFER_SIZE 64
+
+/* events fetched by one epoll_wait() of the fork engine */
+#define MAX_EVENTS 64
+
+/* while accepting is paused, check the accept queue this often (ms) */
+#define SHED_CHECK_INTERVAL 10
 
 /* handling interaction with clients */
 #define PATH_TO_SERVER_LOGIC "/usr/local/bin/simple_message_server_logic"
 #define SERVER_LOGIC "simple_message_server_logic"
 
-#define INFO(function, M, ...) \
-	if (verbose) fprintf(stdout, "%s [%s, %s, line %d]: " M "\n", programName, __FILE__, function, __LINE__, ##__VA_ARGS__)
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+enum serverEngine {
+    ENGINE_FORK,    /* fork() and execl() the server logic per connection */
+    ENGINE_EPOLL,   /* single process event loop with an in-process handler */
+    ENGINE_URING    /* like ENGINE_EPOLL, but driven by io_uring */
+};
+
+struct serverOptions {
+    const char *tcpPort;
+    enum serverEngine engine;
+    const char *handlerPath;
+    int workers;                /* 0: no prefork, or WORKERS_AUTO */
+    const char *workersFile;
+    int poolSize;               /* 0: spawn per connection */
+    enum spawnStrategy spawnStrategy;
+    long deadline;              /* milliseconds, 0: none */
+    const char *accountingPath;
+    int maxInflight;            /* stop accepting at this many children, 0: no limit */
+    int shedQueue;              /* shed clients queued beyond this while paused, 0: never */
+    const char *adminSocket;    /* UNIX socket path or loopback port for metrics */
+    const char *logicPath;      /* NULL: PATH_TO_SERVER_LOGIC */
+    const char *tracePath;      /* record events to <path>.<pid>, NULL: off */
+    const char *unixPath;       /* also listen on this UNIX socket, @name: abstract, NULL: off */
+    long bufferSize;            /* MiB for responses buffered in the server, 0: no buffering */
+    cpu_set_t acceptorCpus;     /* empty: not placed */
+    cpu_set_t logicCpus;        /* empty: not placed */
+    int incomingCpu;            /* place by SO_INCOMING_CPU */
+    int numaLocal;              /* bind memory to the nodes of the CPUs */
+    int placing;                /* any of the above */
+};
+
+
+struct workerContext {
+    enum serverEngine engine;
+    const struct requestHandler *requestHandler;
+};
 
 /*
  * ---------------------------------------------------------------- globals --
  */
 
-static const char *programName;
-static int verbose = 0;
+const char *programName;
+int verbose = 0;
+int listenBacklog = BACKLOG_SIZE;
+int fastOpenQueue = 0;
+int unixListener = ERROR;
+long readTimeout = 0;
+long writeTimeout = 0;
+long idleTimeout = 0;
+
+/* program started for each client of the fork engine, see --logic */
+static const char *serverLogicPath = PATH_TO_SERVER_LOGIC;
+volatile sig_atomic_t shutdownRequested = 0;
 
 /*
  * ------------------------------------------------------------- prototypes --
  */
 
 void printUsage(void);
-void handleChildSignals(int signalNumber);
-void waitForClients(int listening_socket_descriptor);
-void startClientInteraction(int client_socket_descriptor);
-const char *getTcpPort(int argc, const char *argv[]);
+void waitForClients(int listening_socket_descriptor, const struct serverOptions *serverOptions);
+int acceptClients(int listening_socket_descriptor, const struct serverOptions *serverOptions);
+int shedClients(int listening_socket_descriptor, int shedQueue);
+int getServerOptions(int argc, const char *argv[], struct serverOptions *serverOptions);
+int serveAsWorker(int listening_socket_descriptor, int slot, void *context);
+int runEventEngine(enum serverEngine engine, int listening_socket_descriptor, const struct requestHandler *requestHandler);
 
 /*
  * -------------------------------------------------------------- functions --
@@ -100,13 +179,92 @@ int main(int argc, const char * argv[]) {
         exit(EXIT_FAILURE);
     }
     
-    const char *tcpPort = getTcpPort(argc, argv);
-    if (tcpPort == NULL) {
+    struct serverOptions serverOptions;
+    if (getServerOptions(argc, argv, &serverOptions) != SUCCESS) {
+        exit(EXIT_FAILURE);
+    }
+    const char *tcpPort = serverOptions.tcpPort;
+
+    struct requestHandler requestHandler = { NULL, NULL };
+    if (serverOptions.engine != ENGINE_FORK && loadRequestHandler(serverOptions.handlerPath, &requestHandler) != SUCCESS) {
         exit(EXIT_FAILURE);
     }
     
     INFO("main()", "using tcp port %s", tcpPort);
+
+    /* workers and pooled processes forked later trace to files of their own */
+    if (serverOptions.tracePath != NULL && startTrace(serverOptions.tracePath, programName) != SUCCESS) {
+        fprintf(stderr, "%s: can not trace to %s: %s\n", programName, serverOptions.tracePath, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    /* before any fork(), workers and children share the counters */
+    if (initMetrics() != SUCCESS || startMetricsThread(serverOptions.adminSocket) != SUCCESS) {
+        exit(EXIT_FAILURE);
+    }
+
+    /* before any fork(), so pooled processes and workers are placed too */
+    if (serverOptions.placing && startPlacement(&serverOptions.acceptorCpus, &serverOptions.logicCpus, serverOptions.incomingCpu, serverOptions.numaLocal) != SUCCESS) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (serverOptions.workers != 0) {
+        /* the workers share it, and the kernel hands each client to one of them */
+        if (serverOptions.unixPath != NULL && (unixListener = createUnixListeningSocket(serverOptions.unixPath)) == ERROR) {
+            exit(EXIT_FAILURE);
+        }
+        struct workerContext workerContext = { serverOptions.engine, &requestHandler };
+        int result = runPreforkedWorkers(tcpPort, serverOptions.workers, serverOptions.workersFile, serveAsWorker, &workerContext);
+        unloadRequestHandler(&requestHandler);
+        exit(result == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    /* before the listener exists, so the pool does not inherit it */
+    if (serverOptions.poolSize > 0 && startLogicPool(serverOptions.poolSize) != SUCCESS) {
+        exit(EXIT_FAILURE);
+    }
+
+    int listening_socket_descriptor = createListeningSocket(tcpPort, 0, 1);
+    if (listening_socket_descriptor == ERROR) {
+        exit(EXIT_FAILURE);
+    }
+    if (serverOptions.unixPath != NULL && (unixListener = createUnixListeningSocket(serverOptions.unixPath)) == ERROR) {
+        close(listening_socket_descriptor);
+        exit(EXIT_FAILURE);
+    }
+    if (placeAcceptor(ERROR, listening_socket_descriptor) != SUCCESS) {
+        close(listening_socket_descriptor);
+        exit(EXIT_FAILURE);
+    }
     
+    if (serverOptions.engine != ENGINE_FORK) {
+        runEventEngine(serverOptions.engine, listening_socket_descriptor, &requestHandler);
+        unloadRequestHandler(&requestHandler);
+        close(listening_socket_descriptor);
+        exit(EXIT_FAILURE);
+    }
+
+    waitForClients(listening_socket_descriptor, &serverOptions);
+
+    /* not needed, here for convention */
+    exit(EXIT_SUCCESS);
+}
+
+/**
+ * @brief createListeningSocket
+ *
+ * bind a tcp socket to the given port and start listening on it
+ *
+ * \param tcpPort port (or service name) to bind to
+ * \param reusePort set SO_REUSEPORT, so several processes may bind the port
+ * \param startListening if 0 the socket is only bound
+ *
+ * \return int
+ * \retval socket descriptor on Success
+ * \retval ERROR on Error
+ *
+ */
+int createListeningSocket(const char *tcpPort, int reusePort, int startListening) {
     struct addrinfo *addrInfoResult, hints;
     memset(&hints, 0, sizeof(hints));
     
@@ -118,10 +276,10 @@ int main(int argc, const char * argv[]) {
     if ((result = getaddrinfo(NULL, tcpPort, &hints, &addrInfoResult)) != SUCCESS)
     {
         fprintf(stderr, "%s: getaddrinfo(): %s\n", programName, gai_strerror(result));
-        exit(EXIT_FAILURE);
+        return ERROR;
     }
     
-    INFO("main()", "getaddrinfo succeeded %s", "");
+    INFO("createListeningSocket()", "getaddrinfo succeeded %s", "");
     
     int listening_socket_descriptor = 0;
     struct addrinfo *serverCandidate;
@@ -133,7 +291,7 @@ int main(int argc, const char * argv[]) {
                        serverCandidate->ai_socktype, serverCandidate->ai_protocol);
         
         if (listening_socket_descriptor == ERROR) {
-            INFO("main()", "failed creating a socket for %d, %d, %d", serverCandidate->ai_family, serverCandidate->ai_socktype, serverCandidate->ai_protocol);
+            INFO("createListeningSocket()", "failed creating a socket for %d, %d, %d", serverCandidate->ai_family, serverCandidate->ai_socktype, serverCandidate->ai_protocol);
             continue;
         }
         
@@ -143,16 +301,25 @@ int main(int argc, const char * argv[]) {
          The Linux Programming Interface , p1280
          */
         if (setsockopt(listening_socket_descriptor, SOL_SOCKET, SO_REUSEADDR, &optionValue, sizeof(int)) == ERROR) {
-            fprintf(stderr, "%s: getaddrinfo(): %s\n", programName, gai_strerror(result));
-            freeaddrinfo(serverCandidate);
+            fprintf(stderr, "%s: setsockopt(SO_REUSEADDR): %s\n", programName, strerror(errno));
             freeaddrinfo(addrInfoResult);
             close(listening_socket_descriptor);
-            exit(EXIT_FAILURE);
+            return ERROR;
+        }
+
+        /* every preforked worker binds its own socket to the same port, the
+         kernel then load balances new connections across their accept queues */
+        if (reusePort && setsockopt(listening_socket_descriptor, SOL_SOCKET, SO_REUSEPORT, &optionValue, sizeof(int)) == ERROR) {
+            fprintf(stderr, "%s: setsockopt(SO_REUSEPORT): %s\n", programName, strerror(errno));
+            freeaddrinfo(addrInfoResult);
+            close(listening_socket_descriptor);
+            return ERROR;
         }
         
         if (bind(listening_socket_descriptor, serverCandidate->ai_addr, serverCandidate->ai_addrlen) == ERROR) {
             /* could not bind, try next addrInfo */
-            INFO("main()", "failed to bind %s", "");
+            INFO("createListeningSocket()", "failed to bind %s", "");
+            close(listening_socket_descriptor);
             continue;
         }
         
@@ -161,111 +328,399 @@ int main(int argc, const char * argv[]) {
         break;
     }
 
-    INFO("main()", "freeing addrInfoResult %s", "");
+    INFO("createListeningSocket()", "freeing addrInfoResult %s", "");
     freeaddrinfo(addrInfoResult);
     
     if (serverCandidate == NULL) {
         fprintf(stderr, "%s: failed to bind: %s\n", programName, strerror(errno));
+        return ERROR;
+    }
+
+    if (!startListening) {
+        return listening_socket_descriptor;
+    }
+
+    /* the request of a client with a cookie arrives with its SYN, so the
+     connection is readable as soon as it is accepted */
+    if (fastOpenQueue > 0 && setsockopt(listening_socket_descriptor, IPPROTO_TCP, TCP_FASTOPEN, &fastOpenQueue, sizeof(fastOpenQueue)) == ERROR) {
+        fprintf(stderr, "%s: setsockopt(TCP_FASTOPEN): %s\n", programName, strerror(errno));
         close(listening_socket_descriptor);
-        exit(EXIT_FAILURE);
+        return ERROR;
     }
 
-    INFO("main()", "start listening %s", "");
+    INFO("createListeningSocket()", "start listening %s", "");
     
-    if (listen(listening_socket_descriptor, BACKLOG_SIZE) == ERROR) {
+    if (listen(listening_socket_descriptor, listenBacklog) == ERROR) {
         fprintf(stderr, "%s: failed to listen: %s\n", programName, strerror(errno));
         close(listening_socket_descriptor);
-        exit(EXIT_FAILURE);
+        return ERROR;
     }
-    
-    INFO("main()", "attaching signal handler %s", "");
-    struct sigaction onSignalAction;
-    memset(&onSignalAction, 0, sizeof(onSignalAction));
-    
-    onSignalAction.sa_handler = handleChildSignals;
-    onSignalAction.sa_flags = SA_RESTART;
-    
-    /* register handler for SIGCHLD: child status has changed */
-    if (sigaction(SIGCHLD, &onSignalAction, NULL) == ERROR) {
-        fprintf(stderr, "%s: failed to create signal handler: %s\n", programName, strerror(errno));
-        close(listening_socket_descriptor);
-        exit(EXIT_FAILURE);
+
+    return listening_socket_descriptor;
+}
+
+/**
+ * @brief createUnixListeningSocket
+ *
+ * bind a UNIX stream socket for clients on this host and start listening
+ * on it, they connect with the server address unix:<path>
+ *
+ * \param path file system path, or @name for a socket in the abstract
+ * namespace, which needs no cleanup
+ *
+ * \return int
+ * \retval socket descriptor on Success
+ * \retval ERROR on Error
+ *
+ */
+int createUnixListeningSocket(const char *path) {
+    struct sockaddr_un address;
+    struct stat status;
+    size_t length = strlen(path);
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (length >= sizeof(address.sun_path)) {
+        fprintf(stderr, "%s: UNIX socket path %s is too long\n", programName, path);
+        return ERROR;
+    }
+    memcpy(address.sun_path, path, length);
+    socklen_t addressLength = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + length);
+    if (path[0] == '@') {
+        address.sun_path[0] = '\0';
+    }
+    else {
+        addressLength++;
+        /* a socket left over by an earlier run, but nothing else */
+        if (lstat(path, &status) == SUCCESS && S_ISSOCK(status.st_mode)) unlink(path);
     }
-    
-    waitForClients(listening_socket_descriptor);
 
-    /* not needed, here for convention */
-    exit(EXIT_SUCCESS);
+    /* close-on-exec, so no server logic inherits it */
+    int listening = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listening == ERROR
+        || bind(listening, (struct sockaddr *)&address, addressLength) == ERROR
+        || listen(listening, listenBacklog) == ERROR) {
+        fprintf(stderr, "%s: can not listen on UNIX socket %s: %s\n", programName, path, strerror(errno));
+        if (listening != ERROR) close(listening);
+        return ERROR;
+    }
+
+    INFO("createUnixListeningSocket()", "listening on UNIX socket %s", path);
+    return listening;
+}
+
+/**
+ * @brief serveAsWorker
+ *
+ * body of a preforked worker: run the event driven engine on the worker's
+ * own SO_REUSEPORT listening socket, on the acceptor CPU of its slot
+ *
+ * \param listening_socket_descriptor listening socket of this worker
+ * \param slot number of the worker, see placeAcceptor()
+ * \param context the struct workerContext
+ *
+ * \return int
+ * \retval SUCCESS after a graceful shutdown
+ * \retval ERROR on Error
+ *
+ */
+int serveAsWorker(int listening_socket_descriptor, int slot, void *context) {
+    const struct workerContext *workerContext = context;
+
+    if (placeAcceptor(slot, listening_socket_descriptor) != SUCCESS) return ERROR;
+    return runEventEngine(workerContext->engine, listening_socket_descriptor, workerContext->requestHandler);
+}
+
+/**
+ * @brief runEventEngine
+ *
+ * run engine 'epoll' or 'uring', the latter falls back to 'epoll' if the
+ * kernel does not support it
+ *
+ * \param engine ENGINE_EPOLL or ENGINE_URING
+ * \param listening_socket_descriptor listening socket descriptor
+ * \param requestHandler handler producing the responses
+ *
+ * \return int
+ * \retval SUCCESS after a graceful shutdown
+ * \retval ERROR on Error
+ *
+ */
+int runEventEngine(enum serverEngine engine, int listening_socket_descriptor, const struct requestHandler *requestHandler) {
+    if (engine == ENGINE_URING) {
+        int result = runUringEngine(listening_socket_descriptor, requestHandler);
+        if (result != URING_UNAVAILABLE) {
+            return result;
+        }
+        fprintf(stderr, "%s: io_uring not available, falling back to engine epoll\n", programName);
+    }
+
+    return runEpollEngine(listening_socket_descriptor, requestHandler);
 }
 
 /**
  * @brief waitForClients
  *
- * Signal handling connections to client
+ * event loop of the fork engine: accepts clients, starts the server logic
+ * for each of them and supervises the children
  *
  * \param listening_socket_descriptor listening socket descriptor
+ * \param serverOptions spawn strategy, deadline and accounting log
  *
  * \return void
  * \retval void
  *
  */
-void waitForClients(int listening_socket_descriptor) {
-    int client;
-    socklen_t addressSize;
-    struct sockaddr_storage clientAddress;
+void waitForClients(int listening_socket_descriptor, const struct serverOptions *serverOptions) {
+    /* deadlines of the children and timeouts of their clients */
+    static struct timerWheel timers;
+
+    initTimerWheel(&timers);
+    int epollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    if (epollDescriptor == ERROR) {
+        fprintf(stderr, "%s: epoll_create1() failed: %s\n", programName, strerror(errno));
+        close(listening_socket_descriptor);
+        exit(EXIT_FAILURE);
+    }
+
+    if (startChildSupervision(epollDescriptor, &timers, serverOptions->deadline, serverOptions->accountingPath) != SUCCESS) {
+        close(listening_socket_descriptor);
+        exit(EXIT_FAILURE);
+    }
+
+    if (serverOptions->bufferSize > 0 && startResponseBuffering(epollDescriptor, &timers, (size_t)serverOptions->bufferSize * 1024 * 1024) != SUCCESS) {
+        close(listening_socket_descriptor);
+        exit(EXIT_FAILURE);
+    }
+
+    /* the tcp listening socket is the only entry without a tag, the UNIX one is tagged with &unixListener */
+    if (watchListeners(epollDescriptor, listening_socket_descriptor, EPOLL_CTL_ADD, 0) != SUCCESS) {
+        fprintf(stderr, "%s: failed to watch listening socket: %s\n", programName, strerror(errno));
+        close(listening_socket_descriptor);
+        exit(EXIT_FAILURE);
+    }
 
     INFO("waitForClients()", "waiting for client connections %s", "");
+    struct epoll_event events[MAX_EVENTS];
+    int paused = 0;
     while (1 == 1) {
-        addressSize = sizeof(clientAddress);
-        client = accept(listening_socket_descriptor, (struct sockaddr *)&clientAddress, &addressSize);
-        INFO("waitForClients()", "accepted client %s", "");
-        if (client < SUCCESS) {
-            if (errno != EINTR) {
-                fprintf(stderr, "%s: failed to accept client: %s\n", programName, strerror(errno));
+        int timeout = timeToNextTimer(&timers);
+        if (paused && serverOptions->shedQueue > 0 && (timeout == ERROR || timeout > SHED_CHECK_INTERVAL)) {
+            timeout = SHED_CHECK_INTERVAL;
+        }
+
+        int ready = epoll_wait(epollDescriptor, events, MAX_EVENTS, timeout);
+        if (ready == ERROR && errno != EINTR) {
+            fprintf(stderr, "%s: epoll_wait() failed: %s\n", programName, strerror(errno));
+            close(listening_socket_descriptor);
+            exit(EXIT_FAILURE);
+        }
+        updateTimerClock(&timers);
+
+        for (int i = 0; i < ready; i++) {
+            if (events[i].data.ptr == &unixListener) {
+                if (acceptClients(unixListener, serverOptions) != SUCCESS) {
+                    close(listening_socket_descriptor);
+                    exit(EXIT_FAILURE);
+                }
+            }
+            else if (events[i].data.ptr == &responseBuffers) {
+                handleResponseBuffers();
+            }
+            else if (events[i].data.ptr != NULL) {
+                handleChildEvent(events[i].data.ptr, events[i].events);
+            }
+            else if (acceptClients(listening_socket_descriptor, serverOptions) != SUCCESS) {
                 close(listening_socket_descriptor);
                 exit(EXIT_FAILURE);
             }
-            else {
-                /* handle next one, we've been interrupted by a signal */
-                INFO("waitForClients()", "interrupted by signal %s", "");
-                continue;
-            }
         }
-        
-        INFO("waitForClients()", "forking %s", "");
-        switch (fork()) {
-            case ERROR: {
-                fprintf(stderr, "%s: failed to fork: %s\n", programName, strerror(errno));
-                close(client);
+
+        /* children killed here are reaped like any other one */
+        advanceTimers(&timers);
+        freeReapedChildren();
+
+        /* soft watermark: leave further clients in the kernel's accept queue */
+        int inflight = supervisedChildren();
+        if (serverOptions->maxInflight > 0 && paused != (inflight >= serverOptions->maxInflight)) {
+            paused = !paused;
+            INFO("waitForClients()", "%s accepting with %d children", paused ? "pause" : "resume", inflight);
+            if (paused) countMetric(METRIC_PAUSES, 1);
+            if (watchListeners(epollDescriptor, listening_socket_descriptor, paused ? EPOLL_CTL_DEL : EPOLL_CTL_ADD, 0) != SUCCESS) {
+                fprintf(stderr, "%s: failed to %s listening socket: %s\n", programName, paused ? "pause" : "resume", strerror(errno));
                 close(listening_socket_descriptor);
                 exit(EXIT_FAILURE);
             }
-            /* child process */
-            case SUCCESS:
-                if (close(listening_socket_descriptor) != SUCCESS) {
-                    fprintf(stderr, "%s: failed to close listening fd: %s\n", programName, strerror(errno));
-                    close(client);
-                    exit(EXIT_FAILURE);
-                }
-                startClientInteraction(client);
-                break;
-            /* parent process */
-            default: {
-                if (close(client) != SUCCESS) {
-                    fprintf(stderr, "%s: failed to close client fd: %s\n", programName, strerror(errno));
-                    close(listening_socket_descriptor);
-                    exit(EXIT_FAILURE);
-                }
-                break;
+        }
+
+        /* hard watermark: turn away what queues up beyond it */
+        /* only tcp tells the length of its accept queue, UNIX clients just wait */
+        if (paused && serverOptions->shedQueue > 0) {
+            shedClients(listening_socket_descriptor, serverOptions->shedQueue);
+        }
+    }
+}
+
+/**
+ * @brief watchListeners
+ *
+ * add the listening sockets to, or remove them from, an epoll instance,
+ * the tcp one with a NULL tag and the UNIX one, if any, tagged with
+ * &unixListener; adding makes them non-blocking
+ *
+ * \param epollDescriptor epoll instance
+ * \param listening_socket_descriptor tcp listening socket
+ * \param operation EPOLL_CTL_ADD or EPOLL_CTL_DEL
+ * \param extraEvents added to EPOLLIN, e.g. EPOLLEXCLUSIVE
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+int watchListeners(int epollDescriptor, int listening_socket_descriptor, int operation, uint32_t extraEvents) {
+    int listeners[2] = { listening_socket_descriptor, unixListener };
+
+    for (int i = 0; i < 2 && listeners[i] != ERROR; i++) {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | extraEvents;
+        event.data.ptr = i == 0 ? NULL : &unixListener;
+
+        if (operation == EPOLL_CTL_ADD) {
+            int flags = fcntl(listeners[i], F_GETFL);
+            if (flags == ERROR || fcntl(listeners[i], F_SETFL, flags | O_NONBLOCK) == ERROR) return ERROR;
+        }
+        if (epoll_ctl(epollDescriptor, operation, listeners[i], &event) == ERROR) return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief acceptClients
+ *
+ * accept pending clients, up to the in-flight limit, and hand each to the
+ * pool or a new child
+ *
+ * \param listening_socket_descriptor non-blocking listening socket
+ * \param serverOptions spawn strategy and in-flight limit
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+int acceptClients(int listening_socket_descriptor, const struct serverOptions *serverOptions) {
+    enum spawnStrategy spawnStrategy = serverOptions->spawnStrategy;
+
+    while (serverOptions->maxInflight == 0 || supervisedChildren() < serverOptions->maxInflight) {
+        /* close-on-exec, so no child inherits the client of another one */
+        int client = accept4(listening_socket_descriptor, NULL, NULL, SOCK_CLOEXEC);
+        if (client == ERROR) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return SUCCESS;
+            /* the client has gone before we accepted it, or we've been interrupted by a signal */
+            if (errno == ECONNABORTED || errno == EINTR) continue;
+            fprintf(stderr, "%s: failed to accept client: %s\n", programName, strerror(errno));
+            return ERROR;
+        }
+        uint64_t acceptedAt = metricsClock();
+        TRACE(TRACE_ACCEPT, TRACE_INSTANT, (uint64_t)client, 0);
+        INFO("acceptClients()", "accepted client %s", "");
+        countMetric(METRIC_ACCEPTED, 1);
+
+        if (handOverToPool(client) == SUCCESS) {
+            recordLatency(METRIC_ACCEPT_TO_START, metricsClock() - acceptedAt);
+            if (close(client) != SUCCESS) {
+                fprintf(stderr, "%s: failed to close client fd: %s\n", programName, strerror(errno));
+                return ERROR;
             }
+            continue;
         }
+
+        /* a buffered response takes over the client, the child writes into its pipe */
+        int output = client;
+        if (responseBuffers != ERROR) {
+            if ((output = bufferResponse(client, acceptedAt)) == ERROR) {
+                countMetric(METRIC_ERRORS, 1);
+                close(client);
+                continue;
+            }
+        }
+        else {
+            watchFirstByte(client);
+        }
+
+        INFO("acceptClients()", "spawning %s with %s", SERVER_LOGIC, spawnStrategyName(spawnStrategy));
+        TRACE(TRACE_SPAWN, TRACE_BEGIN, (uint64_t)client, 0);
+        pid_t pid = spawnClientProgram(spawnStrategy, client, output, listening_socket_descriptor, serverLogicPath, SERVER_LOGIC, placeLogic(client));
+        int error = errno;
+        TRACE(TRACE_SPAWN, TRACE_END, (uint64_t)client, (uint64_t)pid);
+        /* the response ends, possibly empty, once the child has exited */
+        if (output != client) close(output);
+        if (pid == ERROR) {
+            /* this client is lost, the next one may succeed */
+            fprintf(stderr, "%s: failed to start %s: %s\n", programName, SERVER_LOGIC, strerror(error));
+            countMetric(METRIC_ERRORS, 1);
+            if (output == client) close(client);
+            continue;
+        }
+        recordLatency(METRIC_ACCEPT_TO_START, metricsClock() - acceptedAt);
+
+        /* the supervision keeps our descriptor of the client until the child is reaped */
+        TRACE(TRACE_CHILD, TRACE_BEGIN, (uint64_t)pid, 0);
+        superviseChild(pid, output == client ? client : ERROR, acceptedAt);
     }
+    return SUCCESS;
+}
+
+/**
+ * @brief shedClients
+ *
+ * answer clients queued beyond shedQueue with status=STATUS_BUSY right
+ * away, without starting anything for them
+ *
+ * \param listening_socket_descriptor non-blocking listening socket
+ * \param shedQueue number of clients left waiting in the accept queue
+ *
+ * \return int
+ * \retval number of clients shed
+ *
+ */
+int shedClients(int listening_socket_descriptor, int shedQueue) {
+    static const char busy[] = "status=" STATUS_BUSY_STRING "\n";
+    struct tcp_info info;
+    socklen_t size = sizeof(info);
+
+    /* for a listening socket tcpi_unacked is the length of the accept queue */
+    if (getsockopt(listening_socket_descriptor, IPPROTO_TCP, TCP_INFO, &info, &size) == ERROR) return 0;
+
+    int shed = 0;
+    for (int excess = (int)info.tcpi_unacked - shedQueue; excess > 0; excess--) {
+        int client = accept4(listening_socket_descriptor, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (client == ERROR) {
+            if (errno == ECONNABORTED || errno == EINTR) continue;
+            break;
+        }
+
+        /* drop what has arrived of the request, so close() sends no RST */
+        char discard[1024];
+        while (recv(client, discard, sizeof(discard), MSG_DONTWAIT) > 0) {
+        }
+        if (send(client, busy, sizeof(busy) - 1, MSG_DONTWAIT | MSG_NOSIGNAL) == ERROR) {
+            INFO("shedClients()", "could not tell client: %s", strerror(errno));
+        }
+        close(client);
+        countMetric(METRIC_SHED, 1);
+        shed++;
+    }
+    if (shed > 0) INFO("shedClients()", "shed %d clients", shed);
+    return shed;
 }
 
 /**
  * @brief startClientInteraction
  *
- * Using external SERVER_LOGIC
+ * Using external SERVER_LOGIC (serverLogicPath)
  *
  * \param client client talking to the server
  *
@@ -286,73 +741,297 @@ void startClientInteraction(int client) {
         exit(EXIT_FAILURE);
     }
     
-    (void)execl(PATH_TO_SERVER_LOGIC, SERVER_LOGIC, (char *)NULL);
+    (void)execl(serverLogicPath, SERVER_LOGIC, (char *)NULL);
     
     /* if execl fails */
     _exit(127);
 }
 
 /**
- * @brief handleChildSignals
- *
- * Signal handling connections to client
- *
- * \param signum signalnumber is not used
- *
- * \return void
- * \retval void
- *
- */
-void handleChildSignals(int signalNumber)
-{
-    int status;
-    pid_t pid;
-    
-    /* get rid of compiler warnings */
-    signalNumber = signalNumber;
-  
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-        /* do something very clever while waiting for process to exit :-) */
-    }
-}
-
-/**
- * @brief getTcpPort
+ * @brief getServerOptions
  *
- * Signal handling connections to client
+ * parse the command line
  *
  * \param argc the number of arguments
  * \param argv the arguments itselves (including the program name in argv[0])
+ * \param serverOptions filled with the parsed options
  *
- * \return void
- * \retval void
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
  *
  */
-const char *getTcpPort(int argc, const char *argv[]) {
+int getServerOptions(int argc, const char *argv[], struct serverOptions *serverOptions) {
     
     static struct option options[] = {
         {"port", required_argument, 0, 'p'},
+        {"engine", required_argument, 0, 'e'},
+        {"handler", required_argument, 0, 'H'},
+        {"workers", optional_argument, 0, 'w'},
+        {"workers-file", required_argument, 0, 'W'},
+        {"pool", required_argument, 0, 'P'},
+        {"spawn", required_argument, 0, 'S'},
+        {"deadline", required_argument, 0, 'D'},
+        {"accounting", required_argument, 0, 'A'},
+        {"backlog", required_argument, 0, 'b'},
+        {"max-inflight", required_argument, 0, 'm'},
+        {"shed-queue", required_argument, 0, 'q'},
+        {"admin", required_argument, 0, 'a'},
+        {"logic", required_argument, 0, 'L'},
+        {"fastopen", optional_argument, 0, 'F'},
+        {"trace", required_argument, 0, 'T'},
+        {"unix", required_argument, 0, 'U'},
+        {"buffer", optional_argument, 0, 'B'},
+        {"read-timeout", required_argument, 0, 'r'},
+        {"write-timeout", required_argument, 0, 's'},
+        {"idle-timeout", required_argument, 0, 'i'},
+        {"acceptor-cpus", required_argument, 0, 'c'},
+        {"logic-cpus", required_argument, 0, 'C'},
+        {"incoming-cpu", no_argument, 0, 'I'},
+        {"numa-local", no_argument, 0, 'N'},
+        {"verbose", no_argument, 0, 'v'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
     
-    char *tcpPort = NULL;
     int option = 0;
     int index =0;
     
-    while ((option = getopt_long(argc, (char ** const) argv, "p:h", options, &index)) != ERROR) {
-        INFO("getTcpPort()", "parsing option %c with argument %s", option, optarg);
+    memset(serverOptions, 0, sizeof(*serverOptions));
+    serverOptions->engine = ENGINE_FORK;
+
+    while ((option = getopt_long(argc, (char ** const) argv, "p:e:H:w::W:P:S:D:A:b:m:q:a:L:F::T:U:B::r:s:i:c:C:INvh", options, &index)) != ERROR) {
+        INFO("getServerOptions()", "parsing option %c with argument %s", option, optarg);
         switch(option) {
             case 'p':
-                tcpPort = optarg;
+                serverOptions->tcpPort = optarg;
+                break;
+            case 'e':
+                if (strcmp(optarg, "fork") == 0) {
+                    serverOptions->engine = ENGINE_FORK;
+                }
+                else if (strcmp(optarg, "epoll") == 0) {
+                    serverOptions->engine = ENGINE_EPOLL;
+                }
+                else if (strcmp(optarg, "uring") == 0) {
+                    serverOptions->engine = ENGINE_URING;
+                }
+                else {
+                    fprintf(stderr, "%s: unknown engine %s\n", programName, optarg);
+                    printUsage();
+                    return ERROR;
+                }
+                break;
+            case 'H':
+                serverOptions->handlerPath = optarg;
+                break;
+            case 'w':
+                if (optarg == NULL || strcmp(optarg, "auto") == 0) {
+                    serverOptions->workers = WORKERS_AUTO;
+                }
+                else if ((serverOptions->workers = atoi(optarg)) <= 0) {
+                    fprintf(stderr, "%s: invalid number of workers %s\n", programName, optarg);
+                    printUsage();
+                    return ERROR;
+                }
+                break;
+            case 'W':
+                serverOptions->workersFile = optarg;
+                if (serverOptions->workers == 0) serverOptions->workers = WORKERS_AUTO;
+                break;
+            case 'P':
+                if ((serverOptions->poolSize = atoi(optarg)) <= 0) {
+                    fprintf(stderr, "%s: invalid pool size %s\n", programName, optarg);
+                    printUsage();
+                    return ERROR;
+                }
+                break;
+            case 'S':
+                if (parseSpawnStrategy(optarg, &serverOptions->spawnStrategy) != SUCCESS) {
+                    fprintf(stderr, "%s: unknown spawn strategy %s\n", programName, optarg);
+                    printUsage();
+                    return ERROR;
+                }
+                break;
+            case 'D':
+                if ((serverOptions->deadline = atol(optarg)) <= 0) {
+                    fprintf(stderr, "%s: invalid deadline %s\n", programName, optarg);
+                    printUsage();
+                    return ERROR;
+                }
+                break;
+            case 'A':
+                serverOptions->accountingPath = optarg;
+                break;
+            case 'b':
+                if ((listenBacklog = atoi(optarg)) <= 0) {
+                    fprintf(stderr, "%s: invalid backlog %s\n", programName, optarg);
+                    printUsage();
+                    return ERROR;
+                }
+                break;
+            case 'm':
+                if ((serverOptions->maxInflight = atoi(optarg)) <= 0) {
+                    fprintf(stderr, "%s: invalid in-flight limit %s\n", programName, optarg);
+                    printUsage();
+                    return ERROR;
+                }
+                break;
+            case 'q':
+                if ((serverOptions->shedQueue = atoi(optarg)) <= 0) {
+                    fprintf(stderr, "%s: invalid shed queue length %s\n", programName, optarg);
+                    printUsage();
+                    return ERROR;
+                }
+                break;
+            case 'a':
+                serverOptions->adminSocket = optarg;
+                break;
+            case 'L':
+                serverOptions->logicPath = optarg;
+                break;
+            case 'T':
+                serverOptions->tracePath = optarg;
+                break;
+            case 'U':
+                serverOptions->unixPath = optarg;
+                break;
+            case 'B':
+                if (optarg == NULL) {
+                    serverOptions->bufferSize = RESPONSE_BUFFER_SIZE;
+                }
+                else if ((serverOptions->bufferSize = atol(optarg)) <= 0) {
+                    fprintf(stderr, "%s: invalid response buffer size %s\n", programName, optarg);
+                    printUsage();
+                    return ERROR;
+                }
+                break;
+            case 'r':
+            case 's':
+            case 'i': {
+                long milliseconds = atol(optarg);
+                if (milliseconds <= 0) {
+                    fprintf(stderr, "%s: invalid timeout %s\n", programName, optarg);
+                    printUsage();
+                    return ERROR;
+                }
+                if (option == 'r') readTimeout = milliseconds;
+                else if (option == 's') writeTimeout = milliseconds;
+                else idleTimeout = milliseconds;
+                break;
+            }
+            case 'c':
+            case 'C':
+                if (parseCpuList(optarg, option == 'c' ? &serverOptions->acceptorCpus : &serverOptions->logicCpus) != SUCCESS) {
+                    fprintf(stderr, "%s: invalid cpu list %s\n", programName, optarg);
+                    printUsage();
+                    return ERROR;
+                }
+                serverOptions->placing = 1;
+                break;
+            case 'I':
+                serverOptions->incomingCpu = 1;
+                serverOptions->placing = 1;
+                break;
+            case 'N':
+                serverOptions->numaLocal = 1;
+                serverOptions->placing = 1;
+                break;
+            case 'F':
+                if (optarg == NULL) {
+                    fastOpenQueue = FASTOPEN_QUEUE_SIZE;
+                }
+                else if ((fastOpenQueue = atoi(optarg)) <= 0) {
+                    fprintf(stderr, "%s: invalid fast open queue length %s\n", programName, optarg);
+                    printUsage();
+                    return ERROR;
+                }
+                break;
+            case 'v':
+                verbose = 1;
                 break;
             default:
                 printUsage();
-                return NULL;
+                return ERROR;
         }
     }
     
-    return tcpPort;
+    if (serverOptions->tcpPort == NULL) {
+        printUsage();
+        return ERROR;
+    }
+
+    if (serverOptions->engine != ENGINE_FORK && serverOptions->handlerPath == NULL) {
+        fprintf(stderr, "%s: engines epoll and uring need a request handler (--handler)\n", programName);
+        return ERROR;
+    }
+
+    /* a worker serves many connections, which the fork engine can not do */
+    if (serverOptions->workers != 0 && serverOptions->engine == ENGINE_FORK) {
+        fprintf(stderr, "%s: --workers needs an event driven engine (--engine=epoll|uring)\n", programName);
+        return ERROR;
+    }
+
+    if ((serverOptions->poolSize != 0 || serverOptions->deadline != 0 || serverOptions->accountingPath != NULL
+         || serverOptions->maxInflight != 0 || serverOptions->shedQueue != 0 || serverOptions->logicPath != NULL
+         || serverOptions->bufferSize != 0 || CPU_COUNT(&serverOptions->logicCpus) != 0)
+        && serverOptions->engine != ENGINE_FORK) {
+        fprintf(stderr, "%s: --pool, --deadline, --accounting, --max-inflight, --shed-queue, --logic, --buffer and --logic-cpus only apply to the fork engine\n", programName);
+        return ERROR;
+    }
+
+    /* pooled processes run before their client is known, an event engine
+     follows the incoming CPU only with a listener per CPU */
+    if (serverOptions->incomingCpu && (serverOptions->engine == ENGINE_FORK ? serverOptions->poolSize != 0 : serverOptions->workers == 0)) {
+        fprintf(stderr, "%s: --incoming-cpu needs the fork engine without --pool, or --workers\n", programName);
+        return ERROR;
+    }
+    /* the program already runs when posix_spawn() returns */
+    if (serverOptions->numaLocal && serverOptions->spawnStrategy == SPAWN_POSIX_SPAWN) {
+        fprintf(stderr, "%s: --numa-local can not be combined with --spawn=posix_spawn\n", programName);
+        return ERROR;
+    }
+
+    /* pooled processes get the client itself as stdout */
+    if (serverOptions->bufferSize != 0 && serverOptions->poolSize != 0) {
+        fprintf(stderr, "%s: --buffer can not be combined with --pool\n", programName);
+        return ERROR;
+    }
+
+    /* pooled processes take the client out of our sight, without --buffer
+     the fork engine only sees when the request is complete */
+    if (serverOptions->engine == ENGINE_FORK && serverOptions->poolSize != 0 && timeoutsEnabled()) {
+        fprintf(stderr, "%s: --read-timeout, --write-timeout and --idle-timeout can not be combined with --pool\n", programName);
+        return ERROR;
+    }
+    if (serverOptions->engine == ENGINE_FORK && serverOptions->bufferSize == 0 && (writeTimeout != 0 || idleTimeout != 0)) {
+        fprintf(stderr, "%s: --write-timeout and --idle-timeout need --buffer with the fork engine\n", programName);
+        return ERROR;
+    }
+
+    /* a pooled process is the keeper's child, which reaps it with SA_NOCLDWAIT,
+     so the server can neither kill it nor read its rusage */
+    if (serverOptions->poolSize != 0 && (serverOptions->deadline != 0 || serverOptions->accountingPath != NULL)) {
+        fprintf(stderr, "%s: --deadline and --accounting can not be combined with --pool\n", programName);
+        return ERROR;
+    }
+
+    /* a pooled process is the keeper's child, the server never counts it and
+     the keeper replaces it at once */
+    if (serverOptions->poolSize != 0 && serverOptions->maxInflight != 0) {
+        fprintf(stderr, "%s: --max-inflight and --shed-queue can not be combined with --pool\n", programName);
+        return ERROR;
+    }
+
+    /* clients only queue up once accepting is paused */
+    if (serverOptions->shedQueue != 0 && serverOptions->maxInflight == 0) {
+        fprintf(stderr, "%s: --shed-queue needs --max-inflight\n", programName);
+        return ERROR;
+    }
+
+    if (serverOptions->logicPath != NULL) serverLogicPath = serverOptions->logicPath;
+
+    return SUCCESS;
 }
 
 /**
@@ -368,7 +1047,43 @@ const char *getTcpPort(int argc, const char *argv[]) {
  */
 void printUsage() {
     fprintf(stderr, "usage: %s option:\n", programName);
-    fprintf(stderr, "options:\n\t-p, --port <port>\n\t-h, --help\n");
+    fprintf(stderr, "options:\n\t-p, --port <port>\n"
+                    "\t-e, --engine <fork|epoll|uring>\tfork: fork()/execl() %s per connection (default)\n"
+                    "\t\t\t\t\tepoll: serve all connections in-process with --handler\n"
+                    "\t\t\t\t\turing: like epoll, driven by io_uring (falls back to epoll)\n"
+                    "\t-H, --handler <file.so>\t\trequest handler for engines epoll and uring\n"
+                    "\t-w, --workers[=<n>|auto]\tprefork n workers with SO_REUSEPORT listeners (default: online cpus)\n"
+                    "\t-W, --workers-file <file>\tnumber of workers, re-read on SIGHUP\n"
+                    "\t-P, --pool <n>\t\t\tfork engine: keep n started processes waiting for clients\n"
+                    "\t-S, --spawn <strategy>\t\tfork engine: auto (default), fork, vfork, posix_spawn or clone\n"
+                    "\t-D, --deadline <ms>\t\tfork engine without --pool: kill %s after ms milliseconds\n"
+                    "\t-A, --accounting <file>\t\tfork engine without --pool: append wall time and rusage of each child to file\n"
+                    "\t-b, --backlog <n>\t\tlength of the accept queue (default: SOMAXCONN)\n"
+                    "\t-m, --max-inflight <n>\t\tfork engine without --pool: stop accepting while n children run\n"
+                    "\t-q, --shed-queue <n>\t\tfork engine: answer clients queued beyond n with status=%d while paused\n"
+                    "\t-a, --admin <path|port>\t\tserve metrics over HTTP on a UNIX socket or 127.0.0.1:port,\n"
+                    "\t\t\t\t\tSIGUSR1 prints them to stdout\n"
+                    "\t-L, --logic <file>\t\tfork engine: program to start instead of %s (e.g. sms_stub_logic)\n"
+                    "\t-F, --fastopen[=<n>]\t\taccept requests in the SYN with TCP Fast Open, n pending\n"
+                    "\t\t\t\t\t(default: %d; needs net.ipv4.tcp_fastopen & 2)\n"
+                    "\t-T, --trace <path>\t\trecord accepts, spawns and requests to <path>.<pid>,\n"
+                    "\t\t\t\t\tsee trace_export\n"
+                    "\t-U, --unix <path|@name>\t\talso listen on a UNIX socket, @name: abstract namespace,\n"
+                    "\t\t\t\t\tclients connect to unix:<path|@name>\n"
+                    "\t-B, --buffer[=<MiB>]\t\tfork engine: buffer responses in the server, so %s\n"
+                    "\t\t\t\t\texits before a slow client has read them (default: %d MiB,\n"
+                    "\t\t\t\t\tlarger responses spill to TMPDIR)\n"
+                    "\t-r, --read-timeout <ms>\t\tclose a connection whose request is not complete ms after accept()\n"
+                    "\t-s, --write-timeout <ms>\tclose a connection whose response is not sent ms after the request\n"
+                    "\t-i, --idle-timeout <ms>\t\tclose a connection that has not moved data for ms\n"
+                    "\t\t\t\t\t(fork engine: write and idle timeouts need --buffer)\n"
+                    "\t-c, --acceptor-cpus <list>\trun the acceptor on these cpus, e.g. 0-3,8; each of --workers\n"
+                    "\t\t\t\t\ton one of them\n"
+                    "\t-C, --logic-cpus <list>\t\tfork engine: run %s on these cpus\n"
+                    "\t-I, --incoming-cpu\t\trun %s, or with --workers accept, on the cpu\n"
+                    "\t\t\t\t\tthat received the client's packets (SO_INCOMING_CPU)\n"
+                    "\t-N, --numa-local\t\tbind the memory of placed processes to the numa nodes of their cpus\n"
+                    "\t-v, --verbose\n\t-h, --help\n", SERVER_LOGIC, SERVER_LOGIC, STATUS_BUSY, PATH_TO_SERVER_LOGIC, FASTOPEN_QUEUE_SIZE, SERVER_LOGIC, RESPONSE_BUFFER_SIZE, SERVER_LOGIC, SERVER_LOGIC);
     exit(EXIT_FAILURE);
 }
 
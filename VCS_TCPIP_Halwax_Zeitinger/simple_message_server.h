@@ -0,0 +1,83 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server.h
+ * VCS - Tcp/Ip Exercise - declarations shared by the server's main program
+ * and its I/O engines
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_H
+#define SIMPLE_MESSAGE_SERVER_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdio.h>
+#include <signal.h>
+#include "simple_message_trace.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define ERROR -1
+#define SUCCESS 0
+#define DONE 2
+
+/* status= sent to clients turned away under overload */
+#define STATUS_BUSY 2
+#define STATUS_BUSY_STRING "2"
+
+/* to stderr: stdout of a child may already be the client socket */
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define INFO(function, M, ...) \
+	if (verbose) fprintf(stderr, "%s [%s, %s, line %d]: " M "\n", programName, __FILE__, function, __LINE__, ##__VA_ARGS__)
+#else
+#define INFO(function, M, ...) do { } while (0)
+#endif
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+extern const char *programName;
+extern int verbose;
+
+/* backlog passed to listen() by createListeningSocket() */
+extern int listenBacklog;
+
+/* TCP Fast Open queue length set by createListeningSocket(), 0: off */
+extern int fastOpenQueue;
+
+/* set by SIGTERM in preforked workers: stop accepting, finish, return */
+extern volatile sig_atomic_t shutdownRequested;
+
+/* listening UNIX socket for same-host clients (--unix), ERROR if none */
+extern int unixListener;
+
+/* connection timeouts in milliseconds, 0: none; see
+ simple_message_server_timeouts.h */
+extern long readTimeout;
+extern long writeTimeout;
+extern long idleTimeout;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int createListeningSocket(const char *tcpPort, int reusePort, int startListening);
+int createUnixListeningSocket(const char *path);
+int watchListeners(int epollDescriptor, int listening_socket_descriptor, int operation, uint32_t extraEvents);
+void startClientInteraction(int client_socket_descriptor);
+
+#endif /* SIMPLE_MESSAGE_SERVER_H */
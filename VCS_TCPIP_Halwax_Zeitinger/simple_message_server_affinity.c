@@ -0,0 +1,335 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_affinity.c
+ * VCS - Tcp/Ip Exercise - placement of the server's processes on CPUs and
+ * NUMA nodes. The acceptor of the fork engine or of an event engine runs
+ * on --acceptor-cpus; preforked workers get one of them each, and with
+ * --incoming-cpu their listening sockets carry it as SO_INCOMING_CPU, so
+ * the kernel hands a connection to the worker on the CPU that took its
+ * packets from the NIC.
+ *
+ * Server logic processes run on --logic-cpus, or with --incoming-cpu on
+ * the CPU that received their client's packets, if it is one of them.
+ * --numa-local binds the memory of every placed process to the nodes of
+ * its CPUs, read from sysfs.
+ *
+ * Processes not placed keep the CPUs the server was started with.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include "simple_message_server.h"
+#include "simple_message_server_affinity.h"
+#include "simple_message_server_spawn.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* NUMA nodes with a bit in struct spawnPlacement */
+#define MAX_NODES ((int)(sizeof(unsigned long) * CHAR_BIT))
+
+#define NODE_DIRECTORY "/sys/devices/system/node"
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+static int placing;
+static cpu_set_t acceptorSet;
+static cpu_set_t logicSet;
+static int useIncomingCpu;
+static int bindNodes;
+
+/* CPUs of each node, empty for nodes that do not exist */
+static cpu_set_t nodeCpus[MAX_NODES];
+
+/* returned by placeLogic(), used before the next client is accepted */
+static struct spawnPlacement logicPlacement;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static int availableCpus(const cpu_set_t *wanted, const cpu_set_t *allowed, cpu_set_t *cpus);
+static int readNodes(void);
+static unsigned long nodesOf(const cpu_set_t *cpus);
+static int nthCpu(const cpu_set_t *cpus, int n);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief parseCpuList
+ *
+ * \param list CPU numbers and ranges, e.g. 0-3,8
+ * \param cpus set to the CPUs of the list
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR if list is malformed
+ *
+ */
+int parseCpuList(const char *list, cpu_set_t *cpus) {
+    const char *position = list;
+
+    CPU_ZERO(cpus);
+    while (1 == 1) {
+        char *end;
+        errno = 0;
+        long first = strtol(position, &end, 10);
+        long last = first;
+        if (end == position || errno != 0) return ERROR;
+        if (*end == '-') {
+            position = end + 1;
+            last = strtol(position, &end, 10);
+            if (end == position || errno != 0) return ERROR;
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE) return ERROR;
+        for (long cpu = first; cpu <= last; cpu++) CPU_SET((int)cpu, cpus);
+
+        position = end;
+        if (*position != ',') break;
+        position++;
+    }
+
+    /* a cpulist from sysfs ends with a newline */
+    if (*position == '\n') position++;
+    return *position == '\0' ? SUCCESS : ERROR;
+}
+
+/**
+ * @brief startPlacement
+ *
+ * check the CPU sets against those the server may use and read the NUMA
+ * topology, before any process is placed
+ *
+ * \param acceptorCpus CPUs of the acceptors, empty: those of the server
+ * \param logicCpus CPUs of the server logic, empty: those of the server
+ * \param incomingCpu place by SO_INCOMING_CPU
+ * \param numaLocal bind memory to the nodes of the CPUs
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+int startPlacement(const cpu_set_t *acceptorCpus, const cpu_set_t *logicCpus, int incomingCpu, int numaLocal) {
+    cpu_set_t allowed;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == ERROR) {
+        fprintf(stderr, "%s: sched_getaffinity() failed: %s\n", programName, strerror(errno));
+        return ERROR;
+    }
+    if (availableCpus(acceptorCpus, &allowed, &acceptorSet) != SUCCESS) {
+        fprintf(stderr, "%s: none of the acceptor CPUs is available\n", programName);
+        return ERROR;
+    }
+    if (availableCpus(logicCpus, &allowed, &logicSet) != SUCCESS) {
+        fprintf(stderr, "%s: none of the logic CPUs is available\n", programName);
+        return ERROR;
+    }
+
+    useIncomingCpu = incomingCpu;
+    bindNodes = numaLocal && readNodes() == SUCCESS;
+    placing = 1;
+    INFO("startPlacement()", "%d acceptor cpus, %d logic cpus, numa %s", CPU_COUNT(&acceptorSet), CPU_COUNT(&logicSet), bindNodes ? "local" : "off");
+    return SUCCESS;
+}
+
+/**
+ * @brief placeAcceptor
+ *
+ * move the calling process onto the acceptor CPUs, a no-op without
+ * startPlacement()
+ *
+ * \param slot number of a preforked worker, which gets one CPU, or -1 for
+ *        the only acceptor, which gets them all
+ * \param listening_socket_descriptor the worker's SO_REUSEPORT listener
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+int placeAcceptor(int slot, int listening_socket_descriptor) {
+    struct spawnPlacement placement;
+
+    if (!placing) return SUCCESS;
+
+    memset(&placement, 0, sizeof(placement));
+    if (slot < 0) {
+        placement.cpus = acceptorSet;
+    }
+    else {
+        int cpu = nthCpu(&acceptorSet, slot % CPU_COUNT(&acceptorSet));
+        CPU_SET(cpu, &placement.cpus);
+
+        /* within the reuseport group the kernel prefers the listener of the CPU
+         that received the SYN */
+        if (useIncomingCpu && setsockopt(listening_socket_descriptor, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) == ERROR) {
+            fprintf(stderr, "%s: setsockopt(SO_INCOMING_CPU): %s\n", programName, strerror(errno));
+            return ERROR;
+        }
+    }
+    /* only pages allocated from now on, what a worker inherited stays */
+    if (bindNodes) placement.nodes = nodesOf(&placement.cpus);
+
+    if (applyPlacement(&placement) != SUCCESS) {
+        fprintf(stderr, "%s: can not place acceptor: %s\n", programName, strerror(errno));
+        return ERROR;
+    }
+    INFO("placeAcceptor()", "accepting on %d cpus, numa nodes 0x%lx", CPU_COUNT(&placement.cpus), placement.nodes);
+    return SUCCESS;
+}
+
+/**
+ * @brief placeLogic
+ *
+ * where to run the server logic for a client
+ *
+ * \param client the client, or ERROR for pooled processes
+ *
+ * \return const struct spawnPlacement *
+ * \retval the placement, valid until the next call
+ * \retval NULL without startPlacement(), the logic inherits our CPUs
+ *
+ */
+const struct spawnPlacement *placeLogic(int client) {
+    if (!placing) return NULL;
+
+    logicPlacement.cpus = logicSet;
+    if (useIncomingCpu && client != ERROR) {
+        int cpu = ERROR;
+        socklen_t size = sizeof(cpu);
+
+        /* the CPU that processed the last packet of the client, -1 for none */
+        if (getsockopt(client, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &size) == SUCCESS
+            && cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &logicSet)) {
+            CPU_ZERO(&logicPlacement.cpus);
+            CPU_SET(cpu, &logicPlacement.cpus);
+        }
+    }
+    logicPlacement.nodes = bindNodes ? nodesOf(&logicPlacement.cpus) : 0;
+    return &logicPlacement;
+}
+
+/**
+ * @brief availableCpus
+ *
+ * \param wanted CPUs asked for, empty: all allowed ones
+ * \param allowed CPUs the server may use
+ * \param cpus set to the wanted CPUs that are allowed
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR if none is left
+ *
+ */
+static int availableCpus(const cpu_set_t *wanted, const cpu_set_t *allowed, cpu_set_t *cpus) {
+    if (CPU_COUNT(wanted) == 0) *cpus = *allowed;
+    else CPU_AND(cpus, wanted, allowed);
+    return CPU_COUNT(cpus) > 0 ? SUCCESS : ERROR;
+}
+
+/**
+ * @brief readNodes
+ *
+ * fill nodeCpus from the cpulist of every node in sysfs
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR if the kernel shows no NUMA topology
+ *
+ */
+static int readNodes(void) {
+    DIR *directory = opendir(NODE_DIRECTORY);
+    struct dirent *entry;
+    int found = 0;
+
+    if (directory == NULL) {
+        INFO("readNodes()", "no NUMA topology in %s, memory is not bound", NODE_DIRECTORY);
+        return ERROR;
+    }
+
+    while ((entry = readdir(directory)) != NULL) {
+        char path[sizeof(NODE_DIRECTORY) + sizeof(entry->d_name) + sizeof("/cpulist")];
+        char list[4096];
+        int node;
+
+        if (sscanf(entry->d_name, "node%d", &node) != 1 || node < 0) continue;
+        if (node >= MAX_NODES) {
+            INFO("readNodes()", "ignoring numa node %d", node);
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/%s/cpulist", NODE_DIRECTORY, entry->d_name);
+        FILE *file = fopen(path, "re");
+        if (file == NULL) continue;
+        /* a node with memory only has an empty list */
+        if (fgets(list, sizeof(list), file) != NULL && parseCpuList(list, &nodeCpus[node]) == SUCCESS) found++;
+        fclose(file);
+    }
+    closedir(directory);
+
+    return found > 0 ? SUCCESS : ERROR;
+}
+
+/**
+ * @brief nodesOf
+ *
+ * \param cpus some CPUs
+ *
+ * \return unsigned long
+ * \retval bit per NUMA node with any of the CPUs
+ *
+ */
+static unsigned long nodesOf(const cpu_set_t *cpus) {
+    unsigned long nodes = 0;
+
+    for (int node = 0; node < MAX_NODES; node++) {
+        cpu_set_t common;
+        CPU_AND(&common, &nodeCpus[node], cpus);
+        if (CPU_COUNT(&common) > 0) nodes |= 1UL << node;
+    }
+    return nodes;
+}
+
+/**
+ * @brief nthCpu
+ *
+ * \param cpus some CPUs
+ * \param n index, less than CPU_COUNT(cpus)
+ *
+ * \return int
+ * \retval the n-th CPU of the set, counting from 0
+ *
+ */
+static int nthCpu(const cpu_set_t *cpus, int n) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, cpus) && n-- == 0) return cpu;
+    }
+    return 0;
+}
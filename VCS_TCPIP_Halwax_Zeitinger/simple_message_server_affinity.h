@@ -0,0 +1,37 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_affinity.h
+ * VCS - Tcp/Ip Exercise - CPUs and NUMA nodes of the acceptors and of the
+ * server logic processes
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_AFFINITY_H
+#define SIMPLE_MESSAGE_SERVER_AFFINITY_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <sched.h>
+#include "simple_message_server_spawn.h"
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int parseCpuList(const char *list, cpu_set_t *cpus);
+int startPlacement(const cpu_set_t *acceptorCpus, const cpu_set_t *logicCpus, int incomingCpu, int numaLocal);
+int placeAcceptor(int slot, int listening_socket_descriptor);
+const struct spawnPlacement *placeLogic(int client);
+
+#endif /* SIMPLE_MESSAGE_SERVER_AFFINITY_H */
@@ -0,0 +1,584 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_buffer.c
+ * VCS - Tcp/Ip Exercise - response buffering of the fork engine (--buffer):
+ * the server logic reads its request from the client as always, but writes
+ * its response into a pipe owned by the server instead of the client. The
+ * server absorbs the response into chunks of a memory pool and trickles it
+ * out to the client from its event loop, so the logic exits as soon as it
+ * has produced the response, however slowly the client reads.
+ *
+ * A response holding more than SPILL_SIZE bytes of unsent memory, or one
+ * arriving while the pool is exhausted, continues into an unnamed temporary
+ * file in TMPDIR; its chunks are sent first, then the file.
+ *
+ * The client socket shares its file description with the logic's stdin, it
+ * stays blocking and is written with MSG_DONTWAIT.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include "simple_message_server.h"
+#include "simple_message_server_buffer.h"
+#include "simple_message_server_children.h"
+#include "simple_message_server_metrics.h"
+#include "simple_message_server_timeouts.h"
+#include "simple_message_timer.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* unit of the memory pool */
+#define BUFFER_CHUNK_SIZE (64 * 1024)
+
+/* unsent bytes a response may hold in memory before it spills */
+#define SPILL_SIZE (1024 * 1024)
+
+/* asked for with F_SETPIPE_SZ, the default of 64 KiB wakes us up often */
+#define PIPE_SIZE (1024 * 1024)
+
+/* bytes absorbed from one pipe per event, so a fast logic does not starve
+ the others; the pipe stays readable and is served again */
+#define READ_BUDGET (1024 * 1024)
+
+/* events fetched by one epoll_wait() */
+#define MAX_EVENTS 64
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+enum bufferEventKind {
+    BUFFER_PIPE,                /* the logic wrote to its stdout */
+    BUFFER_CLIENT               /* the client can take more */
+};
+
+struct bufferedResponse;
+
+/* epoll data.ptr of everything registered with responseBuffers */
+struct bufferTag {
+    enum bufferEventKind kind;
+    struct bufferedResponse *response;
+};
+
+struct bufferChunk {
+    struct bufferChunk *next;
+    size_t length;
+    char data[BUFFER_CHUNK_SIZE];
+};
+
+struct bufferedResponse {
+    int client;
+    int pipe;                   /* read end, ERROR after the end of the response */
+    int spill;                  /* temporary file, ERROR until the response spills */
+    off_t spilled;              /* bytes written to the temporary file */
+    off_t spillSent;            /* bytes of the temporary file sent */
+    struct bufferChunk *first;  /* sent before the temporary file */
+    struct bufferChunk *last;
+    size_t firstSent;           /* bytes of first already sent */
+    size_t held;                /* unsent bytes in chunks */
+    uint64_t accepted;
+    uint64_t started;
+    int sentAny;
+    int finished;
+    struct connectionTimeout timeout;
+    struct bufferTag pipeTag;
+    struct bufferTag clientTag;
+    struct bufferedResponse *nextFinished;
+};
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+int responseBuffers = ERROR;
+
+static struct timerWheel *timers;
+static size_t memoryLimit;
+static size_t memoryAllocated;
+static struct bufferChunk *freeChunks;
+static int responseCount;
+
+/* freed after the events of one epoll_wait(), which may still name them */
+static struct bufferedResponse *finishedResponses;
+
+/* sends from temporary files go through here */
+static char spillBuffer[BUFFER_CHUNK_SIZE];
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static int absorbResponse(struct bufferedResponse *response);
+static int sendResponse(struct bufferedResponse *response);
+static int startSpill(struct bufferedResponse *response);
+static void finishResponse(struct bufferedResponse *response, int failed);
+static void freeFinishedResponses(void);
+static void expireResponse(void *context);
+static struct bufferChunk *takeChunk(void);
+static void releaseChunk(struct bufferChunk *chunk);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief startResponseBuffering
+ *
+ * create responseBuffers and register it with the caller's event loop
+ *
+ * \param epollDescriptor epoll instance of the caller's event loop
+ * \param wheel timer wheel of the caller's event loop
+ * \param limit bytes the memory pool may grow to
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+int startResponseBuffering(int epollDescriptor, struct timerWheel *wheel, size_t limit) {
+    timers = wheel;
+    memoryLimit = limit;
+
+    responseBuffers = epoll_create1(EPOLL_CLOEXEC);
+    if (responseBuffers == ERROR) {
+        fprintf(stderr, "%s: epoll_create1() failed: %s\n", programName, strerror(errno));
+        return ERROR;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = &responseBuffers;
+    if (epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, responseBuffers, &event) == ERROR) {
+        fprintf(stderr, "%s: epoll_ctl() failed: %s\n", programName, strerror(errno));
+        close(responseBuffers);
+        responseBuffers = ERROR;
+        return ERROR;
+    }
+    INFO("startResponseBuffering()", "buffering responses in up to %zu bytes of memory", memoryLimit);
+    return SUCCESS;
+}
+
+/**
+ * @brief bufferResponse
+ *
+ * take over a client whose logic is about to be started, the logic gets
+ * the returned descriptor as its stdout
+ *
+ * \param client client connection, closed once the response is sent
+ * \param accepted metricsClock() when the client was accepted
+ *
+ * \return int
+ * \retval write end of the response pipe, the caller closes it after the spawn
+ * \retval ERROR on Error, client is left to the caller
+ *
+ */
+int bufferResponse(int client, uint64_t accepted) {
+    struct bufferedResponse *response = calloc(1, sizeof(*response));
+    int descriptors[2];
+
+    if (response == NULL) {
+        fprintf(stderr, "%s: calloc() failed: %s\n", programName, strerror(errno));
+        return ERROR;
+    }
+    /* close-on-exec, so no other child holds the write end and delays the end of the response */
+    if (pipe2(descriptors, O_CLOEXEC) == ERROR) {
+        fprintf(stderr, "%s: pipe2() failed: %s\n", programName, strerror(errno));
+        free(response);
+        return ERROR;
+    }
+    /* a smaller pipe only means more wakeups */
+    fcntl(descriptors[0], F_SETPIPE_SZ, PIPE_SIZE);
+
+    response->client = client;
+    response->pipe = descriptors[0];
+    response->spill = ERROR;
+    response->accepted = accepted;
+    response->started = metricsClock();
+    response->pipeTag.kind = BUFFER_PIPE;
+    response->pipeTag.response = response;
+    response->clientTag.kind = BUFFER_CLIENT;
+    response->clientTag.response = response;
+    initTimeout(&response->timeout, expireResponse, response);
+
+    struct epoll_event pipeEvent;
+    memset(&pipeEvent, 0, sizeof(pipeEvent));
+    pipeEvent.events = EPOLLIN;
+    pipeEvent.data.ptr = &response->pipeTag;
+
+    /* edge triggered: we only care once a send has hit a full socket buffer, */
+    /* or once the client has sent its request */
+    struct epoll_event clientEvent;
+    memset(&clientEvent, 0, sizeof(clientEvent));
+    clientEvent.events = EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    clientEvent.data.ptr = &response->clientTag;
+
+    /* only our end, the logic's stdout must block */
+    int flags = fcntl(descriptors[0], F_GETFL);
+    if (flags == ERROR || fcntl(descriptors[0], F_SETFL, flags | O_NONBLOCK) == ERROR
+        || epoll_ctl(responseBuffers, EPOLL_CTL_ADD, descriptors[0], &pipeEvent) == ERROR
+        || epoll_ctl(responseBuffers, EPOLL_CTL_ADD, client, &clientEvent) == ERROR) {
+        fprintf(stderr, "%s: can not buffer response: %s\n", programName, strerror(errno));
+        epoll_ctl(responseBuffers, EPOLL_CTL_DEL, descriptors[0], NULL);
+        close(descriptors[0]);
+        close(descriptors[1]);
+        free(response);
+        return ERROR;
+    }
+
+    /* the logic reads the request, we only see its end */
+    startTimeout(timers, &response->timeout, TIMEOUT_READ, 0);
+    responseCount++;
+    countMetric(METRIC_BUFFERED, 1);
+    return descriptors[1];
+}
+
+/**
+ * @brief handleResponseBuffers
+ *
+ * absorb and send what is ready, called when responseBuffers is readable
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void handleResponseBuffers(void) {
+    struct epoll_event events[MAX_EVENTS];
+
+    int ready = epoll_wait(responseBuffers, events, MAX_EVENTS, 0);
+    for (int i = 0; i < ready; i++) {
+        struct bufferTag *tag = events[i].data.ptr;
+        struct bufferedResponse *response = tag->response;
+
+        if (response->finished) continue;
+        /* the request is complete once the client has shut down its side or the logic answers */
+        if (response->timeout.phase == TIMEOUT_READ && (tag->kind == BUFFER_PIPE || (events[i].events & EPOLLRDHUP))) {
+            startTimeout(timers, &response->timeout, TIMEOUT_WRITE, 1);
+        }
+        if (tag->kind == BUFFER_PIPE && absorbResponse(response) != SUCCESS) {
+            finishResponse(response, 1);
+            continue;
+        }
+        if (sendResponse(response) != SUCCESS) {
+            finishResponse(response, 1);
+            continue;
+        }
+        if (response->pipe == ERROR && response->first == NULL && response->spillSent == response->spilled) {
+            finishResponse(response, 0);
+        }
+    }
+
+    freeFinishedResponses();
+}
+
+/**
+ * @brief absorbResponse
+ *
+ * read what the logic has written, into chunks or the temporary file
+ *
+ * \param response the response
+ *
+ * \return int
+ * \retval SUCCESS on Success, also at the end of the response
+ * \retval ERROR on Error
+ *
+ */
+static int absorbResponse(struct bufferedResponse *response) {
+    size_t budget = READ_BUDGET;
+
+    while (budget > 0) {
+        ssize_t count;
+
+        if (response->spill == ERROR && (response->last == NULL || response->last->length == BUFFER_CHUNK_SIZE)) {
+            struct bufferChunk *chunk = response->held < SPILL_SIZE ? takeChunk() : NULL;
+            if (chunk == NULL && startSpill(response) != SUCCESS) return ERROR;
+            if (chunk != NULL) {
+                if (response->last != NULL) response->last->next = chunk;
+                else response->first = chunk;
+                response->last = chunk;
+            }
+        }
+
+        if (response->spill == ERROR) {
+            struct bufferChunk *chunk = response->last;
+            count = read(response->pipe, chunk->data + chunk->length, BUFFER_CHUNK_SIZE - chunk->length);
+            if (count > 0) {
+                chunk->length += (size_t)count;
+                response->held += (size_t)count;
+            }
+        }
+        else {
+            /* advances spilled */
+            count = splice(response->pipe, NULL, response->spill, &response->spilled, budget, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        }
+
+        if (count == 0) {
+            /* a child between fork() and exec() may hold a copy, closing would not remove it */
+            epoll_ctl(responseBuffers, EPOLL_CTL_DEL, response->pipe, NULL);
+            close(response->pipe);
+            response->pipe = ERROR;
+            return SUCCESS;
+        }
+        if (count == ERROR) {
+            if (errno == EAGAIN) return SUCCESS;
+            if (errno == EINTR) continue;
+            fprintf(stderr, "%s: failed to buffer response: %s\n", programName, strerror(errno));
+            return ERROR;
+        }
+        noteProgress(timers, &response->timeout);
+        budget -= (size_t)count < budget ? (size_t)count : budget;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief sendResponse
+ *
+ * send what the client takes without blocking, chunks first
+ *
+ * \param response the response
+ *
+ * \return int
+ * \retval SUCCESS on Success, also if the client takes nothing now
+ * \retval ERROR if the client has gone
+ *
+ */
+static int sendResponse(struct bufferedResponse *response) {
+    while (1 == 1) {
+        const char *data;
+        size_t length;
+
+        if (response->first != NULL) {
+            struct bufferChunk *chunk = response->first;
+            if (response->firstSent == chunk->length) {
+                /* the logic may still fill the last chunk, absorbResponse() takes a new one */
+                response->first = chunk->next;
+                if (response->first == NULL) response->last = NULL;
+                response->firstSent = 0;
+                releaseChunk(chunk);
+                continue;
+            }
+            data = chunk->data + response->firstSent;
+            length = chunk->length - response->firstSent;
+        }
+        else if (response->spillSent < response->spilled) {
+            size_t wanted = (size_t)(response->spilled - response->spillSent);
+            ssize_t count = pread(response->spill, spillBuffer, wanted < sizeof(spillBuffer) ? wanted : sizeof(spillBuffer), response->spillSent);
+            if (count <= 0) {
+                fprintf(stderr, "%s: failed to read spilled response: %s\n", programName, count == 0 ? "short file" : strerror(errno));
+                return ERROR;
+            }
+            data = spillBuffer;
+            length = (size_t)count;
+        }
+        else {
+            return SUCCESS;
+        }
+
+        ssize_t sent = send(response->client, data, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent == ERROR) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return SUCCESS;
+            if (errno == EINTR) continue;
+            INFO("sendResponse()", "client has gone: %s", strerror(errno));
+            return ERROR;
+        }
+
+        noteProgress(timers, &response->timeout);
+        if (!response->sentAny) {
+            recordLatency(METRIC_START_TO_FIRST_BYTE, metricsClock() - response->started);
+            response->sentAny = 1;
+        }
+        if (response->first != NULL) {
+            response->firstSent += (size_t)sent;
+            response->held -= (size_t)sent;
+        }
+        else {
+            response->spillSent += sent;
+        }
+    }
+}
+
+/**
+ * @brief startSpill
+ *
+ * continue a response in an unnamed temporary file
+ *
+ * \param response the response
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int startSpill(struct bufferedResponse *response) {
+    const char *directory = getenv("TMPDIR");
+
+    if (directory == NULL || directory[0] == '\0') directory = "/tmp";
+
+    response->spill = open(directory, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (response->spill == ERROR && (errno == EOPNOTSUPP || errno == EISDIR)) {
+        /* the file system has no O_TMPFILE, unlink a named one right away */
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/simple_message_server.XXXXXX", directory);
+        response->spill = mkostemp(path, O_CLOEXEC);
+        if (response->spill != ERROR) unlink(path);
+    }
+    if (response->spill == ERROR) {
+        fprintf(stderr, "%s: can not spill response to %s: %s\n", programName, directory, strerror(errno));
+        return ERROR;
+    }
+
+    INFO("startSpill()", "spilling response after %zu bytes in memory", response->held);
+    countMetric(METRIC_SPILLED, 1);
+    return SUCCESS;
+}
+
+/**
+ * @brief finishResponse
+ *
+ * close the client and release the response, it is freed after the
+ * current events are handled
+ *
+ * \param response the response
+ * \param failed the client has not received everything
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void finishResponse(struct bufferedResponse *response, int failed) {
+    stopTimeout(timers, &response->timeout);
+    /* the logic may still hold the client, closing would not remove it */
+    epoll_ctl(responseBuffers, EPOLL_CTL_DEL, response->client, NULL);
+    /* a logic still writing gets EPIPE, as it would from a gone client */
+    if (response->pipe != ERROR) {
+        epoll_ctl(responseBuffers, EPOLL_CTL_DEL, response->pipe, NULL);
+        close(response->pipe);
+    }
+    if (response->spill != ERROR) close(response->spill);
+
+    recordLatency(METRIC_REQUEST, metricsClock() - response->accepted);
+    countClientBytes(response->client);
+    if (failed) countMetric(METRIC_ERRORS, 1);
+    close(response->client);
+
+    while (response->first != NULL) {
+        struct bufferChunk *chunk = response->first;
+        response->first = chunk->next;
+        releaseChunk(chunk);
+    }
+
+    response->finished = 1;
+    response->nextFinished = finishedResponses;
+    finishedResponses = response;
+    responseCount--;
+    INFO("finishResponse()", "%s response, %d still buffered", failed ? "dropped" : "sent", responseCount);
+}
+
+/**
+ * @brief freeFinishedResponses
+ *
+ * free the finished responses, no event may name them any more
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void freeFinishedResponses(void) {
+    while (finishedResponses != NULL) {
+        struct bufferedResponse *response = finishedResponses;
+        finishedResponses = response->nextFinished;
+        free(response);
+    }
+}
+
+/**
+ * @brief expireResponse
+ *
+ * timer callback of a response, runs after the events of the caller's
+ * event loop are handled
+ *
+ * \param context the response
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void expireResponse(void *context) {
+    struct bufferedResponse *response = context;
+
+    if (!timeoutExpired(timers, &response->timeout)) return;
+
+    /* the logic may still hold the client as its stdin: it reads the end of */
+    /* the request now, and the connection is reset once it has exited too */
+    shutdown(response->client, SHUT_RD);
+    resetOnClose(response->client);
+    finishResponse(response, 1);
+    freeFinishedResponses();
+}
+
+/**
+ * @brief takeChunk
+ *
+ * \return struct bufferChunk *
+ * \retval an empty chunk
+ * \retval NULL if the pool has reached its limit
+ *
+ */
+static struct bufferChunk *takeChunk(void) {
+    struct bufferChunk *chunk = freeChunks;
+
+    if (chunk != NULL) {
+        freeChunks = chunk->next;
+    }
+    else {
+        if (memoryAllocated + sizeof(*chunk) > memoryLimit) return NULL;
+        if ((chunk = malloc(sizeof(*chunk))) == NULL) return NULL;
+        memoryAllocated += sizeof(*chunk);
+    }
+    chunk->next = NULL;
+    chunk->length = 0;
+    return chunk;
+}
+
+/**
+ * @brief releaseChunk
+ *
+ * return a chunk to the pool, which keeps it for the next response
+ *
+ * \param chunk the chunk
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void releaseChunk(struct bufferChunk *chunk) {
+    chunk->next = freeChunks;
+    freeChunks = chunk;
+}
@@ -0,0 +1,45 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_buffer.h
+ * VCS - Tcp/Ip Exercise - responses of the fork engine buffered in the
+ * server, so slow clients do not keep the server logic running
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_BUFFER_H
+#define SIMPLE_MESSAGE_SERVER_BUFFER_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "simple_message_timer.h"
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+/* epoll instance of the buffered responses, registered with the caller's
+ one tagged with &responseBuffers; ERROR while buffering is off */
+extern int responseBuffers;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int startResponseBuffering(int epollDescriptor, struct timerWheel *wheel, size_t memoryLimit);
+int bufferResponse(int client, uint64_t accepted);
+void handleResponseBuffers(void);
+
+#endif /* SIMPLE_MESSAGE_SERVER_BUFFER_H */
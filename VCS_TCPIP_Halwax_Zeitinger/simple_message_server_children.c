@@ -0,0 +1,663 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_children.c
+ * VCS - Tcp/Ip Exercise - supervision of the server logic processes of the
+ * fork engine from its event loop: every child is watched through a pidfd
+ * registered with the caller's epoll instance, or, on kernels without
+ * pidfd_open(), through a signalfd for SIGCHLD. Children are reaped with
+ * wait4(), their wall time and resource usage is written to an accounting
+ * log, and children running longer than the deadline are killed.
+ *
+ * The server keeps its descriptor of a child's client until the child is
+ * reaped: software transmit timestamps on it tell when the child sent its
+ * first byte, and TCP_INFO tells how many bytes went in and out. A buffered
+ * response (--buffer) outlives its child and accounts the connection itself.
+ *
+ * The deadline of a child and the read timeout of its client are timers on
+ * the wheel of the caller's event loop; the request is complete once the
+ * client has shut down its side, which EPOLLRDHUP on the same descriptor
+ * tells.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include "simple_message_server.h"
+#include "simple_message_server_children.h"
+#include "simple_message_server_metrics.h"
+#include "simple_message_server_timeouts.h"
+#include "simple_message_timer.h"
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+enum eventKind {
+    EVENT_SIGNAL,               /* the signalfd of the fallback */
+    EVENT_EXIT,                 /* pidfd of a child */
+    EVENT_CLIENT                /* transmit timestamp or end of the request on a child's client */
+};
+
+struct supervisedChild;
+
+/* epoll data.ptr of everything registered by this module */
+struct eventTag {
+    enum eventKind kind;
+    struct supervisedChild *child;
+};
+
+struct supervisedChild {
+    pid_t pid;
+    int pidfd;                  /* ERROR with the signalfd fallback */
+    int client;
+    int watchingClient;         /* client is registered for EVENT_CLIENT */
+    int timingFirstByte;
+    uint64_t accepted;
+    uint64_t started;
+    struct timespec startedRealtime;
+    int killed;
+    int reaped;                 /* forgotten, freed after the events at hand */
+    struct wheelTimer deadline;
+    struct connectionTimeout timeout;   /* read timeout of the client */
+    struct eventTag exitTag;
+    struct eventTag clientTag;
+    struct supervisedChild *previous;
+    struct supervisedChild *next;
+};
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+static int epoll;
+static struct timerWheel *timers;
+static long deadlineMilliseconds;   /* 0: no deadline */
+static FILE *accounting;            /* NULL: accounting only with -v */
+static int usePidfd;
+static int signalDescriptor = ERROR;
+
+static struct eventTag signalTag = { EVENT_SIGNAL, NULL };
+
+static struct supervisedChild *children;
+static struct supervisedChild *reapedChildren;
+static int childCount;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void reapChild(struct supervisedChild *child);
+static void reapSignalledChildren(void);
+static void accountChild(const struct supervisedChild *child, int status, const struct rusage *usage);
+static void forgetChild(struct supervisedChild *child);
+static void handleClientEvent(struct supervisedChild *child, uint32_t events);
+static void readFirstByte(struct supervisedChild *child);
+static void watchClient(struct supervisedChild *child);
+static void expireDeadline(void *context);
+static void expireRequest(void *context);
+static void killChild(struct supervisedChild *child);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief startChildSupervision
+ *
+ * pick pidfd or signalfd supervision, must be called before the first
+ * child is started
+ *
+ * \param epollDescriptor epoll instance of the caller's event loop
+ * \param wheel timer wheel of the caller's event loop
+ * \param deadline kill children after this many milliseconds, 0: never
+ * \param accountingPath append one line per child to this file, or NULL
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+int startChildSupervision(int epollDescriptor, struct timerWheel *wheel, long deadline, const char *accountingPath) {
+    epoll = epollDescriptor;
+    timers = wheel;
+    deadlineMilliseconds = deadline;
+
+    if (accountingPath != NULL) {
+        accounting = fopen(accountingPath, "ae");
+        if (accounting == NULL) {
+            fprintf(stderr, "%s: can not open accounting log %s: %s\n", programName, accountingPath, strerror(errno));
+            return ERROR;
+        }
+        setvbuf(accounting, NULL, _IOLBF, 0);
+    }
+
+    /* SIGCHLD keeps its default action, only wait4() may collect a status */
+    struct sigaction onSignalAction;
+    memset(&onSignalAction, 0, sizeof(onSignalAction));
+    onSignalAction.sa_handler = SIG_DFL;
+    sigaction(SIGCHLD, &onSignalAction, NULL);
+
+    int probe = (int)syscall(SYS_pidfd_open, getpid(), 0);
+    if (probe != ERROR) {
+        close(probe);
+        usePidfd = 1;
+        INFO("startChildSupervision()", "supervising children with %s", "pidfd");
+        return SUCCESS;
+    }
+
+    INFO("startChildSupervision()", "pidfd_open() failed (%s), supervising children with signalfd", strerror(errno));
+    sigset_t childSignal;
+    sigemptyset(&childSignal);
+    sigaddset(&childSignal, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &childSignal, NULL) == ERROR
+        || (signalDescriptor = signalfd(ERROR, &childSignal, SFD_NONBLOCK | SFD_CLOEXEC)) == ERROR) {
+        fprintf(stderr, "%s: signalfd() failed: %s\n", programName, strerror(errno));
+        return ERROR;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = &signalTag;
+    if (epoll_ctl(epoll, EPOLL_CTL_ADD, signalDescriptor, &event) == ERROR) {
+        fprintf(stderr, "%s: epoll_ctl() failed: %s\n", programName, strerror(errno));
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief watchFirstByte
+ *
+ * ask for software transmit timestamps on a client, before it is given to
+ * a child, so the child's first send can be timed
+ *
+ * \param client client connection
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void watchFirstByte(int client) {
+    int flags = SOF_TIMESTAMPING_TX_SCHED | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_TSONLY;
+
+    /* without timestamps only the first byte histogram stays empty */
+    setsockopt(client, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+}
+
+/**
+ * @brief superviseChild
+ *
+ * start watching a child, the caller must not reap it
+ *
+ * \param pid the child
+ * \param client the child's client, closed once the child is reaped, or
+ *        ERROR if its response is buffered
+ * \param accepted metricsClock() when the client was accepted
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error, the child is killed and client closed
+ *
+ */
+int superviseChild(pid_t pid, int client, uint64_t accepted) {
+    struct supervisedChild *child = calloc(1, sizeof(*child));
+    if (child == NULL) {
+        fprintf(stderr, "%s: calloc() failed: %s\n", programName, strerror(errno));
+        if (client != ERROR) close(client);
+        kill(pid, SIGKILL);
+        return ERROR;
+    }
+    child->pid = pid;
+    child->pidfd = ERROR;
+    child->client = client;
+    child->accepted = accepted;
+    child->started = metricsClock();
+    clock_gettime(CLOCK_REALTIME, &child->startedRealtime);
+    child->exitTag.kind = EVENT_EXIT;
+    child->exitTag.child = child;
+    child->clientTag.kind = EVENT_CLIENT;
+    child->clientTag.child = child;
+    initTimer(&child->deadline, expireDeadline, child);
+    initTimeout(&child->timeout, expireRequest, child);
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    if (usePidfd) {
+        event.events = EPOLLIN;
+        event.data.ptr = &child->exitTag;
+        child->pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+        if (child->pidfd == ERROR || epoll_ctl(epoll, EPOLL_CTL_ADD, child->pidfd, &event) == ERROR) {
+            fprintf(stderr, "%s: can not watch child %d: %s\n", programName, (int)pid, strerror(errno));
+            if (child->pidfd != ERROR) close(child->pidfd);
+            if (client != ERROR) close(client);
+            free(child);
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+            return ERROR;
+        }
+    }
+
+    if (client != ERROR) {
+        /* the progress of the request is out of sight, only its end */
+        if (readTimeout > 0) startTimeout(timers, &child->timeout, TIMEOUT_READ, 0);
+        child->timingFirstByte = 1;
+        watchClient(child);
+    }
+    if (deadlineMilliseconds > 0) armTimer(timers, &child->deadline, timers->now + (uint64_t)deadlineMilliseconds);
+
+    child->next = children;
+    if (children != NULL) children->previous = child;
+    children = child;
+    childCount++;
+    changeActive(1);
+    return SUCCESS;
+}
+
+/**
+ * @brief handleChildEvent
+ *
+ * handle an epoll event whose data.ptr was set by this module
+ *
+ * \param tag data.ptr of the event
+ * \param events the events reported
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void handleChildEvent(void *tag, uint32_t events) {
+    struct eventTag *event = tag;
+
+    /* reaped earlier in the same batch of events */
+    if (event->child != NULL && event->child->reaped) return;
+
+    switch (event->kind) {
+        case EVENT_SIGNAL:
+            reapSignalledChildren();
+            break;
+        case EVENT_EXIT:
+            reapChild(event->child);
+            break;
+        case EVENT_CLIENT:
+            handleClientEvent(event->child, events);
+            break;
+    }
+}
+
+/**
+ * @brief freeReapedChildren
+ *
+ * free the children reaped while handling a batch of events, to be called
+ * once the batch is done, as later events of it may still name them
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void freeReapedChildren(void) {
+    while (reapedChildren != NULL) {
+        struct supervisedChild *child = reapedChildren;
+        reapedChildren = child->next;
+        free(child);
+    }
+}
+
+/**
+ * @brief supervisedChildren
+ *
+ * \return int
+ * \retval number of children started and not yet reaped
+ *
+ */
+int supervisedChildren(void) {
+    return childCount;
+}
+
+/**
+ * @brief reapChild
+ *
+ * collect the status of a child whose pidfd became readable
+ *
+ * \param child the child
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void reapChild(struct supervisedChild *child) {
+    int status;
+    struct rusage usage;
+
+    pid_t pid = wait4(child->pid, &status, WNOHANG, &usage);
+    if (pid == SUCCESS) return;
+    if (pid == ERROR) {
+        fprintf(stderr, "%s: wait4() failed for child %d: %s\n", programName, (int)child->pid, strerror(errno));
+        forgetChild(child);
+        return;
+    }
+
+    accountChild(child, status, &usage);
+    forgetChild(child);
+}
+
+/**
+ * @brief reapSignalledChildren
+ *
+ * signalfd fallback: collect every child that has terminated
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void reapSignalledChildren(void) {
+    struct signalfd_siginfo signalInfo;
+    int status;
+    struct rusage usage;
+    pid_t pid;
+
+    /* SIGCHLD does not queue, one read covers any number of children */
+    while (read(signalDescriptor, &signalInfo, sizeof(signalInfo)) == sizeof(signalInfo)) {
+    }
+
+    while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+        struct supervisedChild *child = children;
+        while (child != NULL && child->pid != pid) child = child->next;
+
+        /* e.g. the keeper of the pool */
+        if (child == NULL) continue;
+
+        accountChild(child, status, &usage);
+        forgetChild(child);
+    }
+}
+
+/**
+ * @brief accountChild
+ *
+ * update the metrics and write the accounting record of a terminated child
+ *
+ * \param child the child
+ * \param status status returned by wait4()
+ * \param usage resource usage returned by wait4()
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void accountChild(const struct supervisedChild *child, int status, const struct rusage *usage) {
+    TRACE(TRACE_CHILD, TRACE_END, (uint64_t)child->pid, (uint64_t)status);
+    if (child->client != ERROR) {
+        recordLatency(METRIC_REQUEST, metricsClock() - child->accepted);
+        countClientBytes(child->client);
+    }
+    if (child->killed || !WIFEXITED(status) || WEXITSTATUS(status) != 0) countMetric(METRIC_ERRORS, 1);
+
+    if (accounting == NULL && !verbose) return;
+
+    char record[256];
+    snprintf(record, sizeof(record), "pid=%d exit=%d signal=%d killed=%d wall_us=%llu user_us=%llu sys_us=%llu maxrss_kb=%ld",
+             (int)child->pid,
+             WIFEXITED(status) ? WEXITSTATUS(status) : -1,
+             WIFSIGNALED(status) ? WTERMSIG(status) : 0,
+             child->killed,
+             (unsigned long long)((metricsClock() - child->started) / 1000ULL),
+             (unsigned long long)usage->ru_utime.tv_sec * 1000000ULL + (unsigned long long)usage->ru_utime.tv_usec,
+             (unsigned long long)usage->ru_stime.tv_sec * 1000000ULL + (unsigned long long)usage->ru_stime.tv_usec,
+             usage->ru_maxrss);
+
+    if (accounting != NULL) {
+        fprintf(accounting, "%ld %s\n", (long)time(NULL), record);
+    }
+    INFO("accountChild()", "%s", record);
+}
+
+/**
+ * @brief forgetChild
+ *
+ * \param child a reaped child, freed by freeReapedChildren()
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void forgetChild(struct supervisedChild *child) {
+    disarmTimer(timers, &child->deadline);
+    stopTimeout(timers, &child->timeout);
+    /* a grandchild may still hold the client, closing would not remove it */
+    if (child->watchingClient) epoll_ctl(epoll, EPOLL_CTL_DEL, child->client, NULL);
+    if (child->pidfd != ERROR) {
+        epoll_ctl(epoll, EPOLL_CTL_DEL, child->pidfd, NULL);
+        close(child->pidfd);
+    }
+    /* closing removes it from epoll, and the client sees the end of the response */
+    if (child->client != ERROR) close(child->client);
+
+    if (child->previous != NULL) child->previous->next = child->next;
+    else children = child->next;
+    if (child->next != NULL) child->next->previous = child->previous;
+
+    child->reaped = 1;
+    child->next = reapedChildren;
+    reapedChildren = child;
+
+    childCount--;
+    changeActive(-1);
+}
+
+/**
+ * @brief handleClientEvent
+ *
+ * the request is complete once the client has shut down its side, or the
+ * child answers, or the connection fails; the child's first send puts a
+ * timestamp on the error queue, which epoll reports as EPOLLERR
+ *
+ * \param child the child
+ * \param events the events reported for its client
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void handleClientEvent(struct supervisedChild *child, uint32_t events) {
+    if ((events & (EPOLLERR | EPOLLHUP)) && child->timingFirstByte) readFirstByte(child);
+    if (events & (EPOLLRDHUP | EPOLLERR | EPOLLHUP)) stopTimeout(timers, &child->timeout);
+    watchClient(child);
+}
+
+/**
+ * @brief readFirstByte
+ *
+ * take the transmit timestamp of the child's first send from the error
+ * queue of its client, later sends are not timed
+ *
+ * \param child the child
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void readFirstByte(struct supervisedChild *child) {
+    union {
+        char buffer[CMSG_SPACE(sizeof(struct scm_timestamping)) + CMSG_SPACE(sizeof(struct sock_extended_err))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr message;
+
+    memset(&message, 0, sizeof(message));
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    /* nothing queued: the event was a socket error or hangup */
+    if (recvmsg(child->client, &message, MSG_ERRQUEUE | MSG_DONTWAIT) != ERROR) {
+        for (struct cmsghdr *header = CMSG_FIRSTHDR(&message); header != NULL; header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_TIMESTAMPING) continue;
+
+            struct scm_timestamping timestamps;
+            memcpy(&timestamps, CMSG_DATA(header), sizeof(timestamps));
+            int64_t elapsed = (int64_t)(timestamps.ts[0].tv_sec - child->startedRealtime.tv_sec) * 1000000000LL
+                              + (timestamps.ts[0].tv_nsec - child->startedRealtime.tv_nsec);
+            recordLatency(METRIC_START_TO_FIRST_BYTE, elapsed > 0 ? (uint64_t)elapsed : 0);
+            break;
+        }
+    }
+
+    /* later sends are not timed */
+    int flags = 0;
+    setsockopt(child->client, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+    child->timingFirstByte = 0;
+}
+
+/**
+ * @brief watchClient
+ *
+ * register the client for what is still to be watched, or remove it
+ *
+ * \param child the child
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void watchClient(struct supervisedChild *child) {
+    int waitingForRequest = timerArmed(&child->timeout.timer);
+    struct epoll_event event;
+
+    if (!child->timingFirstByte && !waitingForRequest) {
+        if (child->watchingClient) epoll_ctl(epoll, EPOLL_CTL_DEL, child->client, NULL);
+        child->watchingClient = 0;
+        return;
+    }
+
+    /* EPOLLERR, where timestamps are reported, needs no request */
+    memset(&event, 0, sizeof(event));
+    event.events = waitingForRequest ? EPOLLRDHUP : 0;
+    event.data.ptr = &child->clientTag;
+    if (epoll_ctl(epoll, child->watchingClient ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, child->client, &event) == SUCCESS) {
+        child->watchingClient = 1;
+    }
+    else if (!child->watchingClient) {
+        /* neither timed nor timed out, the deadline still applies */
+        stopTimeout(timers, &child->timeout);
+        child->timingFirstByte = 0;
+    }
+}
+
+/**
+ * @brief expireDeadline
+ *
+ * timer callback: the child has run longer than the deadline
+ *
+ * \param context the child
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void expireDeadline(void *context) {
+    struct supervisedChild *child = context;
+
+    INFO("expireDeadline()", "child %d exceeded the deadline of %ld ms", (int)child->pid, deadlineMilliseconds);
+    killChild(child);
+}
+
+/**
+ * @brief expireRequest
+ *
+ * timer callback: the client has not sent its request within the read
+ * timeout
+ *
+ * \param context the child
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void expireRequest(void *context) {
+    struct supervisedChild *child = context;
+
+    if (!timeoutExpired(timers, &child->timeout)) return;
+    INFO("expireRequest()", "child %d has not got its request", (int)child->pid);
+    killChild(child);
+    watchClient(child);
+}
+
+/**
+ * @brief killChild
+ *
+ * SIGKILL a child together with its process group, it is reaped and
+ * accounted like any other child
+ *
+ * \param child the child
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void killChild(struct supervisedChild *child) {
+    if (child->killed) return;
+    if (kill(-child->pid, SIGKILL) == ERROR) kill(child->pid, SIGKILL);
+    child->killed = 1;
+}
+
+/**
+ * @brief countClientBytes
+ *
+ * add the bytes a finished connection has received and sent to the metrics
+ *
+ * \param client the client of a reaped child or a sent buffered response
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void countClientBytes(int client) {
+    struct tcp_info info;
+    socklen_t size = sizeof(info);
+
+    memset(&info, 0, sizeof(info));
+    if (getsockopt(client, IPPROTO_TCP, TCP_INFO, &info, &size) == ERROR) return;
+
+    if (size >= offsetof(struct tcp_info, tcpi_bytes_received) + sizeof(info.tcpi_bytes_received)) {
+        countMetric(METRIC_BYTES_IN, info.tcpi_bytes_received);
+    }
+    /* tcpi_bytes_sent counts retransmissions, older kernels only know what was acked */
+    if (size >= offsetof(struct tcp_info, tcpi_bytes_retrans) + sizeof(info.tcpi_bytes_retrans)) {
+        countMetric(METRIC_BYTES_OUT, info.tcpi_bytes_sent - info.tcpi_bytes_retrans);
+    }
+    else if (size >= offsetof(struct tcp_info, tcpi_bytes_acked) + sizeof(info.tcpi_bytes_acked)) {
+        countMetric(METRIC_BYTES_OUT, info.tcpi_bytes_acked);
+    }
+}
@@ -0,0 +1,41 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_children.h
+ * VCS - Tcp/Ip Exercise - supervision of the server logic processes of the
+ * fork engine
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_CHILDREN_H
+#define SIMPLE_MESSAGE_SERVER_CHILDREN_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include "simple_message_timer.h"
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int startChildSupervision(int epollDescriptor, struct timerWheel *wheel, long deadline, const char *accountingPath);
+void watchFirstByte(int client);
+int superviseChild(pid_t pid, int client, uint64_t accepted);
+void handleChildEvent(void *tag, uint32_t events);
+void freeReapedChildren(void);
+int supervisedChildren(void);
+void countClientBytes(int client);
+
+#endif /* SIMPLE_MESSAGE_SERVER_CHILDREN_H */
@@ -0,0 +1,404 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_epoll.c
+ * VCS - Tcp/Ip Exercise - engine 'epoll': one process multiplexes all client
+ * connections with epoll, accepts them in batches with accept4() and serves
+ * them with an in-process request handler instead of fork()/execl() of the
+ * 'simple_message_server_logic'
+ *
+ * A connection reads the request until the client shuts down its sending
+ * side, runs the handler and then writes the response, all non-blocking.
+ * Handlers run on the event loop, so they must not block.
+ *
+ * When shutdownRequested gets set (preforked workers on SIGTERM) the engine
+ * accepts what is already queued, closes the listening socket and returns
+ * once the remaining connections are done.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include "simple_message_server.h"
+#include "simple_message_server_epoll.h"
+#include "simple_message_server_metrics.h"
+#include "simple_message_server_timeouts.h"
+#include "simple_message_timer.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* number of events fetched by one epoll_wait() */
+#define MAX_EVENTS 64
+
+/* upper bound of connections taken off the listen queue per wakeup */
+#define ACCEPT_BATCH_SIZE 64
+
+#define READ_CHUNK_SIZE 16384
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+struct connection {
+    int fd;
+    char *request;
+    size_t requestLength;
+    size_t requestCapacity;
+    struct responseBuffer response;
+    size_t responseSent;
+    uint64_t accepted;          /* metricsClock() of accept() */
+    uint64_t started;           /* metricsClock() when the handler ran */
+    struct connectionTimeout timeout;
+};
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+static int openConnections;
+static struct timerWheel timers;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static int acceptClients(int epollDescriptor, int listening_socket_descriptor);
+static int readRequest(struct connection *connection);
+static int writeResponse(struct connection *connection);
+static void closeConnection(struct connection *connection);
+static void expireConnection(void *context);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief runEpollEngine
+ *
+ * event loop of the engine, returns after a requested shutdown or if it
+ * could not be set up or epoll_wait() fails
+ *
+ * \param listening_socket_descriptor listening socket descriptor
+ * \param requestHandler handler producing the responses
+ *
+ * \return int
+ * \retval SUCCESS after a requested shutdown
+ * \retval ERROR on Error
+ *
+ */
+int runEpollEngine(int listening_socket_descriptor, const struct requestHandler *requestHandler) {
+    int epollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    if (epollDescriptor == ERROR) {
+        fprintf(stderr, "%s: epoll_create1() failed: %s\n", programName, strerror(errno));
+        return ERROR;
+    }
+
+    /* the listening sockets are the only entries without a connection, */
+    /* preforked workers share the UNIX one, so only one of them is woken */
+    struct epoll_event event;
+    if (watchListeners(epollDescriptor, listening_socket_descriptor, EPOLL_CTL_ADD, EPOLLEXCLUSIVE) != SUCCESS) {
+        fprintf(stderr, "%s: epoll_ctl() failed for listening socket: %s\n", programName, strerror(errno));
+        close(epollDescriptor);
+        return ERROR;
+    }
+
+    /* signals blocked by the caller (SIGTERM in workers) only interrupt epoll_pwait() */
+    /* others, like SIGUSR1 of the metrics thread, stay blocked */
+    sigset_t waitMask;
+    sigprocmask(SIG_BLOCK, NULL, &waitMask);
+    sigdelset(&waitMask, SIGTERM);
+    sigdelset(&waitMask, SIGINT);
+
+    initTimerWheel(&timers);
+
+    INFO("runEpollEngine()", "waiting for client connections %s", "");
+    struct epoll_event events[MAX_EVENTS];
+    int listening = 1;
+    while (listening || openConnections > 0) {
+        if (shutdownRequested && listening) {
+            /* closing an SO_REUSEPORT socket drops its queue, so take it first */
+            while (acceptClients(epollDescriptor, listening_socket_descriptor) == ACCEPT_BATCH_SIZE) {
+                /* keep draining */
+            }
+            /* the UNIX one is shared, but this may be the last worker */
+            while (unixListener != ERROR && acceptClients(epollDescriptor, unixListener) == ACCEPT_BATCH_SIZE) {
+                /* keep draining */
+            }
+            watchListeners(epollDescriptor, listening_socket_descriptor, EPOLL_CTL_DEL, 0);
+            close(listening_socket_descriptor);
+            if (unixListener != ERROR) close(unixListener);
+            listening = 0;
+            INFO("runEpollEngine()", "shutting down, %d connections left", openConnections);
+            continue;
+        }
+
+        int ready = epoll_pwait(epollDescriptor, events, MAX_EVENTS, timeToNextTimer(&timers), &waitMask);
+        if (ready == ERROR) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "%s: epoll_wait() failed: %s\n", programName, strerror(errno));
+            close(epollDescriptor);
+            return ERROR;
+        }
+        updateTimerClock(&timers);
+
+        for (int i = 0; i < ready; i++) {
+            struct connection *connection = events[i].data.ptr;
+
+            if (connection == NULL) {
+                acceptClients(epollDescriptor, listening_socket_descriptor);
+                continue;
+            }
+            if (events[i].data.ptr == &unixListener) {
+                acceptClients(epollDescriptor, unixListener);
+                continue;
+            }
+
+            /* once there is a response the connection only writes */
+            if (connection->response.length > 0) {
+                if (writeResponse(connection) != SUCCESS) closeConnection(connection);
+                continue;
+            }
+
+            switch (readRequest(connection)) {
+                case SUCCESS:
+                    /* need more data */
+                    break;
+                case DONE:
+                    startTimeout(&timers, &connection->timeout, TIMEOUT_WRITE, 1);
+                    connection->started = metricsClock();
+                    recordLatency(METRIC_ACCEPT_TO_START, connection->started - connection->accepted);
+                    countMetric(METRIC_BYTES_IN, connection->requestLength);
+                    if (runRequestHandler(requestHandler, connection->request, connection->requestLength, &connection->response) != SUCCESS) {
+                        fprintf(stderr, "%s: failed to build response: %s\n", programName, strerror(errno));
+                        closeConnection(connection);
+                        break;
+                    }
+                    free(connection->request);
+                    connection->request = NULL;
+
+                    /* most responses fit into the socket buffer right away */
+                    switch (writeResponse(connection)) {
+                        case SUCCESS:
+                            memset(&event, 0, sizeof(event));
+                            event.events = EPOLLOUT;
+                            event.data.ptr = connection;
+                            if (epoll_ctl(epollDescriptor, EPOLL_CTL_MOD, connection->fd, &event) == ERROR) closeConnection(connection);
+                            break;
+                        default:
+                            closeConnection(connection);
+                            break;
+                    }
+                    break;
+                default:
+                    closeConnection(connection);
+                    break;
+            }
+        }
+
+        /* no event names a connection closed here */
+        advanceTimers(&timers);
+    }
+
+    close(epollDescriptor);
+    return SUCCESS;
+}
+
+/**
+ * @brief acceptClients
+ *
+ * take up to ACCEPT_BATCH_SIZE connections off the listen queue and register
+ * them, the listening socket is level triggered so leftovers wake us again
+ *
+ * \param epollDescriptor epoll instance
+ * \param listening_socket_descriptor listening socket descriptor
+ *
+ * \return int
+ * \retval number of accepted connections
+ *
+ */
+static int acceptClients(int epollDescriptor, int listening_socket_descriptor) {
+    int accepted;
+
+    for (accepted = 0; accepted < ACCEPT_BATCH_SIZE; accepted++) {
+        int client = accept4(listening_socket_descriptor, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client == ERROR) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                /* e.g. EMFILE, the connection stays queued until fds are released */
+                fprintf(stderr, "%s: failed to accept client: %s\n", programName, strerror(errno));
+            }
+            break;
+        }
+
+        struct connection *connection = calloc(1, sizeof(*connection));
+        if (connection == NULL) {
+            fprintf(stderr, "%s: out of memory for client connection\n", programName);
+            close(client);
+            break;
+        }
+        connection->fd = client;
+        connection->accepted = metricsClock();
+        initTimeout(&connection->timeout, expireConnection, connection);
+        startTimeout(&timers, &connection->timeout, TIMEOUT_READ, 1);
+        TRACE(TRACE_HANDLE, TRACE_BEGIN, (uint64_t)(uintptr_t)connection, (uint64_t)client);
+        openConnections++;
+        countMetric(METRIC_ACCEPTED, 1);
+        changeActive(1);
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.ptr = connection;
+        if (epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, client, &event) == ERROR) {
+            fprintf(stderr, "%s: epoll_ctl() failed for client: %s\n", programName, strerror(errno));
+            closeConnection(connection);
+        }
+    }
+
+    INFO("acceptClients()", "accepted %d clients", accepted);
+    return accepted;
+}
+
+/**
+ * @brief readRequest
+ *
+ * read everything available on the connection
+ *
+ * \param connection client connection
+ *
+ * \return int
+ * \retval SUCCESS if the request is not complete yet
+ * \retval DONE if the client has sent the complete request
+ * \retval ERROR on Error
+ *
+ */
+static int readRequest(struct connection *connection) {
+    while (1 == 1) {
+        if (connection->requestCapacity - connection->requestLength < READ_CHUNK_SIZE) {
+            size_t capacity = connection->requestCapacity == 0 ? READ_CHUNK_SIZE : connection->requestCapacity * 2;
+            if (capacity > MAX_REQUEST_SIZE) {
+                fprintf(stderr, "%s: request exceeds %d bytes\n", programName, MAX_REQUEST_SIZE);
+                return ERROR;
+            }
+            char *grown = realloc(connection->request, capacity);
+            if (grown == NULL) return ERROR;
+            connection->request = grown;
+            connection->requestCapacity = capacity;
+        }
+
+        ssize_t received = read(connection->fd, connection->request + connection->requestLength, connection->requestCapacity - connection->requestLength);
+        if (received > 0) {
+            connection->requestLength += (size_t)received;
+            noteProgress(&timers, &connection->timeout);
+            continue;
+        }
+        if (received == 0) return DONE;
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return SUCCESS;
+        return ERROR;
+    }
+}
+
+/**
+ * @brief writeResponse
+ *
+ * write as much of the response as the socket takes
+ *
+ * \param connection client connection
+ *
+ * \return int
+ * \retval SUCCESS if the socket is full and there is more to write
+ * \retval DONE if the response was written completely
+ * \retval ERROR on Error
+ *
+ */
+static int writeResponse(struct connection *connection) {
+    while (connection->responseSent < connection->response.length) {
+        ssize_t sent = send(connection->fd, connection->response.data + connection->responseSent,
+                            connection->response.length - connection->responseSent, MSG_NOSIGNAL);
+        if (sent == ERROR) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return SUCCESS;
+            return ERROR;
+        }
+        if (connection->responseSent == 0) recordLatency(METRIC_START_TO_FIRST_BYTE, metricsClock() - connection->started);
+        connection->responseSent += (size_t)sent;
+        noteProgress(&timers, &connection->timeout);
+    }
+
+    /* closeConnection() will be done by the caller */
+    return DONE;
+}
+
+/**
+ * @brief closeConnection
+ *
+ * close the client socket (which also removes it from epoll) and free the
+ * connection, a connection closed before its response was sent counts as an
+ * error
+ *
+ * \param connection client connection
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void closeConnection(struct connection *connection) {
+    if (connection->response.length > 0 && connection->responseSent == connection->response.length) {
+        recordLatency(METRIC_REQUEST, metricsClock() - connection->accepted);
+        countMetric(METRIC_BYTES_OUT, connection->responseSent);
+    }
+    else {
+        countMetric(METRIC_ERRORS, 1);
+    }
+    TRACE(TRACE_HANDLE, TRACE_END, (uint64_t)(uintptr_t)connection, connection->responseSent);
+    stopTimeout(&timers, &connection->timeout);
+    changeActive(-1);
+    openConnections--;
+    close(connection->fd);
+    free(connection->request);
+    releaseResponse(&connection->response);
+    free(connection);
+}
+
+/**
+ * @brief expireConnection
+ *
+ * timer callback of a connection
+ *
+ * \param context client connection
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void expireConnection(void *context) {
+    struct connection *connection = context;
+
+    if (!timeoutExpired(&timers, &connection->timeout)) return;
+    resetOnClose(connection->fd);
+    closeConnection(connection);
+}
@@ -0,0 +1,32 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_epoll.h
+ * VCS - Tcp/Ip Exercise - single process, non-blocking epoll engine
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_EPOLL_H
+#define SIMPLE_MESSAGE_SERVER_EPOLL_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include "simple_message_server_handler.h"
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int runEpollEngine(int listening_socket_descriptor, const struct requestHandler *requestHandler);
+
+#endif /* SIMPLE_MESSAGE_SERVER_EPOLL_H */
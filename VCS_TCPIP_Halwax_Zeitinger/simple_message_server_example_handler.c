@@ -0,0 +1,88 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_example_handler.c
+ * VCS - Tcp/Ip Exercise - example request handler for the 'epoll' engine,
+ * answers every post with a small html page showing the message
+ *
+ * build: make simple_message_server_example_handler.so
+ * run:   simple_message_server -p <port> --engine=epoll \
+ *            --handler=./simple_message_server_example_handler.so
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "simple_message_server_plugin.h"
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static int handlePost(const struct sms_request *request, struct sms_response_writer *response);
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+const struct sms_handler sms_handler_v1 = {
+    SMS_HANDLER_ABI_VERSION,
+    sizeof(struct sms_handler),
+    "example",
+    NULL,
+    handlePost,
+    NULL
+};
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief handlePost
+ *
+ * render the post into "index.html"
+ *
+ * \param request the parsed request
+ * \param response writer for the response
+ *
+ * \return int
+ * \retval 0 on Success
+ * \retval -1 on Error
+ *
+ */
+static int handlePost(const struct sms_request *request, struct sms_response_writer *response) {
+    char *page = NULL;
+    int length;
+
+    if (request->image_url != NULL) {
+        length = asprintf(&page, "<html><body><h1>%.*s</h1><p>%.*s</p><img src=\"%.*s\"/></body></html>\n",
+                          (int)request->user_length, request->user,
+                          (int)request->message_length, request->message,
+                          (int)request->image_url_length, request->image_url);
+    }
+    else {
+        length = asprintf(&page, "<html><body><h1>%.*s</h1><p>%.*s</p></body></html>\n",
+                          (int)request->user_length, request->user,
+                          (int)request->message_length, request->message);
+    }
+    if (length < 0) return -1;
+
+    int result = sms_response_status(response, SMS_STATUS_OK);
+    if (result == 0) result = sms_response_file(response, "index.html", page, (size_t)length);
+    free(page);
+    return result;
+}
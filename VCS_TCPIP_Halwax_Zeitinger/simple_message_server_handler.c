@@ -0,0 +1,230 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_handler.c
+ * VCS - Tcp/Ip Exercise - loads a request handler shared object (see
+ * simple_message_server_plugin.h), parses requests and collects the responses
+ * the handler produces
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include "simple_message_server.h"
+#include "simple_message_server_handler.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define USER_KEY "user="
+#define IMAGE_KEY "img="
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief loadRequestHandler
+ *
+ * dlopen() the handler, check its ABI version and call its init()
+ *
+ * \param path path of the shared object
+ * \param requestHandler filled on success
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+int loadRequestHandler(const char *path, struct requestHandler *requestHandler) {
+    INFO("loadRequestHandler()", "loading %s", path);
+    void *library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (library == NULL) {
+        fprintf(stderr, "%s: dlopen() failed: %s\n", programName, dlerror());
+        return ERROR;
+    }
+
+    const struct sms_handler *handler = dlsym(library, SMS_HANDLER_SYMBOL);
+    if (handler == NULL) {
+        fprintf(stderr, "%s: %s does not export %s\n", programName, path, SMS_HANDLER_SYMBOL);
+        dlclose(library);
+        return ERROR;
+    }
+
+    if (handler->abi_version != SMS_HANDLER_ABI_VERSION || handler->size < sizeof(struct sms_handler) || handler->handle == NULL) {
+        fprintf(stderr, "%s: %s has an incompatible handler ABI (version %u, size %u)\n", programName, path, handler->abi_version, handler->size);
+        dlclose(library);
+        return ERROR;
+    }
+
+    if (handler->init != NULL && handler->init() != SUCCESS) {
+        fprintf(stderr, "%s: init() of handler %s failed\n", programName, handler->name != NULL ? handler->name : path);
+        dlclose(library);
+        return ERROR;
+    }
+
+    INFO("loadRequestHandler()", "loaded handler %s", handler->name != NULL ? handler->name : path);
+    requestHandler->library = library;
+    requestHandler->handler = handler;
+    return SUCCESS;
+}
+
+/**
+ * @brief unloadRequestHandler
+ *
+ * call fini() of the handler and dlclose() it
+ *
+ * \param requestHandler handler loaded by loadRequestHandler()
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void unloadRequestHandler(struct requestHandler *requestHandler) {
+    if (requestHandler->library == NULL) return;
+    if (requestHandler->handler->fini != NULL) requestHandler->handler->fini();
+    dlclose(requestHandler->library);
+    requestHandler->library = NULL;
+    requestHandler->handler = NULL;
+}
+
+/**
+ * @brief parseRequest
+ *
+ * split a complete request "user=<user>\n[img=<url>\n]<message>\n" into its
+ * fields, the fields point into data
+ *
+ * \param data request as received from the client
+ * \param length number of bytes in data
+ * \param request filled on success
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on malformed request
+ *
+ */
+int parseRequest(const char *data, size_t length, struct sms_request *request) {
+    const char *end = data + length;
+
+    if (length < sizeof(USER_KEY) - 1 || memcmp(data, USER_KEY, sizeof(USER_KEY) - 1) != 0) return ERROR;
+    request->user = data + sizeof(USER_KEY) - 1;
+    const char *newline = memchr(request->user, '\n', (size_t)(end - request->user));
+    if (newline == NULL) return ERROR;
+    request->user_length = (size_t)(newline - request->user);
+
+    const char *next = newline + 1;
+    request->image_url = NULL;
+    request->image_url_length = 0;
+    if ((size_t)(end - next) >= sizeof(IMAGE_KEY) - 1 && memcmp(next, IMAGE_KEY, sizeof(IMAGE_KEY) - 1) == 0) {
+        request->image_url = next + sizeof(IMAGE_KEY) - 1;
+        newline = memchr(request->image_url, '\n', (size_t)(end - request->image_url));
+        if (newline == NULL) return ERROR;
+        request->image_url_length = (size_t)(newline - request->image_url);
+        next = newline + 1;
+    }
+
+    /* the message is everything up to the terminating newline */
+    request->message = next;
+    request->message_length = (size_t)(end - next);
+    if (request->message_length > 0 && next[request->message_length - 1] == '\n') request->message_length--;
+    return SUCCESS;
+}
+
+/**
+ * @brief runRequestHandler
+ *
+ * parse a request and let the handler produce the response, if either fails
+ * the response is replaced by "status=1"
+ *
+ * \param requestHandler loaded handler
+ * \param data request as received from the client
+ * \param length number of bytes in data
+ * \param response buffer collecting the response
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR if not even the error response could be built
+ *
+ */
+int runRequestHandler(const struct requestHandler *requestHandler, const char *data, size_t length, struct responseBuffer *response) {
+    struct sms_request request;
+    struct sms_response_writer writer = { response, appendToResponse };
+
+    if (parseRequest(data, length, &request) != SUCCESS) {
+        INFO("runRequestHandler()", "malformed request of %zu bytes", length);
+    }
+    else if (requestHandler->handler->handle(&request, &writer) == SUCCESS) {
+        return SUCCESS;
+    }
+    else {
+        INFO("runRequestHandler()", "handler failed %s", "");
+    }
+
+    response->length = 0;
+    return sms_response_status(&writer, SMS_STATUS_ERROR) == SUCCESS ? SUCCESS : ERROR;
+}
+
+/**
+ * @brief appendToResponse
+ *
+ * write() of the sms_response_writer handed to the handler
+ *
+ * \param context the struct responseBuffer
+ * \param data bytes to append
+ * \param length number of bytes
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR if out of memory
+ *
+ */
+int appendToResponse(void *context, const void *data, size_t length) {
+    struct responseBuffer *response = context;
+
+    if (response->capacity - response->length < length) {
+        size_t capacity = response->capacity == 0 ? 4096 : response->capacity;
+        while (capacity - response->length < length) capacity *= 2;
+        char *grown = realloc(response->data, capacity);
+        if (grown == NULL) return ERROR;
+        response->data = grown;
+        response->capacity = capacity;
+    }
+
+    memcpy(response->data + response->length, data, length);
+    response->length += length;
+    return SUCCESS;
+}
+
+/**
+ * @brief releaseResponse
+ *
+ * free the memory of a response buffer
+ *
+ * \param response buffer to release
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void releaseResponse(struct responseBuffer *response) {
+    free(response->data);
+    response->data = NULL;
+    response->length = 0;
+    response->capacity = 0;
+}
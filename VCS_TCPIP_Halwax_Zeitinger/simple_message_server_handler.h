@@ -0,0 +1,61 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_handler.h
+ * VCS - Tcp/Ip Exercise - loading of in-process request handlers and the
+ * request/response plumbing shared by the event driven engines
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_HANDLER_H
+#define SIMPLE_MESSAGE_SERVER_HANDLER_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include "simple_message_server_plugin.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* requests are read completely before the handler runs, so cap them */
+#define MAX_REQUEST_SIZE (16 * 1024 * 1024)
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+struct requestHandler {
+    void *library;
+    const struct sms_handler *handler;
+};
+
+struct responseBuffer {
+    char *data;
+    size_t length;
+    size_t capacity;
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int loadRequestHandler(const char *path, struct requestHandler *requestHandler);
+void unloadRequestHandler(struct requestHandler *requestHandler);
+int parseRequest(const char *data, size_t length, struct sms_request *request);
+int runRequestHandler(const struct requestHandler *requestHandler, const char *data, size_t length, struct responseBuffer *response);
+int appendToResponse(void *context, const void *data, size_t length);
+void releaseResponse(struct responseBuffer *response);
+
+#endif /* SIMPLE_MESSAGE_SERVER_HANDLER_H */
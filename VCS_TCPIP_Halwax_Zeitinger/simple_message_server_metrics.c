@@ -0,0 +1,396 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_metrics.c
+ * VCS - Tcp/Ip Exercise - exposition of the server metrics. The counters
+ * live in an anonymous shared mapping created before any fork(), so the
+ * values of all preforked workers and of the fork engine add up in one
+ * place without locks.
+ *
+ * A thread of the main process serves them in the Prometheus text format,
+ * over HTTP on an admin UNIX socket or loopback port, and writes them to
+ * stdout on SIGUSR1. SIGUSR1 is blocked in every other thread and in
+ * forked workers, the thread takes it from a signalfd.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include "simple_message_server.h"
+#include "simple_message_server_metrics.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* an admin client gets this long to send its request */
+#define ADMIN_TIMEOUT_SECONDS 1
+
+#define ADMIN_REQUEST_SIZE 4096
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+struct serverMetrics *serverMetrics;
+
+/* listening admin socket, ERROR if there is none */
+static int adminSocket = ERROR;
+
+static const char *counterNames[METRIC_COUNTERS][2] = {
+    { "sms_accepted_total", "Connections accepted" },
+    { "sms_shed_total", "Connections answered with status busy under overload" },
+    { "sms_accept_pauses_total", "Times accepting was paused at the in-flight limit" },
+    { "sms_errors_total", "Failed spawns, server logic processes and connections" },
+    { "sms_received_bytes_total", "Request bytes received from clients" },
+    { "sms_sent_bytes_total", "Response bytes sent to clients" },
+    { "sms_buffered_responses_total", "Responses of the server logic buffered in the server" },
+    { "sms_spilled_responses_total", "Buffered responses spilled to a temporary file" },
+    { "sms_read_timeouts_total", "Connections closed by --read-timeout" },
+    { "sms_write_timeouts_total", "Connections closed by --write-timeout" },
+    { "sms_idle_timeouts_total", "Connections closed by --idle-timeout" }
+};
+
+static const char *histogramNames[METRIC_HISTOGRAMS][2] = {
+    { "sms_accept_to_start_seconds", "From accept() to spawn, pool hand-off or request handler" },
+    { "sms_start_to_first_byte_seconds", "From start to the first response byte sent" },
+    { "sms_request_seconds", "From accept() to the end of the connection" }
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void *serveMetrics(void *unused);
+static int createAdminSocket(const char *admin);
+static void answerAdminClient(int listening);
+static int writeAll(int fd, const char *data, size_t length);
+static uint64_t bucketLimit(unsigned bucket);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief initMetrics
+ *
+ * map the shared counters, must be called before the first fork()
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+int initMetrics(void) {
+    void *mapping = mmap(NULL, sizeof(struct serverMetrics), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, ERROR, 0);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "%s: failed to map metrics: %s\n", programName, strerror(errno));
+        return ERROR;
+    }
+    serverMetrics = mapping;
+    return SUCCESS;
+}
+
+/**
+ * @brief startMetricsThread
+ *
+ * open the admin socket, block SIGUSR1 and start the thread exposing the
+ * metrics
+ *
+ * \param admin UNIX socket path or loopback tcp port to serve them on, or NULL
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+int startMetricsThread(const char *admin) {
+    sigset_t allSignals, previous, dumpSignal;
+    pthread_t thread;
+
+    if (admin != NULL && (adminSocket = createAdminSocket(admin)) == ERROR) {
+        return ERROR;
+    }
+
+    sigemptyset(&dumpSignal);
+    sigaddset(&dumpSignal, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &dumpSignal, NULL);
+
+    /* the thread must not take signals meant for the main thread */
+    sigfillset(&allSignals);
+    pthread_sigmask(SIG_SETMASK, &allSignals, &previous);
+    int result = pthread_create(&thread, NULL, serveMetrics, NULL);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (result != SUCCESS) {
+        fprintf(stderr, "%s: failed to start metrics thread: %s\n", programName, strerror(result));
+        return ERROR;
+    }
+    pthread_detach(thread);
+    return SUCCESS;
+}
+
+/**
+ * @brief renderMetrics
+ *
+ * format the metrics in the Prometheus text exposition format
+ *
+ * \param text set to a malloc()ed buffer, to be free()d by the caller
+ * \param length set to the length of text
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+int renderMetrics(char **text, size_t *length) {
+    FILE *output = open_memstream(text, length);
+    if (output == NULL) return ERROR;
+
+    for (int counter = 0; counter < METRIC_COUNTERS; counter++) {
+        fprintf(output, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+                counterNames[counter][0], counterNames[counter][1], counterNames[counter][0], counterNames[counter][0],
+                (unsigned long long)__atomic_load_n(&serverMetrics->counters[counter], __ATOMIC_RELAXED));
+    }
+
+    fprintf(output, "# HELP sms_active Server logic processes or connections in progress\n# TYPE sms_active gauge\nsms_active %lld\n",
+            (long long)__atomic_load_n(&serverMetrics->active, __ATOMIC_RELAXED));
+    fprintf(output, "# HELP sms_active_peak Highest value of sms_active\n# TYPE sms_active_peak gauge\nsms_active_peak %lld\n",
+            (long long)__atomic_load_n(&serverMetrics->peakActive, __ATOMIC_RELAXED));
+
+    for (int index = 0; index < METRIC_HISTOGRAMS; index++) {
+        const char *name = histogramNames[index][0];
+        struct histogram *histogram = &serverMetrics->histograms[index];
+        uint64_t cumulative = 0;
+
+        fprintf(output, "# HELP %s %s\n# TYPE %s histogram\n", name, histogramNames[index][1], name);
+        /* only buckets that ever got a value, the others add nothing */
+        for (unsigned bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+            uint64_t count = __atomic_load_n(&histogram->buckets[bucket], __ATOMIC_RELAXED);
+            if (count == 0) continue;
+            cumulative += count;
+            fprintf(output, "%s_bucket{le=\"%.9f\"} %llu\n", name, (double)bucketLimit(bucket) / 1e9, (unsigned long long)cumulative);
+        }
+        fprintf(output, "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.9f\n%s_count %llu\n",
+                name, (unsigned long long)cumulative,
+                name, (double)__atomic_load_n(&histogram->sum, __ATOMIC_RELAXED) / 1e9,
+                name, (unsigned long long)cumulative);
+    }
+
+    return fclose(output) == 0 ? SUCCESS : ERROR;
+}
+
+/**
+ * @brief serveMetrics
+ *
+ * body of the metrics thread
+ *
+ * \param unused not used
+ *
+ * \return void *
+ * \retval NULL if it has to give up
+ *
+ */
+static void *serveMetrics(void *unused) {
+    struct pollfd sources[2];
+    sigset_t dumpSignal;
+    int count = adminSocket == ERROR ? 1 : 2;
+
+    (void)unused;
+
+    sigemptyset(&dumpSignal);
+    sigaddset(&dumpSignal, SIGUSR1);
+    sources[0].fd = signalfd(ERROR, &dumpSignal, SFD_CLOEXEC);
+    sources[0].events = POLLIN;
+    if (sources[0].fd == ERROR) {
+        fprintf(stderr, "%s: metrics: signalfd() failed: %s\n", programName, strerror(errno));
+        return NULL;
+    }
+
+    sources[1].fd = adminSocket;
+    sources[1].events = POLLIN;
+
+    while (1 == 1) {
+        if (poll(sources, (nfds_t)count, -1) == ERROR) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "%s: metrics: poll() failed: %s\n", programName, strerror(errno));
+            return NULL;
+        }
+
+        if (sources[0].revents & POLLIN) {
+            struct signalfd_siginfo signalInfo;
+            char *text;
+            size_t length;
+
+            if (read(sources[0].fd, &signalInfo, sizeof(signalInfo)) == sizeof(signalInfo) && renderMetrics(&text, &length) == SUCCESS) {
+                /* write(), the main thread may use stdout at the same time */
+                writeAll(STDOUT_FILENO, text, length);
+                free(text);
+            }
+        }
+
+        if (count == 2 && (sources[1].revents & POLLIN)) {
+            answerAdminClient(adminSocket);
+        }
+    }
+}
+
+/**
+ * @brief createAdminSocket
+ *
+ * \param admin a path for a UNIX socket, or a port number for 127.0.0.1
+ *
+ * \return int
+ * \retval listening socket on Success
+ * \retval ERROR on Error
+ *
+ */
+static int createAdminSocket(const char *admin) {
+    struct sockaddr_storage address;
+    socklen_t addressLength;
+    int on = 1;
+
+    memset(&address, 0, sizeof(address));
+    if (strspn(admin, "0123456789") == strlen(admin)) {
+        struct sockaddr_in *inet = (struct sockaddr_in *)&address;
+        inet->sin_family = AF_INET;
+        inet->sin_port = htons((uint16_t)atoi(admin));
+        inet->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addressLength = sizeof(*inet);
+    }
+    else {
+        struct sockaddr_un *local = (struct sockaddr_un *)&address;
+        if (strlen(admin) >= sizeof(local->sun_path)) {
+            fprintf(stderr, "%s: metrics: socket path %s is too long\n", programName, admin);
+            return ERROR;
+        }
+        local->sun_family = AF_UNIX;
+        strcpy(local->sun_path, admin);
+        addressLength = sizeof(*local);
+        /* a socket left over by an earlier run */
+        unlink(admin);
+    }
+
+    int listening = socket(address.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listening == ERROR
+        || (address.ss_family == AF_INET && setsockopt(listening, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == ERROR)
+        || bind(listening, (struct sockaddr *)&address, addressLength) == ERROR
+        || listen(listening, 16) == ERROR) {
+        fprintf(stderr, "%s: metrics: can not serve on %s: %s\n", programName, admin, strerror(errno));
+        if (listening != ERROR) close(listening);
+        return ERROR;
+    }
+
+    INFO("createAdminSocket()", "serving metrics on %s", admin);
+    return listening;
+}
+
+/**
+ * @brief answerAdminClient
+ *
+ * answer any HTTP request with the metrics
+ *
+ * \param listening listening admin socket
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void answerAdminClient(int listening) {
+    static const char header[] = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n";
+    struct timeval timeout = { ADMIN_TIMEOUT_SECONDS, 0 };
+    char request[ADMIN_REQUEST_SIZE];
+    size_t received = 0;
+    char *text;
+    size_t length;
+
+    int client = accept4(listening, NULL, NULL, SOCK_CLOEXEC);
+    if (client == ERROR) return;
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    /* read up to the end of the header, the request itself does not matter */
+    while (received < sizeof(request) - 1) {
+        ssize_t chunk = recv(client, request + received, sizeof(request) - 1 - received, 0);
+        if (chunk <= 0) break;
+        received += (size_t)chunk;
+        request[received] = '\0';
+        if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL) break;
+    }
+
+    if (renderMetrics(&text, &length) == SUCCESS) {
+        if (writeAll(client, header, sizeof(header) - 1) == SUCCESS) writeAll(client, text, length);
+        free(text);
+    }
+    close(client);
+}
+
+/**
+ * @brief writeAll
+ *
+ * \param fd descriptor to write to
+ * \param data bytes to write
+ * \param length number of bytes
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int writeAll(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = send(fd, data, length, MSG_NOSIGNAL);
+        if (written == ERROR && errno == ENOTSOCK) written = write(fd, data, length);
+        if (written == ERROR) {
+            if (errno == EINTR) continue;
+            return ERROR;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief bucketLimit
+ *
+ * \param bucket index of a histogram bucket
+ *
+ * \return uint64_t
+ * \retval largest value counted in the bucket
+ *
+ */
+static uint64_t bucketLimit(unsigned bucket) {
+    if (bucket < HISTOGRAM_SUB_COUNT) return bucket;
+
+    unsigned shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t lower = (uint64_t)(HISTOGRAM_SUB_COUNT + (bucket & (HISTOGRAM_SUB_COUNT - 1))) << shift;
+    return lower + (((uint64_t)1 << shift) - 1);
+}
@@ -0,0 +1,181 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_metrics.h
+ * VCS - Tcp/Ip Exercise - counters and latency histograms of the server,
+ * kept in shared memory so preforked workers and children update them
+ * with plain atomic increments
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_METRICS_H
+#define SIMPLE_MESSAGE_SERVER_METRICS_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* log-linear buckets: values below 2^HISTOGRAM_SUB_BITS get a bucket each,
+ above that every power of two is split into 2^HISTOGRAM_SUB_BITS buckets,
+ so a bucket is never wider than 1/8 of its lower bound */
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT)
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+enum metricCounter {
+    METRIC_ACCEPTED,            /* connections accepted */
+    METRIC_SHED,                /* connections answered with STATUS_BUSY */
+    METRIC_PAUSES,              /* times accepting was paused at --max-inflight */
+    METRIC_ERRORS,              /* failed spawns, children and connections */
+    METRIC_BYTES_IN,            /* request bytes received */
+    METRIC_BYTES_OUT,           /* response bytes sent */
+    METRIC_BUFFERED,            /* responses buffered in the server (--buffer) */
+    METRIC_SPILLED,             /* buffered responses spilled to a temporary file */
+    METRIC_READ_TIMEOUTS,       /* requests not complete within --read-timeout */
+    METRIC_WRITE_TIMEOUTS,      /* responses not sent within --write-timeout */
+    METRIC_IDLE_TIMEOUTS,       /* connections without progress for --idle-timeout */
+    METRIC_COUNTERS
+};
+
+enum metricHistogram {
+    METRIC_ACCEPT_TO_START,     /* accept() to spawn, hand-off or handler */
+    METRIC_START_TO_FIRST_BYTE, /* start to the first response byte sent */
+    METRIC_REQUEST,             /* accept() to the end of the connection */
+    METRIC_HISTOGRAMS
+};
+
+struct histogram {
+    uint64_t count;
+    uint64_t sum;               /* nanoseconds */
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+struct serverMetrics {
+    uint64_t counters[METRIC_COUNTERS];
+    int64_t active;             /* children or connections in progress */
+    int64_t peakActive;
+    struct histogram histograms[METRIC_HISTOGRAMS];
+};
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+/* NULL until initMetrics(), updates are dropped then */
+extern struct serverMetrics *serverMetrics;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int initMetrics(void);
+int startMetricsThread(const char *admin);
+int renderMetrics(char **text, size_t *length);
+
+/*
+ * -------------------------------------------------------- inline functions --
+ */
+
+/**
+ * @brief metricsClock
+ *
+ * \return uint64_t
+ * \retval monotonic time in nanoseconds
+ *
+ */
+static inline uint64_t metricsClock(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * @brief countMetric
+ *
+ * \param counter counter to increase
+ * \param amount amount to add
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static inline void countMetric(enum metricCounter counter, uint64_t amount) {
+    if (serverMetrics != NULL) __atomic_fetch_add(&serverMetrics->counters[counter], amount, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief changeActive
+ *
+ * \param delta +1 when a child or connection starts, -1 when it ends
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static inline void changeActive(int delta) {
+    if (serverMetrics == NULL) return;
+
+    int64_t active = __atomic_add_fetch(&serverMetrics->active, delta, __ATOMIC_RELAXED);
+    int64_t peak = __atomic_load_n(&serverMetrics->peakActive, __ATOMIC_RELAXED);
+    while (active > peak && !__atomic_compare_exchange_n(&serverMetrics->peakActive, &peak, active, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        /* peak was reloaded */
+    }
+}
+
+/**
+ * @brief histogramBucket
+ *
+ * \param value nanoseconds
+ *
+ * \return unsigned
+ * \retval index of the bucket holding value
+ *
+ */
+static inline unsigned histogramBucket(uint64_t value) {
+    if (value < HISTOGRAM_SUB_COUNT) return (unsigned)value;
+
+    unsigned magnitude = 63U - (unsigned)__builtin_clzll(value);
+    return ((magnitude - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+           + (unsigned)((value >> (magnitude - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_COUNT - 1));
+}
+
+/**
+ * @brief recordLatency
+ *
+ * \param histogram histogram to update
+ * \param nanoseconds measured latency
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static inline void recordLatency(enum metricHistogram histogram, uint64_t nanoseconds) {
+    if (serverMetrics == NULL) return;
+
+    struct histogram *target = &serverMetrics->histograms[histogram];
+    __atomic_fetch_add(&target->buckets[histogramBucket(nanoseconds)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&target->sum, nanoseconds, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&target->count, 1, __ATOMIC_RELAXED);
+}
+
+#endif /* SIMPLE_MESSAGE_SERVER_METRICS_H */
@@ -0,0 +1,121 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_plugin.h
+ * VCS - Tcp/Ip Exercise - ABI between simple_message_server and request
+ * handlers loaded in-process (engine 'epoll')
+ *
+ * A handler is a shared object exporting a symbol named SMS_HANDLER_SYMBOL of
+ * type 'const struct sms_handler'. The server checks abi_version and size
+ * before calling anything, so new members may only ever be appended to the
+ * end of the structures below.
+ *
+ * The handler gets the parsed request (user=, optional img= and the message)
+ * and writes the complete response - "status=<n>\n" followed by any number of
+ * "file=<name>\nlen=<n>\n<data>" records - through the response writer. The
+ * engine takes care of delivering it to the client without blocking.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_PLUGIN_H
+#define SIMPLE_MESSAGE_SERVER_PLUGIN_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define SMS_HANDLER_ABI_VERSION 1
+#define SMS_HANDLER_SYMBOL "sms_handler_v1"
+
+#define SMS_STATUS_OK 0
+#define SMS_STATUS_ERROR 1
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+/** request as sent by simple_message_client, strings are NOT terminated */
+struct sms_request {
+    const char *user;
+    size_t user_length;
+    const char *image_url;          /* NULL if the client sent no img= line */
+    size_t image_url_length;
+    const char *message;
+    size_t message_length;
+};
+
+/** sink for the response, write() returns 0 on success and -1 on error */
+struct sms_response_writer {
+    void *context;
+    int (*write)(void *context, const void *data, size_t length);
+};
+
+struct sms_handler {
+    uint32_t abi_version;           /* SMS_HANDLER_ABI_VERSION */
+    uint32_t size;                  /* sizeof(struct sms_handler) */
+    const char *name;
+    /* optional, called once after loading, non-zero fails the server start */
+    int (*init)(void);
+    /* called for every request, non-zero makes the engine answer status=1 */
+    int (*handle)(const struct sms_request *request, struct sms_response_writer *response);
+    /* optional, called once before unloading */
+    void (*fini)(void);
+};
+
+/*
+ * ------------------------------------------------------- inline functions --
+ */
+
+/**
+ * @brief sms_response_status
+ *
+ * write the "status=<n>" line of a response
+ */
+static inline int sms_response_status(struct sms_response_writer *response, int status) {
+    char line[32];
+    int length = snprintf(line, sizeof(line), "status=%d\n", status);
+
+    return response->write(response->context, line, (size_t)length);
+}
+
+/**
+ * @brief sms_response_file
+ *
+ * write a complete "file=<name>\nlen=<n>\n<data>" record of a response
+ */
+static inline int sms_response_file(struct sms_response_writer *response, const char *name, const void *data, size_t length) {
+    char line[32];
+    int lineLength = snprintf(line, sizeof(line), "\nlen=%zu\n", length);
+
+    if (response->write(response->context, "file=", 5) != 0) return -1;
+    if (response->write(response->context, name, strlen(name)) != 0) return -1;
+    if (response->write(response->context, line, (size_t)lineLength) != 0) return -1;
+    return response->write(response->context, data, length);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIMPLE_MESSAGE_SERVER_PLUGIN_H */
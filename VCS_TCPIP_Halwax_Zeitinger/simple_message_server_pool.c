@@ -0,0 +1,329 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_pool.c
+ * VCS - Tcp/Ip Exercise - warm pool for the fork engine: a small keeper
+ * process, forked at startup, keeps a configurable number of idle processes
+ * blocked in recvmsg() on a shared SOCK_SEQPACKET socket. The server hands
+ * every accepted client to the pool with SCM_RIGHTS instead of forking; the
+ * kernel delivers it to exactly one idle process, which dup2()s it onto
+ * stdin/stdout and execl()s the unmodified 'simple_message_server_logic'
+ * exactly as startClientInteraction() always did.
+ *
+ * A process taking a client tells the keeper through a pipe, and the keeper
+ * starts a replacement, so the pool refills without involving the server.
+ * The server's accept loop is left with one sendmsg() per connection; the
+ * fork happens ahead of time and the exec runs in the pooled process, off
+ * the accept path.
+ *
+ * The socket queues a client whether or not a process is idle, so every
+ * pooled process sends one byte back to the server before it waits, and
+ * the server hands over only as many clients as it has got bytes. If no
+ * process is idle the caller forks as before, instead of the client
+ * waiting for a busy one.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/prctl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include "simple_message_server.h"
+#include "simple_message_server_pool.h"
+#include "simple_message_server_affinity.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* delay before the keeper retries a failed fork() */
+#define SPAWN_RETRY_SECONDS 1
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+/* the server's end of the dispatch socket */
+static int dispatchSocket = ERROR;
+
+/* pooled processes that have reported idle and not been handed a client */
+static int idleProcesses;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void runPoolKeeper(int dispatch, int size);
+static int startPooledProcess(int dispatch, int taken);
+static void waitForClient(int dispatch, int taken);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief startLogicPool
+ *
+ * fork the keeper, which keeps size idle logic processes ready
+ *
+ * \param size number of idle processes
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+int startLogicPool(int size) {
+    int dispatch[2];
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, dispatch) == ERROR) {
+        fprintf(stderr, "%s: socketpair() failed: %s\n", programName, strerror(errno));
+        return ERROR;
+    }
+
+    fflush(stdout);
+    pid_t parent = getpid();
+    switch (fork()) {
+        case ERROR:
+            fprintf(stderr, "%s: failed to fork pool keeper: %s\n", programName, strerror(errno));
+            close(dispatch[0]);
+            close(dispatch[1]);
+            return ERROR;
+
+        /* keeper process */
+        case SUCCESS: {
+            if (prctl(PR_SET_PDEATHSIG, SIGTERM) == ERROR || getppid() != parent) {
+                _exit(EXIT_FAILURE);
+            }
+            close(dispatch[0]);
+            /* pooled processes inherit the keeper's cpus and memory policy */
+            const struct spawnPlacement *placement = placeLogic(ERROR);
+            if (placement != NULL) applyPlacement(placement);
+            runPoolKeeper(dispatch[1], size);
+            _exit(EXIT_FAILURE);
+        }
+
+        /* server process */
+        default:
+            close(dispatch[1]);
+            dispatchSocket = dispatch[0];
+            INFO("startLogicPool()", "keeping %d logic processes ready", size);
+            return SUCCESS;
+    }
+}
+
+/**
+ * @brief handOverToPool
+ *
+ * pass a client to an idle logic process, the caller still has to close
+ * its own descriptor
+ *
+ * \param client client connection
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR if no pooled process is idle or the pool can not take
+ *         the client now
+ *
+ */
+int handOverToPool(int client) {
+    char byte = 0;
+    struct iovec data = { &byte, sizeof(byte) };
+    union {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr message;
+
+    if (dispatchSocket == ERROR) return ERROR;
+
+    /* one byte per process that waits for a client */
+    while (recv(dispatchSocket, &byte, sizeof(byte), MSG_DONTWAIT) > 0) idleProcesses++;
+    if (idleProcesses == 0) {
+        INFO("handOverToPool()", "%s", "no pooled process is idle");
+        return ERROR;
+    }
+
+    byte = 0;
+    memset(&message, 0, sizeof(message));
+    memset(&control, 0, sizeof(control));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &client, sizeof(int));
+
+    if (sendmsg(dispatchSocket, &message, MSG_DONTWAIT | MSG_NOSIGNAL) == ERROR) {
+        INFO("handOverToPool()", "pool did not take client: %s", strerror(errno));
+        return ERROR;
+    }
+    idleProcesses--;
+    return SUCCESS;
+}
+
+/**
+ * @brief runPoolKeeper
+ *
+ * keep size processes waiting on the dispatch socket, start a replacement
+ * whenever one of them reports that it took a client
+ *
+ * \param dispatch the pool's end of the dispatch socket
+ * \param size number of idle processes
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void runPoolKeeper(int dispatch, int size) {
+    int taken[2];
+
+    if (pipe2(taken, O_CLOEXEC) == ERROR) {
+        fprintf(stderr, "%s: pool keeper: pipe2() failed: %s\n", programName, strerror(errno));
+        return;
+    }
+
+    /* pooled processes are reaped by the kernel, they leave no zombies */
+    struct sigaction onSignalAction;
+    memset(&onSignalAction, 0, sizeof(onSignalAction));
+    onSignalAction.sa_handler = SIG_DFL;
+    onSignalAction.sa_flags = SA_NOCLDWAIT;
+    sigaction(SIGCHLD, &onSignalAction, NULL);
+
+    int missing = size;
+    while (1 == 1) {
+        while (missing > 0) {
+            if (startPooledProcess(dispatch, taken[1]) != SUCCESS) {
+                sleep(SPAWN_RETRY_SECONDS);
+                continue;
+            }
+            missing--;
+        }
+
+        char notifications[64];
+        ssize_t count = read(taken[0], notifications, sizeof(notifications));
+        if (count > 0) {
+            missing += (int)count;
+        }
+        else if (count == ERROR && errno != EINTR) {
+            fprintf(stderr, "%s: pool keeper: read() failed: %s\n", programName, strerror(errno));
+            return;
+        }
+    }
+}
+
+/**
+ * @brief startPooledProcess
+ *
+ * fork one idle process of the pool
+ *
+ * \param dispatch the pool's end of the dispatch socket
+ * \param taken write end of the keeper's notification pipe
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int startPooledProcess(int dispatch, int taken) {
+    switch (fork()) {
+        case ERROR:
+            fprintf(stderr, "%s: pool keeper: fork() failed: %s\n", programName, strerror(errno));
+            return ERROR;
+        case SUCCESS:
+            waitForClient(dispatch, taken);
+            _exit(EXIT_FAILURE);
+        default:
+            return SUCCESS;
+    }
+}
+
+/**
+ * @brief waitForClient
+ *
+ * body of an idle pool process: report idle to the server, receive a
+ * client, report to the keeper and become the server logic
+ *
+ * \param dispatch the pool's end of the dispatch socket
+ * \param taken write end of the keeper's notification pipe
+ *
+ * \return void
+ * \retval void (returns only if the logic can not be started)
+ *
+ */
+static void waitForClient(int dispatch, int taken) {
+    char byte;
+    struct iovec data = { &byte, sizeof(byte) };
+    union {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr message;
+    ssize_t received;
+
+    /* the logic must not inherit the keeper's SIGCHLD setup */
+    struct sigaction onSignalAction;
+    memset(&onSignalAction, 0, sizeof(onSignalAction));
+    onSignalAction.sa_handler = SIG_DFL;
+    sigaction(SIGCHLD, &onSignalAction, NULL);
+
+    /* the server hands over no client before it has read this */
+    byte = 0;
+    if (send(dispatch, &byte, sizeof(byte), MSG_NOSIGNAL) == ERROR) _exit(EXIT_FAILURE);
+
+    do {
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+        received = recvmsg(dispatch, &message, MSG_CMSG_CLOEXEC);
+    } while (received == ERROR && errno == EINTR);
+
+    /* 0: the server has gone away */
+    if (received <= 0) _exit(received == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+
+    /* this process is no longer idle either way, the keeper replaces it */
+    if (write(taken, "", 1) == ERROR) {
+        /* the keeper is gone, serve this client anyway */
+    }
+
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (header == NULL || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+        fprintf(stderr, "%s: pooled process: received no client\n", programName);
+        _exit(EXIT_FAILURE);
+    }
+
+    int client;
+    memcpy(&client, CMSG_DATA(header), sizeof(int));
+
+    /* the logic starts with no signals blocked, the server blocks SIGUSR1 */
+    sigset_t noSignals;
+    sigemptyset(&noSignals);
+    sigprocmask(SIG_SETMASK, &noSignals, NULL);
+
+    startClientInteraction(client);
+}
@@ -0,0 +1,27 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_pool.h
+ * VCS - Tcp/Ip Exercise - warm pool of pre-started server logic processes
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_POOL_H
+#define SIMPLE_MESSAGE_SERVER_POOL_H
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int startLogicPool(int size);
+int handOverToPool(int client);
+
+#endif /* SIMPLE_MESSAGE_SERVER_POOL_H */
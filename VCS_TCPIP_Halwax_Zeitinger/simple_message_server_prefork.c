@@ -0,0 +1,430 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_prefork.c
+ * VCS - Tcp/Ip Exercise - prefork mode: the parent starts N long-lived
+ * workers, each binds its own SO_REUSEPORT socket to the port, so the kernel
+ * spreads new connections across the workers' accept queues.
+ *
+ * The parent only supervises:
+ *  - a worker that dies is restarted (delayed if it died right after start)
+ *  - SIGHUP re-reads the number of workers (from --workers-file or, with
+ *    'auto', the number of online cpus) and scales up or down; surplus
+ *    workers get SIGTERM and finish their connections before they exit
+ *  - SIGTERM/SIGINT stop all workers gracefully
+ *
+ * The parent keeps a bound, but not listening, SO_REUSEPORT socket so nobody
+ * else can take over the port while workers are restarted.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include "simple_message_server.h"
+#include "simple_message_server_prefork.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* a worker dying faster than this is considered crash looping */
+#define MIN_WORKER_LIFETIME_SECONDS 1
+
+/* ... and is restarted only after this delay */
+#define RESTART_DELAY_SECONDS 1
+
+/* sanity limit for --workers-file */
+#define MAX_WORKERS 4096
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+struct worker {
+    pid_t pid;
+    int slot;
+    int retiring;
+    time_t started;
+};
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+static struct worker *workerTable;
+static int workerCount;
+static int workerCapacity;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static int getWorkerCount(int workers, const char *workersFile, int current);
+static int startWorker(const char *tcpPort, int reservedSocket, workerFunction serveClients, void *context);
+static void reapWorkers(time_t *restartNotBefore);
+static int countActiveWorkers(void);
+static int findFreeSlot(void);
+static void retireWorker(void);
+static void handleWorkerShutdown(int signalNumber);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief runPreforkedWorkers
+ *
+ * start and supervise the workers until SIGTERM or SIGINT
+ *
+ * \param tcpPort port the workers listen on
+ * \param workers number of workers or WORKERS_AUTO
+ * \param workersFile file holding the number of workers, re-read on SIGHUP (may be NULL)
+ * \param serveClients body of a worker
+ * \param context passed to serveClients
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+int runPreforkedWorkers(const char *tcpPort, int workers, const char *workersFile, workerFunction serveClients, void *context) {
+    int target = getWorkerCount(workers, workersFile, 0);
+    if (target <= 0) {
+        fprintf(stderr, "%s: invalid number of workers\n", programName);
+        return ERROR;
+    }
+
+    int reservedSocket = createListeningSocket(tcpPort, 1, 0);
+    if (reservedSocket == ERROR) {
+        return ERROR;
+    }
+
+    /* all signals of interest are taken synchronously by sigtimedwait() */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    if (sigprocmask(SIG_BLOCK, &signals, NULL) == ERROR) {
+        fprintf(stderr, "%s: sigprocmask() failed: %s\n", programName, strerror(errno));
+        close(reservedSocket);
+        return ERROR;
+    }
+
+    INFO("runPreforkedWorkers()", "starting %d workers", target);
+    int stopping = 0;
+    time_t restartNotBefore = 0;
+
+    while (!stopping || workerCount > 0) {
+        if (!stopping) {
+            int active = countActiveWorkers();
+            time_t now = time(NULL);
+            while (active < target && now >= restartNotBefore) {
+                if (startWorker(tcpPort, reservedSocket, serveClients, context) != SUCCESS) {
+                    restartNotBefore = now + RESTART_DELAY_SECONDS;
+                    break;
+                }
+                active++;
+            }
+            while (active > target) {
+                retireWorker();
+                active--;
+            }
+        }
+
+        /* wake up for a delayed restart even if no signal arrives */
+        struct timespec timeout = { RESTART_DELAY_SECONDS, 0 };
+        siginfo_t info;
+        int signalNumber = sigtimedwait(&signals, &info, (!stopping && countActiveWorkers() < target) ? &timeout : NULL);
+        switch (signalNumber) {
+            case SIGCHLD:
+                reapWorkers(&restartNotBefore);
+                break;
+            case SIGHUP:
+                target = getWorkerCount(workers, workersFile, target);
+                INFO("runPreforkedWorkers()", "scaling to %d workers", target);
+                break;
+            case SIGTERM:
+            case SIGINT:
+                INFO("runPreforkedWorkers()", "stopping %d workers", workerCount);
+                stopping = 1;
+                for (int i = 0; i < workerCount; i++) {
+                    kill(workerTable[i].pid, SIGTERM);
+                    workerTable[i].retiring = 1;
+                }
+                break;
+            default:
+                if (signalNumber == ERROR && errno != EAGAIN && errno != EINTR) {
+                    fprintf(stderr, "%s: sigtimedwait() failed: %s\n", programName, strerror(errno));
+                    close(reservedSocket);
+                    return ERROR;
+                }
+                break;
+        }
+    }
+
+    close(reservedSocket);
+    free(workerTable);
+    return SUCCESS;
+}
+
+/**
+ * @brief getWorkerCount
+ *
+ * determine how many workers should run
+ *
+ * \param workers number given on the command line or WORKERS_AUTO
+ * \param workersFile if not NULL, a file containing a number or "auto"
+ * \param current number to keep if the file can not be read
+ *
+ * \return int
+ * \retval number of workers
+ *
+ */
+static int getWorkerCount(int workers, const char *workersFile, int current) {
+    if (workersFile != NULL) {
+        FILE *file = fopen(workersFile, "r");
+        char line[32];
+        if (file == NULL || fgets(line, sizeof(line), file) == NULL) {
+            fprintf(stderr, "%s: failed to read %s, keeping %d workers\n", programName, workersFile, current);
+            if (file != NULL) fclose(file);
+            return current > 0 ? current : getWorkerCount(workers, NULL, 0);
+        }
+        fclose(file);
+
+        char *end;
+        long value = strtol(line, &end, 10);
+        if (strncmp(line, "auto", 4) == 0) {
+            workers = WORKERS_AUTO;
+        }
+        else if (end != line && value > 0 && value <= MAX_WORKERS) {
+            workers = (int)value;
+        }
+        else {
+            fprintf(stderr, "%s: %s does not contain a number of workers, keeping %d\n", programName, workersFile, current);
+            return current > 0 ? current : getWorkerCount(workers, NULL, 0);
+        }
+    }
+
+    if (workers == WORKERS_AUTO) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        return cpus > 0 ? (int)cpus : 1;
+    }
+    return workers;
+}
+
+/**
+ * @brief startWorker
+ *
+ * fork a worker, which binds its own listening socket and runs serveClients
+ *
+ * \param tcpPort port to listen on
+ * \param reservedSocket the parent's socket, closed in the worker
+ * \param serveClients body of the worker
+ * \param context passed to serveClients
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int startWorker(const char *tcpPort, int reservedSocket, workerFunction serveClients, void *context) {
+    if (workerCount == workerCapacity) {
+        int capacity = workerCapacity == 0 ? 16 : workerCapacity * 2;
+        struct worker *grown = realloc(workerTable, sizeof(struct worker) * (size_t)capacity);
+        if (grown == NULL) {
+            fprintf(stderr, "%s: out of memory for worker table\n", programName);
+            return ERROR;
+        }
+        workerTable = grown;
+        workerCapacity = capacity;
+    }
+
+    int slot = findFreeSlot();
+
+    /* otherwise buffered output, e.g. of SIGUSR1, is written by both processes */
+    fflush(stdout);
+
+    pid_t parent = getpid();
+    pid_t pid = fork();
+    switch (pid) {
+        case ERROR:
+            fprintf(stderr, "%s: failed to fork worker: %s\n", programName, strerror(errno));
+            return ERROR;
+
+        /* worker process */
+        case SUCCESS: {
+            /* do not outlive the supervisor */
+            if (prctl(PR_SET_PDEATHSIG, SIGTERM) == ERROR || getppid() != parent) {
+                _exit(EXIT_FAILURE);
+            }
+            close(reservedSocket);
+
+            struct sigaction onSignalAction;
+            memset(&onSignalAction, 0, sizeof(onSignalAction));
+            onSignalAction.sa_handler = handleWorkerShutdown;
+            sigaction(SIGTERM, &onSignalAction, NULL);
+            sigaction(SIGINT, &onSignalAction, NULL);
+            onSignalAction.sa_handler = SIG_IGN;
+            sigaction(SIGHUP, &onSignalAction, NULL);
+            /* the supervisor prints the metrics of all workers */
+            sigaction(SIGUSR1, &onSignalAction, NULL);
+
+            /* SIGTERM/SIGINT stay blocked, the engine only takes them while waiting */
+            sigset_t signals;
+            sigemptyset(&signals);
+            sigaddset(&signals, SIGTERM);
+            sigaddset(&signals, SIGINT);
+            sigprocmask(SIG_SETMASK, &signals, NULL);
+
+            int listening_socket_descriptor = createListeningSocket(tcpPort, 1, 1);
+            if (listening_socket_descriptor == ERROR) {
+                _exit(EXIT_FAILURE);
+            }
+            exit(serveClients(listening_socket_descriptor, slot, context) == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+
+        /* parent process */
+        default:
+            INFO("startWorker()", "started worker %d in slot %d", (int)pid, slot);
+            workerTable[workerCount].pid = pid;
+            workerTable[workerCount].slot = slot;
+            workerTable[workerCount].retiring = 0;
+            workerTable[workerCount].started = time(NULL);
+            workerCount++;
+            return SUCCESS;
+    }
+}
+
+/**
+ * @brief reapWorkers
+ *
+ * remove all terminated workers from the table, the main loop starts
+ * replacements for those which were not retiring
+ *
+ * \param restartNotBefore set if a worker died right after it was started
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void reapWorkers(time_t *restartNotBefore) {
+    int status;
+    pid_t pid;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (int i = 0; i < workerCount; i++) {
+            if (workerTable[i].pid != pid) continue;
+
+            if (!workerTable[i].retiring) {
+                time_t now = time(NULL);
+                if (WIFSIGNALED(status)) {
+                    fprintf(stderr, "%s: worker %d killed by signal %d (%s), restarting\n", programName, (int)pid, WTERMSIG(status), strsignal(WTERMSIG(status)));
+                }
+                else {
+                    fprintf(stderr, "%s: worker %d exited unexpectedly with status %d, restarting\n", programName, (int)pid, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+                }
+                if (now - workerTable[i].started < MIN_WORKER_LIFETIME_SECONDS) {
+                    *restartNotBefore = now + RESTART_DELAY_SECONDS;
+                }
+            }
+            else {
+                INFO("reapWorkers()", "worker %d finished", (int)pid);
+            }
+
+            workerTable[i] = workerTable[--workerCount];
+            break;
+        }
+    }
+}
+
+/**
+ * @brief countActiveWorkers
+ *
+ * \return int
+ * \retval number of workers which are not retiring
+ *
+ */
+static int countActiveWorkers(void) {
+    int active = 0;
+
+    for (int i = 0; i < workerCount; i++) {
+        if (!workerTable[i].retiring) active++;
+    }
+    return active;
+}
+
+/**
+ * @brief findFreeSlot
+ *
+ * \return int
+ * \retval the lowest slot not taken by an active worker
+ *
+ */
+static int findFreeSlot(void) {
+    for (int slot = 0; ; slot++) {
+        int taken = 0;
+        for (int i = 0; i < workerCount && !taken; i++) {
+            taken = !workerTable[i].retiring && workerTable[i].slot == slot;
+        }
+        if (!taken) return slot;
+    }
+}
+
+/**
+ * @brief retireWorker
+ *
+ * ask the youngest active worker to finish its connections and exit
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void retireWorker(void) {
+    for (int i = workerCount - 1; i >= 0; i--) {
+        if (workerTable[i].retiring) continue;
+        INFO("retireWorker()", "retiring worker %d", (int)workerTable[i].pid);
+        kill(workerTable[i].pid, SIGTERM);
+        workerTable[i].retiring = 1;
+        return;
+    }
+}
+
+/**
+ * @brief handleWorkerShutdown
+ *
+ * SIGTERM/SIGINT handler of a worker, the engine stops accepting and exits
+ * once its connections are done
+ *
+ * \param signalNumber is not used
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void handleWorkerShutdown(int signalNumber) {
+    (void)signalNumber;
+    shutdownRequested = 1;
+}
@@ -0,0 +1,43 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_prefork.h
+ * VCS - Tcp/Ip Exercise - supervisor of preforked workers, each owning an
+ * SO_REUSEPORT listening socket
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_PREFORK_H
+#define SIMPLE_MESSAGE_SERVER_PREFORK_H
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* number of workers: one per online cpu */
+#define WORKERS_AUTO -1
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+/** body of a worker, returns SUCCESS after a graceful shutdown; slot is the
+ lowest number no other active worker has, a replacement gets the one of
+ the worker it replaces */
+typedef int (*workerFunction)(int listening_socket_descriptor, int slot, void *context);
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int runPreforkedWorkers(const char *tcpPort, int workers, const char *workersFile, workerFunction serveClients, void *context);
+
+#endif /* SIMPLE_MESSAGE_SERVER_PREFORK_H */
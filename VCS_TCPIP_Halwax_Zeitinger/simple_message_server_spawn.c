@@ -0,0 +1,353 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_spawn.c
+ * VCS - Tcp/Ip Exercise - strategies to start the server logic with a client
+ * connected to stdin and, unless the server buffers the response, stdout. fork() copies the page tables of the server, so
+ * its cost grows with the server's memory; vfork(), clone(CLONE_VM |
+ * CLONE_VFORK) and glibc's posix_spawn() (which uses the latter internally)
+ * run the child in the server's address space until execve() and cost the
+ * same at any size.
+ *
+ * All strategies block every signal while the child shares the address
+ * space, the child resets caught signals to their default action and
+ * restores the mask right before execve(), so no handler of the server ever
+ * runs on the borrowed memory.
+ *
+ * Every child leads a process group of its own, so the server can signal
+ * the program together with anything it has started.
+ *
+ * A child with a placement sets its CPUs and NUMA memory policy itself, before
+ * execve(), so the program never runs or allocates elsewhere. posix_spawn()
+ * has no attribute for either: auto uses clone() then, and an explicit
+ * posix_spawn only gets its CPUs, from the server, after the start.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <sched.h>
+#include <spawn.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "simple_message_server_spawn.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define ERROR -1
+#define SUCCESS 0
+
+/* the child only runs spawnChild() up to execve() on this stack */
+#define CLONE_STACK_SIZE (64 * 1024)
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+struct spawnRequest {
+    int client;
+    int output;
+    int listening_socket_descriptor;
+    char *argv[2];
+    const char *path;
+    const struct spawnPlacement *placement;
+    sigset_t mask;              /* signal mask of the caller */
+    sigset_t childMask;         /* signal mask to set in the child */
+    volatile int error;         /* errno of a failed execve(), if shared */
+};
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+extern char **environ;
+
+static const char *strategyNames[] = { "auto", "fork", "vfork", "posix_spawn", "clone" };
+
+/* CLONE_VFORK suspends the server until the child has exec'd, one stack is
+ enough */
+static char cloneStack[CLONE_STACK_SIZE] __attribute__((aligned(16)));
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void spawnChild(struct spawnRequest *request) __attribute__((noreturn));
+static int spawnCloneChild(void *request);
+static pid_t spawnWithPosixSpawn(struct spawnRequest *request);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief parseSpawnStrategy
+ *
+ * \param name one of auto, fork, vfork, posix_spawn, clone
+ * \param strategy set to the parsed strategy
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR if name is unknown
+ *
+ */
+int parseSpawnStrategy(const char *name, enum spawnStrategy *strategy) {
+    for (size_t index = 0; index < sizeof(strategyNames) / sizeof(strategyNames[0]); index++) {
+        if (strcmp(name, strategyNames[index]) == 0) {
+            *strategy = (enum spawnStrategy)index;
+            return SUCCESS;
+        }
+    }
+    return ERROR;
+}
+
+/**
+ * @brief spawnStrategyName
+ *
+ * \param strategy a strategy
+ *
+ * \return const char *
+ * \retval the name accepted by parseSpawnStrategy()
+ *
+ */
+const char *spawnStrategyName(enum spawnStrategy strategy) {
+    return strategyNames[strategy];
+}
+
+/**
+ * @brief spawnClientProgram
+ *
+ * start path with client as stdin and output as stdout, the caller still
+ * has to close its own descriptors of both and to reap the child
+ *
+ * \param strategy how to create the child
+ * \param client client connection
+ * \param output client connection, or the pipe of a buffered response
+ * \param listening_socket_descriptor closed in the child, or -1
+ * \param path program to execute
+ * \param name argv[0] of the program
+ * \param placement CPUs and memory of the program, or NULL to inherit ours
+ *
+ * \return pid_t
+ * \retval pid of the child on Success
+ * \retval ERROR on Error, errno is set
+ *
+ */
+pid_t spawnClientProgram(enum spawnStrategy strategy, int client, int output, int listening_socket_descriptor, const char *path, const char *name, const struct spawnPlacement *placement) {
+    struct spawnRequest request;
+    sigset_t allSignals;
+    pid_t pid = ERROR;
+    int error = 0;
+
+    request.client = client;
+    request.output = output;
+    request.listening_socket_descriptor = listening_socket_descriptor;
+    request.argv[0] = (char *)name;
+    request.argv[1] = NULL;
+    request.path = path;
+    request.placement = placement;
+    request.error = 0;
+
+    sigfillset(&allSignals);
+    sigprocmask(SIG_SETMASK, &allSignals, &request.mask);
+
+    /* the server blocks signals it takes from signalfds (SIGCHLD, SIGUSR1),
+     the program starts with none blocked */
+    sigemptyset(&request.childMask);
+
+    switch (strategy) {
+        case SPAWN_FORK:
+            pid = fork();
+            if (pid == SUCCESS) spawnChild(&request);
+            error = errno;
+            /* the child may not have run yet, set its group from here too */
+            if (pid > 0) setpgid(pid, pid);
+            break;
+        case SPAWN_VFORK:
+            pid = vfork();
+            if (pid == SUCCESS) spawnChild(&request);
+            error = errno;
+            break;
+        case SPAWN_AUTO:
+            if (placement == NULL) {
+                pid = spawnWithPosixSpawn(&request);
+                error = errno;
+                break;
+            }
+            /* the child has to place itself, as it does with clone() */
+            /* fall through */
+        case SPAWN_CLONE:
+            /* glibc has no clone3() wrapper, clone() takes the same flags */
+            pid = clone(spawnCloneChild, cloneStack + sizeof(cloneStack), CLONE_VM | CLONE_VFORK | SIGCHLD, &request);
+            error = errno;
+            break;
+        case SPAWN_POSIX_SPAWN:
+            pid = spawnWithPosixSpawn(&request);
+            error = errno;
+            /* the program already runs, only its CPUs can still be set */
+            if (pid > 0 && placement != NULL && CPU_COUNT(&placement->cpus) > 0) {
+                sched_setaffinity(pid, sizeof(placement->cpus), &placement->cpus);
+            }
+            break;
+    }
+
+    /* the child shared our memory and could not execve() */
+    if (pid > 0 && request.error != 0) {
+        error = request.error;
+        pid = ERROR;
+    }
+
+    sigprocmask(SIG_SETMASK, &request.mask, NULL);
+    errno = error;
+    return pid;
+}
+
+/**
+ * @brief applyPlacement
+ *
+ * set the CPUs and the NUMA memory policy of the calling process, async
+ * signal safe, so children sharing the server's memory may call it
+ *
+ * \param placement CPUs and memory to use
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error, errno is set
+ *
+ */
+int applyPlacement(const struct spawnPlacement *placement) {
+    if (CPU_COUNT(&placement->cpus) > 0 && sched_setaffinity(0, sizeof(placement->cpus), &placement->cpus) == ERROR) {
+        return ERROR;
+    }
+    /* glibc has no wrapper, libnuma's would be one more dependency */
+    if (placement->nodes != 0
+        && syscall(SYS_set_mempolicy, MPOL_BIND, &placement->nodes, sizeof(placement->nodes) * CHAR_BIT + 1) == ERROR) {
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief spawnWithPosixSpawn
+ *
+ * \param request what to start
+ *
+ * \return pid_t
+ * \retval pid of the child on Success
+ * \retval ERROR on Error, errno is set
+ *
+ */
+static pid_t spawnWithPosixSpawn(struct spawnRequest *request) {
+    posix_spawn_file_actions_t fileActions;
+    posix_spawnattr_t attributes;
+    pid_t pid;
+    int result;
+
+    posix_spawn_file_actions_init(&fileActions);
+    posix_spawn_file_actions_adddup2(&fileActions, request->client, STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&fileActions, request->output, STDOUT_FILENO);
+    if (request->client > STDOUT_FILENO) {
+        posix_spawn_file_actions_addclose(&fileActions, request->client);
+    }
+    if (request->output > STDOUT_FILENO && request->output != request->client) {
+        posix_spawn_file_actions_addclose(&fileActions, request->output);
+    }
+    if (request->listening_socket_descriptor > STDOUT_FILENO) {
+        posix_spawn_file_actions_addclose(&fileActions, request->listening_socket_descriptor);
+    }
+
+    posix_spawnattr_init(&attributes);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attributes, 0);
+    posix_spawnattr_setsigmask(&attributes, &request->childMask);
+
+    result = posix_spawn(&pid, request->path, &fileActions, &attributes, request->argv, environ);
+
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&fileActions);
+
+    if (result != SUCCESS) {
+        errno = result;
+        return ERROR;
+    }
+    return pid;
+}
+
+/**
+ * @brief spawnCloneChild
+ *
+ * entry point of a clone()d child
+ *
+ * \param request what to start
+ *
+ * \return int
+ * \retval never returns
+ *
+ */
+static int spawnCloneChild(void *request) {
+    spawnChild(request);
+}
+
+/**
+ * @brief spawnChild
+ *
+ * runs in the child, possibly on the server's memory: only async signal
+ * safe calls, no stdio
+ *
+ * \param request what to start
+ *
+ * \return void
+ * \retval never returns
+ *
+ */
+static void spawnChild(struct spawnRequest *request) {
+    struct sigaction action;
+
+    for (int signalNumber = 1; signalNumber < NSIG; signalNumber++) {
+        if (sigaction(signalNumber, NULL, &action) == SUCCESS && action.sa_handler != SIG_DFL && action.sa_handler != SIG_IGN) {
+            action.sa_handler = SIG_DFL;
+            action.sa_flags = 0;
+            sigaction(signalNumber, &action, NULL);
+        }
+    }
+    setpgid(0, 0);
+    sigprocmask(SIG_SETMASK, &request->childMask, NULL);
+
+    /* a program on other CPUs still does its work */
+    if (request->placement != NULL) applyPlacement(request->placement);
+
+    if (dup2(request->client, STDIN_FILENO) == ERROR || dup2(request->output, STDOUT_FILENO) == ERROR) {
+        request->error = errno;
+        _exit(EXIT_FAILURE);
+    }
+    if (request->client > STDOUT_FILENO) close(request->client);
+    if (request->output > STDOUT_FILENO && request->output != request->client) close(request->output);
+    if (request->listening_socket_descriptor > STDOUT_FILENO) close(request->listening_socket_descriptor);
+
+    execve(request->path, request->argv, environ);
+
+    /* if execve fails */
+    request->error = errno;
+    _exit(127);
+}
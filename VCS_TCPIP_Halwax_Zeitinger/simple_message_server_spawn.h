@@ -0,0 +1,55 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_spawn.h
+ * VCS - Tcp/Ip Exercise - strategies to start the server logic per client
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_SPAWN_H
+#define SIMPLE_MESSAGE_SERVER_SPAWN_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <sys/types.h>
+#include <sched.h>
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+enum spawnStrategy {
+    SPAWN_AUTO,         /* cheapest available: SPAWN_POSIX_SPAWN, SPAWN_CLONE with a placement */
+    SPAWN_FORK,         /* fork(), copies the page tables of the server */
+    SPAWN_VFORK,        /* vfork(), borrows the address space until execve() */
+    SPAWN_POSIX_SPAWN,  /* posix_spawn() with file actions for dup2()/close() */
+    SPAWN_CLONE         /* clone(CLONE_VM | CLONE_VFORK) on a private stack */
+};
+
+/* CPUs and memory of a process, set by the process itself before it runs
+ anything, so none of its pages are touched on the wrong node */
+struct spawnPlacement {
+    cpu_set_t cpus;             /* empty: inherit */
+    unsigned long nodes;        /* NUMA nodes for MPOL_BIND, 0: inherit */
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int parseSpawnStrategy(const char *name, enum spawnStrategy *strategy);
+const char *spawnStrategyName(enum spawnStrategy strategy);
+pid_t spawnClientProgram(enum spawnStrategy strategy, int client, int output, int listening_socket_descriptor, const char *path, const char *name, const struct spawnPlacement *placement);
+int applyPlacement(const struct spawnPlacement *placement);
+
+#endif /* SIMPLE_MESSAGE_SERVER_SPAWN_H */
@@ -0,0 +1,181 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_timeouts.c
+ * VCS - Tcp/Ip Exercise - read, write and idle timeouts of a connection.
+ * A connection owns a single timer, armed for the earlier of the end of
+ * its phase and the end of its idle time. Progress only stores the time of
+ * the current turn of the event loop; when the timer fires early because
+ * of it, it is armed again for the rest of the idle time, so reads and
+ * writes never touch the wheel.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include "simple_message_server.h"
+#include "simple_message_server_timeouts.h"
+#include "simple_message_server_metrics.h"
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static uint64_t idleDeadline(const struct connectionTimeout *timeout);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief timeoutsEnabled
+ *
+ * \return int
+ * \retval 1 if any of --read-timeout, --write-timeout, --idle-timeout is set
+ * \retval 0 otherwise
+ *
+ */
+int timeoutsEnabled(void) {
+    return readTimeout > 0 || writeTimeout > 0 || idleTimeout > 0;
+}
+
+/**
+ * @brief initTimeout
+ *
+ * \param timeout timeout of a new connection, not running
+ * \param expire called when the connection has timed out, after
+ *        timeoutExpired() said so
+ * \param context passed to expire
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void initTimeout(struct connectionTimeout *timeout, timerCallback expire, void *context) {
+    initTimer(&timeout->timer, expire, context);
+    timeout->phase = TIMEOUT_READ;
+    timeout->deadline = UINT64_MAX;
+    timeout->lastProgress = 0;
+    timeout->watchIdle = 0;
+}
+
+/**
+ * @brief startTimeout
+ *
+ * enter a phase, counting from wheel->now; nothing is armed if neither the
+ * phase nor the idle time has a timeout
+ *
+ * \param wheel the wheel
+ * \param timeout timeout of the connection
+ * \param phase TIMEOUT_READ or TIMEOUT_WRITE
+ * \param watchIdle 1 if the caller reports progress in this phase with
+ *        noteProgress()
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void startTimeout(struct timerWheel *wheel, struct connectionTimeout *timeout, enum timeoutPhase phase, int watchIdle) {
+    long limit = phase == TIMEOUT_READ ? readTimeout : writeTimeout;
+
+    timeout->phase = phase;
+    timeout->deadline = limit > 0 ? wheel->now + (uint64_t)limit : UINT64_MAX;
+    timeout->lastProgress = wheel->now;
+    timeout->watchIdle = watchIdle && idleTimeout > 0;
+
+    uint64_t expires = idleDeadline(timeout);
+    if (timeout->deadline < expires) expires = timeout->deadline;
+    if (expires == UINT64_MAX) disarmTimer(wheel, &timeout->timer);
+    else armTimer(wheel, &timeout->timer, expires);
+}
+
+/**
+ * @brief stopTimeout
+ *
+ * \param wheel the wheel
+ * \param timeout timeout of a connection that is done or closing
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void stopTimeout(struct timerWheel *wheel, struct connectionTimeout *timeout) {
+    disarmTimer(wheel, &timeout->timer);
+}
+
+/**
+ * @brief timeoutExpired
+ *
+ * to be called by the expire callback: count a connection that has timed
+ * out, or arm the timer again if there was progress since it was armed
+ *
+ * \param wheel the wheel
+ * \param timeout timeout of the connection
+ *
+ * \return int
+ * \retval 1 if the connection has timed out and must be closed
+ * \retval 0 if it goes on
+ *
+ */
+int timeoutExpired(struct timerWheel *wheel, struct connectionTimeout *timeout) {
+    if (wheel->now >= timeout->deadline) {
+        INFO("timeoutExpired()", "%s timeout", timeout->phase == TIMEOUT_READ ? "read" : "write");
+        countMetric(timeout->phase == TIMEOUT_READ ? METRIC_READ_TIMEOUTS : METRIC_WRITE_TIMEOUTS, 1);
+        return 1;
+    }
+
+    uint64_t idle = idleDeadline(timeout);
+    if (wheel->now >= idle) {
+        INFO("timeoutExpired()", "idle for %ld ms", idleTimeout);
+        countMetric(METRIC_IDLE_TIMEOUTS, 1);
+        return 1;
+    }
+
+    armTimer(wheel, &timeout->timer, idle < timeout->deadline ? idle : timeout->deadline);
+    return 0;
+}
+
+/**
+ * @brief resetOnClose
+ *
+ * make the last close() of a timed out client reset the connection, so
+ * the kernel does not go on feeding what is left of the response to a
+ * client that does not read
+ *
+ * \param client the client
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void resetOnClose(int client) {
+    struct linger linger = { 1, 0 };
+
+    setsockopt(client, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+}
+
+/**
+ * @brief idleDeadline
+ *
+ * \param timeout timeout of the connection
+ *
+ * \return uint64_t
+ * \retval when the connection is idle for too long, UINT64_MAX: never
+ *
+ */
+static uint64_t idleDeadline(const struct connectionTimeout *timeout) {
+    return timeout->watchIdle ? timeout->lastProgress + (uint64_t)idleTimeout : UINT64_MAX;
+}
@@ -0,0 +1,77 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_timeouts.h
+ * VCS - Tcp/Ip Exercise - read, write and idle timeouts of a connection,
+ * one timer wheel entry per connection
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_TIMEOUTS_H
+#define SIMPLE_MESSAGE_SERVER_TIMEOUTS_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdint.h>
+#include "simple_message_timer.h"
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+enum timeoutPhase {
+    TIMEOUT_READ,               /* accept() to the end of the request, --read-timeout */
+    TIMEOUT_WRITE               /* end of the request to the end of the response, --write-timeout */
+};
+
+struct connectionTimeout {
+    struct wheelTimer timer;
+    enum timeoutPhase phase;
+    uint64_t deadline;          /* end of the phase, UINT64_MAX: none */
+    uint64_t lastProgress;      /* wheel->now of the last progress */
+    int watchIdle;              /* --idle-timeout applies to this phase */
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int timeoutsEnabled(void);
+void initTimeout(struct connectionTimeout *timeout, timerCallback expire, void *context);
+void startTimeout(struct timerWheel *wheel, struct connectionTimeout *timeout, enum timeoutPhase phase, int watchIdle);
+void stopTimeout(struct timerWheel *wheel, struct connectionTimeout *timeout);
+int timeoutExpired(struct timerWheel *wheel, struct connectionTimeout *timeout);
+void resetOnClose(int client);
+
+/*
+ * -------------------------------------------------------- inline functions --
+ */
+
+/**
+ * @brief noteProgress
+ *
+ * record that the connection moved data; the timer is not touched, it
+ * finds out when it fires and is armed again for the rest of the idle time
+ *
+ * \param wheel the wheel
+ * \param timeout timeout of the connection
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static inline void noteProgress(const struct timerWheel *wheel, struct connectionTimeout *timeout) {
+    timeout->lastProgress = wheel->now;
+}
+
+#endif /* SIMPLE_MESSAGE_SERVER_TIMEOUTS_H */
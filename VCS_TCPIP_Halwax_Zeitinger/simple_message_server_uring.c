@@ -0,0 +1,802 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_uring.c
+ * VCS - Tcp/Ip Exercise - engine 'uring': one thread drives all client
+ * connections through io_uring
+ *
+ *  - one multishot accept delivers every new connection
+ *  - requests are received by multishot recv into a ring of provided
+ *    buffers, so no memory is tied to idle connections
+ *  - responses of the in-process request handler (see
+ *    simple_message_server_plugin.h) go out with send, the socket is closed
+ *    through the ring as well
+ *
+ * The ring is set up with the raw system calls, liburing is not needed. If
+ * the kernel lacks io_uring (or multishot accept/provided buffer rings) the
+ * engine returns URING_UNAVAILABLE and the caller falls back to 'epoll'.
+ * Multishot recv is optional, without it every recv is re-armed.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include "simple_message_server.h"
+#include "simple_message_server_uring.h"
+#include "simple_message_server_metrics.h"
+#include "simple_message_server_timeouts.h"
+#include "simple_message_timer.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define RING_ENTRIES 1024
+
+/* provided buffers for recv, BUFFER_COUNT must be a power of 2 */
+#define BUFFER_GROUP 0
+#define BUFFER_COUNT 1024
+#define BUFFER_SIZE 4096
+
+/* user_data is a struct connection pointer with the operation in the low bits, */
+/* for OP_ACCEPT the listening socket shifted past them */
+#define OPERATION_MASK 7ULL
+#define OP_ACCEPT 0ULL
+#define OP_RECV 1ULL
+#define OP_SEND 2ULL
+#define OP_CLOSE 3ULL
+#define OP_CANCEL 4ULL
+#define OPERATION_BITS 3
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+struct connection {
+    int fd;
+    int recvArmed;
+    int closing;
+    struct responseBuffer request;
+    struct responseBuffer response;
+    size_t responseSent;
+    uint64_t accepted;          /* metricsClock() of the accept completion */
+    uint64_t started;           /* metricsClock() when the handler ran */
+    struct connectionTimeout timeout;
+};
+
+struct ring {
+    int fd;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned sqEntries;
+    unsigned sqLocalTail;
+    unsigned pending;
+    struct io_uring_sqe *sqes;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    struct io_uring_cqe *cqes;
+    void *sqRing;
+    size_t sqRingSize;
+    void *cqRing;
+    size_t cqRingSize;
+    size_t sqesSize;
+    struct io_uring_buf_ring *bufferRing;
+    size_t bufferRingSize;
+    unsigned short bufferLocalTail;
+    char *buffers;
+    int extendedArgument;       /* IORING_FEAT_EXT_ARG: io_uring_enter() takes a timeout */
+};
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+static struct ring ring;
+static int openConnections;
+static int multishotRecv = 1;
+static struct timerWheel timers;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static int setupRing(void);
+static int setupBufferRing(void);
+static void teardownRing(void);
+static struct io_uring_sqe *getSqe(void);
+static int submitAndWait(unsigned minComplete, const sigset_t *waitMask, int timeout);
+static void recycleBuffer(unsigned short bufferId);
+static void prepareAccept(int listening_socket_descriptor);
+static void prepareRecv(struct connection *connection);
+static void prepareSend(struct connection *connection);
+static void prepareCancel(uint64_t userData);
+static void startConnection(int client);
+static void drainListener(int listener);
+static void closeConnection(struct connection *connection);
+static void completeRecv(struct connection *connection, const struct io_uring_cqe *cqe, const struct requestHandler *requestHandler);
+static void completeSend(struct connection *connection, int result);
+static void expireConnection(void *context);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief runUringEngine
+ *
+ * event loop of the engine, returns after a requested shutdown or if it
+ * could not be set up
+ *
+ * \param listening_socket_descriptor listening socket descriptor
+ * \param requestHandler handler producing the responses
+ *
+ * \return int
+ * \retval SUCCESS after a requested shutdown
+ * \retval URING_UNAVAILABLE if the kernel does not support the engine
+ * \retval ERROR on Error
+ *
+ */
+int runUringEngine(int listening_socket_descriptor, const struct requestHandler *requestHandler) {
+    if (setupRing() != SUCCESS) {
+        INFO("runUringEngine()", "io_uring setup failed: %s", strerror(errno));
+        return URING_UNAVAILABLE;
+    }
+    if (setupBufferRing() != SUCCESS) {
+        INFO("runUringEngine()", "provided buffer ring not supported: %s", strerror(errno));
+        teardownRing();
+        return URING_UNAVAILABLE;
+    }
+    if (timeoutsEnabled() && !ring.extendedArgument) {
+        INFO("runUringEngine()", "io_uring_enter() can not wait with a timeout %s", "");
+        teardownRing();
+        return URING_UNAVAILABLE;
+    }
+    initTimerWheel(&timers);
+
+    /* signals blocked by the caller (SIGTERM in workers) only interrupt the wait */
+    /* others, like SIGUSR1 of the metrics thread, stay blocked */
+    sigset_t waitMask;
+    sigprocmask(SIG_BLOCK, NULL, &waitMask);
+    sigdelset(&waitMask, SIGTERM);
+    sigdelset(&waitMask, SIGINT);
+
+    prepareAccept(listening_socket_descriptor);
+    if (unixListener != ERROR) prepareAccept(unixListener);
+
+    INFO("runUringEngine()", "waiting for client connections %s", "");
+    int listening = unixListener != ERROR ? 2 : 1;
+    int cancelling = 0;
+    int acceptedAny = 0;
+    while (listening || openConnections > 0) {
+        if (shutdownRequested && listening && !cancelling) {
+            INFO("runUringEngine()", "shutting down, %d connections left", openConnections);
+            prepareCancel(((uint64_t)listening_socket_descriptor << OPERATION_BITS) | OP_ACCEPT);
+            if (unixListener != ERROR) prepareCancel(((uint64_t)unixListener << OPERATION_BITS) | OP_ACCEPT);
+            cancelling = 1;
+        }
+
+        if (submitAndWait(1, &waitMask, timeToNextTimer(&timers)) != SUCCESS && errno != EINTR && errno != EAGAIN && errno != EBUSY && errno != ETIME) {
+            fprintf(stderr, "%s: io_uring_enter() failed: %s\n", programName, strerror(errno));
+            teardownRing();
+            return ERROR;
+        }
+        updateTimerClock(&timers);
+
+        unsigned head = *ring.cqHead;
+        unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cqMask];
+            struct connection *connection = (struct connection *)(uintptr_t)(cqe->user_data & ~OPERATION_MASK);
+
+            switch (cqe->user_data & OPERATION_MASK) {
+                case OP_ACCEPT:
+                    if (cqe->res >= 0) {
+                        acceptedAny = 1;
+                        startConnection(cqe->res);
+                    }
+                    else if (cqe->res == -EINVAL && !acceptedAny) {
+                        /* no multishot accept (before 5.19) */
+                        teardownRing();
+                        return URING_UNAVAILABLE;
+                    }
+                    else if (cqe->res != -ECANCELED) {
+                        fprintf(stderr, "%s: failed to accept client: %s\n", programName, strerror(-cqe->res));
+                    }
+
+                    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                        int listener = (int)(cqe->user_data >> OPERATION_BITS);
+                        if (shutdownRequested) {
+                            /* closing an SO_REUSEPORT socket drops its queue, so take it first */
+                            drainListener(listener);
+                            close(listener);
+                            listening--;
+                        }
+                        else {
+                            prepareAccept(listener);
+                        }
+                    }
+                    break;
+                case OP_RECV:
+                    completeRecv(connection, cqe, requestHandler);
+                    break;
+                case OP_SEND:
+                    completeSend(connection, cqe->res);
+                    break;
+                case OP_CLOSE:
+                    TRACE(TRACE_HANDLE, TRACE_END, (uint64_t)(uintptr_t)connection, connection->responseSent);
+                    /* a connection closed before its response was sent counts as an error */
+                    if (connection->response.length > 0 && connection->responseSent == connection->response.length) {
+                        recordLatency(METRIC_REQUEST, metricsClock() - connection->accepted);
+                        countMetric(METRIC_BYTES_OUT, connection->responseSent);
+                    }
+                    else {
+                        countMetric(METRIC_ERRORS, 1);
+                    }
+                    changeActive(-1);
+                    openConnections--;
+                    releaseResponse(&connection->request);
+                    releaseResponse(&connection->response);
+                    free(connection);
+                    break;
+                default:
+                    /* OP_CANCEL */
+                    break;
+            }
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+
+        /* a connection that times out is closed through the ring, like any other */
+        advanceTimers(&timers);
+    }
+
+    teardownRing();
+    return SUCCESS;
+}
+
+/**
+ * @brief setupRing
+ *
+ * create the io_uring instance and map its rings
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error, errno is set
+ *
+ */
+static int setupRing(void) {
+    struct io_uring_params params;
+
+    memset(&ring, 0, sizeof(ring));
+    memset(&params, 0, sizeof(params));
+    /* only this thread submits, task work may wait until we enter the kernel */
+    params.flags = IORING_SETUP_CLAMP | IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER;
+    params.cq_entries = RING_ENTRIES * 4;
+    ring.fd = (int)syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    if (ring.fd == ERROR && errno == EINVAL) {
+        /* older kernel, retry without the optimizations */
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CLAMP | IORING_SETUP_CQSIZE;
+        params.cq_entries = RING_ENTRIES * 4;
+        ring.fd = (int)syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    }
+    if (ring.fd == ERROR) return ERROR;
+
+    if (!(params.features & IORING_FEAT_NODROP)) {
+        /* multishot requests could lose completions */
+        close(ring.fd);
+        errno = ENOTSUP;
+        return ERROR;
+    }
+    ring.extendedArgument = (params.features & IORING_FEAT_EXT_ARG) != 0;
+
+    ring.sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring.cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring.cqRingSize > ring.sqRingSize) ring.sqRingSize = ring.cqRingSize;
+        ring.cqRingSize = ring.sqRingSize;
+    }
+
+    ring.sqRing = mmap(NULL, ring.sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    if (ring.sqRing == MAP_FAILED) {
+        close(ring.fd);
+        return ERROR;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring.cqRing = ring.sqRing;
+    }
+    else {
+        ring.cqRing = mmap(NULL, ring.cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+        if (ring.cqRing == MAP_FAILED) {
+            munmap(ring.sqRing, ring.sqRingSize);
+            close(ring.fd);
+            return ERROR;
+        }
+    }
+
+    ring.sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring.sqes = mmap(NULL, ring.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if (ring.sqes == MAP_FAILED) {
+        if (ring.cqRing != ring.sqRing) munmap(ring.cqRing, ring.cqRingSize);
+        munmap(ring.sqRing, ring.sqRingSize);
+        close(ring.fd);
+        return ERROR;
+    }
+
+    char *sq = ring.sqRing;
+    char *cq = ring.cqRing;
+    ring.sqHead = (unsigned *)(sq + params.sq_off.head);
+    ring.sqTail = (unsigned *)(sq + params.sq_off.tail);
+    ring.sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring.sqArray = (unsigned *)(sq + params.sq_off.array);
+    ring.sqEntries = params.sq_entries;
+    ring.sqLocalTail = *ring.sqTail;
+    ring.cqHead = (unsigned *)(cq + params.cq_off.head);
+    ring.cqTail = (unsigned *)(cq + params.cq_off.tail);
+    ring.cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return SUCCESS;
+}
+
+/**
+ * @brief setupBufferRing
+ *
+ * register BUFFER_COUNT buffers the kernel picks from for every recv
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error, errno is set
+ *
+ */
+static int setupBufferRing(void) {
+    ring.bufferRingSize = BUFFER_COUNT * sizeof(struct io_uring_buf);
+    ring.bufferRing = mmap(NULL, ring.bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring.bufferRing == MAP_FAILED) {
+        ring.bufferRing = NULL;
+        return ERROR;
+    }
+    ring.buffers = malloc((size_t)BUFFER_COUNT * BUFFER_SIZE);
+    if (ring.buffers == NULL) return ERROR;
+
+    struct io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = (uint64_t)(uintptr_t)ring.bufferRing;
+    registration.ring_entries = BUFFER_COUNT;
+    registration.bgid = BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_PBUF_RING, &registration, 1) == ERROR) return ERROR;
+
+    ring.bufferLocalTail = 0;
+    for (unsigned short bufferId = 0; bufferId < BUFFER_COUNT; bufferId++) {
+        recycleBuffer(bufferId);
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief teardownRing
+ *
+ * release the io_uring instance and its memory
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void teardownRing(void) {
+    close(ring.fd);
+    munmap(ring.sqes, ring.sqesSize);
+    if (ring.cqRing != ring.sqRing) munmap(ring.cqRing, ring.cqRingSize);
+    munmap(ring.sqRing, ring.sqRingSize);
+    if (ring.bufferRing != NULL) munmap(ring.bufferRing, ring.bufferRingSize);
+    free(ring.buffers);
+    memset(&ring, 0, sizeof(ring));
+}
+
+/**
+ * @brief getSqe
+ *
+ * get the next free submission queue entry, submitting pending ones if the
+ * queue is full
+ *
+ * \return struct io_uring_sqe *
+ * \retval cleared entry
+ *
+ */
+static struct io_uring_sqe *getSqe(void) {
+    while (ring.sqLocalTail - __atomic_load_n(ring.sqHead, __ATOMIC_ACQUIRE) >= ring.sqEntries) {
+        submitAndWait(0, NULL, -1);
+    }
+
+    unsigned index = ring.sqLocalTail & *ring.sqMask;
+    struct io_uring_sqe *sqe = &ring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring.sqArray[index] = index;
+    ring.sqLocalTail++;
+    ring.pending++;
+    return sqe;
+}
+
+/**
+ * @brief submitAndWait
+ *
+ * hand the pending entries to the kernel and wait for completions
+ *
+ * \param minComplete number of completions to wait for
+ * \param waitMask signal mask while waiting (may be NULL)
+ * \param timeout milliseconds to wait at most, -1: no limit
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error, errno is set, ETIME if the timeout expired
+ *
+ */
+static int submitAndWait(unsigned minComplete, const sigset_t *waitMask, int timeout) {
+    __atomic_store_n(ring.sqTail, ring.sqLocalTail, __ATOMIC_RELEASE);
+
+    long submitted;
+    if (minComplete > 0 && timeout >= 0) {
+        /* the timeout needs the extended argument, which also carries the signal mask */
+        struct __kernel_timespec limit = { timeout / 1000, (long long)(timeout % 1000) * 1000000LL };
+        struct io_uring_getevents_arg argument;
+        memset(&argument, 0, sizeof(argument));
+        argument.sigmask = (uint64_t)(uintptr_t)waitMask;
+        argument.sigmask_sz = _NSIG / 8;
+        argument.ts = (uint64_t)(uintptr_t)&limit;
+        submitted = syscall(__NR_io_uring_enter, ring.fd, ring.pending, minComplete,
+                            IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &argument, sizeof(argument));
+    }
+    else {
+        submitted = syscall(__NR_io_uring_enter, ring.fd, ring.pending, minComplete,
+                            minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, waitMask, _NSIG / 8);
+    }
+    if (submitted == ERROR) return ERROR;
+    ring.pending -= (unsigned)submitted;
+    return SUCCESS;
+}
+
+/**
+ * @brief recycleBuffer
+ *
+ * give a provided buffer back to the kernel
+ *
+ * \param bufferId id of the buffer
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void recycleBuffer(unsigned short bufferId) {
+    struct io_uring_buf *buffer = &ring.bufferRing->bufs[ring.bufferLocalTail & (BUFFER_COUNT - 1)];
+
+    buffer->addr = (uint64_t)(uintptr_t)(ring.buffers + (size_t)bufferId * BUFFER_SIZE);
+    buffer->len = BUFFER_SIZE;
+    buffer->bid = bufferId;
+    ring.bufferLocalTail++;
+    __atomic_store_n(&ring.bufferRing->tail, ring.bufferLocalTail, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief prepareAccept
+ *
+ * queue a multishot accept on the listening socket
+ *
+ * \param listening_socket_descriptor listening socket descriptor
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void prepareAccept(int listening_socket_descriptor) {
+    struct io_uring_sqe *sqe = getSqe();
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listening_socket_descriptor;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = ((uint64_t)listening_socket_descriptor << OPERATION_BITS) | OP_ACCEPT;
+}
+
+/**
+ * @brief prepareRecv
+ *
+ * queue a (multishot) recv into the provided buffers
+ *
+ * \param connection client connection
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void prepareRecv(struct connection *connection) {
+    struct io_uring_sqe *sqe = getSqe();
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = connection->fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    if (multishotRecv) sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = (uint64_t)(uintptr_t)connection | OP_RECV;
+    connection->recvArmed = 1;
+}
+
+/**
+ * @brief prepareSend
+ *
+ * queue a send of the unsent rest of the response
+ *
+ * \param connection client connection
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void prepareSend(struct connection *connection) {
+    struct io_uring_sqe *sqe = getSqe();
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = connection->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(connection->response.data + connection->responseSent);
+    sqe->len = (unsigned)(connection->response.length - connection->responseSent);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (uint64_t)(uintptr_t)connection | OP_SEND;
+}
+
+/**
+ * @brief prepareCancel
+ *
+ * queue the cancellation of the request identified by userData
+ *
+ * \param userData user_data of the request to cancel
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void prepareCancel(uint64_t userData) {
+    struct io_uring_sqe *sqe = getSqe();
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = userData;
+    sqe->user_data = OP_CANCEL;
+}
+
+/**
+ * @brief startConnection
+ *
+ * set up an accepted client and wait for its request
+ *
+ * \param client client connection
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void startConnection(int client) {
+    struct connection *connection = calloc(1, sizeof(*connection));
+
+    if (connection == NULL) {
+        fprintf(stderr, "%s: out of memory for client connection\n", programName);
+        close(client);
+        return;
+    }
+    connection->fd = client;
+    connection->accepted = metricsClock();
+    initTimeout(&connection->timeout, expireConnection, connection);
+    startTimeout(&timers, &connection->timeout, TIMEOUT_READ, 1);
+    TRACE(TRACE_HANDLE, TRACE_BEGIN, (uint64_t)(uintptr_t)connection, (uint64_t)connection->fd);
+    openConnections++;
+    countMetric(METRIC_ACCEPTED, 1);
+    changeActive(1);
+    prepareRecv(connection);
+}
+
+/**
+ * @brief drainListener
+ *
+ * accept and serve the clients still queued on a listener whose multishot
+ * accept has been cancelled, as the epoll engine does before it closes its
+ * listeners
+ *
+ * \param listener listening socket descriptor
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void drainListener(int listener) {
+    int flags = fcntl(listener, F_GETFL);
+
+    if (flags == ERROR || fcntl(listener, F_SETFL, flags | O_NONBLOCK) == ERROR) {
+        fprintf(stderr, "%s: can not drain listening socket: %s\n", programName, strerror(errno));
+        return;
+    }
+    while (1 == 1) {
+        int client = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        if (client == ERROR) {
+            if (errno == ECONNABORTED || errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                fprintf(stderr, "%s: failed to accept client: %s\n", programName, strerror(errno));
+            }
+            return;
+        }
+        startConnection(client);
+    }
+}
+
+/**
+ * @brief closeConnection
+ *
+ * close the client socket through the ring, the connection is freed when
+ * the close completes; an armed recv is cancelled first
+ *
+ * \param connection client connection
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void closeConnection(struct connection *connection) {
+    if (connection->recvArmed) {
+        if (!connection->closing) prepareCancel((uint64_t)(uintptr_t)connection | OP_RECV);
+        connection->closing = 1;
+        return;
+    }
+
+    stopTimeout(&timers, &connection->timeout);
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = connection->fd;
+    sqe->user_data = (uint64_t)(uintptr_t)connection | OP_CLOSE;
+}
+
+/**
+ * @brief completeRecv
+ *
+ * append received data to the request; at end of file run the handler and
+ * start sending the response
+ *
+ * \param connection client connection
+ * \param cqe completion of the recv
+ * \param requestHandler handler producing the response
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void completeRecv(struct connection *connection, const struct io_uring_cqe *cqe, const struct requestHandler *requestHandler) {
+    int more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+
+    if (!more) connection->recvArmed = 0;
+
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        unsigned short bufferId = (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        if (cqe->res > 0 && !connection->closing) {
+            if (connection->request.length + (size_t)cqe->res > MAX_REQUEST_SIZE) {
+                fprintf(stderr, "%s: request exceeds %d bytes\n", programName, MAX_REQUEST_SIZE);
+                connection->closing = 1;
+            }
+            else if (appendToResponse(&connection->request, ring.buffers + (size_t)bufferId * BUFFER_SIZE, (size_t)cqe->res) != SUCCESS) {
+                connection->closing = 1;
+            }
+            noteProgress(&timers, &connection->timeout);
+        }
+        recycleBuffer(bufferId);
+    }
+
+    if (connection->closing) {
+        closeConnection(connection);
+        return;
+    }
+
+    if (cqe->res == 0) {
+        /* client has shut down its sending side, the request is complete */
+        startTimeout(&timers, &connection->timeout, TIMEOUT_WRITE, 1);
+        connection->started = metricsClock();
+        recordLatency(METRIC_ACCEPT_TO_START, connection->started - connection->accepted);
+        countMetric(METRIC_BYTES_IN, connection->request.length);
+        if (runRequestHandler(requestHandler, connection->request.data, connection->request.length, &connection->response) != SUCCESS) {
+            fprintf(stderr, "%s: failed to build response: %s\n", programName, strerror(errno));
+            closeConnection(connection);
+            return;
+        }
+        releaseResponse(&connection->request);
+        prepareSend(connection);
+        return;
+    }
+
+    if (cqe->res < 0) {
+        if (cqe->res == -EINVAL && multishotRecv) {
+            /* no multishot recv (before 6.0), arm every recv separately */
+            INFO("completeRecv()", "multishot recv not supported %s", "");
+            multishotRecv = 0;
+        }
+        else if (cqe->res != -ENOBUFS && cqe->res != -EINTR && cqe->res != -EAGAIN) {
+            closeConnection(connection);
+            return;
+        }
+    }
+
+    if (!more) prepareRecv(connection);
+}
+
+/**
+ * @brief completeSend
+ *
+ * continue a partial send or close the connection
+ *
+ * \param connection client connection
+ * \param result result of the send
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void completeSend(struct connection *connection, int result) {
+    if (result < 0 && result != -EINTR && result != -EAGAIN) {
+        closeConnection(connection);
+        return;
+    }
+
+    if (result > 0) {
+        if (connection->responseSent == 0) recordLatency(METRIC_START_TO_FIRST_BYTE, metricsClock() - connection->started);
+        connection->responseSent += (size_t)result;
+        noteProgress(&timers, &connection->timeout);
+    }
+    if (connection->responseSent < connection->response.length && !connection->closing) {
+        prepareSend(connection);
+        return;
+    }
+    closeConnection(connection);
+}
+
+/**
+ * @brief expireConnection
+ *
+ * timer callback of a connection: cancel its recv or send, whose
+ * completion closes it
+ *
+ * \param context client connection
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void expireConnection(void *context) {
+    struct connection *connection = context;
+
+    if (!timeoutExpired(&timers, &connection->timeout)) return;
+
+    resetOnClose(connection->fd);
+    if (connection->response.length == 0) {
+        closeConnection(connection);
+        return;
+    }
+    connection->closing = 1;
+    prepareCancel((uint64_t)(uintptr_t)connection | OP_SEND);
+}
@@ -0,0 +1,40 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_server_uring.h
+ * VCS - Tcp/Ip Exercise - single thread io_uring engine
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_URING_H
+#define SIMPLE_MESSAGE_SERVER_URING_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include "simple_message_server_handler.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* returned by runUringEngine() if the kernel lacks the needed io_uring
+ features, before any client was accepted */
+#define URING_UNAVAILABLE 3
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int runUringEngine(int listening_socket_descriptor, const struct requestHandler *requestHandler);
+
+#endif /* SIMPLE_MESSAGE_SERVER_URING_H */
@@ -0,0 +1,313 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_timer.c
+ * VCS - Tcp/Ip Exercise - hierarchical timer wheel with 1 ms ticks. A timer
+ * due within 64 ms sits in the slot of its tick on level 0; later ones sit
+ * on the level whose slots are just wide enough and are cascaded a level
+ * down whenever the wheel enters their slot. Arming and disarming unlink or
+ * link a list node, so they cost O(1) and no system call, however many
+ * timers are armed.
+ *
+ * A bit per non-empty slot lets advanceTimers() jump straight to the next
+ * tick with work and lets timeToNextTimer() tell the event loop how long
+ * it may sleep, instead of ticking through empty slots.
+ *
+ * Timers due beyond the top level are parked in its farthest slot and put
+ * back when they come down from there.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include "simple_message_timer.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define SLOT_MASK ((uint64_t)TIMER_SLOTS - 1)
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void placeTimer(struct timerWheel *wheel, struct wheelTimer *timer);
+static void unlinkTimer(struct timerWheel *wheel, struct wheelTimer *timer);
+static void takeSlot(struct timerWheel *wheel, unsigned level, unsigned slot, struct wheelTimer **list);
+static uint64_t nextTick(const struct timerWheel *wheel);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief initTimerWheel
+ *
+ * \param wheel an empty wheel, starting at the current time
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void initTimerWheel(struct timerWheel *wheel) {
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->now = timerClock();
+    wheel->current = wheel->now;
+}
+
+/**
+ * @brief initTimer
+ *
+ * \param timer a disarmed timer
+ * \param expire called when the timer expires
+ * \param context passed to expire
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void initTimer(struct wheelTimer *timer, timerCallback expire, void *context) {
+    memset(timer, 0, sizeof(*timer));
+    timer->expire = expire;
+    timer->context = context;
+}
+
+/**
+ * @brief armTimer
+ *
+ * arm, or re-arm, a timer; an expiry in the past fires on the next
+ * advanceTimers()
+ *
+ * \param wheel the wheel
+ * \param timer the timer
+ * \param expires timerClock() milliseconds
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void armTimer(struct timerWheel *wheel, struct wheelTimer *timer, uint64_t expires) {
+    if (timerArmed(timer)) unlinkTimer(wheel, timer);
+    timer->expires = expires;
+    placeTimer(wheel, timer);
+}
+
+/**
+ * @brief disarmTimer
+ *
+ * \param wheel the wheel
+ * \param timer the timer, disarmed timers are left alone
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void disarmTimer(struct timerWheel *wheel, struct wheelTimer *timer) {
+    if (timerArmed(timer)) unlinkTimer(wheel, timer);
+}
+
+/**
+ * @brief timeToNextTimer
+ *
+ * how long the event loop may wait, measured from wheel->now; a higher
+ * level answers with the time of its next cascade, so the loop may wake up
+ * before anything expires
+ *
+ * \param wheel the wheel
+ *
+ * \return int
+ * \retval milliseconds, for epoll_wait()
+ * \retval -1 if no timer is armed
+ *
+ */
+int timeToNextTimer(const struct timerWheel *wheel) {
+    if (wheel->armed == 0) return -1;
+
+    uint64_t tick = nextTick(wheel);
+    if (tick <= wheel->now) return 0;
+    return tick - wheel->now > INT_MAX ? INT_MAX : (int)(tick - wheel->now);
+}
+
+/**
+ * @brief advanceTimers
+ *
+ * run the wheel up to wheel->now, expiring every timer due by then; the
+ * callbacks may arm and disarm timers, this one included
+ *
+ * \param wheel the wheel
+ *
+ * \return int
+ * \retval number of expired timers
+ *
+ */
+int advanceTimers(struct timerWheel *wheel) {
+    int expired = 0;
+
+    while (wheel->current <= wheel->now) {
+        uint64_t tick = wheel->armed > 0 ? nextTick(wheel) : UINT64_MAX;
+        if (tick > wheel->now) {
+            wheel->current = wheel->now + 1;
+            break;
+        }
+        wheel->current = tick;
+
+        /* entering slots of higher levels: move their timers down, from the
+         top, so the lower levels take them before they are cascaded too */
+        unsigned top = 0;
+        while (top < TIMER_LEVELS - 1 && (tick & ((1ULL << ((top + 1) * TIMER_LEVEL_BITS)) - 1)) == 0) top++;
+        for (unsigned level = top; level > 0; level--) {
+            unsigned slot = (unsigned)((tick >> (level * TIMER_LEVEL_BITS)) & SLOT_MASK);
+            struct wheelTimer *list;
+            struct wheelTimer *timer;
+
+            takeSlot(wheel, level, slot, &list);
+            while ((timer = list) != NULL) {
+                unlinkTimer(wheel, timer);
+                placeTimer(wheel, timer);
+            }
+        }
+
+        /* timers armed by the callbacks for this tick go to the next one */
+        struct wheelTimer *list;
+        struct wheelTimer *timer;
+        takeSlot(wheel, 0, (unsigned)(tick & SLOT_MASK), &list);
+        wheel->current = tick + 1;
+        while ((timer = list) != NULL) {
+            unlinkTimer(wheel, timer);
+            if (timer->expires > tick) {
+                /* parked beyond the span of the wheel */
+                placeTimer(wheel, timer);
+                continue;
+            }
+            expired++;
+            timer->expire(timer->context);
+        }
+    }
+    return expired;
+}
+
+/**
+ * @brief placeTimer
+ *
+ * link a disarmed timer into the slot for its expiry
+ *
+ * \param wheel the wheel
+ * \param timer the timer
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void placeTimer(struct timerWheel *wheel, struct wheelTimer *timer) {
+    uint64_t expires = timer->expires < wheel->current ? wheel->current : timer->expires;
+    unsigned level = 0;
+
+    /* the lowest level on which the timer is less than a turn ahead */
+    while (level < TIMER_LEVELS - 1
+           && (expires >> (level * TIMER_LEVEL_BITS)) - (wheel->current >> (level * TIMER_LEVEL_BITS)) >= TIMER_SLOTS) {
+        level++;
+    }
+    if ((expires >> (level * TIMER_LEVEL_BITS)) - (wheel->current >> (level * TIMER_LEVEL_BITS)) >= TIMER_SLOTS) {
+        /* beyond the top level: park it in the farthest slot */
+        expires = ((wheel->current >> (level * TIMER_LEVEL_BITS)) + TIMER_SLOTS - 1) << (level * TIMER_LEVEL_BITS);
+    }
+    unsigned slot = (unsigned)((expires >> (level * TIMER_LEVEL_BITS)) & SLOT_MASK);
+
+    struct wheelTimer **head = &wheel->slots[level][slot];
+    timer->level = (unsigned char)level;
+    timer->slot = (unsigned char)slot;
+    timer->next = *head;
+    timer->previous = head;
+    if (*head != NULL) (*head)->previous = &timer->next;
+    *head = timer;
+    wheel->occupied[level] |= 1ULL << slot;
+    wheel->armed++;
+}
+
+/**
+ * @brief unlinkTimer
+ *
+ * \param wheel the wheel
+ * \param timer an armed timer, possibly on a list taken by takeSlot()
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void unlinkTimer(struct timerWheel *wheel, struct wheelTimer *timer) {
+    *timer->previous = timer->next;
+    if (timer->next != NULL) timer->next->previous = timer->previous;
+    if (wheel->slots[timer->level][timer->slot] == NULL) wheel->occupied[timer->level] &= ~(1ULL << timer->slot);
+    timer->next = NULL;
+    timer->previous = NULL;
+    wheel->armed--;
+}
+
+/**
+ * @brief takeSlot
+ *
+ * move the timers of a slot to a list of the caller, they stay armed
+ *
+ * \param wheel the wheel
+ * \param level level of the slot
+ * \param slot the slot
+ * \param list set to the timers, its head must stay where it is until
+ *        they are unlinked
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void takeSlot(struct timerWheel *wheel, unsigned level, unsigned slot, struct wheelTimer **list) {
+    *list = wheel->slots[level][slot];
+    if (*list != NULL) (*list)->previous = list;
+    wheel->slots[level][slot] = NULL;
+    wheel->occupied[level] &= ~(1ULL << slot);
+}
+
+/**
+ * @brief nextTick
+ *
+ * earliest tick at which a timer expires on level 0 or a slot of a higher
+ * level is entered and cascaded
+ *
+ * \param wheel a wheel with armed timers
+ *
+ * \return uint64_t
+ * \retval the tick
+ *
+ */
+static uint64_t nextTick(const struct timerWheel *wheel) {
+    uint64_t earliest = UINT64_MAX;
+
+    for (unsigned level = 0; level < TIMER_LEVELS; level++) {
+        uint64_t bits = wheel->occupied[level];
+        if (bits == 0) continue;
+
+        unsigned shift = level * TIMER_LEVEL_BITS;
+        uint64_t period = wheel->current >> shift;
+        /* the current slot counts on level 0, and on higher levels until the
+         wheel has run its first tick */
+        unsigned first = (unsigned)(period & SLOT_MASK) + ((wheel->current & ((1ULL << shift) - 1)) == 0 ? 0 : 1);
+        uint64_t rotated = first % TIMER_SLOTS == 0 ? bits : (bits >> (first % TIMER_SLOTS)) | (bits << (TIMER_SLOTS - first % TIMER_SLOTS));
+        uint64_t distance = (uint64_t)__builtin_ctzll(rotated) + (first - (unsigned)(period & SLOT_MASK));
+
+        uint64_t tick = level == 0 ? wheel->current + distance : (period + distance) << shift;
+        if (tick < earliest) earliest = tick;
+    }
+    return earliest;
+}
@@ -0,0 +1,126 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_timer.h
+ * VCS - Tcp/Ip Exercise - hierarchical timer wheel for per-connection
+ * deadlines of the event loops of server and client
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_TIMER_H
+#define SIMPLE_MESSAGE_TIMER_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* every level has 2^TIMER_LEVEL_BITS slots, each one 2^TIMER_LEVEL_BITS
+ times as wide as a slot of the level below; with 1 ms ticks the levels
+ reach 64 ms, 4 s, 4.4 min, 4.7 h and 12.4 days */
+#define TIMER_LEVELS 5
+#define TIMER_LEVEL_BITS 6
+#define TIMER_SLOTS (1 << TIMER_LEVEL_BITS)
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+/* called once a timer has expired, it is disarmed then and may be armed
+ again or freed */
+typedef void (*timerCallback)(void *context);
+
+/* embedded in whatever it times, no allocation when armed */
+struct wheelTimer {
+    struct wheelTimer *next;
+    struct wheelTimer **previous;   /* NULL while disarmed */
+    uint64_t expires;               /* timerClock() milliseconds */
+    unsigned char level;
+    unsigned char slot;
+    timerCallback expire;
+    void *context;
+};
+
+struct timerWheel {
+    uint64_t current;               /* next tick to run */
+    uint64_t now;                   /* set by updateTimerClock() */
+    size_t armed;
+    uint64_t occupied[TIMER_LEVELS];    /* bit per non-empty slot */
+    struct wheelTimer *slots[TIMER_LEVELS][TIMER_SLOTS];
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+void initTimerWheel(struct timerWheel *wheel);
+void initTimer(struct wheelTimer *timer, timerCallback expire, void *context);
+void armTimer(struct timerWheel *wheel, struct wheelTimer *timer, uint64_t expires);
+void disarmTimer(struct timerWheel *wheel, struct wheelTimer *timer);
+int timeToNextTimer(const struct timerWheel *wheel);
+int advanceTimers(struct timerWheel *wheel);
+
+/*
+ * -------------------------------------------------------- inline functions --
+ */
+
+/**
+ * @brief timerClock
+ *
+ * \return uint64_t
+ * \retval monotonic time in milliseconds
+ *
+ */
+static inline uint64_t timerClock(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000ULL + (uint64_t)now.tv_nsec / 1000000ULL;
+}
+
+/**
+ * @brief updateTimerClock
+ *
+ * read the clock once per turn of the event loop, right after waiting;
+ * wheel->now is the time used for arming and for progress until the next
+ * update
+ *
+ * \param wheel the wheel
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static inline void updateTimerClock(struct timerWheel *wheel) {
+    wheel->now = timerClock();
+}
+
+/**
+ * @brief timerArmed
+ *
+ * \param timer a timer
+ *
+ * \return int
+ * \retval 1 if the timer is armed, 0 otherwise
+ *
+ */
+static inline int timerArmed(const struct wheelTimer *timer) {
+    return timer->previous != NULL;
+}
+
+#endif /* SIMPLE_MESSAGE_TIMER_H */
@@ -0,0 +1,380 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_trace.c
+ * VCS - Tcp/Ip Exercise - binary event trace of client and server
+ *
+ * Every thread that records an event gets a ring of TRACE_RING_SIZE events
+ * with one producer, the thread, and one consumer, the flusher thread. An
+ * event is a clock_gettime() and a store into the ring, no lock and no
+ * system call; if the flusher falls behind, events are dropped and counted
+ * rather than waited for. The flusher appends the rings every
+ * TRACE_FLUSH_INTERVAL milliseconds to <path>.<pid>, a traceHeader and
+ * the raw events, which trace_export turns into Chrome trace JSON.
+ *
+ * A process forked by a tracing one starts over with its own file and
+ * flusher at its first event, so children that exec right away never
+ * start a thread.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include "simple_message_trace.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define ERROR -1
+#define SUCCESS 0
+
+/* events per thread, a power of two */
+#define TRACE_RING_SIZE 4096
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+
+/* milliseconds between two flushes */
+#define TRACE_FLUSH_INTERVAL 20
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+struct traceRing {
+    _Atomic uint64_t head;      /* next event written by the thread */
+    _Atomic uint64_t tail;      /* next event written to the file by the flusher */
+    _Atomic uint64_t dropped;
+    uint32_t thread;
+    struct traceRing *next;
+    struct traceEvent events[TRACE_RING_SIZE];
+};
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+int tracing = 0;
+
+static char tracePath[PATH_MAX];
+static char traceProgram[sizeof(((struct traceHeader *)0)->program)];
+static int traceFile = ERROR;
+
+static pthread_mutex_t ringLock = PTHREAD_MUTEX_INITIALIZER;
+static struct traceRing *rings = NULL;
+static __thread struct traceRing *threadRing = NULL;
+
+static pthread_t flusher;
+static int flusherRunning = 0;
+static _Atomic int flusherStopping = 0;
+
+/* set in a forked child, which opens its own file at its first event */
+static int restartPending = 0;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static struct traceRing *registerRing(void);
+static int startFlusher(void);
+static void *flushRings(void *unused);
+static uint64_t drainRings(void);
+static int writeAll(const void *data, size_t length);
+static void forgetParentTrace(void);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief startTrace
+ *
+ * create the trace file of this process and start the flusher, the trace
+ * is stopped by stopTrace() or at exit()
+ *
+ * \param path prefix of the trace files, .<pid> is appended
+ * \param program name of the program in the trace
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+int startTrace(const char *path, const char *program) {
+    static int registered = 0;
+
+    if (tracing) return SUCCESS;
+    if (strlen(path) + 16 > sizeof(tracePath)) {
+        errno = ENAMETOOLONG;
+        return ERROR;
+    }
+    strcpy(tracePath, path);
+    const char *slash = strrchr(program, '/');
+    snprintf(traceProgram, sizeof(traceProgram), "%s", slash != NULL ? slash + 1 : program);
+
+    if (startFlusher() == ERROR) return ERROR;
+    if (!registered) {
+        registered = 1;
+        pthread_atfork(NULL, NULL, forgetParentTrace);
+        atexit(stopTrace);
+    }
+    tracing = 1;
+    return SUCCESS;
+}
+
+/**
+ * @brief traceEvent
+ *
+ * record an event in the ring of the calling thread, use TRACE()
+ *
+ * \param type what happened
+ * \param phase begin or end of a span, or an instant
+ * \param id pairs the begin and the end of a span
+ * \param value e.g. a status or a number of bytes
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void traceEvent(enum traceType type, enum tracePhase phase, uint64_t id, uint64_t value) {
+    struct traceRing *ring = threadRing;
+    if (ring == NULL && (ring = registerRing()) == NULL) return;
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == TRACE_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    struct traceEvent *event = &ring->events[head & TRACE_RING_MASK];
+    event->time = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+    event->thread = ring->thread;
+    event->type = (uint16_t)type;
+    event->phase = (uint16_t)phase;
+    event->id = id;
+    event->value = value;
+    /* the flusher reads the event only after it sees the new head */
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/**
+ * @brief stopTrace
+ *
+ * stop the flusher, write what is left and the number of dropped events,
+ * and close the trace file
+ *
+ * \return void
+ * \retval void
+ *
+ */
+void stopTrace(void) {
+    if (!tracing) return;
+    tracing = 0;
+
+    if (flusherRunning) {
+        atomic_store(&flusherStopping, 1);
+        pthread_join(flusher, NULL);
+        flusherRunning = 0;
+    }
+    if (traceFile == ERROR) return;
+
+    uint64_t dropped = drainRings();
+    if (dropped > 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        struct traceEvent event = {
+            (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec,
+            (uint32_t)syscall(SYS_gettid), TRACE_DROPPED, TRACE_INSTANT, 0, dropped
+        };
+        (void)writeAll(&event, sizeof(event));
+    }
+    close(traceFile);
+    traceFile = ERROR;
+}
+
+/**
+ * @brief registerRing
+ *
+ * allocate the ring of the calling thread, and in a forked child open its
+ * trace file first
+ *
+ * \return struct traceRing *
+ * \retval the ring
+ * \retval NULL on Error, the event is lost
+ *
+ */
+static struct traceRing *registerRing(void) {
+    pthread_mutex_lock(&ringLock);
+    if (restartPending) {
+        restartPending = 0;
+        if (startFlusher() == ERROR) tracing = 0;
+    }
+    struct traceRing *ring = tracing ? calloc(1, sizeof(*ring)) : NULL;
+    if (ring != NULL) {
+        ring->thread = (uint32_t)syscall(SYS_gettid);
+        ring->next = rings;
+        rings = ring;
+    }
+    pthread_mutex_unlock(&ringLock);
+
+    threadRing = ring;
+    return ring;
+}
+
+/**
+ * @brief startFlusher
+ *
+ * create <path>.<pid> with its header and start the flusher thread
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int startFlusher(void) {
+    char fileName[PATH_MAX + 16];
+    struct traceHeader header;
+
+    snprintf(fileName, sizeof(fileName), "%s.%d", tracePath, (int)getpid());
+    traceFile = open(fileName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (traceFile == ERROR) return ERROR;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.eventSize = sizeof(struct traceEvent);
+    header.pid = (uint32_t)getpid();
+    memcpy(header.program, traceProgram, sizeof(header.program));
+
+    atomic_store(&flusherStopping, 0);
+    if (writeAll(&header, sizeof(header)) == ERROR || (errno = pthread_create(&flusher, NULL, flushRings, NULL)) != 0) {
+        close(traceFile);
+        traceFile = ERROR;
+        return ERROR;
+    }
+    flusherRunning = 1;
+    return SUCCESS;
+}
+
+/**
+ * @brief flushRings
+ *
+ * the flusher thread
+ *
+ * \param unused
+ *
+ * \return void *
+ * \retval NULL
+ *
+ */
+static void *flushRings(void *unused) {
+    struct timespec interval = { 0, TRACE_FLUSH_INTERVAL * 1000000L };
+
+    (void)unused;
+    while (!atomic_load(&flusherStopping)) {
+        drainRings();
+        nanosleep(&interval, NULL);
+    }
+    return NULL;
+}
+
+/**
+ * @brief drainRings
+ *
+ * write the events of all rings to the trace file
+ *
+ * \return uint64_t
+ * \retval number of events dropped so far
+ *
+ */
+static uint64_t drainRings(void) {
+    uint64_t dropped = 0;
+
+    pthread_mutex_lock(&ringLock);
+    for (struct traceRing *ring = rings; ring != NULL; ring = ring->next) {
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+        /* at most two pieces, up to the end of the ring and from its start */
+        while (tail != head) {
+            uint64_t first = tail & TRACE_RING_MASK;
+            uint64_t count = head - tail;
+            if (count > TRACE_RING_SIZE - first) count = TRACE_RING_SIZE - first;
+            if (writeAll(&ring->events[first], (size_t)count * sizeof(struct traceEvent)) == ERROR) break;
+            tail += count;
+        }
+        /* the slots may be written again once the new tail is seen */
+        atomic_store_explicit(&ring->tail, head, memory_order_release);
+        dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&ringLock);
+    return dropped;
+}
+
+/**
+ * @brief writeAll
+ *
+ * \param data bytes to append to the trace file
+ * \param length number of bytes
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int writeAll(const void *data, size_t length) {
+    const char *byte = data;
+
+    while (length > 0) {
+        ssize_t written = write(traceFile, byte, length);
+        if (written == ERROR && errno == EINTR) continue;
+        if (written <= 0) return ERROR;
+        byte += written;
+        length -= (size_t)written;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief forgetParentTrace
+ *
+ * pthread_atfork() handler of the child: the rings, the file and the
+ * flusher belong to the parent
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void forgetParentTrace(void) {
+    if (!tracing) return;
+
+    pthread_mutex_init(&ringLock, NULL);
+    rings = NULL;
+    threadRing = NULL;
+    flusherRunning = 0;
+    if (traceFile != ERROR) close(traceFile);
+    traceFile = ERROR;
+    restartPending = 1;
+}
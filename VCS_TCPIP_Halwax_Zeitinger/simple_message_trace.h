@@ -0,0 +1,107 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file simple_message_trace.h
+ * VCS - Tcp/Ip Exercise - binary event trace of client and server, and the
+ * compile-time log level of INFO() and TRACE()
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+#ifndef SIMPLE_MESSAGE_TRACE_H
+#define SIMPLE_MESSAGE_TRACE_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdint.h>
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* LOG_LEVEL, set by the Makefile: what is left in the programs */
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_TRACE 1
+#define LOG_LEVEL_INFO 2
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+/* record an event if tracing was started, compiled out below LOG_LEVEL_TRACE */
+#if LOG_LEVEL >= LOG_LEVEL_TRACE
+#define TRACE(type, phase, id, value) \
+        do { if (tracing) traceEvent(type, phase, id, value); } while (0)
+#else
+#define TRACE(type, phase, id, value) do { if (0) traceEvent(type, phase, id, value); } while (0)
+#endif
+
+/* first bytes of a trace file */
+#define TRACE_MAGIC "SMTRACE1"
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+enum traceType {
+    TRACE_REQUEST,      /* a request, from connect to the last file */
+    TRACE_CONNECT,      /* connection setup of the client */
+    TRACE_SEND,         /* sending the request */
+    TRACE_STATUS,       /* status= received, value: the status */
+    TRACE_FILE,         /* a file of the response, value: its bytes */
+    TRACE_ACCEPT,       /* a client accepted, id: its descriptor */
+    TRACE_SPAWN,        /* starting the logic for a client */
+    TRACE_CHILD,        /* a child from start to reap, id: its pid, value: its status */
+    TRACE_HANDLE,       /* a client of the epoll or io_uring engine */
+    TRACE_DROPPED,      /* events lost to full rings, value: their number */
+    TRACE_TYPES
+};
+
+enum tracePhase {
+    TRACE_BEGIN,
+    TRACE_END,
+    TRACE_INSTANT
+};
+
+/* one event as it is stored in the ring and in the file */
+struct traceEvent {
+    uint64_t time;      /* CLOCK_MONOTONIC, nanoseconds */
+    uint32_t thread;
+    uint16_t type;
+    uint16_t phase;
+    uint64_t id;        /* pairs the begin and the end of a span */
+    uint64_t value;
+};
+
+/* header of a trace file, followed by events */
+struct traceHeader {
+    char magic[8];
+    uint32_t eventSize;
+    uint32_t pid;
+    char program[48];
+};
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+extern int tracing;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int startTrace(const char *path, const char *program);
+void traceEvent(enum traceType type, enum tracePhase phase, uint64_t id, uint64_t value);
+void stopTrace(void);
+
+#endif /* SIMPLE_MESSAGE_TRACE_H */
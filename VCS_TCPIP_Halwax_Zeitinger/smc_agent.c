@@ -0,0 +1,852 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file smc_agent.c
+ * VCS - Tcp/Ip Exercise - long-lived agent of simple_message_client: keeps
+ * a few connections to every server a client has asked for, made before
+ * they are needed, and hands one to each client that asks over a UNIX
+ * socket (SOCK_SEQPACKET), as SCM_RIGHTS. The client then sends its request
+ * and reads the response on it as if it had connected itself, so it pays
+ * neither getaddrinfo() nor the handshake.
+ *
+ * A client whose server has no connection ready is told so at once and
+ * connects itself, while the agent starts warming connections to that
+ * server. The event loop never blocks: resolving and connecting, with
+ * resolveServer() and happyEyeballsConnect() of the client, happen in a
+ * warmer thread, which keeps the addresses of every server for --dns-ttl,
+ * as getaddrinfo() does not tell the TTL of the records. Jobs and their
+ * results pass between the threads through pipes, so the warmer owns the
+ * address cache and the event loop owns everything else.
+ *
+ * Idle connections are watched for the server closing them, e.g. by its
+ * --read-timeout, and replaced; those of a server no client has asked for
+ * during --linger are closed. On the fork engine every idle connection
+ * holds a forked server logic waiting for its request, so --warm costs
+ * the server that many processes per agent and server, for as long as
+ * --linger.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include "simple_message_client_agent.h"
+#include "simple_message_client_connect.h"
+#include "simple_message_timer.h"
+#include "simple_message_trace.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define ERROR -1
+#define SUCCESS 0
+
+/* idle connections kept per server, see --warm */
+#define WARM_CONNECTIONS 2
+#define MAX_WARM_CONNECTIONS 64
+
+/* milliseconds the addresses of a server are used, see --dns-ttl */
+#define DNS_TTL 30000
+
+/* milliseconds the connections of an unused server are kept, see --linger */
+#define LINGER 60000
+
+/* milliseconds before connecting again after a failure, or after a server
+ closed a connection this young */
+#define RETRY_DELAY 1000
+
+/* events fetched by one epoll_wait() */
+#define MAX_EVENTS 64
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define INFO(function, M, ...) \
+		if (verbose) fprintf(stdout, "%s [%s, %s, line %d]: " M "\n", programName, __FILE__, function, __LINE__, ##__VA_ARGS__)
+#else
+#define INFO(function, M, ...) do { } while (0)
+#endif
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+/* first member of everything registered with epoll but the listener */
+enum eventKind {
+    EVENT_CLIENT,               /* a client that has not sent its request yet */
+    EVENT_IDLE,                 /* an idle connection to a server */
+    EVENT_RESULTS               /* the warmer's end of the result pipe */
+};
+
+struct warmServer;
+
+struct idleConnection {
+    enum eventKind kind;
+    int fd;
+    uint64_t connected;         /* wheel time */
+    struct warmServer *server;
+    struct idleConnection *next;
+};
+
+struct waitingClient {
+    enum eventKind kind;
+    int fd;
+};
+
+/* connections of one server and port, as given by the clients */
+struct warmServer {
+    char *name;
+    char *port;
+    struct idleConnection *idle;    /* youngest first */
+    int warming;                /* jobs with the warmer, it is not freed before they are back */
+    int retrying;               /* no connect until the retry timer fires */
+    uint64_t lastUsed;
+    struct wheelTimer linger;
+    struct wheelTimer retry;
+    struct warmServer *next;
+};
+
+/* one connect, passed to the warmer and back by pointer */
+struct warmJob {
+    struct warmServer *server;  /* the event loop's, the warmer only reads name and port */
+    const char *name;
+    const char *port;
+    int fd;
+    int error;
+};
+
+/* the warmer's */
+struct cachedAddresses {
+    char *name;
+    char *port;
+    struct addrinfo *addresses;
+    uint64_t expires;
+    struct cachedAddresses *next;
+};
+
+struct agentOptions {
+    const char *socketPath;     /* NULL: agentSocketPath() */
+    int warm;
+    long dnsTtl;
+    long linger;
+    int connectTimeout;
+};
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+static const char *programName;
+static int verbose;
+static struct agentOptions agentOptions = { NULL, WARM_CONNECTIONS, DNS_TTL, LINGER, CONNECT_TIMEOUT };
+
+static int epoll;
+static struct timerWheel timers;
+static struct warmServer *servers;
+static int jobs[2];
+static int results[2];
+static enum eventKind resultsTag = EVENT_RESULTS;
+static volatile sig_atomic_t stopRequested;
+
+/* the warmer's */
+static struct cachedAddresses *addressCache;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static int getAgentOptions(int argc, char *argv[]);
+static void printUsage(void);
+static int createAgentSocket(const char *path);
+static void acceptClients(int listening);
+static void serveClient(struct waitingClient *client);
+static void answerClient(int client, struct warmServer *server);
+static struct warmServer *findServer(const char *name, const char *port);
+static struct idleConnection *takeIdleConnection(struct warmServer *server);
+static void dropIdleConnection(struct idleConnection *connection);
+static void warmServer(struct warmServer *server);
+static void handleResults(void);
+static void handleIdleEvent(struct idleConnection *connection);
+static void expireLinger(void *context);
+static void expireRetry(void *context);
+static void *runWarmer(void *unused);
+static const struct addrinfo *lookupServer(const char *name, const char *port, int *error);
+static void handleStop(int signalNumber);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief       Main function
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * @return    exit status of program
+ * @retval    EXIT_FAILURE      the agent could not start
+ * @retval    EXIT_SUCCESS      stopped by SIGTERM or SIGINT
+ *
+ */
+int main(int argc, char *argv[]) {
+    char path[sizeof(((struct sockaddr_un *)NULL)->sun_path)];
+    pthread_t warmer;
+
+    programName = argv[0];
+    if (getAgentOptions(argc, argv) != SUCCESS) printUsage();
+
+    if (agentOptions.socketPath != NULL) {
+        if (strlen(agentOptions.socketPath) >= sizeof(path)) {
+            fprintf(stderr, "%s: socket path %s is too long\n", programName, agentOptions.socketPath);
+            exit(EXIT_FAILURE);
+        }
+        strcpy(path, agentOptions.socketPath);
+    }
+    else if (agentSocketPath(path, sizeof(path)) != SUCCESS) {
+        fprintf(stderr, "%s: no socket path, give -a or set SMC_AGENT or XDG_RUNTIME_DIR\n", programName);
+        exit(EXIT_FAILURE);
+    }
+
+    struct sigaction onSignalAction;
+    memset(&onSignalAction, 0, sizeof(onSignalAction));
+    onSignalAction.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &onSignalAction, NULL);
+    /* no SA_RESTART, epoll_wait() returns */
+    onSignalAction.sa_handler = handleStop;
+    sigaction(SIGTERM, &onSignalAction, NULL);
+    sigaction(SIGINT, &onSignalAction, NULL);
+
+    int listening = createAgentSocket(path);
+    if (listening == ERROR) exit(EXIT_FAILURE);
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    if ((epoll = epoll_create1(EPOLL_CLOEXEC)) == ERROR
+        || pipe2(jobs, O_CLOEXEC) == ERROR
+        || pipe2(results, O_CLOEXEC | O_NONBLOCK) == ERROR
+        || epoll_ctl(epoll, EPOLL_CTL_ADD, listening, &event) == ERROR
+        || (event.data.ptr = &resultsTag, epoll_ctl(epoll, EPOLL_CTL_ADD, results[0], &event)) == ERROR) {
+        fprintf(stderr, "%s: can not set up the event loop: %s\n", programName, strerror(errno));
+        unlink(path);
+        exit(EXIT_FAILURE);
+    }
+    int error = pthread_create(&warmer, NULL, runWarmer, NULL);
+    if (error != SUCCESS) {
+        fprintf(stderr, "%s: can not start the warmer: %s\n", programName, strerror(error));
+        unlink(path);
+        exit(EXIT_FAILURE);
+    }
+
+    initTimerWheel(&timers);
+    INFO("main()", "serving %s, %d connections per server", path, agentOptions.warm);
+
+    struct epoll_event events[MAX_EVENTS];
+    while (!stopRequested) {
+        int ready = epoll_wait(epoll, events, MAX_EVENTS, timeToNextTimer(&timers));
+        if (ready == ERROR && errno != EINTR) {
+            fprintf(stderr, "%s: epoll_wait() failed: %s\n", programName, strerror(errno));
+            break;
+        }
+        updateTimerClock(&timers);
+
+        for (int i = 0; i < ready; i++) {
+            enum eventKind *tag = events[i].data.ptr;
+
+            if (tag == NULL) acceptClients(listening);
+            else if (*tag == EVENT_CLIENT) serveClient((struct waitingClient *)tag);
+            else if (*tag == EVENT_IDLE) handleIdleEvent((struct idleConnection *)tag);
+            else handleResults();
+        }
+        advanceTimers(&timers);
+    }
+
+    /* the warmer may be in a connect, exit() ends it */
+    unlink(path);
+    exit(stopRequested ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/**
+ * @brief getAgentOptions
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int getAgentOptions(int argc, char *argv[]) {
+    static struct option options[] = {
+        {"socket", required_argument, 0, 'a'},
+        {"warm", required_argument, 0, 'w'},
+        {"dns-ttl", required_argument, 0, 't'},
+        {"linger", required_argument, 0, 'l'},
+        {"connect-timeout", required_argument, 0, 'c'},
+        {"verbose", no_argument, 0, 'v'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int option;
+
+    while ((option = getopt_long(argc, argv, "a:w:t:l:c:vh", options, NULL)) != ERROR) {
+        switch (option) {
+            case 'a': agentOptions.socketPath = optarg; break;
+            case 'w': agentOptions.warm = atoi(optarg); break;
+            case 't': agentOptions.dnsTtl = atol(optarg); break;
+            case 'l': agentOptions.linger = atol(optarg); break;
+            case 'c': agentOptions.connectTimeout = atoi(optarg); break;
+            case 'v': verbose = 1; break;
+            default: return ERROR;
+        }
+    }
+
+    if (optind != argc || agentOptions.warm <= 0 || agentOptions.warm > MAX_WARM_CONNECTIONS
+        || agentOptions.dnsTtl < 0 || agentOptions.linger <= 0 || agentOptions.connectTimeout <= 0) {
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief printUsage
+ *
+ * print usage parameter to stderr and exit
+ *
+ */
+static void printUsage(void) {
+    fprintf(stderr, "usage: %s [-a socket] [-w connections] [-t dns ttl ms] [-l linger ms] [-c connect timeout ms] [-v]\n"
+                    "\t-a, --socket <path>\t\tdefault: SMC_AGENT or $XDG_RUNTIME_DIR/%s\n"
+                    "\t-w, --warm <n>\t\t\tidle connections per server (default: %d, at most %d)\n"
+                    "\t-t, --dns-ttl <ms>\t\tuse the addresses of a server this long (default: %d)\n"
+                    "\t-l, --linger <ms>\t\tclose the connections of a server unused this long (default: %d)\n"
+                    "\t-c, --connect-timeout <ms>\tfor all addresses of a server together (default: %d)\n"
+                    "\t-v, --verbose\n\t-h, --help\n"
+                    "simple_message_client takes its connections from the agent at the same socket\n",
+            programName, AGENT_SOCKET_NAME, WARM_CONNECTIONS, MAX_WARM_CONNECTIONS, DNS_TTL, LINGER, CONNECT_TIMEOUT);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief createAgentSocket
+ *
+ * listen on a UNIX socket only the user may connect to
+ *
+ * \param path file system path of the socket
+ *
+ * \return int
+ * \retval socket descriptor on Success
+ * \retval ERROR on Error
+ *
+ */
+static int createAgentSocket(const char *path) {
+    struct sockaddr_un address;
+    struct stat status;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    /* a socket left over by an earlier run, but nothing else */
+    if (lstat(path, &status) == SUCCESS && S_ISSOCK(status.st_mode)) unlink(path);
+
+    mode_t mask = umask(S_IRWXG | S_IRWXO);
+    int listening = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listening == ERROR
+        || bind(listening, (struct sockaddr *)&address, sizeof(address)) == ERROR
+        || listen(listening, SOMAXCONN) == ERROR) {
+        fprintf(stderr, "%s: can not listen on %s: %s\n", programName, path, strerror(errno));
+        if (listening != ERROR) close(listening);
+        umask(mask);
+        return ERROR;
+    }
+    umask(mask);
+    return listening;
+}
+
+/**
+ * @brief acceptClients
+ *
+ * accept pending clients and answer those whose request is there already
+ *
+ * \param listening the agent's socket
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void acceptClients(int listening) {
+    while (1 == 1) {
+        int fd = accept4(listening, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == ERROR) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                fprintf(stderr, "%s: failed to accept client: %s\n", programName, strerror(errno));
+            }
+            return;
+        }
+
+        struct waitingClient *client = malloc(sizeof(*client));
+        if (client == NULL) {
+            close(fd);
+            continue;
+        }
+        client->kind = EVENT_CLIENT;
+        client->fd = fd;
+        /* a client sends its request right after connect() */
+        serveClient(client);
+    }
+}
+
+/**
+ * @brief serveClient
+ *
+ * read the request of a client and answer it, or wait for it
+ *
+ * \param client the client, freed once answered
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void serveClient(struct waitingClient *client) {
+    char request[AGENT_REQUEST_SIZE];
+
+    ssize_t length = recv(client->fd, request, sizeof(request), MSG_DONTWAIT);
+    if (length == ERROR && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLONESHOT;
+        event.data.ptr = client;
+        if (epoll_ctl(epoll, EPOLL_CTL_ADD, client->fd, &event) == SUCCESS
+            || (errno == EEXIST && epoll_ctl(epoll, EPOLL_CTL_MOD, client->fd, &event) == SUCCESS)) {
+            return;
+        }
+    }
+
+    /* "<server>\0<port>\0", anything else gets no answer */
+    const char *name = request;
+    const char *nameEnd = length > 0 ? memchr(request, '\0', (size_t)length) : NULL;
+    const char *port = nameEnd != NULL ? nameEnd + 1 : NULL;
+    if (port != NULL && memchr(port, '\0', (size_t)(request + length - port)) != NULL) {
+        answerClient(client->fd, findServer(name, port));
+    }
+
+    /* never shared, closing removes it from epoll */
+    close(client->fd);
+    free(client);
+}
+
+/**
+ * @brief answerClient
+ *
+ * hand over an idle connection, or tell the client to connect itself
+ *
+ * \param client the client
+ * \param server its server, NULL if out of memory
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void answerClient(int client, struct warmServer *server) {
+    struct idleConnection *connection = server != NULL ? takeIdleConnection(server) : NULL;
+    struct agentReply reply = { connection != NULL ? 0 : EAGAIN };
+    struct iovec data = { &reply, sizeof(reply) };
+    union {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr message;
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    if (connection != NULL) {
+        memset(&control, 0, sizeof(control));
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+        struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(header), &connection->fd, sizeof(int));
+    }
+
+    if (sendmsg(client, &message, MSG_DONTWAIT | MSG_NOSIGNAL) == ERROR) {
+        INFO("answerClient()", "client has gone: %s", strerror(errno));
+    }
+    else if (connection != NULL) {
+        INFO("answerClient()", "handed over a connection to %s", server->name);
+    }
+
+    /* the client has its own descriptor now, or the connection is lost with it */
+    if (connection != NULL) dropIdleConnection(connection);
+    if (server != NULL) {
+        server->lastUsed = timers.now;
+        warmServer(server);
+    }
+}
+
+/**
+ * @brief findServer
+ *
+ * \param name server as given by the client
+ * \param port port as given by the client
+ *
+ * \return struct warmServer *
+ * \retval the server, added if it is new
+ * \retval NULL if out of memory
+ *
+ */
+static struct warmServer *findServer(const char *name, const char *port) {
+    struct warmServer *server;
+
+    for (server = servers; server != NULL; server = server->next) {
+        if (strcmp(server->name, name) == 0 && strcmp(server->port, port) == 0) return server;
+    }
+
+    if ((server = calloc(1, sizeof(*server))) == NULL
+        || (server->name = strdup(name)) == NULL
+        || (server->port = strdup(port)) == NULL) {
+        if (server != NULL) free(server->name);
+        free(server);
+        return NULL;
+    }
+    initTimer(&server->linger, expireLinger, server);
+    initTimer(&server->retry, expireRetry, server);
+    armTimer(&timers, &server->linger, timers.now + (uint64_t)agentOptions.linger);
+    server->next = servers;
+    servers = server;
+    INFO("findServer()", "warming connections to %s port %s", name, port);
+    return server;
+}
+
+/**
+ * @brief takeIdleConnection
+ *
+ * \param server a server
+ *
+ * \return struct idleConnection *
+ * \retval the youngest idle connection the server has not closed
+ * \retval NULL if there is none
+ *
+ */
+static struct idleConnection *takeIdleConnection(struct warmServer *server) {
+    struct idleConnection *connection;
+
+    while ((connection = server->idle) != NULL) {
+        char byte;
+        /* the server only speaks after the request, anything else ends the connection */
+        if (recv(connection->fd, &byte, sizeof(byte), MSG_PEEK | MSG_DONTWAIT) == ERROR && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return connection;
+        }
+        dropIdleConnection(connection);
+    }
+    return NULL;
+}
+
+/**
+ * @brief dropIdleConnection
+ *
+ * \param connection an idle connection, closed and freed
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void dropIdleConnection(struct idleConnection *connection) {
+    struct idleConnection **link = &connection->server->idle;
+
+    while (*link != connection) link = &(*link)->next;
+    *link = connection->next;
+
+    /* a client we have handed it to holds it too, closing would not remove it */
+    epoll_ctl(epoll, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    free(connection);
+}
+
+/**
+ * @brief warmServer
+ *
+ * ask the warmer for connections until the server has enough, idle or
+ * being connected
+ *
+ * \param server a server
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void warmServer(struct warmServer *server) {
+    int connections = server->warming;
+
+    if (server->retrying) return;
+    for (struct idleConnection *connection = server->idle; connection != NULL; connection = connection->next) connections++;
+
+    for (; connections < agentOptions.warm; connections++) {
+        struct warmJob *job = malloc(sizeof(*job));
+        if (job == NULL) return;
+        job->server = server;
+        job->name = server->name;
+        job->port = server->port;
+        job->fd = ERROR;
+        job->error = 0;
+        /* a pointer is written at once, the warmer never blocks us for long */
+        if (write(jobs[1], &job, sizeof(job)) != sizeof(job)) {
+            free(job);
+            return;
+        }
+        server->warming++;
+    }
+}
+
+/**
+ * @brief handleResults
+ *
+ * take the connections the warmer has made
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void handleResults(void) {
+    struct warmJob *job;
+
+    while (read(results[0], &job, sizeof(job)) == sizeof(job)) {
+        struct warmServer *server = job->server;
+        struct idleConnection *connection = NULL;
+
+        server->warming--;
+        if (job->fd != ERROR && (connection = malloc(sizeof(*connection))) != NULL) {
+            struct epoll_event event;
+            memset(&event, 0, sizeof(event));
+            /* only the end of the connection, the server sends nothing before the request */
+            event.events = EPOLLRDHUP;
+            event.data.ptr = connection;
+            connection->kind = EVENT_IDLE;
+            connection->fd = job->fd;
+            connection->connected = timers.now;
+            connection->server = server;
+            if (epoll_ctl(epoll, EPOLL_CTL_ADD, job->fd, &event) == SUCCESS) {
+                connection->next = server->idle;
+                server->idle = connection;
+            }
+            else {
+                free(connection);
+                connection = NULL;
+            }
+        }
+
+        if (connection == NULL) {
+            INFO("handleResults()", "can not connect to %s: %s", server->name, strerror(job->error));
+            if (job->fd != ERROR) close(job->fd);
+            server->retrying = 1;
+            armTimer(&timers, &server->retry, timers.now + RETRY_DELAY);
+        }
+        free(job);
+    }
+}
+
+/**
+ * @brief handleIdleEvent
+ *
+ * the server has closed an idle connection, replace it
+ *
+ * \param connection the connection
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void handleIdleEvent(struct idleConnection *connection) {
+    struct warmServer *server = connection->server;
+
+    /* a server closing every connection right away is not asked again at once */
+    if (timers.now - connection->connected < RETRY_DELAY) {
+        server->retrying = 1;
+        armTimer(&timers, &server->retry, timers.now + RETRY_DELAY);
+    }
+    INFO("handleIdleEvent()", "%s closed an idle connection", server->name);
+    dropIdleConnection(connection);
+    warmServer(server);
+}
+
+/**
+ * @brief expireLinger
+ *
+ * timer callback: close the connections of a server unused for --linger
+ *
+ * \param context the server
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void expireLinger(void *context) {
+    struct warmServer *server = context;
+
+    /* the warmer still has its jobs, they are back soon */
+    if (timers.now - server->lastUsed < (uint64_t)agentOptions.linger || server->warming > 0) {
+        uint64_t expires = server->lastUsed + (uint64_t)agentOptions.linger;
+        armTimer(&timers, &server->linger, expires > timers.now ? expires : timers.now + RETRY_DELAY);
+        return;
+    }
+
+    INFO("expireLinger()", "%s unused, closing its connections", server->name);
+    while (server->idle != NULL) dropIdleConnection(server->idle);
+    disarmTimer(&timers, &server->retry);
+
+    struct warmServer **link = &servers;
+    while (*link != server) link = &(*link)->next;
+    *link = server->next;
+    free(server->name);
+    free(server->port);
+    free(server);
+}
+
+/**
+ * @brief expireRetry
+ *
+ * timer callback: connect to a server again after a failure
+ *
+ * \param context the server
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void expireRetry(void *context) {
+    struct warmServer *server = context;
+
+    server->retrying = 0;
+    warmServer(server);
+}
+
+/**
+ * @brief runWarmer
+ *
+ * body of the warmer thread: resolve and connect, one job after the other
+ *
+ * \param unused not used
+ *
+ * \return void *
+ * \retval NULL once the job pipe is closed
+ *
+ */
+static void *runWarmer(void *unused) {
+    struct warmJob *job;
+
+    (void)unused;
+    while (read(jobs[0], &job, sizeof(job)) == sizeof(job)) {
+        const struct addrinfo *addresses = lookupServer(job->name, job->port, &job->error);
+        if (addresses != NULL
+            && happyEyeballsConnect(addresses, CONNECT_ATTEMPT_DELAY, agentOptions.connectTimeout, NULL, &job->fd) != SUCCESS) {
+            job->fd = ERROR;
+            job->error = errno;
+        }
+        /* the event loop reads every result, the pipe never stays full */
+        while (write(results[1], &job, sizeof(job)) == ERROR && errno == EAGAIN) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief lookupServer
+ *
+ * the addresses of a server, resolved again once they are older than
+ * --dns-ttl; expired entries of other servers are removed on the way
+ *
+ * \param name server as given by the client
+ * \param port port as given by the client
+ * \param error set to an errno value if the server can not be resolved
+ *
+ * \return const struct addrinfo *
+ * \retval the addresses, valid until the next call
+ * \retval NULL on Error
+ *
+ */
+static const struct addrinfo *lookupServer(const char *name, const char *port, int *error) {
+    uint64_t now = timerClock();
+    struct cachedAddresses **link = &addressCache;
+    struct cachedAddresses *entry;
+
+    while ((entry = *link) != NULL) {
+        int matches = strcmp(entry->name, name) == 0 && strcmp(entry->port, port) == 0;
+        if (matches && now < entry->expires) return entry->addresses;
+        if (matches || now >= entry->expires) {
+            *link = entry->next;
+            freeServerAddresses(entry->addresses);
+            free(entry->name);
+            free(entry->port);
+            free(entry);
+            continue;
+        }
+        link = &entry->next;
+    }
+
+    struct addrinfo *addresses;
+    int resolved = resolveServer(name, port, &addresses);
+    if (resolved != SUCCESS) {
+        INFO("lookupServer()", "can not resolve %s: %s", name, resolved == EAI_SYSTEM ? strerror(errno) : gai_strerror(resolved));
+        *error = resolved == EAI_SYSTEM ? errno : EHOSTUNREACH;
+        return NULL;
+    }
+
+    /* without a cache entry the addresses are resolved again next time */
+    if ((entry = calloc(1, sizeof(*entry))) == NULL
+        || (entry->name = strdup(name)) == NULL
+        || (entry->port = strdup(port)) == NULL) {
+        if (entry != NULL) free(entry->name);
+        free(entry);
+        freeServerAddresses(addresses);
+        *error = ENOMEM;
+        return NULL;
+    }
+    entry->addresses = addresses;
+    entry->expires = now + (uint64_t)agentOptions.dnsTtl;
+    entry->next = addressCache;
+    addressCache = entry;
+    return addresses;
+}
+
+/**
+ * @brief handleStop
+ *
+ * SIGTERM/SIGINT handler, the event loop ends and removes the socket
+ *
+ * \param signalNumber is not used
+ *
+ */
+static void handleStop(int signalNumber) {
+    (void)signalNumber;
+    stopRequested = 1;
+}
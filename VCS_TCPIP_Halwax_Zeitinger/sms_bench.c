@@ -0,0 +1,648 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file sms_bench.c
+ * VCS - Tcp/Ip Exercise - load generator for simple_message_server: keeps
+ * a number of connections busy, each replaying the user=/img=/message
+ * request of simple_message_client, checks the status=/file=/len= responses
+ * and reports throughput and latency
+ *
+ * Without --rate the benchmark runs closed loop: a connection starts its next
+ * request when the last one is done. With --rate requests arrive on a fixed
+ * or Poisson schedule no matter how fast the server answers; a request that
+ * finds all connections busy waits, and its latency is taken from its
+ * scheduled arrival, so a stalling server can not hide its queueing delay.
+ *
+ * With --fastopen each connection is opened with sendto(MSG_FASTOPEN), so
+ * once the kernel has a TCP Fast Open cookie of the server the request
+ * travels with the SYN; the latency then lacks one round trip.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netdb.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <math.h>
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define ERROR -1
+#define SUCCESS 0
+
+#define MAX_EVENTS 256
+#define RECEIVE_BUFFER_SIZE 65536
+
+/* longest status=, file= or len= line of a response */
+#define MAX_LINE_LENGTH 256
+
+/* status= of a server turned away under overload, see STATUS_BUSY */
+#define STATUS_BUSY 2
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+enum connectionState {
+    STATE_IDLE,
+    STATE_CONNECTING,
+    STATE_SENDING,
+    STATE_RECEIVING
+};
+
+/* where the response parser is: lines up to the first file, then
+ file= len= <data> records until the server closes */
+enum responseState {
+    RESPONSE_STATUS,
+    RESPONSE_FILE,
+    RESPONSE_LENGTH,
+    RESPONSE_DATA,
+    RESPONSE_INVALID
+};
+
+enum arrivalPattern {
+    ARRIVALS_FIXED,
+    ARRIVALS_POISSON
+};
+
+struct responseCheck {
+    enum responseState state;
+    char line[MAX_LINE_LENGTH];
+    size_t lineLength;
+    unsigned long remaining;    /* bytes of the current file still expected */
+    int status;
+    int files;
+};
+
+struct connection {
+    int fd;
+    enum connectionState state;
+    size_t requestSent;
+    uint64_t started;           /* scheduled arrival with --rate */
+    struct responseCheck check;
+};
+
+struct benchOptions {
+    const char *server;
+    const char *port;
+    int concurrency;
+    long requests;
+    const char *user;
+    const char *message;
+    const char *imageUrl;
+    double rate;                /* requests per second, 0: closed loop */
+    enum arrivalPattern arrivals;
+    int fastOpen;               /* connect with TCP Fast Open */
+};
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+static const char *programName;
+static char *request;
+static size_t requestLength;
+static struct addrinfo *serverAddress;
+static uint64_t *latencies;
+static uint64_t *arrivalTimes;  /* open loop only */
+static long completed;
+static long failed;             /* connect, send or receive failed */
+static long invalid;            /* malformed response */
+static long rejected;           /* status= other than 0 */
+static long busy;               /* status=STATUS_BUSY */
+static long started;
+static long maxWaiting;
+static int fastOpen;
+static long fastOpened;         /* requests whose SYN carried data */
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void printUsage(void);
+static int getBenchOptions(int argc, char *argv[], struct benchOptions *benchOptions);
+static uint64_t now(void);
+static void scheduleArrivals(const struct benchOptions *benchOptions, uint64_t begin);
+static int startRequest(int epollDescriptor, struct connection *connection, uint64_t arrival);
+static void finishRequest(struct connection *connection, int ok);
+static void checkResponse(struct responseCheck *check, const char *data, size_t length);
+static int checkLine(struct responseCheck *check);
+static int compareLatencies(const void *a, const void *b);
+static uint64_t percentile(int permille);
+static void printReport(const struct benchOptions *benchOptions, uint64_t elapsed);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief       Main function
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * @return    exit status of program
+ * @retval    EXIT_FAILURE      benchmark could not run or requests failed
+ * @retval    EXIT_SUCCESS      all requests succeeded
+ *
+ */
+int main(int argc, char *argv[]) {
+    struct benchOptions benchOptions;
+
+    programName = argv[0];
+    if (getBenchOptions(argc, argv, &benchOptions) != SUCCESS) {
+        printUsage();
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int result = getaddrinfo(benchOptions.server, benchOptions.port, &hints, &serverAddress);
+    if (result != SUCCESS) {
+        fprintf(stderr, "%s: getaddrinfo(): %s\n", programName, gai_strerror(result));
+        exit(EXIT_FAILURE);
+    }
+
+    int length;
+    if (benchOptions.imageUrl != NULL) {
+        length = asprintf(&request, "user=%s\nimg=%s\n%s\n", benchOptions.user, benchOptions.imageUrl, benchOptions.message);
+    }
+    else {
+        length = asprintf(&request, "user=%s\n%s\n", benchOptions.user, benchOptions.message);
+    }
+    latencies = calloc((size_t)benchOptions.requests, sizeof(uint64_t));
+    struct connection *connections = calloc((size_t)benchOptions.concurrency, sizeof(struct connection));
+    int epollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    if (length < 0 || latencies == NULL || connections == NULL || epollDescriptor == ERROR) {
+        fprintf(stderr, "%s: setup failed: %s\n", programName, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    requestLength = (size_t)length;
+
+    for (int i = 0; i < benchOptions.concurrency; i++) {
+        connections[i].fd = ERROR;
+    }
+
+    uint64_t begin = now();
+    long arrived = benchOptions.requests;
+    if (benchOptions.rate > 0) {
+        arrivalTimes = calloc((size_t)benchOptions.requests, sizeof(uint64_t));
+        if (arrivalTimes == NULL) {
+            fprintf(stderr, "%s: setup failed: %s\n", programName, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        scheduleArrivals(&benchOptions, begin);
+        arrived = 0;
+    }
+
+    static char receiveBuffer[RECEIVE_BUFFER_SIZE];
+    struct epoll_event events[MAX_EVENTS];
+    while (completed + failed < benchOptions.requests) {
+        int timeout = -1;
+
+        if (arrivalTimes != NULL) {
+            uint64_t current = now();
+            while (arrived < benchOptions.requests && arrivalTimes[arrived] <= current) arrived++;
+            /* epoll_wait() sleeps in milliseconds, a late wakeup only
+             delays the start, the latency still counts from the arrival */
+            if (arrived < benchOptions.requests) timeout = (int)((arrivalTimes[arrived] - current + 999999) / 1000000);
+        }
+
+        for (int i = 0; i < benchOptions.concurrency && started < arrived; i++) {
+            if (connections[i].state == STATE_IDLE) {
+                startRequest(epollDescriptor, &connections[i], arrivalTimes != NULL ? arrivalTimes[started] : now());
+            }
+        }
+        if (arrived - started > maxWaiting) maxWaiting = arrived - started;
+        if (completed + failed == benchOptions.requests) break;
+
+        int ready = epoll_wait(epollDescriptor, events, MAX_EVENTS, timeout);
+        if (ready == ERROR) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "%s: epoll_wait() failed: %s\n", programName, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < ready; i++) {
+            struct connection *connection = events[i].data.ptr;
+            int ok = ERROR;
+
+            if (connection->state == STATE_CONNECTING) {
+                int socketError = 0;
+                socklen_t size = sizeof(socketError);
+                if (getsockopt(connection->fd, SOL_SOCKET, SO_ERROR, &socketError, &size) == ERROR || socketError != 0) {
+                    finishRequest(connection, ERROR);
+                    continue;
+                }
+                connection->state = STATE_SENDING;
+            }
+
+            if (connection->state == STATE_SENDING) {
+                ssize_t sent = send(connection->fd, request + connection->requestSent, requestLength - connection->requestSent, MSG_NOSIGNAL);
+                if (sent == ERROR) {
+                    if (errno != EAGAIN && errno != EINTR) finishRequest(connection, ERROR);
+                    continue;
+                }
+                connection->requestSent += (size_t)sent;
+                if (connection->requestSent < requestLength) continue;
+
+                shutdown(connection->fd, SHUT_WR);
+                connection->state = STATE_RECEIVING;
+                struct epoll_event event;
+                memset(&event, 0, sizeof(event));
+                event.events = EPOLLIN;
+                event.data.ptr = connection;
+                epoll_ctl(epollDescriptor, EPOLL_CTL_MOD, connection->fd, &event);
+                continue;
+            }
+
+            /* STATE_RECEIVING: check the response until the server closes */
+            while (1 == 1) {
+                ssize_t received = recv(connection->fd, receiveBuffer, sizeof(receiveBuffer), 0);
+                if (received > 0) {
+                    checkResponse(&connection->check, receiveBuffer, (size_t)received);
+                    continue;
+                }
+                if (received == 0) {
+                    ok = SUCCESS;
+                }
+                else if (errno == EAGAIN || errno == EINTR) {
+                    break;
+                }
+                finishRequest(connection, ok);
+                break;
+            }
+        }
+    }
+
+    printReport(&benchOptions, now() - begin);
+    freeaddrinfo(serverAddress);
+    exit(failed + invalid + rejected == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/**
+ * @brief scheduleArrivals
+ *
+ * compute the arrival time of every request up front, so generating the
+ * schedule never delays an arrival
+ *
+ * \param benchOptions rate and arrival pattern
+ * \param begin start of the run
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void scheduleArrivals(const struct benchOptions *benchOptions, uint64_t begin) {
+    double offset = 0;
+
+    srand48((long)begin);
+    for (long i = 0; i < benchOptions->requests; i++) {
+        arrivalTimes[i] = begin + (uint64_t)offset;
+        if (benchOptions->arrivals == ARRIVALS_POISSON) {
+            /* exponential gaps, 1 - drand48() is never 0 */
+            offset += -log(1.0 - drand48()) * 1e9 / benchOptions->rate;
+        }
+        else {
+            offset += 1e9 / benchOptions->rate;
+        }
+    }
+}
+
+/**
+ * @brief startRequest
+ *
+ * start a non-blocking connect for the next request
+ *
+ * \param epollDescriptor epoll instance
+ * \param connection idle connection slot
+ * \param arrival time the request is measured from
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error (counted as failed request)
+ *
+ */
+static int startRequest(int epollDescriptor, struct connection *connection, uint64_t arrival) {
+    started++;
+    connection->requestSent = 0;
+    connection->started = arrival;
+    memset(&connection->check, 0, sizeof(connection->check));
+    connection->state = STATE_CONNECTING;
+    connection->fd = socket(serverAddress->ai_family, serverAddress->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, serverAddress->ai_protocol);
+    if (connection->fd == ERROR) {
+        finishRequest(connection, ERROR);
+        return ERROR;
+    }
+
+    if (fastOpen) {
+        /* without a cookie only the SYN goes out, the request follows once connected */
+        ssize_t sent = sendto(connection->fd, request, requestLength, MSG_FASTOPEN | MSG_NOSIGNAL, serverAddress->ai_addr, serverAddress->ai_addrlen);
+        if (sent == ERROR && errno != EINPROGRESS) {
+            finishRequest(connection, ERROR);
+            return ERROR;
+        }
+        if (sent > 0) {
+            connection->requestSent = (size_t)sent;
+            fastOpened++;
+        }
+    }
+    else if (connect(connection->fd, serverAddress->ai_addr, serverAddress->ai_addrlen) == ERROR && errno != EINPROGRESS) {
+        finishRequest(connection, ERROR);
+        return ERROR;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLOUT;
+    event.data.ptr = connection;
+    if (epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, connection->fd, &event) == ERROR) {
+        finishRequest(connection, ERROR);
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief finishRequest
+ *
+ * record the result of a request and free the connection slot, a request
+ * completes with any well-formed response, only status=0 counts as ok
+ *
+ * \param connection connection slot
+ * \param ok SUCCESS if the server closed the connection after responding
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void finishRequest(struct connection *connection, int ok) {
+    if (connection->fd != ERROR) close(connection->fd);
+    connection->fd = ERROR;
+    connection->state = STATE_IDLE;
+
+    if (ok != SUCCESS) {
+        failed++;
+        return;
+    }
+
+    latencies[completed++] = now() - connection->started;
+
+    const struct responseCheck *check = &connection->check;
+    if (check->state != RESPONSE_FILE || check->lineLength != 0 || (check->status == 0 && check->files == 0)) {
+        invalid++;
+    }
+    else if (check->status == STATUS_BUSY) {
+        busy++;
+    }
+    else if (check->status != 0) {
+        rejected++;
+    }
+}
+
+/**
+ * @brief checkResponse
+ *
+ * feed received bytes to the response parser of a connection, file data is
+ * only counted
+ *
+ * \param check parser state
+ * \param data received bytes
+ * \param length number of bytes
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void checkResponse(struct responseCheck *check, const char *data, size_t length) {
+    while (length > 0 && check->state != RESPONSE_INVALID) {
+        if (check->state == RESPONSE_DATA) {
+            size_t part = length < check->remaining ? length : (size_t)check->remaining;
+            check->remaining -= part;
+            data += part;
+            length -= part;
+            if (check->remaining == 0) check->state = RESPONSE_FILE;
+            continue;
+        }
+
+        const char *newline = memchr(data, '\n', length);
+        size_t part = newline != NULL ? (size_t)(newline - data) : length;
+        if (check->lineLength + part >= MAX_LINE_LENGTH) {
+            check->state = RESPONSE_INVALID;
+            break;
+        }
+        memcpy(check->line + check->lineLength, data, part);
+        check->lineLength += part;
+        if (newline == NULL) break;
+
+        check->line[check->lineLength] = '\0';
+        data += part + 1;
+        length -= part + 1;
+        if (checkLine(check) != SUCCESS) check->state = RESPONSE_INVALID;
+        check->lineLength = 0;
+    }
+}
+
+/**
+ * @brief checkLine
+ *
+ * \param check parser state holding a complete line
+ *
+ * \return int
+ * \retval SUCCESS if the line is what the state expects
+ * \retval ERROR otherwise
+ *
+ */
+static int checkLine(struct responseCheck *check) {
+    switch (check->state) {
+        case RESPONSE_STATUS:
+            if (sscanf(check->line, "status=%d", &check->status) != 1) return ERROR;
+            check->state = RESPONSE_FILE;
+            return SUCCESS;
+        case RESPONSE_FILE:
+            if (strncmp(check->line, "file=", 5) != 0 || check->line[5] == '\0') return ERROR;
+            check->state = RESPONSE_LENGTH;
+            return SUCCESS;
+        case RESPONSE_LENGTH:
+            if (sscanf(check->line, "len=%lu", &check->remaining) != 1) return ERROR;
+            check->files++;
+            check->state = check->remaining > 0 ? RESPONSE_DATA : RESPONSE_FILE;
+            return SUCCESS;
+        default:
+            return ERROR;
+    }
+}
+
+/**
+ * @brief now
+ *
+ * \return uint64_t
+ * \retval monotonic time in nanoseconds
+ *
+ */
+static uint64_t now(void) {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000ULL + (uint64_t)time.tv_nsec;
+}
+
+/**
+ * @brief compareLatencies
+ *
+ * qsort() comparison of two latencies
+ *
+ */
+static int compareLatencies(const void *a, const void *b) {
+    uint64_t left = *(const uint64_t *)a;
+    uint64_t right = *(const uint64_t *)b;
+
+    return (left > right) - (left < right);
+}
+
+/**
+ * @brief printReport
+ *
+ * print throughput and latency percentiles to stdout
+ *
+ * \param elapsed duration of the run in nanoseconds
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void printReport(const struct benchOptions *benchOptions, uint64_t elapsed) {
+    qsort(latencies, (size_t)completed, sizeof(uint64_t), compareLatencies);
+
+    long ok = completed - invalid - rejected - busy;
+    printf("requests:   %ld ok, %ld busy, %ld rejected, %ld invalid, %ld failed\n", ok, busy, rejected, invalid, failed);
+    printf("elapsed:    %.3f s\n", (double)elapsed / 1e9);
+    if (benchOptions->rate > 0) {
+        printf("offered:    %.1f requests/s (%s), at most %ld waiting for a connection\n", benchOptions->rate,
+               benchOptions->arrivals == ARRIVALS_POISSON ? "poisson" : "fixed", maxWaiting);
+    }
+    printf("throughput: %.1f requests/s\n", (double)completed / ((double)elapsed / 1e9));
+    if (benchOptions->fastOpen) {
+        printf("fastopen:   %ld of %ld requests sent with the SYN\n", fastOpened, started);
+    }
+    if (completed > 0) {
+        printf("latency:    p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+               (double)percentile(500) / 1e3, (double)percentile(990) / 1e3,
+               (double)percentile(999) / 1e3, (double)latencies[completed - 1] / 1e3);
+    }
+}
+
+/**
+ * @brief percentile
+ *
+ * \param permille 500 for the median, 999 for p99.9
+ *
+ * \return uint64_t
+ * \retval latency in nanoseconds of the sorted latencies
+ *
+ */
+static uint64_t percentile(int permille) {
+    return latencies[(completed - 1) * permille / 1000];
+}
+
+/**
+ * @brief getBenchOptions
+ *
+ * parse the command line
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ * \param benchOptions filled with the parsed options
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int getBenchOptions(int argc, char *argv[], struct benchOptions *benchOptions) {
+    static struct option options[] = {
+        {"server", required_argument, 0, 's'},
+        {"port", required_argument, 0, 'p'},
+        {"concurrency", required_argument, 0, 'c'},
+        {"requests", required_argument, 0, 'n'},
+        {"user", required_argument, 0, 'u'},
+        {"message", required_argument, 0, 'm'},
+        {"image", required_argument, 0, 'i'},
+        {"rate", required_argument, 0, 'r'},
+        {"arrivals", required_argument, 0, 'a'},
+        {"fastopen", no_argument, 0, 'F'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int option;
+
+    memset(benchOptions, 0, sizeof(*benchOptions));
+    benchOptions->server = "localhost";
+    benchOptions->concurrency = 16;
+    benchOptions->requests = 10000;
+    benchOptions->user = "sms_bench";
+    benchOptions->message = "hello from sms_bench";
+
+    while ((option = getopt_long(argc, argv, "s:p:c:n:u:m:i:r:a:Fh", options, NULL)) != ERROR) {
+        switch (option) {
+            case 's': benchOptions->server = optarg; break;
+            case 'p': benchOptions->port = optarg; break;
+            case 'c': benchOptions->concurrency = atoi(optarg); break;
+            case 'n': benchOptions->requests = atol(optarg); break;
+            case 'u': benchOptions->user = optarg; break;
+            case 'm': benchOptions->message = optarg; break;
+            case 'i': benchOptions->imageUrl = optarg; break;
+            case 'r': benchOptions->rate = atof(optarg); break;
+            case 'a':
+                if (strcmp(optarg, "fixed") == 0) benchOptions->arrivals = ARRIVALS_FIXED;
+                else if (strcmp(optarg, "poisson") == 0) benchOptions->arrivals = ARRIVALS_POISSON;
+                else return ERROR;
+                break;
+            case 'F': benchOptions->fastOpen = 1; break;
+            default: return ERROR;
+        }
+    }
+
+    fastOpen = benchOptions->fastOpen;
+    if (benchOptions->port == NULL || benchOptions->concurrency <= 0 || benchOptions->requests <= 0 || benchOptions->rate < 0) return ERROR;
+    return SUCCESS;
+}
+
+/**
+ * @brief printUsage
+ *
+ * print usage parameter to stderr and exit
+ *
+ */
+static void printUsage(void) {
+    fprintf(stderr, "usage: %s -p port [-s server] [-c concurrency] [-n requests] [-u user] [-m message] [-i image URL]\n"
+                    "\t[-r requests/s [-a fixed|poisson]] [-F]\n"
+                    "without -r each of the c connections sends its next request when the last is answered,\n"
+                    "with -r requests arrive at that rate and use at most c connections,\n"
+                    "-F sends the request with the SYN by TCP Fast Open\n", programName);
+    exit(EXIT_FAILURE);
+}
@@ -0,0 +1,443 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file sms_stub_logic.c
+ * VCS - Tcp/Ip Exercise - stand-in for simple_message_server_logic, so the
+ * fork engine can be benchmarked without the installed logic: reads the
+ * request from stdin, waits a think time and answers with a generated page
+ * of a configurable size
+ *
+ * The server starts the logic without arguments, so every option can also
+ * be set in the environment the server was started with.
+ *
+ * have=<size> <hash> <name> lines behind user= and img= name files the
+ * client holds; a file whose first size bytes hash the same is answered
+ * with offset=<size> before len=, and only the bytes behind are sent.
+ * With a checksum=crc32c line every file is followed by crc32c=<hex>, the
+ * CRC32C of the bytes sent.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <stdint.h>
+#include "simple_message_hash.h"
+#include "simple_message_crc32c.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define ERROR -1
+#define SUCCESS 0
+
+#define MAX_REQUEST_SIZE (1024 * 1024)
+#define READ_CHUNK_SIZE 4096
+#define WRITE_CHUNK_SIZE 65536
+
+#define DEFAULT_RESPONSE_SIZE 1024
+
+/* have= lines looked at */
+#define MAX_HAVE_FILES 64
+
+/* status= of simple_message_server_logic for requests it can not parse */
+#define STATUS_INVALID_REQUEST 1
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+struct stubOptions {
+    long responseSize;          /* bytes of the page */
+    long imageSize;             /* bytes of the image for requests with img=, 0: none */
+    long thinkTime;             /* microseconds before answering */
+};
+
+struct haveFile {
+    const char *name;           /* in the request, not terminated */
+    size_t nameLength;
+    unsigned long size;
+    uint64_t hash;
+};
+
+struct requestExtensions {
+    struct haveFile files[MAX_HAVE_FILES];
+    int count;
+    int checksum;               /* checksum=crc32c */
+    int image;                  /* img= right after user= */
+};
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+static const char *programName;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void printUsage(void);
+static int getStubOptions(int argc, char *argv[], struct stubOptions *stubOptions);
+static long environmentValue(const char *name, long fallback);
+static char *readRequest(size_t *length);
+static int writeAll(const char *data, size_t length);
+static void parseExtensions(const char *request, size_t length, struct requestExtensions *have);
+static unsigned long resumeOffset(const struct requestExtensions *have, const char *name, long size, char fill);
+static int writeFile(const char *name, long size, char fill, const struct requestExtensions *have);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief       Main function
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * @return    exit status of program
+ * @retval    EXIT_FAILURE      the response could not be sent
+ * @retval    EXIT_SUCCESS      the response was sent
+ *
+ */
+int main(int argc, char *argv[]) {
+    struct stubOptions stubOptions;
+    size_t length;
+
+    programName = argv[0];
+    if (getStubOptions(argc, argv, &stubOptions) != SUCCESS) {
+        printUsage();
+    }
+
+    char *request = readRequest(&length);
+    if (request == NULL) exit(EXIT_FAILURE);
+
+    if (stubOptions.thinkTime > 0) {
+        struct timespec think = { stubOptions.thinkTime / 1000000, (stubOptions.thinkTime % 1000000) * 1000 };
+        while (nanosleep(&think, &think) == ERROR && errno == EINTR) {
+            /* sleep the rest */
+        }
+    }
+
+    /* like the real logic: a request starts with user=, img= is optional */
+    if (length < 5 || strncmp(request, "user=", 5) != 0) {
+        char status[32];
+        int statusLength = snprintf(status, sizeof(status), "status=%d\n", STATUS_INVALID_REQUEST);
+        exit(writeAll(status, (size_t)statusLength) == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    static struct requestExtensions have;
+    parseExtensions(request, length, &have);
+    if (have.checksum) initCrc32c();
+
+    if (writeAll("status=0\n", 9) != SUCCESS) exit(EXIT_FAILURE);
+    if (writeFile("sms_stub_logic.html", stubOptions.responseSize, 'h', &have) != SUCCESS) exit(EXIT_FAILURE);
+    if (have.image && stubOptions.imageSize > 0 && writeFile("sms_stub_logic.png", stubOptions.imageSize, 'p', &have) != SUCCESS) exit(EXIT_FAILURE);
+    free(request);
+    exit(EXIT_SUCCESS);
+}
+
+/**
+ * @brief readRequest
+ *
+ * read stdin up to end of file
+ *
+ * \param length set to the length of the request
+ *
+ * \return char *
+ * \retval the request, to be freed by the caller
+ * \retval NULL on Error
+ *
+ */
+static char *readRequest(size_t *length) {
+    char *request = NULL;
+    size_t capacity = 0;
+
+    *length = 0;
+    while (1 == 1) {
+        if (capacity - *length < READ_CHUNK_SIZE) {
+            capacity = capacity == 0 ? READ_CHUNK_SIZE * 2 : capacity * 2;
+            if (capacity > MAX_REQUEST_SIZE) {
+                fprintf(stderr, "%s: request exceeds %d bytes\n", programName, MAX_REQUEST_SIZE);
+                free(request);
+                return NULL;
+            }
+            char *grown = realloc(request, capacity);
+            if (grown == NULL) {
+                fprintf(stderr, "%s: realloc() failed: %s\n", programName, strerror(errno));
+                free(request);
+                return NULL;
+            }
+            request = grown;
+        }
+
+        ssize_t received = read(STDIN_FILENO, request + *length, capacity - *length);
+        if (received > 0) {
+            *length += (size_t)received;
+            continue;
+        }
+        if (received == 0) return request;
+        if (errno == EINTR) continue;
+        fprintf(stderr, "%s: read() failed: %s\n", programName, strerror(errno));
+        free(request);
+        return NULL;
+    }
+}
+
+/**
+ * @brief parseExtensions
+ *
+ * note the img= line right after user= and collect the have= and
+ * checksum= lines that follow
+ *
+ * \param request the request
+ * \param length length of the request
+ * \param have filled with the files the client holds and what it asks for
+ *
+ * \return void
+ * \retval void
+ *
+ */
+static void parseExtensions(const char *request, size_t length, struct requestExtensions *have) {
+    const char *end = request + length;
+    const char *line = request;
+
+    const char *second = memchr(request, '\n', length);
+
+    have->count = 0;
+    have->checksum = 0;
+    have->image = 0;
+    if (second != NULL) second++;
+    while (line < end) {
+        const char *newline = memchr(line, '\n', (size_t)(end - line));
+        if (newline == NULL) break;
+
+        /* have= lines beyond MAX_HAVE_FILES are skipped, a checksum= line may follow */
+        if (strncmp(line, "have=", 5) == 0) {
+            if (have->count == MAX_HAVE_FILES) {
+                line = newline + 1;
+                continue;
+            }
+            struct haveFile *file = &have->files[have->count];
+            char *next;
+            file->size = strtoul(line + 5, &next, 10);
+            if (*next == ' ') {
+                file->hash = strtoull(next + 1, &next, 16);
+                if (*next == ' ' && next + 1 < newline) {
+                    file->name = next + 1;
+                    file->nameLength = (size_t)(newline - file->name);
+                    have->count++;
+                }
+            }
+        }
+        else if (strncmp(line, "checksum=crc32c\n", 16) == 0) {
+            have->checksum = 1;
+        }
+        /* only the line after user= is img=, a message line may start with it too */
+        else if (line == second && strncmp(line, "img=", 4) == 0) {
+            have->image = 1;
+        }
+        /* the message starts at the first other line */
+        else if (line != request) {
+            break;
+        }
+        line = newline + 1;
+    }
+}
+
+/**
+ * @brief resumeOffset
+ *
+ * \param have files the client holds
+ * \param name value of file=
+ * \param size length of the file
+ * \param fill byte the content is made of
+ *
+ * \return unsigned long
+ * \retval bytes the client holds already, 0 to send all
+ *
+ */
+static unsigned long resumeOffset(const struct requestExtensions *have, const char *name, long size, char fill) {
+    static char chunk[WRITE_CHUNK_SIZE];
+
+    for (int i = 0; i < have->count; i++) {
+        const struct haveFile *file = &have->files[i];
+        if (file->nameLength != strlen(name) || memcmp(file->name, name, file->nameLength) != 0) continue;
+        if (file->size > (unsigned long)size) return 0;
+
+        struct contentHash hash;
+        unsigned long remaining = file->size;
+        initContentHash(&hash);
+        memset(chunk, fill, sizeof(chunk));
+        while (remaining > 0) {
+            size_t part = remaining < WRITE_CHUNK_SIZE ? (size_t)remaining : WRITE_CHUNK_SIZE;
+            updateContentHash(&hash, chunk, part);
+            remaining -= part;
+        }
+        return finishContentHash(&hash) == file->hash ? file->size : 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief writeFile
+ *
+ * write one file= len= record followed by size bytes of fill, or by the
+ * bytes behind an offset= the client holds already, and the crc32c= line
+ * if the client asked for it
+ *
+ * \param name value of file=
+ * \param size length of the file
+ * \param fill byte the content is made of
+ * \param have files the client holds and what it asks for
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int writeFile(const char *name, long size, char fill, const struct requestExtensions *have) {
+    static char chunk[WRITE_CHUNK_SIZE];
+    char header[256];
+    int headerLength;
+
+    unsigned long offset = resumeOffset(have, name, size, fill);
+    if (offset > 0) {
+        size -= (long)offset;
+        headerLength = snprintf(header, sizeof(header), "file=%s\noffset=%lu\nlen=%ld\n", name, offset, size);
+    }
+    else {
+        headerLength = snprintf(header, sizeof(header), "file=%s\nlen=%ld\n", name, size);
+    }
+    if (writeAll(header, (size_t)headerLength) != SUCCESS) return ERROR;
+
+    memset(chunk, fill, sizeof(chunk));
+    uint32_t checksum = 0;
+    while (size > 0) {
+        size_t part = size < WRITE_CHUNK_SIZE ? (size_t)size : WRITE_CHUNK_SIZE;
+        if (have->checksum) checksum = crc32c(checksum, chunk, part);
+        if (writeAll(chunk, part) != SUCCESS) return ERROR;
+        size -= (long)part;
+    }
+
+    if (have->checksum) {
+        headerLength = snprintf(header, sizeof(header), "crc32c=%08x\n", checksum);
+        if (writeAll(header, (size_t)headerLength) != SUCCESS) return ERROR;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief writeAll
+ *
+ * \param data bytes to write to stdout
+ * \param length number of bytes
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int writeAll(const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(STDOUT_FILENO, data, length);
+        if (written == ERROR) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "%s: write() failed: %s\n", programName, strerror(errno));
+            return ERROR;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief environmentValue
+ *
+ * \param name environment variable
+ * \param fallback value if the variable is not set
+ *
+ * \return long
+ * \retval the value of the variable or fallback
+ *
+ */
+static long environmentValue(const char *name, long fallback) {
+    const char *value = getenv(name);
+
+    return value != NULL && *value != '\0' ? atol(value) : fallback;
+}
+
+/**
+ * @brief getStubOptions
+ *
+ * parse the environment, then the command line
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ * \param stubOptions filled with the parsed options
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int getStubOptions(int argc, char *argv[], struct stubOptions *stubOptions) {
+    static struct option options[] = {
+        {"size", required_argument, 0, 's'},
+        {"image-size", required_argument, 0, 'i'},
+        {"think", required_argument, 0, 't'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+    int option;
+
+    stubOptions->responseSize = environmentValue("SMS_STUB_SIZE", DEFAULT_RESPONSE_SIZE);
+    stubOptions->imageSize = environmentValue("SMS_STUB_IMAGE_SIZE", 0);
+    stubOptions->thinkTime = environmentValue("SMS_STUB_THINK_US", 0);
+
+    while ((option = getopt_long(argc, argv, "s:i:t:h", options, NULL)) != ERROR) {
+        switch (option) {
+            case 's': stubOptions->responseSize = atol(optarg); break;
+            case 'i': stubOptions->imageSize = atol(optarg); break;
+            case 't': stubOptions->thinkTime = atol(optarg); break;
+            default: return ERROR;
+        }
+    }
+
+    if (stubOptions->responseSize < 0 || stubOptions->imageSize < 0 || stubOptions->thinkTime < 0) return ERROR;
+    return SUCCESS;
+}
+
+/**
+ * @brief printUsage
+ *
+ * print usage parameter to stderr and exit
+ *
+ */
+static void printUsage(void) {
+    fprintf(stderr, "usage: %s [-s page bytes] [-i image bytes] [-t think time us]\n"
+                    "environment: SMS_STUB_SIZE (default %d), SMS_STUB_IMAGE_SIZE, SMS_STUB_THINK_US\n",
+            programName, DEFAULT_RESPONSE_SIZE);
+    exit(EXIT_FAILURE);
+}
@@ -0,0 +1,274 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file spawn_bench.c
+ * VCS - Tcp/Ip Exercise - cost of the spawn strategies of the fork engine:
+ * for each parent memory size and strategy start a program with a socket
+ * on stdin/stdout, as waitForClients() does per connection, and report
+ * spawns per second (including the wait for the child) and the latency of
+ * the spawn call itself, which is the time the accept loop is blocked
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "simple_message_server_spawn.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define ERROR -1
+#define SUCCESS 0
+
+#define MEGABYTE (1024UL * 1024UL)
+
+/*
+ * --------------------------------------------------------------- typedefs --
+ */
+
+struct benchOptions {
+    long spawns;
+    char *memorySizes;          /* comma separated, in MB */
+    char *strategies;           /* comma separated, see parseSpawnStrategy() */
+    const char *program;
+};
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+static const char *programName;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void printUsage(void);
+static int getBenchOptions(int argc, char *argv[], struct benchOptions *benchOptions);
+static uint64_t now(void);
+static int compareLatencies(const void *a, const void *b);
+static int runStrategy(enum spawnStrategy strategy, long spawns, const char *program, uint64_t *latencies);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief       Main function
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * @return    exit status of program
+ * @retval    EXIT_FAILURE      benchmark could not run
+ * @retval    EXIT_SUCCESS      all spawns succeeded
+ *
+ */
+int main(int argc, char *argv[]) {
+    struct benchOptions benchOptions;
+
+    programName = argv[0];
+    if (getBenchOptions(argc, argv, &benchOptions) != SUCCESS) {
+        printUsage();
+    }
+
+    uint64_t *latencies = calloc((size_t)benchOptions.spawns, sizeof(uint64_t));
+    if (latencies == NULL) {
+        fprintf(stderr, "%s: calloc() failed: %s\n", programName, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%8s  %-12s %12s %12s %12s\n", "rss MB", "strategy", "spawns/s", "p50 us", "p99 us");
+
+    char *sizeContext = NULL;
+    for (char *size = strtok_r(benchOptions.memorySizes, ",", &sizeContext); size != NULL; size = strtok_r(NULL, ",", &sizeContext)) {
+        size_t bytes = strtoul(size, NULL, 10) * MEGABYTE;
+
+        /* touch every page, so fork() has page tables to copy */
+        char *ballast = bytes > 0 ? malloc(bytes) : NULL;
+        if (bytes > 0 && ballast == NULL) {
+            fprintf(stderr, "%s: can not allocate %s MB\n", programName, size);
+            exit(EXIT_FAILURE);
+        }
+        if (ballast != NULL) memset(ballast, 1, bytes);
+
+        char *strategies = strdup(benchOptions.strategies);
+        char *strategyContext = NULL;
+        for (char *name = strtok_r(strategies, ",", &strategyContext); name != NULL; name = strtok_r(NULL, ",", &strategyContext)) {
+            enum spawnStrategy strategy;
+            if (parseSpawnStrategy(name, &strategy) != SUCCESS) {
+                fprintf(stderr, "%s: unknown spawn strategy %s\n", programName, name);
+                exit(EXIT_FAILURE);
+            }
+
+            uint64_t begin = now();
+            if (runStrategy(strategy, benchOptions.spawns, benchOptions.program, latencies) != SUCCESS) {
+                exit(EXIT_FAILURE);
+            }
+            uint64_t elapsed = now() - begin;
+
+            qsort(latencies, (size_t)benchOptions.spawns, sizeof(uint64_t), compareLatencies);
+            printf("%8s  %-12s %12.1f %12.1f %12.1f\n", size, name,
+                   (double)benchOptions.spawns / ((double)elapsed / 1e9),
+                   (double)latencies[(benchOptions.spawns - 1) * 50 / 100] / 1e3,
+                   (double)latencies[(benchOptions.spawns - 1) * 99 / 100] / 1e3);
+            fflush(stdout);
+        }
+        free(strategies);
+        free(ballast);
+    }
+
+    free(latencies);
+    exit(EXIT_SUCCESS);
+}
+
+/**
+ * @brief runStrategy
+ *
+ * spawn program one after the other, each with a fresh socket as client
+ *
+ * \param strategy spawn strategy to measure
+ * \param spawns number of children to start
+ * \param program program to execute
+ * \param latencies filled with the duration of each spawn call
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int runStrategy(enum spawnStrategy strategy, long spawns, const char *program, uint64_t *latencies) {
+    for (long i = 0; i < spawns; i++) {
+        int client[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, client) == ERROR) {
+            fprintf(stderr, "%s: socketpair() failed: %s\n", programName, strerror(errno));
+            return ERROR;
+        }
+
+        uint64_t begin = now();
+        pid_t pid = spawnClientProgram(strategy, client[0], client[0], ERROR, program, program, NULL);
+        latencies[i] = now() - begin;
+
+        close(client[0]);
+        close(client[1]);
+        if (pid == ERROR) {
+            fprintf(stderr, "%s: %s: can not start %s: %s\n", programName, spawnStrategyName(strategy), program, strerror(errno));
+            return ERROR;
+        }
+
+        int status;
+        if (waitpid(pid, &status, 0) == ERROR || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "%s: %s: %s did not exit cleanly\n", programName, spawnStrategyName(strategy), program);
+            return ERROR;
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief now
+ *
+ * \return uint64_t
+ * \retval monotonic time in nanoseconds
+ *
+ */
+static uint64_t now(void) {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000ULL + (uint64_t)time.tv_nsec;
+}
+
+/**
+ * @brief compareLatencies
+ *
+ * qsort() comparison of two latencies
+ *
+ */
+static int compareLatencies(const void *a, const void *b) {
+    uint64_t left = *(const uint64_t *)a;
+    uint64_t right = *(const uint64_t *)b;
+
+    return (left > right) - (left < right);
+}
+
+/**
+ * @brief getBenchOptions
+ *
+ * parse the command line
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ * \param benchOptions filled with the parsed options
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int getBenchOptions(int argc, char *argv[], struct benchOptions *benchOptions) {
+    static struct option options[] = {
+        {"spawns", required_argument, 0, 'n'},
+        {"memory", required_argument, 0, 'm'},
+        {"strategies", required_argument, 0, 'S'},
+        {"program", required_argument, 0, 'x'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}
+    };
+    static char defaultSizes[] = "0,256,1024";
+    static char defaultStrategies[] = "fork,vfork,posix_spawn,clone";
+    int option;
+
+    memset(benchOptions, 0, sizeof(*benchOptions));
+    benchOptions->spawns = 1000;
+    benchOptions->memorySizes = defaultSizes;
+    benchOptions->strategies = defaultStrategies;
+    benchOptions->program = "/bin/true";
+
+    while ((option = getopt_long(argc, argv, "n:m:S:x:h", options, NULL)) != ERROR) {
+        switch (option) {
+            case 'n': benchOptions->spawns = atol(optarg); break;
+            case 'm': benchOptions->memorySizes = optarg; break;
+            case 'S': benchOptions->strategies = optarg; break;
+            case 'x': benchOptions->program = optarg; break;
+            default: return ERROR;
+        }
+    }
+
+    if (benchOptions->spawns <= 0) return ERROR;
+    return SUCCESS;
+}
+
+/**
+ * @brief printUsage
+ *
+ * print usage parameter to stderr and exit
+ *
+ */
+static void printUsage(void) {
+    fprintf(stderr, "usage: %s [-n spawns] [-m MB,MB,...] [-S strategy,strategy,...] [-x program]\n", programName);
+    exit(EXIT_FAILURE);
+}
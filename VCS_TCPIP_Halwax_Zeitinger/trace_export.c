@@ -0,0 +1,157 @@
+/* vim: set ts=4 sw=4 sts=4 et : */
+/**
+ * @file trace_export.c
+ * VCS - Tcp/Ip Exercise - convert the binary trace files of
+ * simple_message_client (SMC_TRACE) and simple_message_server (--trace)
+ * into Chrome trace JSON, for chrome://tracing or ui.perfetto.dev
+ *
+ * A span becomes a pair of async events, begin "b" and end "e", with an
+ * id made of the pid and the id of the span, so spans of different
+ * processes and overlapping spans of one process stay apart; an instant
+ * becomes an "i" event on its thread. The value of an event is in its
+ * args. Timestamps are CLOCK_MONOTONIC of the machine, the files of client
+ * and server of one run line up.
+ *
+ * @author Thomas Halwax <ic14b050@technikum-wien.at>
+ * @author Thomas Zeitinger <ic14b033@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ * @version $Revision: 1.0 $
+ *
+ * URL: $HeadURL$
+ *
+ * Last Modified: $Author: thomas $
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "simple_message_trace.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define ERROR -1
+#define SUCCESS 0
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+static const char *programName;
+
+static const char *const typeNames[TRACE_TYPES] = {
+    "request", "connect", "send", "status", "file",
+    "accept", "spawn", "child", "handle", "dropped"
+};
+
+/* separates the events of all files */
+static const char *separator = "\n";
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static int exportFile(const char *fileName);
+static void printUsage(void);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * @brief       Main function
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * @return    exit status of program
+ * @retval    EXIT_FAILURE      a file could not be read
+ * @retval    EXIT_SUCCESS      all files exported
+ *
+ */
+int main(int argc, char *argv[]) {
+    programName = argv[0];
+    if (argc < 2 || strcmp(argv[1], "-h") == 0) printUsage();
+
+    int result = EXIT_SUCCESS;
+    printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (int i = 1; i < argc; i++) {
+        if (exportFile(argv[i]) != SUCCESS) result = EXIT_FAILURE;
+    }
+    printf("\n]}\n");
+
+    if (fflush(stdout) == EOF) {
+        fprintf(stderr, "%s: failed to write: %s\n", programName, strerror(errno));
+        result = EXIT_FAILURE;
+    }
+    exit(result);
+}
+
+/**
+ * @brief exportFile
+ *
+ * print the events of one trace file
+ *
+ * \param fileName trace file of one process
+ *
+ * \return int
+ * \retval SUCCESS on Success
+ * \retval ERROR on Error
+ *
+ */
+static int exportFile(const char *fileName) {
+    struct traceHeader header;
+    struct traceEvent event;
+
+    FILE *file = fopen(fileName, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "%s: can not open %s: %s\n", programName, fileName, strerror(errno));
+        return ERROR;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0
+        || header.eventSize != sizeof(event)) {
+        fprintf(stderr, "%s: %s is not a trace file of this version\n", programName, fileName);
+        fclose(file);
+        return ERROR;
+    }
+
+    header.program[sizeof(header.program) - 1] = '\0';
+    printf("%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"%s\"}}", separator, header.pid, header.program);
+    separator = ",\n";
+
+    while (fread(&event, sizeof(event), 1, file) == 1) {
+        const char *name = event.type < TRACE_TYPES ? typeNames[event.type] : "unknown";
+        printf(",\n{\"name\":\"%s\",\"cat\":\"sms\",\"pid\":%u,\"tid\":%u,\"ts\":%llu.%03u,", name, header.pid, event.thread,
+               (unsigned long long)(event.time / 1000), (unsigned)(event.time % 1000));
+        if (event.phase == TRACE_INSTANT) {
+            printf("\"ph\":\"i\",\"s\":\"t\",");
+        }
+        else {
+            printf("\"ph\":\"%s\",\"id\":\"%u:%llu\",", event.phase == TRACE_BEGIN ? "b" : "e", header.pid, (unsigned long long)event.id);
+        }
+        printf("\"args\":{\"id\":%llu,\"value\":%llu}}", (unsigned long long)event.id, (unsigned long long)event.value);
+    }
+
+    int result = ferror(file) ? ERROR : SUCCESS;
+    if (result == ERROR) fprintf(stderr, "%s: failed to read %s\n", programName, fileName);
+    fclose(file);
+    return result;
+}
+
+/**
+ * @brief printUsage
+ *
+ * print usage parameter to stderr and exit
+ *
+ */
+static void printUsage(void) {
+    fprintf(stderr, "usage: %s tracefile... > trace.json\n", programName);
+    exit(EXIT_FAILURE);
+}